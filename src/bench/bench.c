@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+
+int bench_min_time_ms = 200;        // Minimum duration of one run, the iterations are raised until it is reached.
+int bench_runs = 5;                 // Number of runs of every benchmark, the median is reported.
+char const *bench_filter = NULL;    // Only benchmarks whose name contains this are run, NULL for all.
+volatile unsigned long bench_sink = 0; // Results are added here, so the compiler cannot drop the work.
+
+static struct bench_result results[BENCH_MAX_RESULTS];  // Results of the benchmarks run so far.
+static int num_results = 0;                             // Number of results.
+
+static unsigned long allocs = 0;        // Calls to malloc(), calloc() and realloc() since the start.
+static unsigned long alloc_bytes = 0;   // Bytes asked of them since the start.
+
+static u_int64_t start_ns = 0;          // When the measured part of the current run started.
+static unsigned long start_allocs = 0;  // allocs when it started.
+static unsigned long start_bytes = 0;   // alloc_bytes when it started.
+static u_int64_t elapsed_ns = 0;        // Duration of the measured part, set by bench_stop().
+static unsigned long run_allocs = 0;    // Allocations in the measured part, set by bench_stop().
+static unsigned long run_bytes = 0;     // Bytes allocated in the measured part, set by bench_stop().
+static int stopped = 0;                 // Set by bench_stop(), until the next bench_reset().
+
+/*
+ * The benchmarks are linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, so the allocations of the code
+ * under test come through here and are counted before they are passed on to the C library.
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    allocs++;
+    alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    allocs++;
+    alloc_bytes += nmemb * size;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocs++;
+    alloc_bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+/**
+ * Returns the time of CLOCK_MONOTONIC in nanoseconds.
+ */
+static u_int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Starts the measured part of a run. Called by a benchmark after its setup, and by bench_run() before the
+ * benchmark is called, so benchmarks without setup need not call it.
+ */
+void bench_reset() {
+    stopped = 0;
+    start_allocs = allocs;
+    start_bytes = alloc_bytes;
+    start_ns = now_ns();
+}
+
+/**
+ * Ends the measured part of a run. Called by a benchmark before its teardown, and by bench_run() after the
+ * benchmark returns if it did not.
+ */
+void bench_stop() {
+    if (stopped) {
+        return;
+    }
+    elapsed_ns = now_ns() - start_ns;
+    run_allocs = allocs - start_allocs;
+    run_bytes = alloc_bytes - start_bytes;
+    stopped = 1;
+}
+
+/**
+ * Runs a benchmark once.
+ *
+ * @param function: The benchmark.
+ * @param iterations: The number of operations.
+ * @return: The duration of the measured part in nanoseconds.
+ */
+static u_int64_t run_once(bench_function function, unsigned long iterations) {
+    bench_reset();
+    function(iterations);
+    bench_stop();
+    return elapsed_ns;
+}
+
+/**
+ * Compares two doubles for qsort().
+ */
+static int compare_doubles(void const *a, void const *b) {
+    double x = *(double const *)a, y = *(double const *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Runs a benchmark, unless it is filtered out, and keeps its result.
+ *
+ * The number of iterations is raised until one run takes at least bench_min_time_ms. The benchmark is then run
+ * bench_runs times with that number of iterations, and the median time per operation is kept, which is steadier
+ * than the mean when some runs are disturbed. Allocations do not vary between runs, those of the last run are kept.
+ *
+ * @param name: Name of the benchmark.
+ * @param function: The benchmark.
+ * @return: 0 if the benchmark was run or filtered out, -1 if there is no room for its result.
+ */
+int bench_run(char const *name, bench_function function) {
+    if (bench_filter != NULL && strstr(name, bench_filter) == NULL) {
+        return 0;
+    }
+    if (num_results == BENCH_MAX_RESULTS) {
+        fprintf(stderr, "Too many benchmarks, %s is not run\n", name);
+        return -1;
+    }
+
+    u_int64_t min_ns = (u_int64_t)bench_min_time_ms * 1000000;
+    unsigned long iterations = 1;
+    u_int64_t ns = run_once(function, iterations);
+    while (ns < min_ns && iterations < BENCH_MAX_ITERATIONS) {
+        // Aim 20% past the minimum, but grow at most a hundredfold at a time
+        double wanted = ns > 0 ? (double)iterations * (double)min_ns * 1.2 / (double)ns : (double)iterations * 100;
+        unsigned long next = wanted > (double)iterations * 100 ? iterations * 100 : (unsigned long)wanted;
+        iterations = next > iterations ? next : iterations + 1;
+        if (iterations > BENCH_MAX_ITERATIONS) {
+            iterations = BENCH_MAX_ITERATIONS;
+        }
+        ns = run_once(function, iterations);
+    }
+
+    double per_op[bench_runs];
+    for (int i = 0; i < bench_runs; i++) {
+        per_op[i] = (double)run_once(function, iterations) / (double)iterations;
+    }
+    qsort(per_op, bench_runs, sizeof(double), compare_doubles);
+
+    struct bench_result *result = &results[num_results++];
+    result->name = name;
+    result->iterations = iterations;
+    result->ns_per_op = per_op[bench_runs / 2];
+    result->allocs_per_op = (double)run_allocs / (double)iterations;
+    result->bytes_per_op = (double)run_bytes / (double)iterations;
+    return 0;
+}
+
+/**
+ * Prints the results, as a table or as JSON. The JSON has one benchmark per line, in the order they were run,
+ * with the same keys and number formats every time, so results of two builds can be compared line by line.
+ *
+ * @param json: 1 for JSON, 0 for a table.
+ */
+void bench_print(int json) {
+    if (json) {
+        printf("{\"min_time_ms\": %d, \"runs\": %d, \"benchmarks\": [\n", bench_min_time_ms, bench_runs);
+        for (int i = 0; i < num_results; i++) {
+            struct bench_result const *result = &results[i];
+            printf("  {\"name\": \"%s\", \"iterations\": %lu, \"ns_per_op\": %.2f, \"allocs_per_op\": %.2f, "
+                   "\"bytes_per_op\": %.1f}%s\n", result->name, result->iterations, result->ns_per_op,
+                   result->allocs_per_op, result->bytes_per_op, i + 1 < num_results ? "," : "");
+        }
+        printf("]}\n");
+        return;
+    }
+
+    printf("%-44s %12s %12s %10s %10s\n", "benchmark", "iterations", "ns/op", "allocs/op", "B/op");
+    for (int i = 0; i < num_results; i++) {
+        struct bench_result const *result = &results[i];
+        printf("%-44s %12lu %12.2f %10.2f %10.1f\n", result->name, result->iterations, result->ns_per_op,
+               result->allocs_per_op, result->bytes_per_op);
+    }
+}
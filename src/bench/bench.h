@@ -0,0 +1,39 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <sys/types.h>
+
+#define BENCH_MAX_RESULTS 64        // Maximum number of benchmarks in one run.
+#define BENCH_MAX_ITERATIONS 1000000000UL // Upper bound of the iterations of one run.
+
+/**
+ * A benchmark. Runs the operation it measures the given number of times. Setup that should not be measured is done
+ * before calling bench_reset(), teardown after calling bench_stop().
+ */
+typedef void (*bench_function)(unsigned long iterations);
+
+/**
+ * The result of a benchmark.
+ */
+struct bench_result {
+    char const *name;           // Name of the benchmark.
+    unsigned long iterations;   // Iterations of every run.
+    double ns_per_op;           // Median time per operation over the runs.
+    double allocs_per_op;       // Calls to malloc(), calloc() and realloc() per operation.
+    double bytes_per_op;        // Bytes asked of them per operation.
+};
+
+extern int bench_min_time_ms;       // Minimum duration of one run, the iterations are raised until it is reached.
+extern int bench_runs;              // Number of runs of every benchmark, the median is reported.
+extern char const *bench_filter;    // Only benchmarks whose name contains this are run, NULL for all.
+extern volatile unsigned long bench_sink; // Results are added here, so the compiler cannot drop the work.
+
+void bench_reset();
+
+void bench_stop();
+
+int bench_run(char const *name, bench_function function);
+
+void bench_print(int json);
+
+#endif //BENCH_H
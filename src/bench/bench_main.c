@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include "bench.h"
+#include "../mipd/lower/arp/arp.h"
+#include "../mipd/lower/arp/cache.h"
+#include "../mipd/lower/mip/mip.h"
+#include "../mipd/lower/mip/queues/arp_queue.h"
+#include "../mipd/lower/mip/queues/route_queue.h"
+#include "../common/routing/routing_messages.h"
+#include "../routingd/routing_common.h"
+#include "../routingd/table/table.h"
+#include "../routingd/timer/timer.h"
+#include "../routingd/update/update.h"
+
+#define BENCH_ARP_ENTRIES 254       // ARP cache entries, MIP addresses 1 to 254.
+#define BENCH_ROUTE_DEPTH 16        // Packets already waiting in the route queue.
+#define BENCH_ARP_NEXT_HOPS 16      // Next hops with packets waiting in the ARP queue.
+#define BENCH_ARP_DEPTH 64          // Packets already waiting in the ARP queue, spread over the next hops.
+#define BENCH_ARP_BURST 4           // Packets waiting in the ARP queue for the next hop an ARP response resolves.
+#define BENCH_NEIGHBOURS 8          // Neighbours in the routing table, each with a route to every destination.
+#define BENCH_PDUS 64               // Distinct PDU headers cycled through by the encode and decode benchmarks.
+
+static struct mip_pdu pdu;                      // A PDU to queue.
+static struct mip_pdu encoded[BENCH_PDUS];      // PDU headers to decode.
+static update_message updates[2][2];            // UPDATE messages from neighbour 1, [cost variant][half].
+static unsigned long frames_sent;               // Frames mipd sent through count_frame().
+
+/**
+ * Prints the help message
+ * @param argv: The command line arguments
+ * @return void
+ */
+void print_help(char *argv[]) {
+    printf("Usage: %s [-h] [-j] [-t <ms>] [-r <runs>] [-f <filter>]\n", argv[0]);
+    printf("  -h\t\tPrints this help message\n");
+    printf("  -j\t\tPrints the results as JSON\n");
+    printf("  -t <ms>\tMinimum duration of one run of a benchmark (default %d)\n", bench_min_time_ms);
+    printf("  -r <runs>\tRuns of every benchmark, the median is reported (default %d)\n", bench_runs);
+    printf("  -f <filter>\tOnly runs the benchmarks whose name contains <filter>\n");
+}
+
+/**
+ * Prints a basic usage message and exits the program.
+ * @param argv The command line arguments
+ * @return void
+ */
+void usage_and_exit(char *argv[]) {
+    printf("Usage: %s [-h] [-j] [-t <ms>] [-r <runs>] [-f <filter>]\n", argv[0]);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Stands in for the routing unix socket, in case the routing engine sends anything.
+ */
+static long discard_message(int usd, void const *message, size_t len) {
+    (void)usd;
+    (void)message;
+    return (long)len;
+}
+
+/**
+ * Fills the ARP cache with BENCH_ARP_ENTRIES entries.
+ */
+static void fill_arp_cache() {
+    arp_cache_init();
+    for (int addr = 1; addr <= BENCH_ARP_ENTRIES; addr++) {
+        u_int8_t mac[6] = {0x02, 0, 0, 0, 0, (u_int8_t)addr};
+        arp_cache_add((u_int8_t)addr, mac, (u_int8_t)(addr % 4));
+    }
+}
+
+/**
+ * Looks up entries spread over a full ARP cache.
+ */
+static void bench_arp_cache_get(unsigned long iterations) {
+    fill_arp_cache();
+    bench_reset();
+    for (unsigned long i = 0; i < iterations; i++) {
+        struct arp_cache_entry const *entry = arp_cache_get((u_int8_t)(i % BENCH_ARP_ENTRIES + 1));
+        bench_sink += entry->interface;
+    }
+    bench_stop();
+    free(arp_cache);
+}
+
+/**
+ * Refreshes entries spread over a full ARP cache, as ARP responses do.
+ */
+static void bench_arp_cache_add(unsigned long iterations) {
+    fill_arp_cache();
+    u_int8_t mac[6] = {0x02, 0, 0, 0, 0, 0};
+    bench_reset();
+    for (unsigned long i = 0; i < iterations; i++) {
+        mac[5] = (u_int8_t)i;
+        bench_sink += arp_cache_add((u_int8_t)(i % BENCH_ARP_ENTRIES + 1), mac, 0);
+    }
+    bench_stop();
+    free(arp_cache);
+}
+
+/**
+ * Adds a packet to the route queue and takes the oldest one out, with BENCH_ROUTE_DEPTH packets waiting.
+ */
+static void bench_route_queue(unsigned long iterations) {
+    init_route_queue();
+    for (int i = 0; i < BENCH_ROUTE_DEPTH; i++) {
+        route_enqueue(pdu);
+    }
+    bench_reset();
+    for (unsigned long i = 0; i < iterations; i++) {
+        pdu.dest_addr = (u_int8_t)i;
+        route_enqueue(pdu);
+        bench_sink += route_dequeue().dest_addr;
+    }
+    bench_stop();
+    free_route_queue();
+}
+
+/**
+ * Adds a packet to the ARP queue and takes one out for the same next hop, with BENCH_ARP_DEPTH packets waiting
+ * for BENCH_ARP_NEXT_HOPS next hops.
+ */
+static void bench_arp_queue(unsigned long iterations) {
+    init_arp_queue();
+    for (int i = 0; i < BENCH_ARP_DEPTH; i++) {
+        arp_enqueue_mip_pdu(&pdu, (u_int8_t)(i % BENCH_ARP_NEXT_HOPS + 1));
+    }
+    bench_reset();
+    for (unsigned long i = 0; i < iterations; i++) {
+        u_int8_t next_hop = (u_int8_t)(i % BENCH_ARP_NEXT_HOPS + 1);
+        arp_enqueue_mip_pdu(&pdu, next_hop);
+        struct mip_pdu *dequeued = arp_dequeue_mip_pdu(next_hop);
+        bench_sink += dequeued->dest_addr;
+        free(dequeued);
+    }
+    bench_stop();
+    destroy_arp_queue();
+}
+
+/**
+ * Stands in for the raw socket, counting the frames mipd sends.
+ */
+static long count_frame(int rsd, struct msghdr const *msghdr) {
+    (void)rsd;
+    long len = 0;
+    for (size_t i = 0; i < msghdr->msg_iovlen; i++) {
+        len += (long)msghdr->msg_iov[i].iov_len;
+    }
+    frames_sent++;
+    return len;
+}
+
+/**
+ * Hands mipd, as MIP address 1 with one interface, an ARP response from MIP address 2 on that interface.
+ */
+static void receive_arp_response(struct fds fds, struct ifs_data ifs_data) {
+    struct sockaddr_ll from;
+    memset(&from, 0, sizeof(from));
+    from.sll_ifindex = ifs_data.addr[0].sll_ifindex;
+    struct ether_frame frame_hdr = {{0}, {0x02, 0, 0, 0, 0, 2}, {0}};
+    struct mip_pdu response;
+    memset(&response, 0, sizeof(response));
+    response.dest_addr = 1;
+    response.src_addr = 2;
+    response.ttl = 1;
+    response.sdu_type = MIP_SDU_TYPE_ARP;
+    response.sdu_len = sizeof(struct arp_message);
+    struct arp_message arp_msg = {ARP_TYPE_RESPONSE, 2, 0};
+    memcpy(response.sdu, &arp_msg, sizeof(arp_msg));
+
+    struct iovec iov[2] = {{&frame_hdr, sizeof(frame_hdr)}, {&response, sizeof(response)}};
+    struct msghdr msghdr;
+    memset(&msghdr, 0, sizeof(msghdr));
+    msghdr.msg_name = &from;
+    msghdr.msg_namelen = sizeof(from);
+    msghdr.msg_iov = iov;
+    msghdr.msg_iovlen = 2;
+    handle_arp_packet(fds, ifs_data, &msghdr);
+}
+
+/**
+ * Sends BENCH_ARP_BURST packets to a next hop that is not in the ARP cache, then delivers one ARP response from it.
+ * Exits if the packets did not share one ARP request, or if the response did not send every one of them.
+ */
+static void check_arp_response(struct fds fds, struct ifs_data ifs_data) {
+    arp_cache_init();
+    init_arp_queue();
+    frames_sent = 0;
+    for (int i = 0; i < BENCH_ARP_BURST; i++) {
+        send_to_next_hop(fds, ifs_data, pdu, 2);
+    }
+    if (frames_sent != 1 || arp_queue_length(2) != BENCH_ARP_BURST) {
+        fprintf(stderr, "arp_response: %lu frames sent and %d packets queued, expected 1 and %d\n", frames_sent,
+                arp_queue_length(2), BENCH_ARP_BURST);
+        exit(EXIT_FAILURE);
+    }
+    receive_arp_response(fds, ifs_data);
+    if (frames_sent != 1 + BENCH_ARP_BURST || arp_queue_length(2) != 0) {
+        fprintf(stderr, "arp_response: %lu packets sent and %d left queued after the response, expected %d and 0\n",
+                frames_sent - 1, arp_queue_length(2), BENCH_ARP_BURST);
+        exit(EXIT_FAILURE);
+    }
+    destroy_arp_queue();
+    free(arp_cache);
+}
+
+/**
+ * Handles an ARP response with BENCH_ARP_BURST packets waiting for the next hop it resolves, which are all sent.
+ */
+static void bench_arp_response(unsigned long iterations) {
+    struct fds fds;
+    memset(&fds, 0, sizeof(fds));
+    fds.rsd = -1;
+    fds.routing_usd = -1;
+    struct ifs_data ifs_data;
+    memset(&ifs_data, 0, sizeof(ifs_data));
+    ifs_data.ifn = 1;
+    ifs_data.local_mip_addr = 1;
+    ifs_data.addr[0].sll_ifindex = 1;
+    packet_transmit_hook = count_frame;
+
+    check_arp_response(fds, ifs_data);
+    arp_cache_init();
+    init_arp_queue();
+    bench_reset();
+    for (unsigned long i = 0; i < iterations; i++) {
+        for (int j = 0; j < BENCH_ARP_BURST; j++) {
+            arp_enqueue_mip_pdu(&pdu, 2);
+        }
+        receive_arp_response(fds, ifs_data);
+    }
+    bench_stop();
+    destroy_arp_queue();
+    free(arp_cache);
+    packet_transmit_hook = NULL;
+}
+
+/**
+ * Writes the header fields of a PDU, as mipd does for every packet it sends.
+ */
+static void bench_pdu_encode(unsigned long iterations) {
+    static struct mip_pdu out[BENCH_PDUS];
+    for (unsigned long i = 0; i < iterations; i++) {
+        struct mip_pdu *header = &out[i % BENCH_PDUS];
+        header->dest_addr = (u_int8_t)i;
+        header->src_addr = (u_int8_t)(i >> 8);
+        header->ttl = (u_int8_t)(i % 16);
+        header->sdu_len = (u_int16_t)(i % 512);
+        header->sdu_type = MIP_SDU_TYPE_PING;
+        __asm__ volatile("" : : "r"(header) : "memory"); // Keep the stores
+    }
+    bench_sink += out[0].dest_addr;
+}
+
+/**
+ * Reads the header fields of a PDU, as mipd does for every packet it receives.
+ */
+static void bench_pdu_decode(unsigned long iterations) {
+    unsigned long sum = 0;
+    for (unsigned long i = 0; i < iterations; i++) {
+        struct mip_pdu const *header = &encoded[i % BENCH_PDUS];
+        sum += header->dest_addr + header->src_addr + header->ttl + header->sdu_len + header->sdu_type;
+        __asm__ volatile("" : "+r"(sum)); // Keep the loads
+    }
+    bench_sink += sum;
+}
+
+/**
+ * Empties the routing table and fills it with BENCH_NEIGHBOURS neighbours, which each have a route to every one
+ * of the MAX_NODES destinations, so that every destination has BENCH_NEIGHBOURS routes to choose from.
+ */
+static void fill_routing_table() {
+    for (int dest = 0; dest < MAX_NODES; dest++) {
+        route_node *node = routing_table[dest];
+        while (node != NULL) {
+            route_node *next = node->next;
+            free(node);
+            node = next;
+        }
+    }
+    init_routing_table();
+    for (int neighbour = 1; neighbour <= BENCH_NEIGHBOURS; neighbour++) {
+        add_update_route(neighbour, neighbour, 1);
+    }
+    for (int dest = 0; dest < MAX_NODES; dest++) {
+        for (int neighbour = 1; neighbour <= BENCH_NEIGHBOURS; neighbour++) {
+            if (dest != neighbour) {
+                add_update_route(dest, neighbour, 2 + (dest * neighbour) % 13);
+            }
+        }
+    }
+}
+
+/**
+ * Finds the fastest route to destinations spread over a full routing table, as every routing request does.
+ */
+static void bench_find_fastest_route(unsigned long iterations) {
+    fill_routing_table();
+    bench_reset();
+    for (unsigned long i = 0; i < iterations; i++) {
+        bench_sink += find_fastest_route((u_int8_t)i).cost;
+    }
+}
+
+/**
+ * Computes the costs to announce to a neighbour from a full routing table, as every UPDATE message does.
+ */
+static void bench_get_all_fastest_routes_for_neighbour(unsigned long iterations) {
+    static u_int16_t fastest_routes[MAX_NODES];
+    fill_routing_table();
+    bench_reset();
+    for (unsigned long i = 0; i < iterations; i++) {
+        get_all_fastest_routes_for_neighbour((u_int8_t)(i % BENCH_NEIGHBOURS + 1), fastest_routes);
+        bench_sink += fastest_routes[i % MAX_NODES];
+    }
+}
+
+/**
+ * Builds the UPDATE messages neighbour 1 sends for a full table, in two variants with different costs.
+ */
+static void build_updates() {
+    for (int variant = 0; variant < 2; variant++) {
+        for (int half = 0; half < 2; half++) {
+            update_message *update = &updates[variant][half];
+            memset(update, 0, sizeof(*update));
+            update->header.mip_addr = 1;
+            update->header.ttl = 1;
+            update->header.id1 = 0x55; // U
+            update->header.id2 = 0x50; // P
+            update->header.id3 = 0x44; // D
+            update->first_node = half * UPDATE_NODES_PER_MESSAGE;
+            update->num_nodes = UPDATE_NODES_PER_MESSAGE;
+            for (int i = 0; i < UPDATE_NODES_PER_MESSAGE; i++) {
+                int node = update->first_node + i;
+                update->fastest_routes[i] = htons((u_int16_t)(1 + (node * 7 + variant * 5) % 11));
+            }
+        }
+    }
+}
+
+/**
+ * Handles UPDATE messages that change nothing, the common case once the network has converged.
+ */
+static void bench_handle_update_unchanged(unsigned long iterations) {
+    fill_routing_table();
+    handle_update_message(updates[0][0]);
+    handle_update_message(updates[0][1]);
+    bench_reset();
+    for (unsigned long i = 0; i < iterations; i++) {
+        handle_update_message(updates[0][i % 2]);
+    }
+}
+
+/**
+ * Handles UPDATE messages that change the cost of every route via the sender.
+ */
+static void bench_handle_update_changed(unsigned long iterations) {
+    fill_routing_table();
+    bench_reset();
+    for (unsigned long i = 0; i < iterations; i++) {
+        handle_update_message(updates[(i / 2) % 2][i % 2]);
+    }
+}
+
+/**
+ * Main function of the microbenchmarks.
+ *
+ * Measures the data structures that mipd and routingd use for every packet or routing message: the ARP cache, the
+ * route and ARP queues, the MIP header, and a full routing table of MAX_NODES destinations. Each benchmark reports
+ * the time and the allocations per operation, so changes to these modules can be judged with numbers.
+ *
+ * @param argc: Integer, number of arguments passed to the program from the terminal.
+ * @param argv: Array of strings representing the arguments passed to the program.
+ *
+ * @return: Integer representing the exit status of the program. 0 indicating normal termination,
+ * and exits with EXIT_FAILURE status on invalid options.
+ */
+int main(int argc, char *argv[]) {
+    int opt, hflag = 0, json = 0;
+
+    while ((opt = getopt(argc, argv, "hjt:r:f:")) != -1) {
+        switch (opt) {
+            case 'h':
+                // Help flag given
+                hflag = 1;
+                break;
+            case 'j':
+                json = 1;
+                break;
+            case 't':
+                bench_min_time_ms = atoi(optarg);
+                break;
+            case 'r':
+                bench_runs = atoi(optarg);
+                break;
+            case 'f':
+                bench_filter = optarg;
+                break;
+            default:
+                usage_and_exit(argv);
+        }
+    }
+
+    // Check if the help flag was given, if so print help message and exit
+    if (hflag) {
+        print_help(argv);
+        exit(EXIT_SUCCESS);
+    }
+    if (argc - optind != 0 || bench_min_time_ms < 1 || bench_runs < 1) {
+        usage_and_exit(argv);
+    }
+
+    // The routing engine arms timers when routes change, and may send messages
+    if (init_timers() == -1) {
+        exit(EXIT_FAILURE);
+    }
+    routing_transport_hook = discard_message;
+
+    memset(&pdu, 0, sizeof(pdu));
+    pdu.src_addr = 1;
+    pdu.ttl = MIP_MAX_TTL;
+    pdu.sdu_len = sizeof(pdu.sdu);
+    pdu.sdu_type = MIP_SDU_TYPE_PING;
+    for (int i = 0; i < BENCH_PDUS; i++) {
+        encoded[i].dest_addr = (u_int8_t)(i * 3);
+        encoded[i].src_addr = (u_int8_t)i;
+        encoded[i].ttl = (u_int8_t)(i % 16);
+        encoded[i].sdu_len = (u_int16_t)(i * 8);
+        encoded[i].sdu_type = MIP_SDU_TYPE_ROUTING;
+    }
+    build_updates();
+
+    bench_run("mipd/arp_cache_get", bench_arp_cache_get);
+    bench_run("mipd/arp_cache_add", bench_arp_cache_add);
+    bench_run("mipd/route_enqueue+route_dequeue", bench_route_queue);
+    bench_run("mipd/arp_enqueue+arp_dequeue", bench_arp_queue);
+    bench_run("mipd/arp_response", bench_arp_response);
+    bench_run("mipd/pdu_header_encode", bench_pdu_encode);
+    bench_run("mipd/pdu_header_decode", bench_pdu_decode);
+    bench_run("routingd/find_fastest_route", bench_find_fastest_route);
+    bench_run("routingd/get_all_fastest_routes_for_neighbour", bench_get_all_fastest_routes_for_neighbour);
+    bench_run("routingd/handle_update_message/unchanged", bench_handle_update_unchanged);
+    bench_run("routingd/handle_update_message/changed", bench_handle_update_changed);
+
+    bench_print(json);
+    return 0;
+}
@@ -17,13 +17,31 @@ typedef struct __attribute__((packed)){
     u_int8_t buffer[511];
 } general_message;
 
+#define MAX_HELLO_ECHOES 40           // Maximum number of neighbours echoed in one HELLO message.
+#define UPDATE_NODES_PER_MESSAGE 128  // Number of destinations in one UPDATE message, two make up the table.
+
+typedef struct __attribute__((packed)){
+    u_int8_t mip_addr;          // The neighbour whose HELLO is echoed.
+    u_int16_t seq;              // Sequence number of the last HELLO received from the neighbour, in network byte order.
+    u_int32_t timestamp_us;     // Timestamp of that HELLO, echoed back unchanged.
+    u_int32_t hold_us;          // Microseconds between receiving that HELLO and sending this one, in network byte order.
+    u_int8_t delivery_ratio;    // Share of the neighbour's HELLO messages that were received, 0-255.
+} hello_echo;
+
 typedef struct __attribute__((packed)){
     message_header header;
+    u_int16_t seq;              // Sequence number of the HELLO, in network byte order.
+    u_int32_t timestamp_us;     // Sender's clock when the HELLO was sent, only meaningful to the sender.
+    u_int32_t hold_ms;          // How long the sender may stay silent before it is considered dead, in network byte order.
+    u_int8_t num_echoes;        // Number of entries in echoes.
+    hello_echo echoes[MAX_HELLO_ECHOES];
 } hello_message;
 
 typedef struct __attribute__((packed)){
     message_header header;
-    u_int8_t fastest_routes[MAX_NODES];
+    u_int8_t first_node;        // The destination of fastest_routes[0].
+    u_int8_t num_nodes;         // Number of entries in fastest_routes.
+    u_int16_t fastest_routes[UPDATE_NODES_PER_MESSAGE]; // Cost to each destination, in network byte order.
 } update_message;
 
 typedef struct {
@@ -34,6 +52,46 @@ typedef struct {
 typedef struct {
     message_header header;
     u_int8_t next_hop_mip;
+    u_int8_t backup_next_hop_mip;   // Loop-free alternate to use if next_hop_mip is down, 255 if none.
+    u_int8_t num_equal_cost;        // Number of entries in equal_cost_next_hops, next_hop_mip is the first.
+    u_int8_t equal_cost_next_hops[MAX_EQUAL_COST_ROUTES]; // All next hops with the lowest cost.
 } response_message;
 
+typedef struct __attribute__((packed)){
+    message_header header;
+    u_int8_t state;             // Liveness session state of the sender.
+    u_int8_t detect_mult;       // Number of missed intervals after which the sender declares the session down.
+    u_int16_t desired_tx_ms;    // Interval the sender would like to transmit at, in network byte order.
+    u_int16_t required_rx_ms;   // Shortest interval the sender is willing to receive at, in network byte order.
+} liveness_message;
+
+#define MAX_LSA_LINKS 160     // Maximum number of links in one link-state advertisement.
+
+typedef struct __attribute__((packed)){
+    u_int8_t mip_addr;          // The neighbour at the other end of the link.
+    u_int16_t cost;             // Cost of the link, in network byte order.
+} lsa_link;
+
+typedef struct __attribute__((packed)){
+    message_header header;
+    u_int8_t origin;            // The node whose links are advertised.
+    u_int16_t seq;              // Sequence number of the advertisement, in network byte order.
+    u_int8_t num_links;         // Number of entries in links.
+    lsa_link links[MAX_LSA_LINKS];
+} lsa_message;
+
+#define NEXTHOP_DOWN_SEND_ERRORS    1   // sendmsg() to the next hop kept failing.
+#define NEXTHOP_DOWN_ARP_UNANSWERED 2   // ARP requests for the next hop were not answered.
+#define NEXTHOP_DOWN_ARP_QUEUE      3   // Too many packets are waiting in the ARP queue for the next hop. No longer sent.
+
+typedef struct __attribute__((packed)){
+    message_header header;
+    u_int8_t next_hop_mip;      // The next hop that mipd considers down.
+    u_int8_t reason;            // NEXTHOP_DOWN_*
+} nexthop_down_message;
+
+typedef struct __attribute__((packed)){
+    message_header header;
+} table_request_message;
+
 #endif // MESSAGES_H
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+
+/**
+ * Returns the wall clock time in milliseconds.
+ * Snapshots outlive the process that wrote them, so their timestamps cannot use the monotonic clock of
+ * either daemon.
+ *
+ * @return: Milliseconds since the epoch.
+ */
+u_int64_t snapshot_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (u_int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Opens a snapshot file, creating it if needed, and maps it into memory.
+ *
+ * The file is mapped shared, so every write to the data ends up in the file without any system call, and
+ * survives the process being killed. A file of the wrong size is truncated to the right size, which also
+ * makes its contents invalid.
+ *
+ * @param snapshot: The snapshot to fill in.
+ * @param path: Pathname of the snapshot file.
+ * @param magic: Identifies what the snapshot holds.
+ * @param size: Size of the data to keep in the snapshot.
+ * @return: Pointer to the mapped data, or NULL on failure.
+ */
+void *snapshot_map(struct snapshot *snapshot, const char *path, u_int32_t magic, size_t size) {
+    snapshot->fd = -1;
+    snapshot->header = NULL;
+    snapshot->data = NULL;
+    snapshot->size = size;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd == -1) {
+        perror("open: snapshot");
+        return NULL;
+    }
+
+    size_t total = sizeof(struct snapshot_header) + size;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat: snapshot");
+        close(fd);
+        return NULL;
+    }
+    if ((size_t)st.st_size != total) {
+        // Empty, or from another layout. Start over with zeroes.
+        if (ftruncate(fd, 0) == -1 || ftruncate(fd, (off_t)total) == -1) {
+            perror("ftruncate: snapshot");
+            close(fd);
+            return NULL;
+        }
+    }
+
+    void *map = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap: snapshot");
+        close(fd);
+        return NULL;
+    }
+
+    snapshot->fd = fd;
+    snapshot->header = map;
+    snapshot->data = (u_int8_t *)map + sizeof(struct snapshot_header);
+    if (snapshot->header->magic != magic || snapshot->header->version != SNAPSHOT_VERSION ||
+        snapshot->header->size != size) {
+        snapshot->header->magic = magic;
+        snapshot->header->version = SNAPSHOT_VERSION;
+        snapshot->header->size = (u_int32_t)size;
+        snapshot->header->seq = 0;
+        snapshot->header->written_ms = 0;
+    }
+    return snapshot->data;
+}
+
+/**
+ * Checks if a mapped snapshot holds data from a completed write.
+ *
+ * @param snapshot: The mapped snapshot.
+ * @return: 1 if the data can be loaded, 0 otherwise.
+ */
+int snapshot_valid(struct snapshot const *snapshot) {
+    return snapshot->header != NULL && snapshot->header->written_ms != 0 && snapshot->header->seq % 2 == 0;
+}
+
+/**
+ * Returns how long ago the snapshot was last written.
+ *
+ * @param snapshot: The mapped snapshot.
+ * @return: Milliseconds since the last completed write, 0 if the clock went backwards.
+ */
+u_int64_t snapshot_age_ms(struct snapshot const *snapshot) {
+    u_int64_t now = snapshot_now_ms();
+    return now > snapshot->header->written_ms ? now - snapshot->header->written_ms : 0;
+}
+
+/**
+ * Marks the start of a write to the snapshot data. Until snapshot_end_write() is called the snapshot is
+ * not valid.
+ *
+ * @param snapshot: The mapped snapshot.
+ */
+void snapshot_begin_write(struct snapshot *snapshot) {
+    if (snapshot->header->seq % 2 == 0) {
+        snapshot->header->seq++;
+    }
+    __sync_synchronize();
+}
+
+/**
+ * Marks the end of a write to the snapshot data, and records when it was written.
+ *
+ * @param snapshot: The mapped snapshot.
+ */
+void snapshot_end_write(struct snapshot *snapshot) {
+    __sync_synchronize();
+    snapshot->header->written_ms = snapshot_now_ms();
+    snapshot->header->seq++;
+}
+
+/**
+ * Unmaps a snapshot and closes its file. The contents stay in the file.
+ *
+ * @param snapshot: The mapped snapshot.
+ */
+void snapshot_unmap(struct snapshot *snapshot) {
+    if (snapshot->header != NULL) {
+        munmap(snapshot->header, sizeof(struct snapshot_header) + snapshot->size);
+    }
+    if (snapshot->fd != -1) {
+        close(snapshot->fd);
+    }
+    snapshot->fd = -1;
+    snapshot->header = NULL;
+    snapshot->data = NULL;
+}
@@ -0,0 +1,46 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SNAPSHOT_VERSION 1  // Bumped when the layout of the header changes.
+
+/**
+ * Header at the start of every snapshot file.
+ * The sequence number is odd while the snapshot is being written, so a daemon that died in the middle of a
+ * write leaves a snapshot that is not loaded.
+ */
+struct snapshot_header {
+    u_int32_t magic;        // Identifies what the snapshot holds, chosen by the daemon.
+    u_int32_t version;      // SNAPSHOT_VERSION
+    u_int32_t size;         // Size of the data after the header.
+    u_int32_t seq;          // Incremented before and after every write.
+    u_int64_t written_ms;   // Wall clock time of the last completed write, 0 if never written.
+};
+
+/**
+ * A snapshot file mapped into memory.
+ */
+struct snapshot {
+    int fd;                         // The snapshot file, -1 if not open.
+    struct snapshot_header *header; // The mapped header.
+    void *data;                     // The mapped data, right after the header.
+    size_t size;                    // Size of the data.
+};
+
+u_int64_t snapshot_now_ms();
+
+void *snapshot_map(struct snapshot *snapshot, const char *path, u_int32_t magic, size_t size);
+
+int snapshot_valid(struct snapshot const *snapshot);
+
+u_int64_t snapshot_age_ms(struct snapshot const *snapshot);
+
+void snapshot_begin_write(struct snapshot *snapshot);
+
+void snapshot_end_write(struct snapshot *snapshot);
+
+void snapshot_unmap(struct snapshot *snapshot);
+
+#endif //SNAPSHOT_H
@@ -0,0 +1,754 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include "../mipd/mipd_common.h"
+#include "../mipd/lower/mip/mip.h"
+
+#define MAX_SIZES 16            // Maximum number of SDU sizes in the size mix.
+#define MAX_BATCH 256           // Maximum number of frames sent or received with one system call.
+#define RING_FRAMES 1024        // Frames in the TX ring.
+#define RING_FRAME_SIZE 2048    // Bytes of every frame slot in the TX ring, header included.
+#define RING_BLOCK_SIZE 4096    // Bytes of every block of the TX ring, a multiple of the page size.
+#define RCVBUF_SIZE (8 << 20)   // Receive buffer of the counting socket, so bursts are not dropped by the generator.
+#define PKTGEN_MAGIC "MPKT"     // Marks the frames of the generator.
+#define PONG_PREFIX_LEN 5       // ping_server puts "PONG:" in front of the SDU it echoes.
+#define MIP_HEADER_LEN 4        // Bytes of struct mip_pdu before the SDU.
+#define FRAME_LEN(sdu_size) (sizeof(struct ether_frame) + MIP_HEADER_LEN + (sdu_size))
+
+/**
+ * The start of the SDU of every generated frame. Lets the counting side tell its own frames from the rest of the
+ * traffic, such as HELLOs, and measure the one-way latency when both sides run on the same host.
+ */
+struct pktgen_header {
+    char magic[4];              // PKTGEN_MAGIC.
+    u_int32_t seq;              // Sequence number of the frame, in network byte order.
+    u_int64_t sent_us;          // CLOCK_MONOTONIC time the frame was built, in microseconds.
+} __attribute__((packed));
+
+/**
+ * The frames to generate.
+ */
+struct pktgen_config {
+    u_int8_t dst_mac[6];        // Destination MAC address, the interface of mipd under test.
+    u_int8_t src_mac[6];        // MAC address of the sending interface.
+    u_int8_t src_addr;          // Source MIP address.
+    u_int8_t dest_addr;         // Destination MIP address.
+    u_int8_t ttl;               // TTL of the frames.
+    u_int8_t sdu_type;          // SDU type of the frames.
+    int sizes[MAX_SIZES];       // SDU sizes, used in turn.
+    int num_sizes;              // Number of SDU sizes.
+};
+
+/**
+ * The statistics of a run.
+ */
+struct pktgen_stats {
+    unsigned long sent;         // Frames sent.
+    unsigned long sent_bytes;   // Bytes of the frames sent, ethernet header included.
+    unsigned long retries;      // Sends that found the socket or the ring full, and were tried again.
+    unsigned long received;     // Frames of the generator received.
+    unsigned long other;        // Other MIP frames received.
+    unsigned long drops;        // Frames the counting socket dropped, as told by PACKET_STATISTICS.
+    u_int64_t latency_sum_us;   // Sum of the one-way latencies of the frames received.
+    u_int64_t latency_min_us;   // Shortest one-way latency.
+    u_int64_t latency_max_us;   // Longest one-way latency.
+};
+
+static volatile sig_atomic_t stop_flag = 0; // Set by SIGINT, the generator then stops and prints the summary.
+
+/**
+ * Prints the help message
+ * @param argv: The command line arguments
+ * @return void
+ */
+void print_help(char *argv[]) {
+    printf("Usage: %s [-h] [-I <tx_if>] [-i <rx_if>] [-m <mac>] [-S <src>] [-d <dest>] [-t <ttl>] [-T <type>] [-z <sizes>] [-r <pps>] [-c <count>] [-D <s>] [-b <batch>] [-x] [-W <ms>] [-q] [-j]\n", argv[0]);
+    printf("  -h\t\tPrints this help message\n");
+    printf("  -I <tx_if>\tSends the frames on this interface\n");
+    printf("  -i <rx_if>\tCounts the frames of the generator that come back, forwarded or echoed, on this interface\n");
+    printf("  -m <mac>\tDestination MAC address of the frames (default ff:ff:ff:ff:ff:ff)\n");
+    printf("  -S <src>\tSource MIP address (default 254)\n");
+    printf("  -d <dest>\tDestination MIP address, required with -I\n");
+    printf("  -t <ttl>\tTTL of the frames (default %d)\n", MIP_MAX_TTL);
+    printf("  -T <type>\tSDU type: ping, routing, arp or a number (default ping)\n");
+    printf("  -z <sizes>\tSDU sizes separated by commas, used in turn, from %zu to 511 (default 511)\n", sizeof(struct pktgen_header));
+    printf("  -r <pps>\tFrames sent per second, 0 for as fast as possible (default 0)\n");
+    printf("  -c <count>\tNumber of frames to send, 0 for no limit (default 0)\n");
+    printf("  -D <s>\tSeconds to run, 0 for no limit (default 10, or no limit when -c is given)\n");
+    printf("  -b <batch>\tFrames sent with one system call, at most %d (default 32)\n", MAX_BATCH);
+    printf("  -x\t\tSends through a PACKET_TX_RING instead of sendmmsg()\n");
+    printf("  -W <ms>\tTime to keep counting after the last frame is sent (default 1000)\n");
+    printf("  -q\t\tOnly prints the summary\n");
+    printf("  -j\t\tPrints the summary as JSON\n");
+}
+
+/**
+ * Prints a basic usage message and exits the program.
+ * @param argv The command line arguments
+ * @return void
+ */
+void usage_and_exit(char *argv[]) {
+    printf("Usage: %s [-h] [-I <tx_if>] [-i <rx_if>] [-m <mac>] [-S <src>] [-d <dest>] [-t <ttl>] [-T <type>] [-z <sizes>] [-r <pps>] [-c <count>] [-D <s>] [-b <batch>] [-x] [-W <ms>] [-q] [-j]\n", argv[0]);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Handles SIGINT by telling the main loop to stop.
+ */
+static void handle_sigint(int sig) {
+    (void)sig;
+    stop_flag = 1;
+}
+
+/**
+ * Returns the current time of CLOCK_MONOTONIC in microseconds.
+ */
+static u_int64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Parses a MAC address written as six hexadecimal bytes separated by colons.
+ *
+ * @param text: The MAC address.
+ * @param mac: Set to the parsed address.
+ * @return: 0 on success, -1 if the address is malformed.
+ */
+static int parse_mac(char const *text, u_int8_t mac[6]) {
+    unsigned int bytes[6];
+    if (sscanf(text, "%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6) {
+        return -1;
+    }
+    for (int i = 0; i < 6; i++) {
+        if (bytes[i] > 0xFF) {
+            return -1;
+        }
+        mac[i] = (u_int8_t)bytes[i];
+    }
+    return 0;
+}
+
+/**
+ * Parses an SDU type, given by name or as a number.
+ *
+ * @param text: The SDU type.
+ * @return: The SDU type, or -1 if it is unknown or does not fit in the 3 bits of the header.
+ */
+static int parse_sdu_type(char const *text) {
+    if (strcmp(text, "ping") == 0) {
+        return MIP_SDU_TYPE_PING;
+    }
+    if (strcmp(text, "routing") == 0) {
+        return MIP_SDU_TYPE_ROUTING;
+    }
+    if (strcmp(text, "arp") == 0) {
+        return MIP_SDU_TYPE_ARP;
+    }
+    char *end;
+    long type = strtol(text, &end, 0);
+    return *end == '\0' && type >= 0 && type <= 7 ? (int)type : -1;
+}
+
+/**
+ * Parses the size mix, SDU sizes separated by commas.
+ *
+ * @param text: The sizes. Modified by strtok.
+ * @param config: Gets the sizes.
+ * @return: 0 on success, -1 if a size is out of range or there are too many.
+ */
+static int parse_sizes(char *text, struct pktgen_config *config) {
+    config->num_sizes = 0;
+    for (char *size = strtok(text, ","); size != NULL; size = strtok(NULL, ",")) {
+        int value = atoi(size);
+        if (config->num_sizes == MAX_SIZES || value < (int)sizeof(struct pktgen_header) || value > 511) {
+            return -1;
+        }
+        config->sizes[config->num_sizes++] = value;
+    }
+    return config->num_sizes > 0 ? 0 : -1;
+}
+
+/**
+ * Opens a raw socket bound to an interface.
+ *
+ * @param ifname: Name of the interface.
+ * @param protocol: ETH_P_MIP to receive the MIP frames of the interface, 0 to only send.
+ * @param mac: If not NULL, set to the MAC address of the interface.
+ * @return: The socket, or -1 on failure.
+ */
+static int open_raw_socket(char const *ifname, int protocol, u_int8_t mac[6]) {
+    int rsd = socket(AF_PACKET, SOCK_RAW, htons(protocol));
+    if (rsd == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(protocol);
+    addr.sll_ifindex = (int)if_nametoindex(ifname);
+    if (addr.sll_ifindex == 0) {
+        fprintf(stderr, "Unknown interface %s\n", ifname);
+        close(rsd);
+        return -1;
+    }
+    if (bind(rsd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror("bind");
+        close(rsd);
+        return -1;
+    }
+
+    if (mac != NULL) {
+        struct ifreq ifr;
+        memset(&ifr, 0, sizeof(ifr));
+        strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+        if (ioctl(rsd, SIOCGIFHWADDR, &ifr) == -1) {
+            perror("ioctl");
+            close(rsd);
+            return -1;
+        }
+        memcpy(mac, ifr.ifr_hwaddr.sa_data, 6);
+    }
+    return rsd;
+}
+
+/**
+ * Writes a frame of the generator.
+ *
+ * The MIP header is written through struct mip_pdu, so that the bit fields are laid out as mipd reads them. Only
+ * the header and the SDU size are written, the frame is sent shorter than the full struct mipd sends.
+ *
+ * @param config: The frames to generate.
+ * @param seq: Sequence number of the frame, also selects its size from the size mix.
+ * @param frame: Buffer of at least FRAME_LEN(511) bytes.
+ * @return: The length of the frame.
+ */
+static size_t build_frame(struct pktgen_config const *config, u_int32_t seq, u_int8_t *frame) {
+    int sdu_size = config->sizes[seq % config->num_sizes];
+
+    struct ether_frame *ether = (struct ether_frame *)frame;
+    memcpy(ether->dst_addr, config->dst_mac, 6);
+    memcpy(ether->src_addr, config->src_mac, 6);
+    ether->eth_proto[0] = (ETH_P_MIP >> 8) & 0xFF;
+    ether->eth_proto[1] = ETH_P_MIP & 0xFF;
+
+    struct mip_pdu *pdu = (struct mip_pdu *)(frame + sizeof(struct ether_frame));
+    pdu->dest_addr = config->dest_addr;
+    pdu->src_addr = config->src_addr;
+    pdu->ttl = config->ttl;
+    pdu->sdu_len = sdu_size;
+    pdu->sdu_type = config->sdu_type;
+
+    struct pktgen_header header;
+    memcpy(header.magic, PKTGEN_MAGIC, sizeof(header.magic));
+    header.seq = htonl(seq);
+    header.sent_us = now_us();
+    memcpy(pdu->sdu, &header, sizeof(header));
+    return FRAME_LEN(sdu_size);
+}
+
+/**
+ * Sends frames with sendmmsg(). Frames the socket cannot take right away are counted as retries and sent again on
+ * the next call.
+ *
+ * @param rsd: The sending socket.
+ * @param config: The frames to generate.
+ * @param count: Number of frames to send, at most MAX_BATCH.
+ * @param stats: Gets the frames sent.
+ * @return: The number of frames sent, or -1 on failure.
+ */
+static int send_batch_mmsg(int rsd, struct pktgen_config const *config, int count, struct pktgen_stats *stats) {
+    static u_int8_t frames[MAX_BATCH][FRAME_LEN(511)];
+    static struct iovec iov[MAX_BATCH];
+    static struct mmsghdr msgs[MAX_BATCH];
+
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = frames[i];
+        iov[i].iov_len = build_frame(config, (u_int32_t)(stats->sent + i), frames[i]);
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int sent = sendmmsg(rsd, msgs, count, MSG_DONTWAIT);
+    if (sent == -1) {
+        if (errno == EAGAIN || errno == ENOBUFS) {
+            stats->retries++;
+            return 0;
+        }
+        perror("sendmmsg");
+        return -1;
+    }
+    for (int i = 0; i < sent; i++) {
+        stats->sent_bytes += iov[i].iov_len;
+    }
+    stats->sent += sent;
+    return sent;
+}
+
+/**
+ * A PACKET_TX_RING mapped into the generator. Frames are written straight into the slots the kernel sends from.
+ */
+struct tx_ring {
+    u_int8_t *map;              // The mapped ring.
+    size_t size;                // Bytes mapped.
+    unsigned int next;          // Next slot to fill.
+};
+
+/**
+ * Sets up a PACKET_TX_RING on a sending socket.
+ *
+ * @param rsd: The sending socket.
+ * @param ring: Gets the mapped ring.
+ * @return: 0 on success, -1 on failure.
+ */
+static int setup_tx_ring(int rsd, struct tx_ring *ring) {
+    int version = TPACKET_V2;
+    if (setsockopt(rsd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1) {
+        perror("setsockopt PACKET_VERSION");
+        return -1;
+    }
+    struct tpacket_req req = {
+            .tp_block_size = RING_BLOCK_SIZE,
+            .tp_block_nr = RING_FRAMES / (RING_BLOCK_SIZE / RING_FRAME_SIZE),
+            .tp_frame_size = RING_FRAME_SIZE,
+            .tp_frame_nr = RING_FRAMES,
+    };
+    if (setsockopt(rsd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) == -1) {
+        perror("setsockopt PACKET_TX_RING");
+        return -1;
+    }
+    ring->size = (size_t)req.tp_block_size * req.tp_block_nr;
+    ring->map = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, rsd, 0);
+    if (ring->map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    ring->next = 0;
+    return 0;
+}
+
+/**
+ * Sends frames through the TX ring. Fills the free slots, up to count, and tells the kernel to send them. When the
+ * ring is full, waits for the kernel to free a slot.
+ *
+ * @param rsd: The sending socket.
+ * @param ring: The mapped ring.
+ * @param config: The frames to generate.
+ * @param count: Number of frames to send.
+ * @param stats: Gets the frames sent.
+ * @return: The number of frames sent, or -1 on failure.
+ */
+static int send_batch_ring(int rsd, struct tx_ring *ring, struct pktgen_config const *config, int count,
+                           struct pktgen_stats *stats) {
+    int filled = 0;
+    while (filled < count) {
+        struct tpacket2_hdr *slot = (struct tpacket2_hdr *)(ring->map + (size_t)ring->next * RING_FRAME_SIZE);
+        if (__atomic_load_n(&slot->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+            break;
+        }
+        u_int8_t *frame = (u_int8_t *)slot + TPACKET_ALIGN(sizeof(struct tpacket2_hdr));
+        slot->tp_len = build_frame(config, (u_int32_t)(stats->sent + filled), frame);
+        stats->sent_bytes += slot->tp_len;
+        __atomic_store_n(&slot->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+        ring->next = (ring->next + 1) % RING_FRAMES;
+        filled++;
+    }
+
+    if (filled == 0) {
+        // The ring is full, wait for the kernel to send some of it
+        stats->retries++;
+        struct pollfd pfd = {.fd = rsd, .events = POLLOUT};
+        poll(&pfd, 1, 1);
+    }
+    if (send(rsd, NULL, 0, MSG_DONTWAIT) == -1 && errno != EAGAIN && errno != ENOBUFS) {
+        perror("send");
+        return -1;
+    }
+    stats->sent += filled;
+    return filled;
+}
+
+/**
+ * Reads the frames waiting on the counting socket, and counts those of the generator. A frame that mipd forwarded
+ * carries the header of the generator at the start of its SDU, a ping that ping_server echoed carries it after the
+ * "PONG:" prefix.
+ *
+ * @param rsd: The counting socket.
+ * @param stats: Gets the frames received.
+ * @return: The number of frames read, or -1 on failure.
+ */
+static int receive_batch(int rsd, struct pktgen_stats *stats) {
+    static u_int8_t frames[MAX_BATCH][FRAME_LEN(511)];
+    static struct iovec iov[MAX_BATCH];
+    static struct mmsghdr msgs[MAX_BATCH];
+    static struct sockaddr_ll addrs[MAX_BATCH];
+
+    for (int i = 0; i < MAX_BATCH; i++) {
+        iov[i].iov_base = frames[i];
+        iov[i].iov_len = sizeof(frames[i]);
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    }
+
+    int received = recvmmsg(rsd, msgs, MAX_BATCH, MSG_DONTWAIT, NULL);
+    if (received == -1) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return 0;
+        }
+        perror("recvmmsg");
+        return -1;
+    }
+
+    u_int64_t now = now_us();
+    for (int i = 0; i < received; i++) {
+        if (addrs[i].sll_pkttype == PACKET_OUTGOING) {
+            continue; // Sent on this interface, by the generator or by mipd
+        }
+        u_int8_t const *sdu = frames[i] + sizeof(struct ether_frame) + MIP_HEADER_LEN;
+        size_t sdu_len = msgs[i].msg_len - FRAME_LEN(0);
+        struct pktgen_header header;
+        if (msgs[i].msg_len >= FRAME_LEN(sizeof(header)) && memcmp(sdu, PKTGEN_MAGIC, 4) == 0) {
+            memcpy(&header, sdu, sizeof(header));
+        } else if (msgs[i].msg_len >= FRAME_LEN(0) && sdu_len >= PONG_PREFIX_LEN + sizeof(header)
+                   && memcmp(sdu + PONG_PREFIX_LEN, PKTGEN_MAGIC, 4) == 0) {
+            memcpy(&header, sdu + PONG_PREFIX_LEN, sizeof(header));
+        } else {
+            stats->other++;
+            continue;
+        }
+
+        u_int64_t latency = now > header.sent_us ? now - header.sent_us : 0;
+        if (stats->received == 0 || latency < stats->latency_min_us) {
+            stats->latency_min_us = latency;
+        }
+        if (latency > stats->latency_max_us) {
+            stats->latency_max_us = latency;
+        }
+        stats->latency_sum_us += latency;
+        stats->received++;
+    }
+    return received;
+}
+
+/**
+ * Adds the frames the counting socket dropped since the last call to the statistics.
+ */
+static void update_drops(int rsd, struct pktgen_stats *stats) {
+    struct tpacket_stats kstats;
+    socklen_t len = sizeof(kstats);
+    if (getsockopt(rsd, SOL_PACKET, PACKET_STATISTICS, &kstats, &len) == 0) {
+        stats->drops += kstats.tp_drops;
+    }
+}
+
+/**
+ * Prints the summary of a run, as text or as one line of JSON.
+ */
+static void print_summary(struct pktgen_stats const *stats, int sending, int counting, double tx_s, double rx_s,
+                          int json) {
+    double tx_pps = tx_s > 0 ? stats->sent / tx_s : 0;
+    double mbps = tx_s > 0 ? stats->sent_bytes * 8 / tx_s / 1e6 : 0;
+    double rx_pps = rx_s > 0 ? stats->received / rx_s : 0;
+    double loss = stats->sent > 0 && stats->received <= stats->sent
+                  ? 100.0 * (double)(stats->sent - stats->received) / (double)stats->sent : 0;
+    double latency_avg = stats->received > 0 ? (double)stats->latency_sum_us / (double)stats->received : 0;
+
+    if (json) {
+        printf("{\"sent\": %lu, \"tx_seconds\": %.3f, \"tx_pps\": %.0f, \"tx_mbps\": %.1f, \"retries\": %lu, "
+               "\"received\": %lu, \"rx_seconds\": %.3f, \"rx_pps\": %.0f, \"other\": %lu, \"drops\": %lu, "
+               "\"loss_pct\": %.2f, \"latency_us\": {\"min\": %lu, \"avg\": %.1f, \"max\": %lu}}\n",
+               stats->sent, tx_s, tx_pps, mbps, stats->retries, stats->received, rx_s, rx_pps, stats->other,
+               stats->drops, sending && counting ? loss : 0, (unsigned long)stats->latency_min_us, latency_avg,
+               (unsigned long)stats->latency_max_us);
+        return;
+    }
+
+    printf("--- mip_pktgen statistics ---\n");
+    if (sending) {
+        printf("%lu frames sent in %.3f s, %.0f pps, %.1f Mbit/s, %lu retries\n",
+               stats->sent, tx_s, tx_pps, mbps, stats->retries);
+    }
+    if (counting) {
+        printf("%lu frames received in %.3f s, %.0f pps, %lu other frames, %lu dropped by the generator\n",
+               stats->received, rx_s, rx_pps, stats->other, stats->drops);
+        if (sending) {
+            printf("%.2f%% lost\n", loss);
+        }
+        if (stats->received > 0) {
+            printf("one-way latency min/avg/max = %lu/%.1f/%lu us\n",
+                   (unsigned long)stats->latency_min_us, latency_avg, (unsigned long)stats->latency_max_us);
+        }
+    }
+}
+
+/**
+ * Main function of the MIP packet generator.
+ *
+ * Crafts MIP frames with the addresses, TTL, SDU type and sizes given, and sends them on the interface given with -I,
+ * as fast as possible or at a fixed rate. Frames go out in batches, with sendmmsg() or through a PACKET_TX_RING.
+ * With -i, counts the frames of the generator that come back on another interface, or the same one, after mipd
+ * forwarded them or ping_server echoed them. Without -I, only counts, e.g. on the far side of mipd in another network
+ * namespace, until the time given with -D is up or SIGINT is received.
+ *
+ * Which path of mipd is measured follows from the frames: a destination address behind mipd measures forwarding, the
+ * address of mipd measures local delivery, and a TTL of 1 with a destination address behind mipd measures the drop
+ * path, where the rate mipd keeps up with is read off its CPU use rather than counted.
+ *
+ * @param argc: Integer, number of arguments passed to the program from the terminal.
+ * @param argv: Array of strings representing the arguments passed to the program.
+ *
+ * @return: Integer representing the exit status of the program. 0 indicating normal termination,
+ * and exits with EXIT_FAILURE status on invalid options or when the sockets cannot be set up.
+ */
+int main(int argc, char *argv[]) {
+    int opt, hflag = 0;
+    char const *tx_if = NULL, *rx_if = NULL;
+    char sizes[] = "511";
+    char *size_mix = sizes;
+    struct pktgen_config config = {
+            .dst_mac = MIP_BROADCAST_MAC_ADDR,
+            .src_addr = 254,
+            .ttl = MIP_MAX_TTL,
+            .sdu_type = MIP_SDU_TYPE_PING,
+    };
+    int dest_addr = -1;
+    long rate = 0;                  // Frames per second, 0 for as fast as possible.
+    unsigned long count = 0;        // Frames to send, 0 for no limit.
+    long duration_s = -1;           // Seconds to run, 0 for no limit.
+    int batch = 32;
+    int use_ring = 0;
+    long drain_ms = 1000;
+    int quiet = 0, json = 0;
+
+    while ((opt = getopt(argc, argv, "hI:i:m:S:d:t:T:z:r:c:D:b:xW:qj")) != -1) {
+        switch (opt) {
+            case 'h':
+                // Help flag given
+                hflag = 1;
+                break;
+            case 'I':
+                tx_if = optarg;
+                break;
+            case 'i':
+                rx_if = optarg;
+                break;
+            case 'm':
+                if (parse_mac(optarg, config.dst_mac) == -1) {
+                    usage_and_exit(argv);
+                }
+                break;
+            case 'S':
+                config.src_addr = (u_int8_t)atoi(optarg);
+                break;
+            case 'd':
+                dest_addr = atoi(optarg);
+                break;
+            case 't':
+                config.ttl = (u_int8_t)atoi(optarg);
+                break;
+            case 'T': {
+                int type = parse_sdu_type(optarg);
+                if (type == -1) {
+                    usage_and_exit(argv);
+                }
+                config.sdu_type = (u_int8_t)type;
+                break;
+            }
+            case 'z':
+                size_mix = optarg;
+                break;
+            case 'r':
+                rate = atol(optarg);
+                break;
+            case 'c':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'D':
+                duration_s = atol(optarg);
+                break;
+            case 'b':
+                batch = atoi(optarg);
+                break;
+            case 'x':
+                use_ring = 1;
+                break;
+            case 'W':
+                drain_ms = atol(optarg);
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            case 'j':
+                json = 1;
+                break;
+            default:
+                usage_and_exit(argv);
+        }
+    }
+
+    // Check if the help flag was given, if so print help message and exit
+    if (hflag) {
+        print_help(argv);
+        exit(EXIT_SUCCESS);
+    }
+    if (argc - optind != 0 || (tx_if == NULL && rx_if == NULL) || parse_sizes(size_mix, &config) == -1) {
+        usage_and_exit(argv);
+    }
+    if (tx_if != NULL && (dest_addr < 0 || dest_addr > 255)) {
+        usage_and_exit(argv);
+    }
+    if (config.ttl > MIP_MAX_TTL || rate < 0 || batch < 1 || batch > MAX_BATCH || drain_ms < 0) {
+        usage_and_exit(argv);
+    }
+    config.dest_addr = (u_int8_t)dest_addr;
+    if (duration_s == -1) {
+        duration_s = count > 0 ? 0 : 10;
+    }
+
+    int tx_rsd = -1, rx_rsd = -1;
+    struct tx_ring ring = {0};
+    if (tx_if != NULL) {
+        tx_rsd = open_raw_socket(tx_if, 0, config.src_mac);
+        if (tx_rsd == -1 || (use_ring && setup_tx_ring(tx_rsd, &ring) == -1)) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (rx_if != NULL) {
+        rx_rsd = open_raw_socket(rx_if, ETH_P_MIP, NULL);
+        if (rx_rsd == -1) {
+            exit(EXIT_FAILURE);
+        }
+        int rcvbuf = RCVBUF_SIZE;
+        if (setsockopt(rx_rsd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) == -1) {
+            setsockopt(rx_rsd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        }
+        update_drops(rx_rsd, &(struct pktgen_stats){0}); // Reading the statistics resets them
+    }
+    signal(SIGINT, handle_sigint);
+
+    struct pktgen_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    u_int64_t start = now_us();
+    u_int64_t end = duration_s > 0 ? start + (u_int64_t)duration_s * 1000000 : 0;
+    u_int64_t tx_end = 0, first_rx = 0, last_rx = 0;
+    u_int64_t next_report = start + 1000000;
+    unsigned long last_sent = 0, last_received = 0;
+    int sending = tx_rsd != -1;
+
+    while (!stop_flag) {
+        u_int64_t now = now_us();
+        if (end != 0 && now >= end) {
+            break;
+        }
+
+        if (sending) {
+            // Send the frames that are due, at most one batch
+            unsigned long due = rate > 0 ? (unsigned long)((now - start) * (u_int64_t)rate / 1000000) + 1 : ULONG_MAX;
+            if (count > 0 && due > count) {
+                due = count;
+            }
+            if (due > stats.sent) {
+                int n = due - stats.sent < (unsigned long)batch ? (int)(due - stats.sent) : batch;
+                int sent = use_ring ? send_batch_ring(tx_rsd, &ring, &config, n, &stats)
+                                    : send_batch_mmsg(tx_rsd, &config, n, &stats);
+                if (sent == -1) {
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if (count > 0 && stats.sent >= count) {
+                sending = 0;
+                tx_end = now_us();
+                if (rx_rsd == -1) {
+                    break;
+                }
+                end = tx_end + (u_int64_t)drain_ms * 1000;
+            }
+        }
+
+        if (rx_rsd != -1) {
+            unsigned long before = stats.received;
+            if (receive_batch(rx_rsd, &stats) == -1) {
+                exit(EXIT_FAILURE);
+            }
+            if (stats.received > before) {
+                last_rx = now_us();
+                if (before == 0) {
+                    first_rx = last_rx;
+                }
+            }
+        }
+
+        now = now_us();
+        if (!sending || (rate > 0 && (unsigned long)((now - start) * (u_int64_t)rate / 1000000) + 1 <= stats.sent)) {
+            // Nothing to send right away, wait for frames to count or for the next frame to be due
+            long wait_ms = sending ? 1 : (long)((next_report > now ? next_report - now : 0) / 1000);
+            if (end != 0 && end > now && (long)((end - now) / 1000) < wait_ms) {
+                wait_ms = (long)((end - now) / 1000);
+            }
+            if (rx_rsd != -1) {
+                struct pollfd pfd = {.fd = rx_rsd, .events = POLLIN};
+                poll(&pfd, 1, (int)wait_ms);
+            } else if (wait_ms > 0) {
+                usleep((useconds_t)(sending ? 100 : wait_ms * 1000));
+            }
+        }
+
+        now = now_us();
+        if (now >= next_report) {
+            if (rx_rsd != -1) {
+                update_drops(rx_rsd, &stats);
+            }
+            if (!quiet) {
+                printf("%.0f s: tx %lu pps, rx %lu pps, %lu dropped by the generator\n",
+                       (double)(now - start) / 1e6, stats.sent - last_sent, stats.received - last_received,
+                       stats.drops);
+                fflush(stdout);
+            }
+            last_sent = stats.sent;
+            last_received = stats.received;
+            next_report += 1000000;
+        }
+    }
+
+    u_int64_t stop = now_us();
+    if (tx_rsd != -1 && tx_end == 0) {
+        tx_end = stop;
+    }
+    if (rx_rsd != -1) {
+        update_drops(rx_rsd, &stats);
+    }
+    double tx_s = tx_rsd != -1 ? (double)(tx_end - start) / 1e6 : 0;
+    double rx_s = first_rx != 0 && last_rx > first_rx ? (double)(last_rx - first_rx) / 1e6 : 0;
+    print_summary(&stats, tx_rsd != -1, rx_rsd != -1, tx_s, rx_s, json);
+
+    if (use_ring && tx_rsd != -1) {
+        munmap(ring.map, ring.size);
+    }
+    if (tx_rsd != -1) {
+        close(tx_rsd);
+    }
+    if (rx_rsd != -1) {
+        close(rx_rsd);
+    }
+    return 0;
+}
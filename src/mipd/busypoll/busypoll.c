@@ -0,0 +1,149 @@
+#define _GNU_SOURCE // For sched_setaffinity().
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include "busypoll.h"
+#include "../mipd_common.h"
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+
+/*
+ * A busy-poll mode for the main loop of mipd, used with -b.
+ *
+ * The main thread is pinned to one CPU and, instead of sleeping in epoll_wait() until a socket is readable, asks
+ * epoll without waiting over and over. A frame or message is then handled as soon as it arrives, without the
+ * wakeup of a sleeping thread in between. The raw socket is set to busy-poll the device queue in the kernel as
+ * well, where the driver supports it. After busypoll_idle_us without events the main loop blocks in epoll_wait()
+ * again, so an idle mipd does not keep the CPU busy, and it spins again from the next event on. The CPU should be
+ * one that nothing else is scheduled on.
+ */
+
+/**
+ * Statistics of the busy-poll mode.
+ */
+struct busypoll_stats {
+    unsigned long polls;        // Calls to epoll_wait() that did not wait.
+    unsigned long hits;         // Of those, the calls that found events.
+    unsigned long blocks;       // Calls to epoll_wait() that waited, after an idle period.
+    u_int64_t spin_ns;          // Time spent polling without finding events.
+};
+
+int busypoll_idle_us = BUSYPOLL_DEFAULT_IDLE_US; // Time without events before the main loop blocks again.
+
+static int cpu_pinned = -1;             // The CPU the main thread is pinned to.
+static u_int64_t idle_since_ns = 0;     // When the last events were found, 0 if the loop was not idle.
+static struct busypoll_stats stats;
+
+/**
+ * Returns the monotonic time in nanoseconds.
+ */
+static u_int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Pins the calling thread to a CPU and starts the busy-poll mode. Threads created before keep their CPUs.
+ *
+ * @param cpu: The CPU to pin the main thread to.
+ * @return: 0 on success, -1 if the thread could not be pinned to the CPU.
+ */
+int busypoll_start(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        fprintf(stderr, "Invalid CPU %d\n", cpu);
+        return -1;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_setaffinity");
+        return -1;
+    }
+    cpu_pinned = cpu;
+    global_debug("Busy-polling on CPU %d, blocking after %d us without events", cpu, busypoll_idle_us);
+    return 0;
+}
+
+/**
+ * Asks the kernel to busy-poll the device queue of a socket, instead of waiting for an interrupt, when the socket
+ * is read or polled with no data waiting. Not all drivers support it, and a kernel without it is not an error.
+ *
+ * @param sd: The socket.
+ * @return: 0 on success, -1 if the kernel refused the options.
+ */
+int busypoll_socket(int sd) {
+    int busy_us = BUSYPOLL_SOCKET_US;
+    int prefer = 1;
+    int budget = BUSYPOLL_BUDGET;
+    if (setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL, &busy_us, sizeof(busy_us)) < 0) {
+        perror("setsockopt: SO_BUSY_POLL");
+        return -1;
+    }
+    if (setsockopt(sd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) < 0
+        || setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof(budget)) < 0) {
+        global_debug("SO_PREFER_BUSY_POLL is not supported, busy-polling without it");
+    }
+    return 0;
+}
+
+/**
+ * Waits for events like epoll_wait(), by polling without waiting until there are events. After busypoll_idle_us
+ * without events, it blocks in epoll_wait() instead. Every BUSYPOLL_SPINS empty polls it returns 0, so the main
+ * loop can check the flags set by signal handlers.
+ *
+ * @param epollfd: The epoll instance.
+ * @param events: Set to the events.
+ * @param max_events: Room in events.
+ * @return: The number of events, 0 if there are none yet, or -1 on failure with errno set.
+ */
+int busypoll_wait(int epollfd, struct epoll_event *events, int max_events) {
+    u_int64_t started_ns = now_ns();
+    if (idle_since_ns == 0) {
+        idle_since_ns = started_ns;
+    }
+
+    for (int spin = 0; spin < BUSYPOLL_SPINS; spin++) {
+        int num_events = epoll_wait(epollfd, events, max_events, 0);
+        stats.polls++;
+        if (num_events != 0) {
+            if (spin > 0) {
+                stats.spin_ns += now_ns() - started_ns;
+            }
+            stats.hits += num_events > 0;
+            idle_since_ns = 0;
+            return num_events;
+        }
+        // Costs a syscall on a CPU of its own, but lets the routing daemon and the applications run on a shared one
+        sched_yield();
+    }
+
+    u_int64_t now = now_ns();
+    stats.spin_ns += now - started_ns;
+    if (now - idle_since_ns < (u_int64_t)busypoll_idle_us * 1000) {
+        return 0;
+    }
+
+    // Idle for long enough, sleep until the next event
+    stats.blocks++;
+    idle_since_ns = 0;
+    return epoll_wait(epollfd, events, max_events, -1);
+}
+
+/**
+ * Prints the statistics of the busy-poll mode to stdout.
+ */
+void print_busypoll_stats() {
+    printf("Busy-poll (CPU %d, blocking after %d us idle): polls=%lu hits=%lu (%.2f%%) blocks=%lu spin=%.3f s\n",
+           cpu_pinned, busypoll_idle_us, stats.polls, stats.hits,
+           stats.polls > 0 ? 100.0 * stats.hits / stats.polls : 0.0, stats.blocks, stats.spin_ns / 1e9);
+    fflush(stdout);
+}
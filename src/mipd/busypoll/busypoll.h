@@ -0,0 +1,21 @@
+#ifndef BUSYPOLL_H
+#define BUSYPOLL_H
+
+#include <sys/epoll.h>
+
+#define BUSYPOLL_SOCKET_US      50      // Time the kernel busy-polls the device queue of a socket with no data.
+#define BUSYPOLL_BUDGET         64      // Packets the kernel handles per busy-poll of the device queue.
+#define BUSYPOLL_SPINS          1024    // Empty polls before the main loop gets to check its flags.
+#define BUSYPOLL_DEFAULT_IDLE_US 1000   // Default time without events before the main loop blocks again.
+
+extern int busypoll_idle_us; // Time without events before the main loop blocks in epoll_wait() again.
+
+int busypoll_start(int cpu);
+
+int busypoll_socket(int sd);
+
+int busypoll_wait(int epollfd, struct epoll_event *events, int max_events);
+
+void print_busypoll_stats();
+
+#endif //BUSYPOLL_H
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "colo.h"
+#include "../upper/upper.h"
+#include "../upper/routing/routing.h"
+#include "../../common/routing/routing_messages.h"
+#include "../../routingd/routingd.h"
+#include "../../routingd/handle_messages.h"
+#include "../../routingd/timer/timer.h"
+
+/*
+ * The routing engine of routingd running inside mipd. Messages from routingd to mipd are handled right away, as if
+ * they had been received on the routing unix socket. Messages from mipd to routingd are queued and handled by
+ * colo_run() after the event that produced them, so a routing request is always answered after the packet that
+ * caused it has been added to the route queue.
+ */
+
+static struct fds *colo_fds = NULL;                     // The file descriptors of mipd.
+static struct ifs_data *colo_ifs_data = NULL;           // The interfaces of mipd.
+static general_message queue[COLO_QUEUE_SIZE];          // Messages from mipd that wait for the routing engine.
+static int queue_head = 0;                              // Index of the oldest message in the queue.
+static int queue_len = 0;                               // Number of messages in the queue.
+static unsigned long delivered_up = 0;                  // Messages handed from mipd to the routing engine.
+static unsigned long delivered_down = 0;                // Messages handed from the routing engine to mipd.
+static unsigned long dropped = 0;                       // Messages dropped because the queue was full.
+
+/**
+ * Hands a message from the routing engine to mipd, in place of sending it on the routing unix socket.
+ *
+ * @param usd: Unused, there is no unix socket.
+ * @param message: The message, starting with the routing message header.
+ * @param len: The length of the message.
+ * @return: The length of the message, or -1 if it is too long.
+ */
+static long colo_to_mipd(int usd, void const *message, size_t len) {
+    (void)usd;
+    char buf[1024];
+    if (len > sizeof(buf)) {
+        return -1;
+    }
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, message, len);
+    delivered_down++;
+    handle_upper_message(*colo_fds, *colo_ifs_data, MIP_SDU_TYPE_ROUTING, buf);
+    return (long)len;
+}
+
+/**
+ * Queues a message from mipd for the routing engine, in place of sending it on the routing unix socket.
+ *
+ * @param message: The message, starting with the routing message header.
+ * @param len: The length of the message.
+ * @return: The length of the message, or -1 if it is too long or the queue is full.
+ */
+static long colo_to_routingd(void const *message, size_t len) {
+    if (len > sizeof(general_message)) {
+        return -1;
+    }
+    if (queue_len == COLO_QUEUE_SIZE) {
+        dropped++;
+        global_debug("Routing engine queue full, dropping message");
+        return -1;
+    }
+    general_message *slot = &queue[(queue_head + queue_len) % COLO_QUEUE_SIZE];
+    memset(slot, 0, sizeof(general_message));
+    memcpy(slot, message, len);
+    queue_len++;
+    return (long)len;
+}
+
+/**
+ * Starts the routing engine inside mipd.
+ *
+ * @param fds: The file descriptors of mipd. Kept, so the routing engine always sees the current sockets.
+ * @param ifs_data: The interfaces of mipd. Kept, like fds.
+ * @param options: The options of the routing engine separated by spaces, as given to routingd. May be NULL.
+ * @return: The timerfd of the routing engine, to be added to the epoll instance, or -1 on failure.
+ */
+int colo_start(struct fds *fds, struct ifs_data *ifs_data, char *options) {
+    char *argv[COLO_MAX_ARGS + 1];
+    int argc = 0;
+    argv[argc++] = "routing";
+    if (options != NULL) {
+        for (char *arg = strtok(options, " "); arg != NULL && argc < COLO_MAX_ARGS; arg = strtok(NULL, " ")) {
+            argv[argc++] = arg;
+        }
+    }
+    argv[argc] = NULL;
+
+    optind = 0; // Restart getopt, it has already been used for the options of mipd.
+    if (routingd_parse_options(argc, argv) != 0 || optind != argc) {
+        fprintf(stderr, "Invalid routing engine options: %s\n", options);
+        return -1;
+    }
+
+    colo_fds = fds;
+    colo_ifs_data = ifs_data;
+    local_mip_addr = ifs_data->local_mip_addr;
+    routing_transport_hook = colo_to_mipd;
+    routingd_transport_hook = colo_to_routingd;
+    return routingd_start(-1);
+}
+
+/**
+ * Runs the expired timers of the routing engine. Called when its timerfd is readable.
+ */
+void colo_timer_event() {
+    handle_timer_event(-1);
+}
+
+/**
+ * Hands the queued messages from mipd to the routing engine. Called after every batch of events.
+ * Messages queued while handling these are handled in the same call.
+ *
+ * Also called before a handoff. The routing engine of the new mipd never sees the messages queued for this one,
+ * and the packets in the route queue that wait for their answers would be stuck there.
+ */
+void colo_run() {
+    while (queue_len > 0) {
+        general_message message = queue[queue_head];
+        queue_head = (queue_head + 1) % COLO_QUEUE_SIZE;
+        queue_len--;
+        delivered_up++;
+        handle_message(-1, message);
+    }
+    routingd_event_done();
+}
+
+/**
+ * Prints the help for the option that sets the routing engine options.
+ */
+void colo_print_options() {
+    printf("  -R <options>\tOptions of the routing engine running inside mipd, as one argument. Those of routingd:\n");
+    routingd_print_options();
+}
+
+/**
+ * Prints the statistics of the routing engine, and of the messages handed between it and mipd.
+ */
+void colo_print_stats() {
+    printf("Co-located routing: to engine=%lu to mipd=%lu dropped=%lu\n", delivered_up, delivered_down, dropped);
+    routingd_print_stats();
+}
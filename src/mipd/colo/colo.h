@@ -0,0 +1,19 @@
+#ifndef COLO_H
+#define COLO_H
+
+#include "../mipd_common.h"
+
+#define COLO_QUEUE_SIZE 64      // Maximum number of messages from mipd that wait for the routing engine.
+#define COLO_MAX_ARGS 32        // Maximum number of routing engine options given with -R.
+
+int colo_start(struct fds *fds, struct ifs_data *ifs_data, char *options);
+
+void colo_timer_event();
+
+void colo_run();
+
+void colo_print_options();
+
+void colo_print_stats();
+
+#endif //COLO_H
@@ -0,0 +1,302 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include "handoff.h"
+#include "../lower/mip/mip.h"
+#include "../lower/mip/queues/arp_queue.h"
+#include "../lower/mip/queues/route_queue.h"
+
+#define HANDOFF_MAX_FDS (2 + MAX_ACCEPTED_USDS)
+
+/**
+ * Sets the send and receive timeouts of a control connection to HANDOFF_TIMEOUT_MS.
+ *
+ * @param sd: The control connection.
+ */
+static void set_handoff_timeout(int sd) {
+    struct timeval tv;
+    tv.tv_sec = HANDOFF_TIMEOUT_MS / 1000;
+    tv.tv_usec = (HANDOFF_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/**
+ * Fills in a unix socket address for the control socket.
+ *
+ * @param addr: The address to fill in.
+ * @param path: Pathname of the control socket.
+ */
+static void control_address(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    strncpy(addr->sun_path, path, sizeof(addr->sun_path) - 1);
+}
+
+/**
+ * Takes over from a running mipd, if there is one listening on the control socket.
+ *
+ * The running mipd passes its raw socket, its listening unix socket and the unix sockets of the connected
+ * routing daemon and applications, so none of them notice the restart. The ARP cache, the backup next hops
+ * and the packets waiting in the ARP and route queues come along. ARP cache entries are mapped to the
+ * interfaces of this mipd by their kernel index, and dropped if their interface is gone. Once everything is
+ * received, an acknowledgement tells the running mipd to exit. If the queued packets stop coming, it is told
+ * to keep running instead.
+ *
+ * @param path: Pathname of the control socket.
+ * @param fds: Receives the socket file descriptors. num_accepted_usds must be 0.
+ * @param ifs_data: The interfaces of this mipd, with the MIP address it was started with.
+ *
+ * @return: 1 if the sockets were taken over, 0 if no mipd is listening on the control socket,
+ *          -1 if the handoff failed after it started.
+ */
+int handoff_receive(const char *path, struct fds *fds, struct ifs_data ifs_data) {
+    int sd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (sd < 0) {
+        perror("socket: handoff");
+        return -1;
+    }
+    struct sockaddr_un addr;
+    control_address(&addr, path);
+    if (connect(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        // Nothing to take over from
+        close(sd);
+        return 0;
+    }
+    set_handoff_timeout(sd);
+    global_debug("Connected to running mipd on %s, taking over", path);
+
+    static struct handoff_header header;
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    struct iovec iov = { &header, sizeof(header) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    long rc = recvmsg(sd, &msg, 0);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (rc != sizeof(header) || header.magic != HANDOFF_MAGIC || cmsg == NULL ||
+        cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        header.num_accepted_usds > MAX_ACCEPTED_USDS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int) * (2 + header.num_accepted_usds))) {
+        global_debug("Invalid handoff header");
+        close(sd);
+        return -1;
+    }
+    int passed[HANDOFF_MAX_FDS];
+    memcpy(passed, CMSG_DATA(cmsg), sizeof(int) * (2 + header.num_accepted_usds));
+
+    if (header.local_mip_addr != ifs_data.local_mip_addr) {
+        global_debug("Running mipd had MIP address %d, continuing as %d", header.local_mip_addr,
+                     ifs_data.local_mip_addr);
+    }
+
+    fds->rsd = passed[0];
+    fds->usd = passed[1];
+    fds->num_accepted_usds = header.num_accepted_usds;
+    fds->routing_usd = -1;
+    fds->ping_usd = -1;
+    for (int i = 0; i < header.num_accepted_usds; i++) {
+        fds->accepted_usds[i].usd = passed[2 + i];
+        fds->accepted_usds[i].type = header.types[i];
+    }
+    if (header.routing_index >= 0 && header.routing_index < header.num_accepted_usds) {
+        fds->routing_usd = passed[2 + header.routing_index];
+    }
+    if (header.ping_index >= 0 && header.ping_index < header.num_accepted_usds) {
+        fds->ping_usd = passed[2 + header.ping_index];
+    }
+
+    arp_cache->size = 0;
+    int num_arp_entries = header.num_arp_entries < 256 ? header.num_arp_entries : 256;
+    for (int i = 0; i < num_arp_entries; i++) {
+        struct handoff_arp_entry const *entry = &header.arp_entries[i];
+        int ifi = get_if_index(ifs_data, entry->ifindex);
+        if (ifi < 0) {
+            global_debug("Interface %d of ARP cache entry %d is gone, dropping it", entry->ifindex, entry->mip_addr);
+            continue;
+        }
+        struct arp_cache_entry *new_entry = &arp_cache->entries[arp_cache->size++];
+        new_entry->mip_addr = entry->mip_addr;
+        memcpy(new_entry->mac_addr, entry->mac_addr, 6);
+        new_entry->interface = ifi;
+        new_entry->updated_ms = entry->updated_ms;
+        new_entry->stale = entry->stale;
+    }
+    memcpy(backup_next_hops, header.backup_next_hops, sizeof(backup_next_hops));
+
+    u_int8_t ack = HANDOFF_ACK;
+    for (u_int32_t i = 0; i < header.num_queued; i++) {
+        struct handoff_queued queued;
+        if (recv(sd, &queued, sizeof(queued), 0) != sizeof(queued)) {
+            global_debug("Handoff ended after %u of %u queued packets", i, header.num_queued);
+            ack = HANDOFF_NAK;
+            break;
+        }
+        if (queued.queue == HANDOFF_QUEUE_ARP) {
+            arp_enqueue_mip_pdu(&queued.pdu, queued.next_hop);
+        } else {
+            route_enqueue(queued.pdu);
+        }
+    }
+
+    // Tell the running mipd that it can exit, or that it has to keep running
+    if (send(sd, &ack, sizeof(ack), 0) != sizeof(ack)) {
+        perror("send: handoff ack");
+        close(sd);
+        return -1;
+    }
+    close(sd);
+    if (ack != HANDOFF_ACK) {
+        return -1;
+    }
+    global_debug("Took over %d unix sockets, %d ARP cache entries and %u queued packets",
+                 header.num_accepted_usds, arp_cache->size, header.num_queued);
+    return 1;
+}
+
+/**
+ * Creates the control socket that a new mipd connects to when it takes over.
+ * A control socket left by the previous mipd is replaced.
+ *
+ * @param path: Pathname of the control socket.
+ *
+ * @return: The listening control socket, or -1 on failure.
+ */
+int handoff_listen(const char *path) {
+    int sd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (sd < 0) {
+        perror("socket: handoff");
+        return -1;
+    }
+    struct sockaddr_un addr;
+    control_address(&addr, path);
+    unlink(path);
+    if (bind(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sd, 1) < 0) {
+        perror("bind: handoff");
+        close(sd);
+        return -1;
+    }
+    return sd;
+}
+
+/**
+ * Returns the position of a socket among the accepted unix sockets, -1 if it is not one of them.
+ */
+static int accepted_index(struct fds const *fds, int usd) {
+    for (int i = 0; i < fds->num_accepted_usds; i++) {
+        if (fds->accepted_usds[i].usd == usd) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Hands the sockets and state of this mipd over to a new mipd connecting to the control socket.
+ *
+ * Nothing is read from the sockets while the handoff is in progress, so packets and messages that arrive in
+ * the meantime wait in the socket buffers for the new mipd. If the new mipd does not acknowledge within
+ * HANDOFF_TIMEOUT_MS, or tells that it did not receive everything, this mipd keeps running.
+ *
+ * @param control_sd: The listening control socket.
+ * @param fds: The socket file descriptors of this mipd.
+ * @param ifs_data: The interfaces of this mipd.
+ *
+ * @return: 0 if the new mipd has taken over and this one should exit, -1 otherwise.
+ */
+int handoff_send(int control_sd, struct fds fds, struct ifs_data ifs_data) {
+    int sd = accept(control_sd, NULL, NULL);
+    if (sd < 0) {
+        perror("accept: handoff");
+        return -1;
+    }
+    set_handoff_timeout(sd);
+    global_debug("New mipd connected, handing over");
+
+    static struct handoff_header header;
+    static u_int8_t arp_next_hops[HANDOFF_MAX_QUEUED];
+    static struct mip_pdu arp_pdus[HANDOFF_MAX_QUEUED];
+    static struct mip_pdu route_pdus[HANDOFF_MAX_QUEUED];
+    int num_arp = arp_queue_copy(arp_next_hops, arp_pdus, HANDOFF_MAX_QUEUED);
+    int num_route = route_queue_copy(route_pdus, HANDOFF_MAX_QUEUED - num_arp);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = HANDOFF_MAGIC;
+    header.local_mip_addr = ifs_data.local_mip_addr;
+    header.num_accepted_usds = fds.num_accepted_usds;
+    int passed[HANDOFF_MAX_FDS];
+    passed[0] = fds.rsd;
+    passed[1] = fds.usd;
+    for (int i = 0; i < fds.num_accepted_usds; i++) {
+        header.types[i] = fds.accepted_usds[i].type;
+        passed[2 + i] = fds.accepted_usds[i].usd;
+    }
+    header.routing_index = accepted_index(&fds, fds.routing_usd);
+    header.ping_index = accepted_index(&fds, fds.ping_usd);
+    header.num_queued = num_arp + num_route;
+    header.num_arp_entries = arp_cache->size;
+    for (int i = 0; i < arp_cache->size; i++) {
+        struct arp_cache_entry const *entry = &arp_cache->entries[i];
+        header.arp_entries[i].mip_addr = entry->mip_addr;
+        memcpy(header.arp_entries[i].mac_addr, entry->mac_addr, 6);
+        header.arp_entries[i].ifindex = ifs_data.addr[entry->interface].sll_ifindex;
+        header.arp_entries[i].updated_ms = entry->updated_ms;
+        header.arp_entries[i].stale = entry->stale;
+    }
+    memcpy(header.backup_next_hops, backup_next_hops, sizeof(backup_next_hops));
+
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { &header, sizeof(header) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * (2 + fds.num_accepted_usds));
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (2 + fds.num_accepted_usds));
+    memcpy(CMSG_DATA(cmsg), passed, sizeof(int) * (2 + fds.num_accepted_usds));
+
+    if (sendmsg(sd, &msg, 0) != sizeof(header)) {
+        perror("sendmsg: handoff");
+        close(sd);
+        return -1;
+    }
+
+    for (int i = 0; i < num_arp + num_route; i++) {
+        struct handoff_queued queued;
+        if (i < num_arp) {
+            queued.queue = HANDOFF_QUEUE_ARP;
+            queued.next_hop = arp_next_hops[i];
+            queued.pdu = arp_pdus[i];
+        } else {
+            queued.queue = HANDOFF_QUEUE_ROUTE;
+            queued.next_hop = 0;
+            queued.pdu = route_pdus[i - num_arp];
+        }
+        if (send(sd, &queued, sizeof(queued), 0) != sizeof(queued)) {
+            perror("send: handoff");
+            close(sd);
+            return -1;
+        }
+    }
+
+    u_int8_t ack;
+    if (recv(sd, &ack, sizeof(ack), 0) != sizeof(ack) || ack != HANDOFF_ACK) {
+        global_debug("New mipd did not acknowledge the handoff, continuing");
+        close(sd);
+        return -1;
+    }
+    close(sd);
+    return 0;
+}
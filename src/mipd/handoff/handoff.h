@@ -0,0 +1,60 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include "../mipd_common.h"
+#include "../lower/arp/cache.h"
+#include "../lower/mip/mip.h"
+
+#define HANDOFF_MAGIC 0x4D484432        // "MHD2", identifies a handoff from a running mipd.
+#define HANDOFF_MAX_QUEUED 4096         // Maximum number of queued packets that are handed over.
+#define HANDOFF_TIMEOUT_MS 2000         // How long either side waits for the other during a handoff.
+#define HANDOFF_QUEUE_ARP 1             // The packet waits in the ARP queue.
+#define HANDOFF_QUEUE_ROUTE 2           // The packet waits in the route queue.
+#define HANDOFF_NAK 0                   // Sent by the new mipd if it did not receive everything.
+#define HANDOFF_ACK 1                   // Sent by the new mipd once it has received everything.
+
+/**
+ * One ARP cache entry as handed over. The interface is sent by its kernel index, since the order of the
+ * interfaces in ifs_data may differ in the new mipd.
+ */
+struct handoff_arp_entry {
+    u_int8_t mip_addr;
+    u_int8_t mac_addr[6];
+    int32_t ifindex;
+    u_int64_t updated_ms;
+    u_int8_t stale;
+} __attribute__((packed));
+
+/**
+ * First message of a handoff. The socket file descriptors are passed along with it as SCM_RIGHTS,
+ * in the order rsd, usd and then the accepted unix sockets.
+ */
+struct handoff_header {
+    u_int32_t magic;                            // HANDOFF_MAGIC
+    u_int8_t local_mip_addr;                    // The MIP address of the running mipd.
+    u_int8_t num_accepted_usds;                 // Number of accepted unix sockets passed.
+    u_int8_t types[MAX_ACCEPTED_USDS];          // The SDU type of each accepted unix socket.
+    int8_t routing_index;                       // Which accepted unix socket is routing_usd, -1 if none.
+    int8_t ping_index;                          // Which accepted unix socket is ping_usd, -1 if none.
+    u_int32_t num_queued;                       // Number of queued packets that follow the header.
+    u_int16_t num_arp_entries;                  // Number of entries in the ARP cache.
+    struct handoff_arp_entry arp_entries[256];  // The ARP cache.
+    u_int8_t backup_next_hops[256];             // The backup next hop of each destination.
+};
+
+/**
+ * A packet waiting in one of the queues, sent after the header.
+ */
+struct handoff_queued {
+    u_int8_t queue;             // HANDOFF_QUEUE_*
+    u_int8_t next_hop;          // The next hop the packet waits for, for the ARP queue.
+    struct mip_pdu pdu;         // The packet.
+} __attribute__((packed));
+
+int handoff_receive(const char *path, struct fds *fds, struct ifs_data ifs_data);
+
+int handoff_listen(const char *path);
+
+int handoff_send(int control_sd, struct fds fds, struct ifs_data ifs_data);
+
+#endif //HANDOFF_H
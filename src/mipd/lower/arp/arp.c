@@ -4,6 +4,7 @@
 #include "../../mipd_common.h"
 #include "arp.h"
 #include "cache.h"
+#include "../nexthop/nexthop.h"
 
 /**
  * Sends an ARP  request to resolve the MIP address to a MAC address.
@@ -30,6 +31,7 @@ int send_arp_request(int rsd, struct ifs_data ifs_data, u_int8_t dest_addr) {
     arp_msg.padding = 0;
 
     struct mip_pdu mip_pdu;
+    memset(&mip_pdu, 0, sizeof(struct mip_pdu)); // The whole SDU is sent, without stack contents after the message
     mip_pdu.src_addr = ifs_data.local_mip_addr;
     mip_pdu.sdu_type = MIP_SDU_TYPE_ARP;
     mip_pdu.dest_addr = MIP_BROADCAST_ADDR;
@@ -46,6 +48,31 @@ int send_arp_request(int rsd, struct ifs_data ifs_data, u_int8_t dest_addr) {
     return rc;
 }
 
+/**
+ * Sends an ARP request for every stale entry in the ARP cache.
+ *
+ * Used after the ARP cache was loaded from a snapshot. The stale entries are used while the requests are
+ * outstanding, and the responses refresh them.
+ *
+ * @param rsd: A raw socket descriptor used to send the ARP requests.
+ * @param ifs_data: A struct containing information about network interfaces, including the local MIP address.
+ *
+ * @return: The number of ARP requests sent, or -1 if one of them could not be sent.
+ */
+int send_arp_refresh(int rsd, struct ifs_data ifs_data) {
+    int sent = 0;
+    for (int i = 0; i < arp_cache->size; i++) {
+        if (!arp_cache->entries[i].stale) {
+            continue;
+        }
+        if (send_arp_request(rsd, ifs_data, arp_cache->entries[i].mip_addr) < 0) {
+            return -1;
+        }
+        sent++;
+    }
+    return sent;
+}
+
 /**
  * Processes received ARP  packets, handling both ARP requests and responses.
  *
@@ -95,6 +122,7 @@ int handle_arp_packet(struct fds fds, struct ifs_data ifs_data, struct msghdr *m
         arp_response.padding = 0;
 
         struct mip_pdu mip_pdu;
+        memset(&mip_pdu, 0, sizeof(struct mip_pdu));
         mip_pdu.src_addr = ifs_data.local_mip_addr;
         mip_pdu.sdu_type = MIP_SDU_TYPE_ARP;
         mip_pdu.dest_addr = recv_mip_pdu.src_addr;
@@ -119,6 +147,7 @@ int handle_arp_packet(struct fds fds, struct ifs_data ifs_data, struct msghdr *m
         global_debug("Received ARP response");
         // Add the MIP address to the ARP cache
         arp_cache_add(recv_mip_pdu.src_addr, frame_hdr.src_addr, ifi);
+        nexthop_arp_answered(recv_mip_pdu.src_addr);
         // Check if there are any packets in the MIP queue for this MIP address
         check_arp_queue(fds, arp_msg->mip_addr, ifs_data);
     } else {
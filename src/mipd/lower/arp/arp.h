@@ -15,6 +15,8 @@ struct arp_message {
 
 int send_arp_request(int rsd, struct ifs_data ifs_data, u_int8_t dest_addr);
 
+int send_arp_refresh(int rsd, struct ifs_data ifs_data);
+
 int handle_arp_packet(struct fds fds, struct ifs_data ifs_data, struct msghdr *msghdr);
 
 #endif //ARP_H
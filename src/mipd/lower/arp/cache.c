@@ -1,10 +1,66 @@
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "../../mipd_common.h"
 #include "cache.h"
+#include "../../../common/snapshot/snapshot.h"
 
 struct arp_cache *arp_cache;
 
+/**
+ * One ARP cache entry as kept in the snapshot. The interface is stored by its kernel index, since the order
+ * of the interfaces in ifs_data may differ after a restart.
+ */
+struct arp_snapshot_entry {
+    u_int8_t mip_addr;
+    u_int8_t mac_addr[6];
+    int ifindex;
+    u_int64_t updated_ms;
+};
+
+/**
+ * The ARP cache as kept in the snapshot file.
+ */
+struct arp_snapshot {
+    u_int32_t num_entries;
+    struct arp_snapshot_entry entries[256];
+};
+
+static struct snapshot snapshot;                // The mapped snapshot file.
+static struct arp_snapshot *saved = NULL;       // The data of the snapshot file, NULL if there is none.
+static int snapshot_ifindex[MAX_IFS];           // The kernel index of each interface in ifs_data.
+static u_int64_t loaded_ms = 0;                 // Time of CLOCK_MONOTONIC when the snapshot was loaded.
+
+/**
+ * Returns the time of CLOCK_MONOTONIC in milliseconds.
+ * Used for the grace time of stale entries, which must not jump with the wall clock.
+ */
+static u_int64_t monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Writes the whole ARP cache to the snapshot, if there is one.
+ * Called after every change. The cache holds at most 256 small entries, so this is cheap.
+ */
+static void arp_cache_save() {
+    if (saved == NULL) {
+        return;
+    }
+    snapshot_begin_write(&snapshot);
+    for (int i = 0; i < arp_cache->size; i++) {
+        struct arp_cache_entry const *entry = &arp_cache->entries[i];
+        saved->entries[i].mip_addr = entry->mip_addr;
+        memcpy(saved->entries[i].mac_addr, entry->mac_addr, 6);
+        saved->entries[i].ifindex = snapshot_ifindex[entry->interface];
+        saved->entries[i].updated_ms = entry->updated_ms;
+    }
+    saved->num_entries = arp_cache->size;
+    snapshot_end_write(&snapshot);
+}
+
 /**
  * Initializes the mip_arp_cache. The max size of the cache is set in arp.h.
  */
@@ -14,8 +70,66 @@ void arp_cache_init() {
     arp_cache->size = 0;
 }
 
+/**
+ * Checks if the ARP cache has an entry for a MIP address, stale or not.
+ */
+static int arp_cache_contains(u_int8_t mip_addr) {
+    for (int i = 0; i < arp_cache->size; i++) {
+        if (arp_cache->entries[i].mip_addr == mip_addr) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Loads the ARP cache from a snapshot file, and keeps the file up to date with every change from now on.
+ *
+ * Entries from a snapshot younger than ARP_SNAPSHOT_MAX_AGE_MS are added as stale, as long as their interface
+ * still exists and the cache has no entry for them yet. Stale entries are used like any other, so packets are sent without waiting for ARP, until they
+ * are refreshed by an ARP packet from the neighbour or ARP_STALE_GRACE_MS has passed.
+ *
+ * @param path Pathname of the snapshot file. Type: const char *.
+ * @param ifs_data The interfaces of this node. Type: struct ifs_data.
+ * @return The number of entries loaded. -1 if the snapshot file could not be mapped.
+ */
+int arp_cache_load_snapshot(const char *path, struct ifs_data ifs_data) {
+    for (int i = 0; i < ifs_data.ifn; i++) {
+        snapshot_ifindex[i] = ifs_data.addr[i].sll_ifindex;
+    }
+    saved = snapshot_map(&snapshot, path, ARP_SNAPSHOT_MAGIC, sizeof(struct arp_snapshot));
+    if (saved == NULL) {
+        return -1;
+    }
+
+    int loaded = 0;
+    if (snapshot_valid(&snapshot) && snapshot_age_ms(&snapshot) < ARP_SNAPSHOT_MAX_AGE_MS) {
+        u_int32_t count = saved->num_entries < 256 ? saved->num_entries : 256;
+        for (u_int32_t i = 0; i < count; i++) {
+            struct arp_snapshot_entry const *entry = &saved->entries[i];
+            int ifi = get_if_index(ifs_data, entry->ifindex);
+            if (ifi < 0 || arp_cache->size >= 256 || arp_cache_contains(entry->mip_addr)) {
+                continue;
+            }
+            struct arp_cache_entry *new_entry = &arp_cache->entries[arp_cache->size++];
+            new_entry->mip_addr = entry->mip_addr;
+            memcpy(new_entry->mac_addr, entry->mac_addr, 6);
+            new_entry->interface = ifi;
+            new_entry->updated_ms = entry->updated_ms;
+            new_entry->stale = 1;
+            loaded++;
+        }
+        global_debug("Loaded %d stale entries from a snapshot %llu ms old", loaded,
+                     (unsigned long long)snapshot_age_ms(&snapshot));
+    }
+    loaded_ms = monotonic_ms();
+    arp_cache_save();
+    return loaded;
+}
+
 /**
  * Takes the given values and creates and adds a entry to the mip_arp_cache.
+ * If there already is an entry for the MIP address, it is updated instead and is no longer stale.
  * @param mip_addr 8-bit MIP address that maps to the MAC address. Type: u_int_8.
  * @param mac_addr 48-bit MAC address that maps to the MIP address. Type: u_int8_t array[6].
  * @param interface The interface on which the response was received. Type: u_int8_t.
@@ -29,6 +143,18 @@ int arp_cache_add(u_int8_t mip_addr, u_int8_t const mac_addr[6], u_int8_t interf
     //             mac_addr[3],
     //             mac_addr[4],
     //             mac_addr[5]);
+    for (int i = 0; i < arp_cache->size; i++) {
+        struct arp_cache_entry *entry = &arp_cache->entries[i];
+        if (entry->mip_addr == mip_addr) {
+            memcpy(entry->mac_addr, mac_addr, 6);
+            entry->interface = interface;
+            entry->updated_ms = snapshot_now_ms();
+            entry->stale = 0;
+            arp_cache_save();
+            return 0;
+        }
+    }
+
     if (arp_cache->size >= 256) {
         global_debug("ARP cache is full");
         return -1;
@@ -38,9 +164,12 @@ int arp_cache_add(u_int8_t mip_addr, u_int8_t const mac_addr[6], u_int8_t interf
     new_entry.mip_addr = mip_addr;
     memcpy(new_entry.mac_addr, mac_addr, 6);
     new_entry.interface = interface;
+    new_entry.updated_ms = snapshot_now_ms();
+    new_entry.stale = 0;
 
     arp_cache->entries[arp_cache->size] = new_entry;
     arp_cache->size++;
+    arp_cache_save();
     return 0;
 }
 
@@ -57,6 +186,7 @@ int arp_cache_remove(u_int8_t mip_addr) {
             arp_cache->entries[i] = arp_cache->entries[arp_cache->size - 1];
             // Decrement the size of the cache
             arp_cache->size--;
+            arp_cache_save();
             return 0;
         }
     }
@@ -66,6 +196,8 @@ int arp_cache_remove(u_int8_t mip_addr) {
 
 /**
  * Returns the MAC address of the entry with the given MIP address.
+ * A stale entry that was not refreshed within ARP_STALE_GRACE_MS of loading is removed, so a new ARP request
+ * is sent for it.
  * @param mip_addr The MIP address of the entry to get. Type: u_int8_t.
  * @return The MAC address of the entry. Type: u_int8_t array[6].
  */
@@ -73,6 +205,11 @@ struct arp_cache_entry *arp_cache_get(u_int8_t mip_addr) {
     //global_debug("Getting entry: %d from ARP cache", mip_addr);
     for (int i = 0; i < arp_cache->size; i++) {
         if (arp_cache->entries[i].mip_addr == mip_addr) {
+            if (arp_cache->entries[i].stale && monotonic_ms() - loaded_ms >= ARP_STALE_GRACE_MS) {
+                global_debug("Stale entry: %d was never refreshed, removing it", mip_addr);
+                arp_cache_remove(mip_addr);
+                return NULL;
+            }
             return &arp_cache->entries[i];
         }
     }
@@ -86,7 +223,7 @@ struct arp_cache_entry *arp_cache_get(u_int8_t mip_addr) {
 void arp_cache_print_to_debug() {
     global_debug("Printing ARP cache");
     for (int i = 0; i < arp_cache->size; i++) {
-        global_debug("Entry %d: %d -> %02x:%02x:%02x:%02x:%02x:%02x",
+        global_debug("Entry %d: %d -> %02x:%02x:%02x:%02x:%02x:%02x%s",
                      i,
                      arp_cache->entries[i].mip_addr,
                      arp_cache->entries[i].mac_addr[0],
@@ -94,6 +231,7 @@ void arp_cache_print_to_debug() {
                      arp_cache->entries[i].mac_addr[2],
                      arp_cache->entries[i].mac_addr[3],
                      arp_cache->entries[i].mac_addr[4],
-                     arp_cache->entries[i].mac_addr[5]);
+                     arp_cache->entries[i].mac_addr[5],
+                     arp_cache->entries[i].stale ? " (stale)" : "");
     }
 }
\ No newline at end of file
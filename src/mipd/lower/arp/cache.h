@@ -3,11 +3,18 @@
 
 
 #include <sys/types.h>
+#include "../../mipd_common.h"
+
+#define ARP_SNAPSHOT_MAGIC 0x41524331       // "ARC1", identifies an ARP cache snapshot.
+#define ARP_SNAPSHOT_MAX_AGE_MS 300000      // Snapshots older than this are not loaded.
+#define ARP_STALE_GRACE_MS 10000            // How long a loaded entry is used without being refreshed.
 
 struct arp_cache_entry {
     u_int8_t mip_addr;
     u_int8_t mac_addr[6];
     u_int8_t interface;
+    u_int64_t updated_ms;   // Wall clock time the entry was last learned or refreshed.
+    int stale;              // Set for entries loaded from a snapshot that have not been refreshed since.
 };
 
 struct arp_cache {
@@ -15,8 +22,12 @@ struct arp_cache {
     int size;
 };
 
+extern struct arp_cache *arp_cache;
+
 void arp_cache_init();
 
+int arp_cache_load_snapshot(const char *path, struct ifs_data ifs_data);
+
 int arp_cache_add(u_int8_t mip_addr, u_int8_t const mac_addr[6], u_int8_t interface);
 
 int arp_cache_remove(u_int8_t mip_addr);
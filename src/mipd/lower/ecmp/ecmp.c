@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include "ecmp.h"
+#include "../nexthop/nexthop.h"
+
+int ecmp_flow_label_len = 0;    // Number of leading SDU bytes used as flow label when hashing, 0 to disable.
+
+static unsigned long packets_per_next_hop[256];    // Packets sent to each next hop.
+static unsigned long multipath_decisions;           // Packets that had more than one equal cost next hop.
+
+/**
+ * Hashes the fields that identify the flow of a MIP packet, using 32 bit FNV-1a.
+ * The fields are the source and destination address, the SDU type and, if enabled, the flow label.
+ *
+ * @param mip_pdu: The MIP packet to hash.
+ * @return: The hash of the flow.
+ */
+static u_int32_t flow_hash(struct mip_pdu const *mip_pdu) {
+    u_int32_t hash = 2166136261u;
+    u_int8_t fields[3] = {mip_pdu->src_addr, mip_pdu->dest_addr, mip_pdu->sdu_type};
+
+    for (int i = 0; i < 3; i++) {
+        hash = (hash ^ fields[i]) * 16777619u;
+    }
+
+    int label_len = ecmp_flow_label_len < mip_pdu->sdu_len ? ecmp_flow_label_len : mip_pdu->sdu_len;
+    for (int i = 0; i < label_len; i++) {
+        hash = (hash ^ mip_pdu->sdu[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * Selects one of a set of equal cost next hops for a MIP packet.
+ *
+ * The choice is made by hashing the flow of the packet, so all packets of a flow take the same path and
+ * stay in order, while different flows are spread across the paths. Next hops that the data plane
+ * considers down are left out before hashing.
+ *
+ * @param mip_pdu: The MIP packet to send.
+ * @param next_hops: The equal cost next hops, as given by routingd.
+ * @param num_next_hops: The number of entries in next_hops.
+ * @return: The selected next hop, or next_hops[0] if all of them are down.
+ */
+u_int8_t ecmp_select_next_hop(struct mip_pdu const *mip_pdu, u_int8_t const next_hops[], int num_next_hops) {
+    u_int8_t usable[MAX_EQUAL_COST_ROUTES];
+    int num_usable = 0;
+
+    if (num_next_hops <= 1) {
+        return next_hops[0];
+    }
+    if (num_next_hops > MAX_EQUAL_COST_ROUTES) {
+        num_next_hops = MAX_EQUAL_COST_ROUTES;
+    }
+
+    for (int i = 0; i < num_next_hops; i++) {
+        if (!nexthop_is_down(next_hops[i])) {
+            usable[num_usable++] = next_hops[i];
+        }
+    }
+    if (num_usable == 0) {
+        return next_hops[0];
+    }
+
+    multipath_decisions++;
+    return usable[flow_hash(mip_pdu) % num_usable];
+}
+
+/**
+ * Counts a packet sent to a next hop, used to show how the traffic is split.
+ *
+ * @param next_hop: The MIP address of the next hop.
+ */
+void ecmp_count_packet(u_int8_t next_hop) {
+    packets_per_next_hop[next_hop]++;
+}
+
+/**
+ * Prints the number of packets sent to each next hop to stdout.
+ */
+void print_ecmp_stats() {
+    printf("Packets per next hop (%lu with multiple equal cost next hops, flow label %d bytes):\n",
+           multipath_decisions, ecmp_flow_label_len);
+    for (int i = 0; i < 256; i++) {
+        if (packets_per_next_hop[i] != 0) {
+            printf("  next hop %d: %lu packets\n", i, packets_per_next_hop[i]);
+        }
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,14 @@
+#ifndef ECMP_H
+#define ECMP_H
+
+#include "../mip/mip.h"
+
+extern int ecmp_flow_label_len;     // Number of leading SDU bytes used as flow label when hashing, 0 to disable.
+
+u_int8_t ecmp_select_next_hop(struct mip_pdu const *mip_pdu, u_int8_t const next_hops[], int num_next_hops);
+
+void ecmp_count_packet(u_int8_t next_hop);
+
+void print_ecmp_stats();
+
+#endif //ECMP_H
@@ -5,6 +5,7 @@
 #include "../mipd_common.h"
 #include "mip/mip.h"
 #include "forwarding/forwarding.h"
+#include "../record/record.h"
 
 /**
  * Handles and processes events that are received by the raw socket 
@@ -47,6 +48,24 @@ int handle_rsd_event(struct fds fds, struct ifs_data ifs_data) {
         return -1;
     }
 
+    return handle_frame(fds, ifs_data, &msghdr);
+}
+
+/**
+ * Handles a frame received on the raw socket.
+ *
+ * @param fds: A struct that contains multiple file descriptors including raw and unix sockets.
+ * @param ifs_data: A struct that contains information about network interfaces.
+ * @param msghdr: The received frame. msg_name is the sockaddr_ll it came from, msg_iov[0] the ethernet header
+ * and msg_iov[1] the MIP packet.
+ *
+ * @return: Always returns 0, errors in handling the MIP packet are only logged.
+ */
+int handle_frame(struct fds fds, struct ifs_data ifs_data, struct msghdr *msghdr) {
+    struct ether_frame frame_hdr = *((struct ether_frame *)msghdr->msg_iov[0].iov_base);
+    struct mip_pdu *mip_pdu = (struct mip_pdu *)msghdr->msg_iov[1].iov_base;
+    record_frame(msghdr);
+
     global_debug("Received frame from %02X:%02X:%02X:%02X:%02X:%02X to %02X:%02X:%02X:%02X:%02X:%02X",
                  frame_hdr.src_addr[0], frame_hdr.src_addr[1], frame_hdr.src_addr[2], frame_hdr.src_addr[3], frame_hdr.src_addr[4], frame_hdr.src_addr[5],
                  frame_hdr.dst_addr[0], frame_hdr.dst_addr[1], frame_hdr.dst_addr[2], frame_hdr.dst_addr[3], frame_hdr.dst_addr[4], frame_hdr.dst_addr[5]);
@@ -72,7 +91,7 @@ int handle_rsd_event(struct fds fds, struct ifs_data ifs_data) {
     if ((frame_hdr.eth_proto[0] == (ETH_P_MIP >> 8)) && (frame_hdr.eth_proto[1] == (ETH_P_MIP & 0xFF))) {
         // Send frame to the MIP forwarder.
         //global_debug("Received MIP-packet, forwarding to MIP forwarder");
-        int err = forward_mip_pdu(fds, ifs_data, mip_pdu, &msghdr);
+        int err = forward_mip_pdu(fds, ifs_data, *mip_pdu, msghdr);
         if (err < 0) {
             global_debug("Error handling MIP packet");
             return 0;
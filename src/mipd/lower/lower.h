@@ -1,9 +1,12 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <sys/socket.h>
 #include "../mipd_common.h"
 
 int handle_rsd_event(struct fds fds, struct ifs_data ifs_data);
 
+int handle_frame(struct fds fds, struct ifs_data ifs_data, struct msghdr *msghdr);
+
 
 #endif //UTIL_H
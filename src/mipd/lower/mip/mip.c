@@ -9,6 +9,26 @@
 #include "../arp/arp.h"
 #include "queues/route_queue.h"
 #include "../../upper/routing/routing.h"
+#include "../nexthop/nexthop.h"
+#include "../ecmp/ecmp.h"
+
+u_int8_t backup_next_hops[256]; // The backup next hop from the last routing response for each destination.
+packet_transmit packet_transmit_hook = NULL; // Set to queue frames instead of sending them right away, NULL otherwise.
+
+/**
+ * Sends a frame on the raw socket, or hands it to packet_transmit_hook if it is set.
+ *
+ * @param rsd: Raw socket descriptor used for sending the frame.
+ * @param msghdr: The frame, with the sockaddr_ll of the interface as msg_name.
+ *
+ * @return: The number of bytes sent or queued, or -1 on failure.
+ */
+static long transmit(int rsd, struct msghdr const *msghdr) {
+    if (packet_transmit_hook != NULL) {
+        return packet_transmit_hook(rsd, msghdr);
+    }
+    return sendmsg(rsd, msghdr, 0);
+}
 
 /**
  * Sends a packet over the network using a specified Ethernet frame format.
@@ -53,7 +73,7 @@ int send_packet(int rsd, struct ifs_data ifs_data, u_int8_t *sdu, int sdu_len, c
     msghdr->msg_iov	 = msgvec;
     msghdr->msg_name	 = &(ifs_data.addr[dest_if]);
 
-    rc = sendmsg(rsd, msghdr, 0);
+    rc = transmit(rsd, msghdr);
     if (rc < 0) {
         free(msghdr);
         return -2;
@@ -172,7 +192,7 @@ int send_broadcast_packet(int rsd, struct ifs_data ifs_data, u_int8_t *sdu, int
         memcpy(frame_hdr.src_addr, ifs_data.addr[ifi].sll_addr, 6);
         msghdr->msg_name	 = &(ifs_data.addr[ifi]);
 
-        rc += sendmsg(rsd, msghdr, 0);
+        rc += transmit(rsd, msghdr);
         if (rc < 0) {
             global_debug("sendmsg() failed");
             free(msghdr);
@@ -186,75 +206,78 @@ int send_broadcast_packet(int rsd, struct ifs_data ifs_data, u_int8_t *sdu, int
 }
 
 /**
- * Checks the ARP queue for any packets waiting to be sent to a specified next hop and sends them.
+ * Sends every packet waiting in the ARP queue for a next hop whose MAC address has just been resolved.
  *
  * @param fds: File descriptor structure containing raw and UNIX socket descriptors.
  * @param next_hop: The MIP address of the next hop to which packets should be sent.
  * @param ifs_data: Structure containing information about network interfaces.
  *
+ * Called on an ARP response. The packets already had their next hop chosen, so they are sent straight to it
+ * without new routing requests. They are left in the queue if the next hop is still not in the ARP cache.
+ *
  * @return: Returns 0 if there are no packets for the specified next hop or if packets are successfully sent;
- *          returns -1 if there is a failure in sending a packet.
+ *          returns -1 if there is a failure in sending a packet. The packets after a failed one are still sent.
  *
  */
 int check_arp_queue(struct fds fds, u_int8_t next_hop, struct ifs_data ifs_data) {
     //global_debug("Checking MIP queue for MIP address %d", next_hop);
-    struct mip_pdu const *mip_pdu = arp_dequeue_mip_pdu(next_hop);
-    if (mip_pdu == NULL) {
-        global_debug("No MIP packet in queue for MIP address %d", next_hop);
+    if (arp_cache_get(next_hop) == NULL) {
+        global_debug("MIP address %d is not in the ARP cache, keeping its queued packets", next_hop);
         return 0;
     }
-    //global_debug("Found MIP packet in queue for MIP address %d", next_hop);
 
-    int err = send_mip_packet(fds, ifs_data, *mip_pdu);
-    if (err < 0) {
-        global_debug("Failed to send MIP packet");
-        return -1;
+    int rc = 0;
+    struct mip_pdu *mip_pdu;
+    while ((mip_pdu = arp_dequeue_mip_pdu(next_hop)) != NULL) {
+        struct mip_pdu pdu = *mip_pdu;
+        free(mip_pdu);
+        if (send_to_next_hop(fds, ifs_data, pdu, next_hop) < 0) {
+            global_debug("Failed to send MIP packet");
+            rc = -1;
+        }
     }
 
-    return 0;
+    return rc;
 }
 
 /**
- * Processes a routing response and handles the forwarding of packets based on the received route information.
+ * Sends a MIP packet to a resolved next hop.
  *
  * @param fds: File descriptor structure containing raw and UNIX socket descriptors.
  * @param ifs_data: Structure containing information about network interfaces.
- * @param response: The routing response message indicating the next hop for a queued MIP packet.
+ * @param mip_pdu: The MIP packet to send.
+ * @param next_hop: The MIP address of the neighbour to send the packet to.
  *
- * @return: Returns 0 if the process is successful or if no route is found (packet dropped);
- *          returns -1 for failures in sending ARP requests or MIP packets;
- *          returns -2 if the routing queue is empty when a routing response is received.
+ * If the MAC address of the next hop is not in the ARP cache, the packet waits in the ARP queue, and an ARP
+ * request is sent unless one is already outstanding for the next hop. The queued packets are rerouted if the
+ * ARP requests time out. A send that makes the next hop go down is retried via the backup next hop of the
+ * destination.
  *
+ * @return: Returns the number of bytes sent, or 0 if the packet was queued;
+ *          returns -1 for failures in sending ARP requests or MIP packets.
  */
-int receive_routing_response(struct fds fds, struct ifs_data ifs_data, response_message response) {
-    // Check if routing queue is not empty
-    if (is_route_queue_empty() == 1) {
-        global_debug("Got a routing response, but the routing queue is empty.");
-        return -2;
-    }
-    u_int8_t next_hop = response.next_hop_mip;
-    // Check if no route was found
-    if (next_hop == 255) {
-        global_debug("No route found, dropping one packet from the routing queue");
-        route_dequeue();
-        return 0;
-    }
-    // Get next mip_pdu from routing queue
-    global_debug("Dequeueing MIP packet from routing queue");
-    struct mip_pdu mip_pdu = route_dequeue();
-
+int send_to_next_hop(struct fds fds, struct ifs_data ifs_data, struct mip_pdu mip_pdu, u_int8_t next_hop) {
     // Check if the destination address is in the arp cache
     struct arp_cache_entry const *cache_entry = arp_cache_get(next_hop);
     if (cache_entry == NULL) {
         global_debug("No MAC address found in arp-cache for MIP address %d", next_hop);
-        int err = send_arp_request(fds.rsd, ifs_data, next_hop);
-        if (err < 0) {
-            global_debug("Failed to send ARP request");
+        // One ARP request at a time per next hop, the packets queued behind it wait for the same answer
+        if (!nexthop_arp_outstanding(next_hop)) {
+            int err = send_arp_request(fds.rsd, ifs_data, next_hop);
+            if (err < 0) {
+                global_debug("Failed to send ARP request");
+                return -1;
+            }
+            nexthop_arp_sent(next_hop);
+        }
+        // A long queue only means the answer has not arrived yet, the ARP timeout decides if the next hop is down
+        if (arp_queue_length(next_hop) >= nexthop_queue_threshold) {
+            global_debug("ARP queue for next hop %d is full, dropping packet", next_hop);
             return -1;
         }
-        global_debug("Sent ARP, adding MIP packet to queue");
-        err = arp_enqueue_mip_pdu(&mip_pdu, next_hop);
-        if (err < 0) {
+        global_debug("Adding MIP packet to ARP queue");
+        int err = arp_enqueue_mip_pdu(&mip_pdu, next_hop);
+        if (err != 0) {
             global_debug("Failed to route_enqueue MIP packet");
             return -1;
         }
@@ -285,7 +308,89 @@ int receive_routing_response(struct fds fds, struct ifs_data ifs_data, response_
     int rc = send_packet(fds.rsd, ifs_data, (u_int8_t *)&mip_pdu, sizeof(struct mip_pdu), cache_entry->mac_addr, cache_entry->interface);
     if (rc < 0) {
         global_debug("Failed to send MIP packet");
+        nexthop_send_failed(fds, ifs_data, next_hop);
+        u_int8_t backup = backup_next_hops[mip_pdu.dest_addr];
+        if (nexthop_is_down(next_hop) && backup != 0 && backup != 255 && backup != next_hop && !nexthop_is_down(backup)) {
+            // The send just made the next hop go down, retry via the backup
+            global_debug("Retrying packet for %d via backup %d", mip_pdu.dest_addr, backup);
+            return send_to_next_hop(fds, ifs_data, mip_pdu, backup);
+        }
         return -1;
     }
+    nexthop_send_succeeded(next_hop);
+    ecmp_count_packet(next_hop);
     return rc;
-}
\ No newline at end of file
+}
+
+/**
+ * Moves the packets waiting in the ARP queue for a failed next hop to their backup next hops.
+ *
+ * Called when a next hop is reported down. The backup next hop for each packet's destination comes from the
+ * last routing response for that destination, so no new routing request is needed. Packets without a usable
+ * backup are dropped.
+ *
+ * @param fds: File descriptor structure containing raw and UNIX socket descriptors.
+ * @param ifs_data: Structure containing information about network interfaces.
+ * @param next_hop: The MIP address of the next hop that is down.
+ */
+void reroute_arp_queue(struct fds fds, struct ifs_data ifs_data, u_int8_t next_hop) {
+    struct mip_pdu *mip_pdu;
+    while ((mip_pdu = arp_dequeue_mip_pdu(next_hop)) != NULL) {
+        struct mip_pdu pdu = *mip_pdu;
+        free(mip_pdu);
+        u_int8_t backup = backup_next_hops[pdu.dest_addr];
+        if (backup == 0 || backup == 255 || backup == next_hop || nexthop_is_down(backup)) {
+            global_debug("No backup next hop for %d, dropping packet", pdu.dest_addr);
+            continue;
+        }
+        global_debug("Rerouting packet for %d from %d to backup %d", pdu.dest_addr, next_hop, backup);
+        send_to_next_hop(fds, ifs_data, pdu, backup);
+    }
+}
+
+/**
+ * Processes a routing response and handles the forwarding of packets based on the received route information.
+ *
+ * @param fds: File descriptor structure containing raw and UNIX socket descriptors.
+ * @param ifs_data: Structure containing information about network interfaces.
+ * @param response: The routing response message indicating the next hop for a queued MIP packet.
+ *
+ * If the response holds several equal cost next hops, one of them is selected by hashing the flow of the packet.
+ * The backup next hop in the response is remembered for the destination. If the data plane already knows that
+ * the selected next hop is down, the packet is sent via the backup right away.
+ *
+ * @return: Returns 0 if the process is successful or if no route is found (packet dropped);
+ *          returns -1 for failures in sending ARP requests or MIP packets;
+ *          returns -2 if the routing queue is empty when a routing response is received.
+ *
+ */
+int receive_routing_response(struct fds fds, struct ifs_data ifs_data, response_message response) {
+    // Check if routing queue is not empty
+    if (is_route_queue_empty() == 1) {
+        global_debug("Got a routing response, but the routing queue is empty.");
+        return -2;
+    }
+    u_int8_t next_hop = response.next_hop_mip;
+    // Check if no route was found
+    if (next_hop == 255) {
+        global_debug("No route found, dropping one packet from the routing queue");
+        route_dequeue();
+        return 0;
+    }
+    // Get next mip_pdu from routing queue
+    global_debug("Dequeueing MIP packet from routing queue");
+    struct mip_pdu mip_pdu = route_dequeue();
+
+    if (response.num_equal_cost > 1) {
+        next_hop = ecmp_select_next_hop(&mip_pdu, response.equal_cost_next_hops, response.num_equal_cost);
+    }
+
+    u_int8_t backup = response.backup_next_hop_mip;
+    backup_next_hops[mip_pdu.dest_addr] = backup;
+    if (nexthop_is_down(next_hop) && backup != 255 && !nexthop_is_down(backup)) {
+        global_debug("Next hop %d is down, using backup %d", next_hop, backup);
+        next_hop = backup;
+    }
+
+    return send_to_next_hop(fds, ifs_data, mip_pdu, next_hop);
+}
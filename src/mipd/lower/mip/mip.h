@@ -31,6 +31,15 @@ struct ether_frame {
     uint8_t eth_proto[2];
 } __attribute__((packed));
 
+extern u_int8_t backup_next_hops[256]; // The backup next hop from the last routing response for each destination.
+
+/**
+ * Sends a frame on the raw socket in place of sendmsg(). Used by event loops that batch their transmits.
+ */
+typedef long (*packet_transmit)(int rsd, struct msghdr const *msghdr);
+
+extern packet_transmit packet_transmit_hook; // Set to queue frames instead of sending them right away, NULL otherwise.
+
 int send_mip_packet(struct fds fds, struct ifs_data ifs_data, struct mip_pdu mip_pdu);
 
 int send_broadcast_packet(int rsd, struct ifs_data ifs_data, u_int8_t *sdu, int sdu_len);
@@ -39,6 +48,10 @@ int check_arp_queue(struct fds fds, u_int8_t next_hop, struct ifs_data ifs_data)
 
 int receive_routing_response(struct fds fds, struct ifs_data ifs_data, response_message response);
 
+int send_to_next_hop(struct fds fds, struct ifs_data ifs_data, struct mip_pdu mip_pdu, u_int8_t next_hop);
+
+void reroute_arp_queue(struct fds fds, struct ifs_data ifs_data, u_int8_t next_hop);
+
 int send_packet(int rsd, struct ifs_data ifs_data, u_int8_t *sdu, int sdu_len, const u_int8_t *dest_mac, u_int8_t dest_if);
 
 #endif //LOWER_H
\ No newline at end of file
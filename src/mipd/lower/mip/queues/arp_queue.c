@@ -157,3 +157,43 @@ struct mip_pdu *arp_peek_mip_pdu(u_int8_t next_hop) {
     }
     return NULL; // mipd not found
 }
+
+/**
+ * Counts the mip_pdus in the mip_queue that are waiting for the given next hop.
+ *
+ * @param next_hop: The next hop to count queued mip_pdus for.
+ *
+ * @return: The number of mip_pdus waiting for the next hop.
+ */
+int arp_queue_length(u_int8_t next_hop) {
+    int length = 0;
+    struct node const *temp = head;
+    while (temp != NULL) {
+        if (temp->next_hop == next_hop) {
+            length++;
+        }
+        temp = temp->next;
+    }
+    return length;
+}
+
+/**
+ * Copies the mip_pdus in the mip_queue, in order, without removing them.
+ *
+ * @param next_hops: Array that receives the next hop of each copied mip_pdu.
+ * @param pdus: Array that receives the copied mip_pdus.
+ * @param max: The size of the arrays.
+ *
+ * @return: The number of mip_pdus copied, at most max.
+ */
+int arp_queue_copy(u_int8_t next_hops[], struct mip_pdu pdus[], int max) {
+    int count = 0;
+    struct node const *temp = head;
+    while (temp != NULL && count < max) {
+        next_hops[count] = temp->next_hop;
+        pdus[count] = temp->pdu;
+        count++;
+        temp = temp->next;
+    }
+    return count;
+}
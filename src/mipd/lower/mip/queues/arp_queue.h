@@ -13,4 +13,8 @@ struct mip_pdu *arp_dequeue_mip_pdu(u_int8_t mip);
 
 struct mip_pdu *arp_peek_mip_pdu(u_int8_t mip);
 
+int arp_queue_length(u_int8_t next_hop);
+
+int arp_queue_copy(u_int8_t next_hops[], struct mip_pdu pdus[], int max);
+
 #endif // ARP_QUEUE_H
@@ -124,3 +124,20 @@ void free_route_queue() {
     }
 }
 
+/**
+ * Copies the MIP PDUs in the routing queue, in order, without removing them.
+ *
+ * @param pdus: Array that receives the copied PDUs.
+ * @param max: The size of the array.
+ *
+ * @return: The number of PDUs copied, at most max.
+ */
+int route_queue_copy(struct mip_pdu pdus[], int max) {
+    int count = 0;
+    struct queue_node const *temp = route_queue.front;
+    while (temp != NULL && count < max) {
+        pdus[count++] = temp->pdu;
+        temp = temp->next;
+    }
+    return count;
+}
@@ -27,4 +27,6 @@ int is_route_queue_empty();
 
 void free_route_queue();
 
+int route_queue_copy(struct mip_pdu pdus[], int max);
+
 #endif // ROUTE_QUEUE_H
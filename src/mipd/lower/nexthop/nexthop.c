@@ -0,0 +1,248 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "nexthop.h"
+#include "../../upper/routing/routing.h"
+#include "../../record/record.h"
+#include "../mip/mip.h"
+#include "../arp/arp.h"
+
+int nexthop_send_error_threshold = 3;  // Consecutive send errors before a next hop is reported down.
+int nexthop_arp_threshold = 3;         // ARP requests timed out before a next hop is reported down.
+int nexthop_queue_threshold = 16;      // Packets the ARP queue holds for a next hop, more are dropped.
+
+/**
+ * What the data plane has seen of a next hop since it was last known to work.
+ */
+struct nexthop_health {
+    int send_errors;        // Consecutive failed sends to the next hop.
+    int arp_unanswered;     // ARP requests that timed out since the next hop last answered one.
+    int arp_outstanding;    // Set while an ARP request for the next hop waits for its answer.
+    int arp_age;            // Ticks of the ARP timer since the outstanding ARP request was sent.
+    int down;               // Set when the next hop has been reported down to routingd.
+    unsigned long reports;  // Number of times the next hop has been reported down.
+};
+
+static struct nexthop_health nexthops[256];
+static int timer_fd = -1;   // Ticks while ARP requests are outstanding, -1 if not started.
+static int timer_armed = 0; // If the timer is running.
+
+/**
+ * Starts the ARP timer ticking every NEXTHOP_ARP_TICK_MS, unless it is running or was never started.
+ */
+static void arm_timer() {
+    if (timer_fd < 0 || timer_armed) {
+        return;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = NEXTHOP_ARP_TICK_MS / 1000;
+    its.it_value.tv_nsec = (NEXTHOP_ARP_TICK_MS % 1000) * 1000000L;
+    its.it_interval = its.it_value;
+    if (timerfd_settime(timer_fd, 0, &its, NULL) < 0) {
+        global_debug("timerfd_settime: nexthop");
+        return;
+    }
+    timer_armed = 1;
+}
+
+/**
+ * Stops the ARP timer.
+ */
+static void disarm_timer() {
+    if (timer_fd < 0 || !timer_armed) {
+        return;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(timer_fd, 0, &its, NULL);
+    timer_armed = 0;
+}
+
+/**
+ * Reports a next hop as down to routingd, unless it has already been reported.
+ * The next hop stays down until it answers an ARP request or a send to it succeeds.
+ * Packets waiting in the ARP queue for the next hop are moved to their backup next hops, also when it was
+ * already down, since they were queued behind an ARP request that was not answered either.
+ */
+static void report_down(struct fds fds, struct ifs_data ifs_data, u_int8_t next_hop, u_int8_t reason) {
+    struct nexthop_health *health = &nexthops[next_hop];
+    if (!health->down) {
+        health->down = 1;
+        health->reports++;
+        global_debug("Next hop %d is down (reason %d), telling routingd", next_hop, reason);
+        send_nexthop_down(fds.routing_usd, ifs_data, next_hop, reason);
+    }
+    reroute_arp_queue(fds, ifs_data, next_hop);
+}
+
+/**
+ * Marks a next hop as working again and resets its counters.
+ */
+static void mark_up(u_int8_t next_hop) {
+    struct nexthop_health *health = &nexthops[next_hop];
+    if (health->down) {
+        global_debug("Next hop %d is up again", next_hop);
+    }
+    health->send_errors = 0;
+    health->arp_unanswered = 0;
+    health->arp_outstanding = 0;
+    health->down = 0;
+}
+
+/**
+ * Records that sending a packet to a next hop failed.
+ *
+ * @param fds: File descriptor structure, the routing socket is used for the report.
+ * @param ifs_data: Structure containing information about network interfaces.
+ * @param next_hop: The MIP address of the next hop.
+ */
+void nexthop_send_failed(struct fds fds, struct ifs_data ifs_data, u_int8_t next_hop) {
+    if (++nexthops[next_hop].send_errors >= nexthop_send_error_threshold) {
+        report_down(fds, ifs_data, next_hop, NEXTHOP_DOWN_SEND_ERRORS);
+    }
+}
+
+/**
+ * Records that a packet was sent to a next hop without errors.
+ *
+ * @param next_hop: The MIP address of the next hop.
+ */
+void nexthop_send_succeeded(u_int8_t next_hop) {
+    nexthops[next_hop].send_errors = 0;
+    if (nexthops[next_hop].down && nexthops[next_hop].arp_unanswered == 0) {
+        mark_up(next_hop);
+    }
+}
+
+/**
+ * Starts the timer that ages the outstanding ARP requests.
+ *
+ * @return: The timer file descriptor, to be added to the epoll instance and handled with nexthop_timer_event(),
+ * or -1 on failure.
+ */
+int nexthop_start() {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (timer_fd < 0) {
+        perror("timerfd_create: nexthop");
+        return -1;
+    }
+    return timer_fd;
+}
+
+/**
+ * Checks if an ARP request for a next hop is waiting for its answer. One is enough for all the packets queued
+ * for the next hop.
+ *
+ * @param next_hop: The MIP address of the next hop.
+ * @return: 1 if an ARP request is outstanding, 0 if a new one should be sent.
+ */
+int nexthop_arp_outstanding(u_int8_t next_hop) {
+    return nexthops[next_hop].arp_outstanding;
+}
+
+/**
+ * Records that an ARP request was sent for a next hop. It counts as unanswered only if no answer arrives within
+ * NEXTHOP_ARP_TIMEOUT_TICKS ticks of the ARP timer.
+ *
+ * @param next_hop: The MIP address of the next hop.
+ */
+void nexthop_arp_sent(u_int8_t next_hop) {
+    nexthops[next_hop].arp_outstanding = 1;
+    nexthops[next_hop].arp_age = 0;
+    arm_timer();
+}
+
+/**
+ * Ages the outstanding ARP requests by one tick. A request that times out counts as unanswered and is sent again.
+ * Once nexthop_arp_threshold requests in a row have timed out, the next hop is reported down and the packets
+ * waiting for it are moved to their backup next hops. The timer stops when no requests are outstanding.
+ *
+ * @param fds: File descriptor structure, the raw socket is used for the requests and the routing socket for the report.
+ * @param ifs_data: Structure containing information about network interfaces.
+ */
+void nexthop_arp_tick(struct fds fds, struct ifs_data ifs_data) {
+    int outstanding = 0;
+    for (int i = 0; i < 256; i++) {
+        struct nexthop_health *health = &nexthops[i];
+        if (!health->arp_outstanding) {
+            continue;
+        }
+        if (++health->arp_age < NEXTHOP_ARP_TIMEOUT_TICKS) {
+            outstanding = 1;
+            continue;
+        }
+        health->arp_outstanding = 0;
+        if (++health->arp_unanswered >= nexthop_arp_threshold) {
+            report_down(fds, ifs_data, (u_int8_t)i, NEXTHOP_DOWN_ARP_UNANSWERED);
+            continue;
+        }
+        global_debug("ARP request for next hop %d timed out, asking again", i);
+        if (send_arp_request(fds.rsd, ifs_data, (u_int8_t)i) < 0) {
+            global_debug("Failed to send ARP request");
+            continue;
+        }
+        health->arp_outstanding = 1;
+        health->arp_age = 0;
+        outstanding = 1;
+    }
+    if (!outstanding) {
+        disarm_timer();
+    }
+}
+
+/**
+ * Handles a tick of the ARP timer.
+ *
+ * @param fds: File descriptor structure, the raw socket is used for the requests and the routing socket for the report.
+ * @param ifs_data: Structure containing information about network interfaces.
+ */
+void nexthop_timer_event(struct fds fds, struct ifs_data ifs_data) {
+    u_int64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        global_debug("read: nexthop timer");
+        return;
+    }
+    record_timer();
+    nexthop_arp_tick(fds, ifs_data);
+}
+
+/**
+ * Records that a next hop answered an ARP request. This marks it as working again.
+ *
+ * @param next_hop: The MIP address of the next hop.
+ */
+void nexthop_arp_answered(u_int8_t next_hop) {
+    mark_up(next_hop);
+}
+
+/**
+ * Checks if a next hop has been reported down and has not recovered.
+ *
+ * @param next_hop: The MIP address of the next hop.
+ * @return: 1 if the next hop is down, 0 otherwise.
+ */
+int nexthop_is_down(u_int8_t next_hop) {
+    return nexthops[next_hop].down;
+}
+
+/**
+ * Prints the next hops that have been reported down to stdout.
+ */
+void print_nexthop_stats() {
+    printf("Next hop health (thresholds: send errors %d, timed out ARP %d, ARP queue %d):\n",
+           nexthop_send_error_threshold, nexthop_arp_threshold, nexthop_queue_threshold);
+    for (int i = 0; i < 256; i++) {
+        struct nexthop_health const *health = &nexthops[i];
+        if (health->reports == 0 && health->send_errors == 0 && health->arp_unanswered == 0
+            && !health->arp_outstanding) {
+            continue;
+        }
+        printf("  next hop %d: %s send_errors=%d arp_unanswered=%d arp_outstanding=%d reports=%lu\n", i,
+               health->down ? "down" : "up", health->send_errors, health->arp_unanswered, health->arp_outstanding,
+               health->reports);
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,33 @@
+#ifndef NEXTHOP_H
+#define NEXTHOP_H
+
+#include "../../mipd_common.h"
+
+#define NEXTHOP_ARP_TICK_MS     250     // Interval of the timer that ages the outstanding ARP requests.
+#define NEXTHOP_ARP_TIMEOUT_TICKS 4     // Ticks before an outstanding ARP request counts as unanswered.
+
+extern int nexthop_send_error_threshold;    // Consecutive send errors before a next hop is reported down.
+extern int nexthop_arp_threshold;           // ARP requests timed out before a next hop is reported down.
+extern int nexthop_queue_threshold;         // Packets the ARP queue holds for a next hop, more are dropped.
+
+void nexthop_send_failed(struct fds fds, struct ifs_data ifs_data, u_int8_t next_hop);
+
+void nexthop_send_succeeded(u_int8_t next_hop);
+
+int nexthop_start();
+
+int nexthop_arp_outstanding(u_int8_t next_hop);
+
+void nexthop_arp_sent(u_int8_t next_hop);
+
+void nexthop_arp_tick(struct fds fds, struct ifs_data ifs_data);
+
+void nexthop_timer_event(struct fds fds, struct ifs_data ifs_data);
+
+void nexthop_arp_answered(u_int8_t next_hop);
+
+int nexthop_is_down(u_int8_t next_hop);
+
+void print_nexthop_stats();
+
+#endif //NEXTHOP_H
@@ -0,0 +1,266 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include "txsched.h"
+#include "../mip/mip.h"
+#include "../../pipeline/spsc_ring.h"
+
+/*
+ * A strict-priority transmit scheduler for the raw socket, used with -Q.
+ *
+ * Frames are sent without blocking. As long as the kernel takes them, nothing changes. When the socket buffer or the
+ * queue of the device is full, the kernel refuses the frame, and from then on frames are held back in a queue per
+ * class, chosen by the SDU type. They are offered to the kernel again at the end of every event loop iteration and
+ * after TXSCHED_RETRY_US, always the queue of the highest class first, so ARP and routing messages never wait behind
+ * data that is already held back. When the queue of a class is full, the new frame of that class is dropped.
+ */
+
+/**
+ * A frame held back by the scheduler.
+ */
+struct txsched_frame {
+    struct sockaddr_ll addr;    // The interface to send the frame from.
+    u_int16_t len;              // Length of the frame.
+    u_int8_t data[sizeof(struct ether_frame) + sizeof(struct mip_pdu)];
+};
+
+/**
+ * Statistics of one class.
+ */
+struct txsched_class_stats {
+    unsigned long sent;         // Frames the kernel has taken.
+    unsigned long held;         // Frames that were held back.
+    unsigned long dropped;      // Frames dropped because the queue of the class was full.
+    unsigned long errors;       // Frames the kernel failed to send for other reasons.
+};
+
+static char const *class_names[TXSCHED_CLASSES] = {"arp", "routing", "data"};
+
+static struct spsc_ring queues[TXSCHED_CLASSES];    // The frames held back, by class.
+static int rsd = -1;                                // The raw socket.
+static int timer_fd = -1;                           // Expires when the held back frames are to be offered again.
+static int timer_armed = 0;                         // If the timer is running.
+static unsigned long refused = 0;                   // Times the kernel refused a frame because it was full.
+static struct txsched_class_stats stats[TXSCHED_CLASSES];
+
+/**
+ * Tells the class of the frames with an SDU type.
+ *
+ * @param sdu_type: The SDU type.
+ * @return: TXSCHED_CLASS_ARP, TXSCHED_CLASS_ROUTING or TXSCHED_CLASS_DATA.
+ */
+int txsched_class(u_int8_t sdu_type) {
+    switch (sdu_type) {
+        case MIP_SDU_TYPE_ARP:
+            return TXSCHED_CLASS_ARP;
+        case MIP_SDU_TYPE_ROUTING:
+            return TXSCHED_CLASS_ROUTING;
+        default:
+            return TXSCHED_CLASS_DATA;
+    }
+}
+
+/**
+ * Tells if an error of a send without blocking means that the kernel cannot take the frame yet.
+ */
+static int is_full(int err) {
+    return err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS;
+}
+
+/**
+ * Tells the number of frames held back in all classes.
+ */
+static unsigned backlog() {
+    unsigned held = 0;
+    for (int i = 0; i < TXSCHED_CLASSES; i++) {
+        held += spsc_ring_used(&queues[i]);
+    }
+    return held;
+}
+
+/**
+ * Starts the timer that offers the held back frames to the kernel again, unless it is running.
+ */
+static void arm_timer() {
+    if (timer_armed) {
+        return;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = TXSCHED_RETRY_US * 1000;
+    if (timerfd_settime(timer_fd, 0, &its, NULL) < 0) {
+        global_debug("timerfd_settime: txsched");
+        return;
+    }
+    timer_armed = 1;
+}
+
+/**
+ * Offers the held back frames to the kernel, the highest class first, until they are all sent or the kernel is
+ * full again. Called at the end of every event loop iteration.
+ */
+void txsched_flush() {
+    for (int class = 0; class < TXSCHED_CLASSES; class++) {
+        struct spsc_ring *queue = &queues[class];
+        while (spsc_ring_readable(queue) > 0) {
+            struct txsched_frame *frame = spsc_ring_slot(queue, queue->head);
+            struct iovec iov = {frame->data, frame->len};
+            struct msghdr msghdr;
+            memset(&msghdr, 0, sizeof(msghdr));
+            msghdr.msg_name = &frame->addr;
+            msghdr.msg_namelen = sizeof(struct sockaddr_ll);
+            msghdr.msg_iov = &iov;
+            msghdr.msg_iovlen = 1;
+            if (sendmsg(rsd, &msghdr, MSG_DONTWAIT) < 0) {
+                if (is_full(errno)) {
+                    // Keep the frame, and every frame of a lower class, for later
+                    refused++;
+                    arm_timer();
+                    return;
+                }
+                stats[class].errors++;
+            } else {
+                stats[class].sent++;
+            }
+            spsc_ring_pop(queue, 1);
+        }
+    }
+}
+
+/**
+ * Sends a frame, or holds it back in the queue of its class. Used as packet_transmit_hook.
+ *
+ * The frame is sent right away if nothing is held back and the kernel takes it. Otherwise it is queued and the
+ * queues are flushed, so it goes out as soon as the frames of higher classes and the frames before it in its own
+ * class have gone out.
+ *
+ * @param sd: Raw socket descriptor used for sending the frame.
+ * @param msghdr: The frame, with the sockaddr_ll of the interface as msg_name.
+ * @return: The number of bytes sent or held back, or -1 on failure. A frame dropped because the queue of its class
+ * is full fails with ENOBUFS, as when the queue of the device is full.
+ */
+static long txsched_transmit(int sd, struct msghdr const *msghdr) {
+    int class = TXSCHED_CLASS_DATA;
+    if (msghdr->msg_iovlen > 1) {
+        struct mip_pdu const *mip_pdu = msghdr->msg_iov[1].iov_base;
+        class = txsched_class(mip_pdu->sdu_type);
+    }
+
+    if (backlog() == 0) {
+        long rc = sendmsg(sd, msghdr, MSG_DONTWAIT);
+        if (rc >= 0) {
+            stats[class].sent++;
+            return rc;
+        }
+        if (!is_full(errno)) {
+            stats[class].errors++;
+            return -1;
+        }
+        refused++;
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; i < msghdr->msg_iovlen; i++) {
+        len += msghdr->msg_iov[i].iov_len;
+    }
+    struct spsc_ring *queue = &queues[class];
+    if (len > sizeof(((struct txsched_frame *)0)->data) || spsc_ring_writable(queue) == 0) {
+        stats[class].dropped++;
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    struct txsched_frame *frame = spsc_ring_slot(queue, queue->tail);
+    size_t offset = 0;
+    for (size_t i = 0; i < msghdr->msg_iovlen; i++) {
+        memcpy(frame->data + offset, msghdr->msg_iov[i].iov_base, msghdr->msg_iov[i].iov_len);
+        offset += msghdr->msg_iov[i].iov_len;
+    }
+    memcpy(&frame->addr, msghdr->msg_name, sizeof(struct sockaddr_ll));
+    frame->len = len;
+    spsc_ring_push(queue, 1);
+    stats[class].held++;
+
+    txsched_flush();
+    return (long)len;
+}
+
+/**
+ * Starts the scheduler. From here on, the frames mipd sends on the raw socket go through it.
+ *
+ * @param sd: The raw socket.
+ * @param depth: The number of frames each class can hold back, rounded up to a power of two.
+ * @return: A timer file descriptor, to be added to the epoll instance and handled with txsched_timer_event(),
+ * or -1 on failure.
+ */
+int txsched_start(int sd, unsigned depth) {
+    unsigned size = 1;
+    while (size < depth) {
+        size <<= 1;
+    }
+    for (int i = 0; i < TXSCHED_CLASSES; i++) {
+        if (spsc_ring_init(&queues[i], size, sizeof(struct txsched_frame)) < 0) {
+            fprintf(stderr, "txsched: could not allocate queues\n");
+            return -1;
+        }
+    }
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (timer_fd < 0) {
+        perror("timerfd_create: txsched");
+        return -1;
+    }
+    rsd = sd;
+    packet_transmit_hook = txsched_transmit;
+    global_debug("Transmit scheduler with queues of %u frames", size);
+    return timer_fd;
+}
+
+/**
+ * Handles the expiry of the timer, by offering the held back frames to the kernel again.
+ */
+void txsched_timer_event() {
+    u_int64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        global_debug("read: txsched timer");
+    }
+    timer_armed = 0;
+    txsched_flush();
+}
+
+/**
+ * Sends the held back frames before the raw socket is handed over to another mipd, which does not take them over.
+ *
+ * The frames are offered to the kernel every TXSCHED_RETRY_US until they are all sent, or for at most
+ * TXSCHED_DRAIN_MS. The frames still held back after that are lost if the handoff goes through, and are sent as
+ * usual if it does not.
+ *
+ * @return: The number of frames still held back.
+ */
+unsigned txsched_drain() {
+    for (int waited_us = 0; backlog() > 0 && waited_us < TXSCHED_DRAIN_MS * 1000; waited_us += TXSCHED_RETRY_US) {
+        txsched_flush();
+        if (backlog() > 0) {
+            usleep(TXSCHED_RETRY_US);
+        }
+    }
+    unsigned held = backlog();
+    if (held > 0) {
+        global_debug("%u frames are still held back before the handoff", held);
+    }
+    return held;
+}
+
+/**
+ * Prints the statistics of the scheduler to stdout, one line per class.
+ */
+void print_txsched_stats() {
+    printf("Transmit scheduler (%u frames per class): refused by the kernel=%lu\n", queues[0].size, refused);
+    for (int i = 0; i < TXSCHED_CLASSES; i++) {
+        printf("  %-8s sent=%lu held=%lu queued=%u max=%lu dropped=%lu errors=%lu\n", class_names[i], stats[i].sent,
+               stats[i].held, spsc_ring_used(&queues[i]), queues[i].max_used, stats[i].dropped, stats[i].errors);
+    }
+    fflush(stdout);
+}
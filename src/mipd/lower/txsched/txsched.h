@@ -0,0 +1,25 @@
+#ifndef TXSCHED_H
+#define TXSCHED_H
+
+#include <sys/types.h>
+
+#define TXSCHED_CLASS_ARP       0       // ARP requests and replies, sent first.
+#define TXSCHED_CLASS_ROUTING   1       // HELLOs and UPDATEs of the routing daemon.
+#define TXSCHED_CLASS_DATA      2       // Pings and every other SDU type, sent last.
+#define TXSCHED_CLASSES         3       // Number of classes.
+#define TXSCHED_RETRY_US        200     // Time before the kernel is offered the held back frames again.
+#define TXSCHED_DRAIN_MS        100     // Longest the held back frames are offered to the kernel before a handoff.
+
+int txsched_class(u_int8_t sdu_type);
+
+int txsched_start(int rsd, unsigned depth);
+
+void txsched_flush();
+
+void txsched_timer_event();
+
+unsigned txsched_drain();
+
+void print_txsched_stats();
+
+#endif //TXSCHED_H
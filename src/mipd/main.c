@@ -2,12 +2,35 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/epoll.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
 #include "mipd_common.h"
 #include "lower/arp/cache.h"
 #include "upper/upper.h"
+#include "upper/routing/routing.h"
 #include "lower/mip/queues/arp_queue.h"
 #include "lower/lower.h"
 #include "lower/mip/queues/route_queue.h"
+#include "lower/nexthop/nexthop.h"
+#include "lower/ecmp/ecmp.h"
+#include "lower/arp/arp.h"
+#include "handoff/handoff.h"
+#include "uring/uring.h"
+#include "pipeline/pipeline.h"
+#include "record/record.h"
+#include "xdp/xdp.h"
+#include "busypoll/busypoll.h"
+#include "lower/txsched/txsched.h"
+#ifdef MIPD_COLOCATED
+#include "colo/colo.h"
+#define MIPD_OPTIONS "dhe:a:q:f:s:H:UPXb:w:Q:r:R:"
+#define MIPD_USAGE "[-h] [-d] [-e <n>] [-a <n>] [-q <n>] [-f <n>] [-s <file>] [-H <path>] [-U] [-P] [-X] [-b <cpu>] [-w <us>] [-Q <n>] [-r <file>] [-R <options>] <socket_upper> <MIP address>"
+#else
+#define MIPD_OPTIONS "dhe:a:q:f:s:H:UPXb:w:Q:r:"
+#define MIPD_USAGE "[-h] [-d] [-e <n>] [-a <n>] [-q <n>] [-f <n>] [-s <file>] [-H <path>] [-U] [-P] [-X] [-b <cpu>] [-w <us>] [-Q <n>] [-r <file>] <socket_upper> <MIP address>"
+#endif
 
 /**
  * Prints the help message
@@ -15,9 +38,25 @@
  * @return void
  */
 void print_help(char *argv[]) {
-    printf("Usage: %s [-h] [-d] <socket_upper> <MIP address>\n", argv[0]);
+    printf("Usage: %s " MIPD_USAGE "\n", argv[0]);
     printf("  -h\t\tPrints this help message\n");
     printf("  -d\t\tRuns the program in debug mode\n");
+    printf("  -e <n>\t\tReport a next hop down after <n> consecutive send errors (default %d)\n", nexthop_send_error_threshold);
+    printf("  -a <n>\t\tReport a next hop down after <n> ARP requests in a row time out (default %d)\n", nexthop_arp_threshold);
+    printf("  -q <n>\t\tDrop packets for a next hop when <n> already wait in the ARP queue for it (default %d)\n", nexthop_queue_threshold);
+    printf("  -f <n>\t\tUse the first <n> bytes of the SDU as flow label when spreading flows over equal cost paths\n");
+    printf("  -s <file>\tKeeps a snapshot of the ARP cache in <file>, and starts from it after a restart\n");
+    printf("  -H <path>\tTakes over the sockets of the mipd listening on control socket <path>, then listens on it\n");
+    printf("  -U\t\tUses an io_uring event loop, or epoll if io_uring is not available\n");
+    printf("  -P\t\tReceives and sends frames in their own threads, pipelined with the forwarding\n");
+    printf("  -X\t\tReceives and sends MIP frames through AF_XDP sockets, or the raw socket if AF_XDP is not available\n");
+    printf("  -b <cpu>\tPins the main loop to CPU <cpu> and busy-polls the sockets instead of sleeping\n");
+    printf("  -w <us>\tWith -b, sleeps again after <us> microseconds without events (default %d)\n", BUSYPOLL_DEFAULT_IDLE_US);
+    printf("  -Q <n>\t\tSends ARP and routing frames before data frames when the link is full, holding back up to <n> frames per class\n");
+    printf("  -r <file>\tRecords every frame and upper layer message to <file>, to be replayed with mipd-replay\n");
+#ifdef MIPD_COLOCATED
+    colo_print_options();
+#endif
     printf("  <socket_upper>\tPathname of the UNIX socket used to interface with upper layers.\n");
     printf("  <MIP address>\tThe MIP address to assign to this host\n");
 }
@@ -28,12 +67,61 @@ void print_help(char *argv[]) {
  * @return void
  */
 void usage_and_exit(char *argv[]) {
-    printf("Usage: %s [-h] [-d] <socket_upper> <MIP address>\n", argv[0]);
+    printf("Usage: %s " MIPD_USAGE "\n", argv[0]);
     exit(EXIT_FAILURE);
 }
 
+/**
+ * Parses the argument of a numeric option.
+ * @param arg The argument
+ * @return The number, or -1 if the argument is not a decimal number from 0 to INT_MAX.
+ */
+static int parse_count(char const *arg) {
+    char *end;
+    errno = 0;
+    long value = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno != 0 || value < 0 || value > INT_MAX) {
+        return -1;
+    }
+    return (int)value;
+}
+
+static volatile sig_atomic_t print_stats_flag = 0; // Set by SIGUSR1, the main loop then prints the statistics.
+static volatile sig_atomic_t stop_flag = 0;        // Set by SIGINT and SIGTERM while recording, the main loop then exits.
+
+/**
+ * Signal handler for SIGUSR1. Asks the main loop to print the statistics.
+ * @param signum: The signal number
+ * @return void
+ */
+void handle_stats_signal(int signum) {
+    (void)signum;
+    print_stats_flag = 1;
+}
+
+/**
+ * Signal handler for SIGINT and SIGTERM while recording. Asks the main loop to finish the recording and exit.
+ * @param signum: The signal number
+ * @return void
+ */
+void handle_stop_signal(int signum) {
+    (void)signum;
+    stop_flag = 1;
+}
+
 /**
  * Main function for the daemon process for mip communication.
+ * Sending SIGUSR1 to the process prints the statistics to stdout.
+ * With -H, a mipd that is already running on the control socket hands its sockets and state over to this one
+ * and exits, so the routing daemon and the applications stay connected across the restart.
+ * With -U, the sockets are served by an io_uring event loop instead of epoll, if the kernel supports it.
+ * With -P, frames are received and sent by their own threads, and the main thread only forwards them.
+ * With -X, MIP frames are redirected by an XDP program to an AF_XDP socket on every interface, and sent through it.
+ * With -b, the main loop is pinned to a CPU and polls the sockets without sleeping, until it has been idle for -w.
+ * With -Q, frames the kernel cannot take yet are held back, and ARP and routing frames are sent before data frames.
+ * With -r, every frame received and every message from the upper layers is recorded to a log before it is handled,
+ * and SIGINT or SIGTERM writes out the rest of the log before mipd exits.
+ * When built as mipd-colo, the routing engine of routingd runs inside mipd and is configured with -R.
  *
  *
  * @param argc: Integer, number of arguments passed to the program from the terminal.
@@ -50,9 +138,21 @@ int main(int argc,char *argv[]) {
     int hflag = 0;      // Stores if the help-flag is given.
     int mip_addr = 0;   // The given MIP-address of this node. Initialized as 0.
     char *socket_upper; // String for storing the name of the unix-socket used to communicate with the upper layers.
+    char *snapshot_path = NULL; // Pathname of the ARP cache snapshot, NULL if none is kept.
+    char *handoff_path = NULL;  // Pathname of the control socket for handoffs, NULL if handoffs are disabled.
+    int uring_flag = 0;         // Stores if the io_uring event loop is asked for.
+    int pipeline_flag = 0;      // Stores if the pipelined data plane is asked for.
+    int xdp_flag = 0;           // Stores if the AF_XDP sockets are asked for.
+    int busypoll_cpu = -1;      // The CPU to busy-poll on, -1 if the main loop sleeps in epoll_wait().
+    int busypoll_idle_flag = 0; // Stores if the time without events before blocking was given.
+    int txsched_depth = 0;      // Frames each class of the transmit scheduler holds back, 0 if it is not used.
+    char *record_path = NULL;   // Pathname of the log of input events, NULL if not recording.
+#ifdef MIPD_COLOCATED
+    char *routing_options = NULL; // Options of the routing engine running inside mipd.
+#endif
 
     // Loop through the given options to set the appropriate flags.
-    while ((opt = getopt(argc, argv, "dh")) != -1) {
+    while ((opt = getopt(argc, argv, MIPD_OPTIONS)) != -1) {
         switch (opt) {
             case 'd':
                 // Running in debug mode
@@ -63,6 +163,80 @@ int main(int argc,char *argv[]) {
                 // Help flag given
                 hflag = 1;
                 break;
+            case 'e':
+                nexthop_send_error_threshold = parse_count(optarg);
+                if (nexthop_send_error_threshold < 1) {
+                    fprintf(stderr, "-e needs a number of send errors of at least 1\n");
+                    usage_and_exit(argv);
+                }
+                break;
+            case 'a':
+                nexthop_arp_threshold = parse_count(optarg);
+                if (nexthop_arp_threshold < 1) {
+                    fprintf(stderr, "-a needs a number of ARP timeouts of at least 1\n");
+                    usage_and_exit(argv);
+                }
+                break;
+            case 'q':
+                nexthop_queue_threshold = parse_count(optarg);
+                if (nexthop_queue_threshold < 1) {
+                    fprintf(stderr, "-q needs a number of packets of at least 1\n");
+                    usage_and_exit(argv);
+                }
+                break;
+            case 'f':
+                ecmp_flow_label_len = parse_count(optarg);
+                if (ecmp_flow_label_len < 0) {
+                    fprintf(stderr, "-f needs a number of bytes\n");
+                    usage_and_exit(argv);
+                }
+                break;
+            case 's':
+                snapshot_path = optarg;
+                break;
+            case 'H':
+                handoff_path = optarg;
+                break;
+            case 'U':
+                uring_flag = 1;
+                break;
+            case 'P':
+                pipeline_flag = 1;
+                break;
+            case 'X':
+                xdp_flag = 1;
+                break;
+            case 'b':
+                busypoll_cpu = parse_count(optarg);
+                if (busypoll_cpu < 0) {
+                    fprintf(stderr, "-b needs the number of a CPU\n");
+                    usage_and_exit(argv);
+                }
+                break;
+            case 'w':
+                // Multiplied by 1000 when compared with nanoseconds, so it must not be negative
+                busypoll_idle_us = parse_count(optarg);
+                if (busypoll_idle_us < 0) {
+                    fprintf(stderr, "-w needs a number of microseconds\n");
+                    usage_and_exit(argv);
+                }
+                busypoll_idle_flag = 1;
+                break;
+            case 'Q':
+                txsched_depth = parse_count(optarg);
+                if (txsched_depth < 1) {
+                    fprintf(stderr, "-Q needs a number of frames of at least 1\n");
+                    usage_and_exit(argv);
+                }
+                break;
+            case 'r':
+                record_path = optarg;
+                break;
+#ifdef MIPD_COLOCATED
+            case 'R':
+                routing_options = optarg;
+                break;
+#endif
             default:
                 usage_and_exit(argv);
         }
@@ -74,6 +248,36 @@ int main(int argc,char *argv[]) {
         exit(EXIT_SUCCESS);
     }
 
+    // The pipeline threads own the raw socket, which io_uring would also read from
+    if (uring_flag && pipeline_flag) {
+        fprintf(stderr, "-U and -P cannot be combined\n");
+        usage_and_exit(argv);
+    }
+
+    // The AF_XDP sockets send frames through their own transmit hook, as io_uring and the pipeline do
+    if (xdp_flag && (uring_flag || pipeline_flag)) {
+        fprintf(stderr, "-X cannot be combined with -U or -P\n");
+        usage_and_exit(argv);
+    }
+
+    // The transmit scheduler is a transmit hook too
+    if (txsched_depth > 0 && (uring_flag || pipeline_flag || xdp_flag)) {
+        fprintf(stderr, "-Q cannot be combined with -U, -P or -X\n");
+        usage_and_exit(argv);
+    }
+
+    // The time without events only applies to busy-polling
+    if (busypoll_idle_flag && busypoll_cpu < 0) {
+        fprintf(stderr, "-w needs -b\n");
+        usage_and_exit(argv);
+    }
+
+    // io_uring waits for the events itself
+    if (busypoll_cpu >= 0 && uring_flag) {
+        fprintf(stderr, "-b cannot be combined with -U\n");
+        usage_and_exit(argv);
+    }
+
     // Check if the correct number of arguments were given
     if (argc - optind != 2) {
         usage_and_exit(argv);
@@ -90,24 +294,9 @@ int main(int argc,char *argv[]) {
     init_route_queue();
 
     struct fds fds; // Struct that stores the different socket file-descriptors used by the daemon. Defined in common.h.
-
-    // Create raw socket for sending and receiving MIP packets
-    int rsd = prepare_rsd();
-    if (rsd < 0) {
-        perror("prepare_rsd() failed");
-        return -1;
-    }
-
-    // Create unix socket for interfacing with upper layers
-    int usd = prepare_usd(socket_upper);
-    if (usd < 0) {
-        perror("prepare_usd() failed");
-        return -1;
-    }
-
-    fds.rsd = rsd;
-    fds.usd = usd;
     fds.num_accepted_usds = 0;
+    fds.routing_usd = -1;
+    fds.ping_usd = -1;
 
     // Initialize interface data
     struct ifs_data ifs_data;
@@ -116,6 +305,41 @@ int main(int argc,char *argv[]) {
         return -1;
     }
 
+    // Take over the sockets and state of a running mipd, if there is one
+    int handed_over = 0;
+    if (handoff_path != NULL) {
+        handed_over = handoff_receive(handoff_path, &fds, ifs_data);
+        if (handed_over < 0) {
+            fprintf(stderr, "handoff_receive() failed\n");
+            return -1;
+        }
+    }
+
+    if (!handed_over) {
+        // Create raw socket for sending and receiving MIP packets
+        fds.rsd = prepare_rsd();
+        if (fds.rsd < 0) {
+            perror("prepare_rsd() failed");
+            return -1;
+        }
+
+        // Create unix socket for interfacing with upper layers
+        fds.usd = prepare_usd(socket_upper);
+        if (fds.usd < 0) {
+            perror("prepare_usd() failed");
+            return -1;
+        }
+    }
+    int rsd = fds.rsd;
+    int usd = fds.usd;
+
+    // Start from the ARP cache of the previous run, and refresh it in the background
+    if (snapshot_path != NULL) {
+        if (arp_cache_load_snapshot(snapshot_path, ifs_data) > 0 && send_arp_refresh(rsd, ifs_data) < 0) {
+            global_debug("send_arp_refresh() failed");
+        }
+    }
+
     // Create epoll instance
     struct epoll_event ev_raw, ev_usd, events[MAX_EVENTS];
     int epollfd;
@@ -142,16 +366,222 @@ int main(int argc,char *argv[]) {
         return -1;
     }
 
+    // Add the unix sockets taken over from the previous mipd to the epoll-table
+    for (int i = 0; i < fds.num_accepted_usds; i++) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fds.accepted_usds[i].usd;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fds.accepted_usds[i].usd, &ev) == -1) {
+            perror("epoll_ctl: accepted_usd");
+            return -1;
+        }
+    }
+
+    // Listen for a new mipd that wants to take over
+    int control_sd = -1;
+    if (handoff_path != NULL) {
+        control_sd = handoff_listen(handoff_path);
+        if (control_sd < 0) {
+            return -1;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = control_sd;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, control_sd, &ev) == -1) {
+            perror("epoll_ctl: control_sd");
+            return -1;
+        }
+    }
+
+    // Time out the ARP requests that are not answered
+    int nexthop_timer_fd = nexthop_start();
+    if (nexthop_timer_fd < 0) {
+        return -1;
+    }
+    struct epoll_event ev_nexthop;
+    ev_nexthop.events = EPOLLIN;
+    ev_nexthop.data.fd = nexthop_timer_fd;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, nexthop_timer_fd, &ev_nexthop) == -1) {
+        perror("epoll_ctl: nexthop_timer_fd");
+        return -1;
+    }
+
+#ifdef MIPD_COLOCATED
+    // Start the routing engine inside mipd. It talks to mipd through function calls instead of a unix socket.
+    int routing_timer_fd = colo_start(&fds, &ifs_data, routing_options);
+    if (routing_timer_fd < 0) {
+        return -1;
+    }
+    struct epoll_event ev_timer;
+    ev_timer.events = EPOLLIN;
+    ev_timer.data.fd = routing_timer_fd;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, routing_timer_fd, &ev_timer) == -1) {
+        perror("epoll_ctl: routing_timer_fd");
+        return -1;
+    }
+#endif
+
+    // Record the input events from here on. SIGINT and SIGTERM are blocked while the pipeline threads are started,
+    // so that they inherit the mask and the signals reach the main loop, which writes out the log.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    if (record_path != NULL) {
+        if (record_start(record_path, fds, ifs_data) < 0) {
+            return -1;
+        }
+        struct sigaction sa_stop;
+        memset(&sa_stop, 0, sizeof(sa_stop));
+        sa_stop.sa_handler = handle_stop_signal;
+        sigaction(SIGINT, &sa_stop, NULL);
+        sigaction(SIGTERM, &sa_stop, NULL);
+        sigprocmask(SIG_BLOCK, &stop_signals, NULL);
+    }
+
+    // Hand the raw socket over to the RX and TX threads if asked for. The main thread is then woken by the RX thread.
+    int pipeline_fd = -1;
+    if (pipeline_flag) {
+        pipeline_fd = pipeline_start(&fds);
+        if (pipeline_fd < 0) {
+            return -1;
+        }
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, rsd, NULL);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = pipeline_fd;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pipeline_fd, &ev) == -1) {
+            perror("epoll_ctl: pipeline_fd");
+            return -1;
+        }
+    }
+    if (record_path != NULL) {
+        sigprocmask(SIG_UNBLOCK, &stop_signals, NULL);
+    }
+
+    // Receive and send the MIP frames through AF_XDP sockets if asked for. The raw socket stays in the epoll instance,
+    // for the MIP frames the XDP program passes on to the kernel.
+    int xdp_sockets[MAX_IFS];
+    if (xdp_flag) {
+        int num_xdp_sockets = xdp_start(&ifs_data, xdp_sockets);
+        if (num_xdp_sockets < 0) {
+            fprintf(stderr, "AF_XDP is not available, using the raw socket\n");
+            xdp_flag = 0;
+        }
+        for (int i = 0; i < num_xdp_sockets; i++) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = xdp_sockets[i];
+            if (epoll_ctl(epollfd, EPOLL_CTL_ADD, xdp_sockets[i], &ev) == -1) {
+                perror("epoll_ctl: xdp_socket");
+                return -1;
+            }
+        }
+    }
+
+    // Hold back the frames the kernel cannot take yet, by class, if asked for
+    int txsched_fd = -1;
+    if (txsched_depth > 0) {
+        txsched_fd = txsched_start(rsd, txsched_depth);
+        if (txsched_fd < 0) {
+            return -1;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = txsched_fd;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, txsched_fd, &ev) == -1) {
+            perror("epoll_ctl: txsched_fd");
+            return -1;
+        }
+    }
+
+    // Busy-poll the sockets from a pinned main thread if asked for. Done after the pipeline threads are started,
+    // so they are not pinned to the same CPU.
+    if (busypoll_cpu >= 0) {
+        if (busypoll_start(busypoll_cpu) < 0) {
+            return -1;
+        }
+        busypoll_socket(rsd);
+        for (int i = 0; xdp_flag && i < ifs_data.ifn; i++) {
+            busypoll_socket(xdp_sockets[i]);
+        }
+    }
+
+    // Use the io_uring event loop if asked for. The epoll instance is kept as the fallback.
+    int use_uring = 0;
+    if (uring_flag) {
+        if (uring_init(&fds, &ifs_data) == 0) {
+            use_uring = 1;
+            if (control_sd >= 0) {
+                uring_watch(control_sd);
+            }
+            uring_watch(nexthop_timer_fd);
+#ifdef MIPD_COLOCATED
+            uring_watch(routing_timer_fd);
+#endif
+            global_debug("Using the io_uring event loop");
+        } else {
+            fprintf(stderr, "io_uring is not available, using epoll\n");
+        }
+    }
+
+    // Print statistics on SIGUSR1
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stats_signal;
+    sigaction(SIGUSR1, &sa, NULL);
+
     // Main loop. Waits indefinitely for events on the sockets and handles them when they arise.
     int num_events;
     global_debug("Entering main loop");
     while (1) {
-        num_events = epoll_wait(epollfd, events, MAX_EVENTS, -1);
-        if (num_events == -1) {
-            perror("epoll_wait");
+        if (use_uring) {
+            num_events = uring_wait(events, MAX_EVENTS);
+        } else if (busypoll_cpu >= 0) {
+            num_events = busypoll_wait(epollfd, events, MAX_EVENTS);
+        } else {
+            num_events = epoll_wait(epollfd, events, MAX_EVENTS, -1);
+        }
+        if (num_events == -1 && errno == EINTR) {
+            num_events = 0;
+        } else if (num_events == -1) {
+            perror(use_uring ? "uring_wait" : "epoll_wait");
             return -1;
         }
 
+        if (stop_flag) {
+            record_stop();
+            print_record_stats();
+            exit(EXIT_SUCCESS);
+        }
+
+        if (print_stats_flag) {
+            print_stats_flag = 0;
+            print_nexthop_stats();
+            print_ecmp_stats();
+            if (use_uring) {
+                print_uring_stats();
+            }
+            if (pipeline_fd >= 0) {
+                print_pipeline_stats();
+            }
+            if (xdp_flag) {
+                print_xdp_stats();
+            }
+            if (busypoll_cpu >= 0) {
+                print_busypoll_stats();
+            }
+            if (txsched_fd >= 0) {
+                print_txsched_stats();
+            }
+            if (record_active()) {
+                print_record_stats();
+            }
+#ifdef MIPD_COLOCATED
+            colo_print_stats();
+#endif
+        }
+
         for (int i = 0; i < num_events; i++) {
 
 
@@ -169,7 +599,18 @@ int main(int argc,char *argv[]) {
                     continue;
                 }
 
-                // Add the new socket to the epoll instance
+                // Tell a routing daemon our address, so it does not have to learn it from a neighbour
+                if (accept_usd == fds.routing_usd) {
+                    send_routing_request(accept_usd, ifs_data, ifs_data.local_mip_addr);
+                }
+
+                // Receive on the new socket with io_uring, or add it to the epoll instance
+                if (use_uring) {
+                    if (uring_watch_usd(accept_usd) < 0) {
+                        global_debug("uring_watch_usd() failed");
+                    }
+                    continue;
+                }
                 //global_debug("Adding new socket to epoll instance");
                 struct epoll_event ev;
                 ev.events = EPOLLIN;
@@ -180,6 +621,55 @@ int main(int argc,char *argv[]) {
                     continue;
                 }
 
+#ifdef MIPD_COLOCATED
+            // ----------------- Routing Engine Timers -----------------
+            } else if (events[i].data.fd == routing_timer_fd) {
+                colo_timer_event();
+#endif
+
+            // ----------------- ARP Timer -----------------
+            } else if (events[i].data.fd == nexthop_timer_fd) {
+                nexthop_timer_event(fds, ifs_data);
+
+            // ----------------- Handoff Control Socket -----------------
+            } else if (events[i].data.fd == control_sd) {
+                // A new mipd wants to take over. If it does, leave the sockets to it and exit.
+                if (use_uring) {
+                    uring_pause();
+                }
+                if (pipeline_fd >= 0) {
+                    pipeline_pause(fds, ifs_data);
+                }
+#ifdef MIPD_COLOCATED
+                // The new mipd runs its own routing engine, so answer the requests still queued for this one
+                colo_run();
+#endif
+                if (txsched_fd >= 0) {
+                    txsched_drain();
+                }
+                if (handoff_send(control_sd, fds, ifs_data) == 0) {
+                    global_debug("Handed over to the new mipd, exiting");
+                    exit(EXIT_SUCCESS);
+                }
+                if (use_uring) {
+                    uring_resume();
+                }
+                if (pipeline_fd >= 0) {
+                    pipeline_resume();
+                }
+
+            // ----------------- Pipeline RX Ring -----------------
+            } else if (events[i].data.fd == pipeline_fd) {
+                pipeline_rx_event(fds, ifs_data);
+
+            // ----------------- AF_XDP Sockets -----------------
+            } else if (xdp_flag && xdp_socket_index(events[i].data.fd) >= 0) {
+                xdp_rx_event(fds, ifs_data, xdp_socket_index(events[i].data.fd));
+
+            // ----------------- Transmit Scheduler Timer -----------------
+            } else if (events[i].data.fd == txsched_fd) {
+                txsched_timer_event();
+
             // ----------------- Raw Socket -----------------
             } else if (events[i].data.fd == rsd) {
                 // Raw socket event
@@ -212,12 +702,7 @@ int main(int argc,char *argv[]) {
                             if (err == -2) {
                                 global_debug("EOF received. Closing socket.");
                             }
-                            close(fds.accepted_usds[j].usd);
-                            // Remove usd from accepted_usds
-                            for (int k = j; k < fds.num_accepted_usds - 1; k++) {
-                                fds.accepted_usds[k] = fds.accepted_usds[k + 1];
-                            }
-                            fds.num_accepted_usds--;
+                            close_accepted_usd(&fds, j);
                             continue;
                         }
                     }
@@ -228,5 +713,25 @@ int main(int argc,char *argv[]) {
                 }
             }
         }
+
+#ifdef MIPD_COLOCATED
+        // Let the routing engine handle the messages that mipd queued for it during these events
+        colo_run();
+#endif
+
+        // Let the TX thread send the frames queued during these events
+        if (pipeline_fd >= 0) {
+            pipeline_flush();
+        }
+
+        // Wake the kernel to send the frames queued on the AF_XDP sockets during these events
+        if (xdp_flag) {
+            xdp_flush();
+        }
+
+        // Offer the frames held back during these events to the kernel again
+        if (txsched_fd >= 0) {
+            txsched_flush();
+        }
     }
 }
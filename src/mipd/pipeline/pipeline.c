@@ -0,0 +1,379 @@
+#define _GNU_SOURCE // For recvmmsg() and sendmmsg().
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "pipeline.h"
+#include "spsc_ring.h"
+#include "../lower/lower.h"
+#include "../lower/mip/mip.h"
+
+/*
+ * A pipelined data plane for mipd, used with -P.
+ *
+ * An RX thread receives frames from the raw socket in batches with recvmmsg() and passes them to the main thread
+ * through a ring. The main thread is the forwarding stage: it handles the frames with handle_frame(), which does
+ * the ARP, routing and queueing, along with its other events. The frames it sends are passed through a second ring
+ * to a TX thread, which sends them in batches with sendmmsg(). The RX thread wakes the main thread with an eventfd
+ * once per batch, and the main thread wakes the TX thread once per event loop iteration.
+ *
+ * Before the raw socket is handed over to another mipd, pipeline_pause() stops the RX thread and empties both
+ * rings, so nothing is read from the socket after the handoff and no frame is lost when this mipd exits.
+ */
+
+/**
+ * A frame in one of the rings between the stages.
+ */
+struct pipeline_frame {
+    struct sockaddr_ll addr;    // The interface the frame was received on or is sent from.
+    u_int16_t len;              // Length of the frame.
+    u_int8_t data[sizeof(struct ether_frame) + sizeof(struct mip_pdu)];
+};
+
+/**
+ * The time a stage has spent working, to report its utilization.
+ */
+struct pipeline_stage {
+    unsigned long frames;       // Frames handled by the stage.
+    unsigned long batches;      // Batches of frames handled by the stage.
+    u_int64_t busy_ns;          // Time spent handling frames.
+};
+
+static struct spsc_ring rx_ring;        // Frames from the RX thread to the forwarding stage.
+static struct spsc_ring tx_ring;        // Frames from the forwarding stage to the TX thread.
+static int rx_event_fd = -1;            // Readable when the RX thread has pushed frames.
+static int tx_event_fd = -1;            // Written by the forwarding stage to wake the TX thread.
+static int rsd = -1;                    // The raw socket.
+static pthread_t rx;                    // The RX thread.
+static int rx_running = 0;              // If the RX thread is running, it is stopped by pipeline_pause().
+static int tx_pending = 0;              // If frames have been pushed to the TX ring since the last wakeup.
+static int paused = 0;                  // Set by pipeline_pause(), frames are then sent right away.
+static u_int64_t start_ns;              // When the pipeline was started.
+
+static struct pipeline_stage rx_stage, forward_stage, tx_stage;
+static unsigned long rx_dropped = 0;    // Frames dropped by the RX thread because its ring was full.
+static unsigned long tx_direct = 0;     // Frames sent by the forwarding stage because the TX ring was full.
+static unsigned long tx_errors = 0;     // Frames the TX thread failed to send.
+
+/**
+ * Returns the monotonic time in nanoseconds.
+ */
+static u_int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Adds a batch of frames to the statistics of a stage.
+ */
+static void stage_done(struct pipeline_stage *stage, unsigned frames, u_int64_t started_ns) {
+    stage->frames += frames;
+    stage->batches++;
+    stage->busy_ns += now_ns() - started_ns;
+}
+
+/**
+ * The RX stage. Receives frames from the raw socket directly into the free slots of the RX ring.
+ * When the ring is full, frames are received into a scratch slot and dropped, so the socket does not fill up.
+ */
+static void *rx_thread(void *arg) {
+    (void)arg;
+    struct mmsghdr msgs[PIPELINE_BATCH];
+    struct iovec iovs[PIPELINE_BATCH];
+    struct pipeline_frame scratch;
+    u_int64_t one = 1;
+
+    while (1) {
+        unsigned free_slots = spsc_ring_writable(&rx_ring);
+        unsigned batch = free_slots < PIPELINE_BATCH ? free_slots : PIPELINE_BATCH;
+        unsigned slots = batch > 0 ? batch : 1;
+        memset(msgs, 0, sizeof(struct mmsghdr) * slots);
+        for (unsigned i = 0; i < slots; i++) {
+            struct pipeline_frame *frame = batch > 0 ? spsc_ring_slot(&rx_ring, rx_ring.tail + i) : &scratch;
+            iovs[i].iov_base = frame->data;
+            iovs[i].iov_len = sizeof(frame->data);
+            msgs[i].msg_hdr.msg_name = &frame->addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int received = recvmmsg(rsd, msgs, slots, MSG_WAITFORONE, NULL);
+        if (received < 0) {
+            if (errno != EINTR) {
+                perror("recvmmsg");
+            }
+            continue;
+        }
+        u_int64_t started_ns = now_ns();
+        if (batch == 0) {
+            rx_dropped += received;
+            continue;
+        }
+        for (int i = 0; i < received; i++) {
+            struct pipeline_frame *frame = spsc_ring_slot(&rx_ring, rx_ring.tail + i);
+            frame->len = msgs[i].msg_len;
+        }
+        spsc_ring_push(&rx_ring, received);
+        if (write(rx_event_fd, &one, sizeof(one)) < 0) {
+            perror("write: rx_event_fd");
+        }
+        stage_done(&rx_stage, received, started_ns);
+    }
+    return NULL;
+}
+
+/**
+ * The TX stage. Sends the frames in the TX ring with sendmmsg(), straight from their slots.
+ */
+static void *tx_thread(void *arg) {
+    (void)arg;
+    struct mmsghdr msgs[PIPELINE_BATCH];
+    struct iovec iovs[PIPELINE_BATCH];
+    u_int64_t count;
+
+    while (1) {
+        unsigned ready = spsc_ring_readable(&tx_ring);
+        if (ready == 0) {
+            // Sleep until the forwarding stage has pushed more frames
+            if (read(tx_event_fd, &count, sizeof(count)) < 0 && errno != EINTR) {
+                perror("read: tx_event_fd");
+            }
+            continue;
+        }
+
+        u_int64_t started_ns = now_ns();
+        unsigned batch = ready < PIPELINE_BATCH ? ready : PIPELINE_BATCH;
+        memset(msgs, 0, sizeof(struct mmsghdr) * batch);
+        for (unsigned i = 0; i < batch; i++) {
+            struct pipeline_frame *frame = spsc_ring_slot(&tx_ring, tx_ring.head + i);
+            iovs[i].iov_base = frame->data;
+            iovs[i].iov_len = frame->len;
+            msgs[i].msg_hdr.msg_name = &frame->addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int sent = sendmmsg(rsd, msgs, batch, 0);
+        if (sent < (int)batch) {
+            // sendmmsg() stops at the first frame that fails, skip that one
+            tx_errors++;
+            sent = sent < 0 ? 1 : sent + 1;
+        }
+        spsc_ring_pop(&tx_ring, sent);
+        stage_done(&tx_stage, sent, started_ns);
+    }
+    return NULL;
+}
+
+/**
+ * Pushes a frame to the TX ring. Used as packet_transmit_hook by the forwarding stage.
+ * If the ring is full, or the pipeline is paused, the frame is sent right away with sendmsg().
+ *
+ * @param rsd: Raw socket descriptor used for sending the frame.
+ * @param msghdr: The frame, with the sockaddr_ll of the interface as msg_name.
+ * @return: The number of bytes queued or sent, or -1 on failure.
+ */
+static long pipeline_transmit(int rsd, struct msghdr const *msghdr) {
+    size_t len = 0;
+    for (size_t i = 0; i < msghdr->msg_iovlen; i++) {
+        len += msghdr->msg_iov[i].iov_len;
+    }
+    if (paused || spsc_ring_writable(&tx_ring) == 0 || len > sizeof(((struct pipeline_frame *)0)->data)) {
+        tx_direct++;
+        return sendmsg(rsd, msghdr, 0);
+    }
+
+    struct pipeline_frame *frame = spsc_ring_slot(&tx_ring, tx_ring.tail);
+    size_t offset = 0;
+    for (size_t i = 0; i < msghdr->msg_iovlen; i++) {
+        memcpy(frame->data + offset, msghdr->msg_iov[i].iov_base, msghdr->msg_iov[i].iov_len);
+        offset += msghdr->msg_iov[i].iov_len;
+    }
+    memcpy(&frame->addr, msghdr->msg_name, sizeof(struct sockaddr_ll));
+    frame->len = len;
+    spsc_ring_push(&tx_ring, 1);
+    tx_pending = 1;
+    return (long)len;
+}
+
+/**
+ * Starts a thread of the pipeline. The thread blocks all signals, so they are always handled by the main thread,
+ * and SIGUSR1 starts a handoff there.
+ *
+ * @param thread: Receives the thread.
+ * @param start: The function the thread runs.
+ * @return: 0 on success, -1 on failure.
+ */
+static int start_thread(pthread_t *thread, void *(*start)(void *)) {
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int rc = pthread_create(thread, NULL, start, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        errno = rc;
+        perror("pthread_create");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Starts the RX and TX threads. From here on, the main thread must not read from the raw socket, and the frames
+ * it sends go through the TX thread.
+ *
+ * @param fds: The file descriptors of mipd.
+ * @return: A file descriptor that is readable when received frames are waiting, to be added to the epoll instance
+ * and handled with pipeline_rx_event(). -1 on failure.
+ */
+int pipeline_start(struct fds *fds) {
+    rsd = fds->rsd;
+    if (spsc_ring_init(&rx_ring, PIPELINE_RING_SIZE, sizeof(struct pipeline_frame)) < 0
+        || spsc_ring_init(&tx_ring, PIPELINE_RING_SIZE, sizeof(struct pipeline_frame)) < 0) {
+        fprintf(stderr, "pipeline: could not allocate rings\n");
+        return -1;
+    }
+    rx_event_fd = eventfd(0, EFD_NONBLOCK);
+    tx_event_fd = eventfd(0, 0);
+    if (rx_event_fd < 0 || tx_event_fd < 0) {
+        perror("eventfd");
+        return -1;
+    }
+
+    start_ns = now_ns();
+    pthread_t tx;
+    if (start_thread(&rx, rx_thread) < 0 || start_thread(&tx, tx_thread) < 0) {
+        return -1;
+    }
+    rx_running = 1;
+    pthread_detach(tx);
+    packet_transmit_hook = pipeline_transmit;
+    return rx_event_fd;
+}
+
+/**
+ * The forwarding stage. Handles the frames that the RX thread has pushed to the RX ring.
+ *
+ * @param fds: A struct that contains multiple file descriptors including raw and unix sockets.
+ * @param ifs_data: A struct that contains information about network interfaces.
+ */
+void pipeline_rx_event(struct fds fds, struct ifs_data ifs_data) {
+    u_int64_t count;
+    if (read(rx_event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        global_debug("read: rx_event_fd");
+    }
+
+    u_int64_t started_ns = now_ns();
+    unsigned handled = 0;
+    unsigned ready;
+    while ((ready = spsc_ring_readable(&rx_ring)) > 0) {
+        for (unsigned i = 0; i < ready; i++) {
+            struct pipeline_frame *frame = spsc_ring_slot(&rx_ring, rx_ring.head + i);
+            if (frame->len < sizeof(struct ether_frame)) {
+                continue;
+            }
+            // The slot is large enough for a whole MIP packet after the ethernet header, as with recvmsg()
+            struct iovec msgvec[2];
+            msgvec[0].iov_base = frame->data;
+            msgvec[0].iov_len = sizeof(struct ether_frame);
+            msgvec[1].iov_base = frame->data + sizeof(struct ether_frame);
+            msgvec[1].iov_len = frame->len - sizeof(struct ether_frame);
+            struct msghdr msghdr;
+            memset(&msghdr, 0, sizeof(struct msghdr));
+            msghdr.msg_name = &frame->addr;
+            msghdr.msg_namelen = sizeof(struct sockaddr_ll);
+            msghdr.msg_iov = msgvec;
+            msghdr.msg_iovlen = 2;
+            handle_frame(fds, ifs_data, &msghdr);
+        }
+        spsc_ring_pop(&rx_ring, ready);
+        handled += ready;
+    }
+    stage_done(&forward_stage, handled, started_ns);
+}
+
+/**
+ * Wakes the TX thread if frames have been pushed to the TX ring. Called after every batch of events.
+ */
+void pipeline_flush() {
+    if (!tx_pending) {
+        return;
+    }
+    tx_pending = 0;
+    u_int64_t one = 1;
+    if (write(tx_event_fd, &one, sizeof(one)) < 0) {
+        global_debug("write: tx_event_fd");
+    }
+}
+
+/**
+ * Stops reading from the raw socket and empties the rings. Used before handing the raw socket over to another mipd.
+ *
+ * The RX thread is cancelled while it waits in recvmmsg() and joined, the frames it had already received are
+ * handled, and the frames waiting in the TX ring are sent before this returns. Frames sent after that, until
+ * pipeline_resume(), bypass the TX ring.
+ *
+ * @param fds: A struct that contains multiple file descriptors including raw and unix sockets.
+ * @param ifs_data: A struct that contains information about network interfaces.
+ */
+void pipeline_pause(struct fds fds, struct ifs_data ifs_data) {
+    if (rx_running) {
+        pthread_cancel(rx);
+        pthread_join(rx, NULL);
+        rx_running = 0;
+    }
+    pipeline_rx_event(fds, ifs_data);
+
+    pipeline_flush();
+    // Only the TX thread may read the TX ring, spsc_ring_used() just loads its indexes
+    while (spsc_ring_used(&tx_ring) > 0) {
+        usleep(100);
+    }
+    paused = 1;
+}
+
+/**
+ * Starts the RX thread again after pipeline_pause(), if the handover did not happen.
+ */
+void pipeline_resume() {
+    paused = 0;
+    if (rx_running) {
+        return;
+    }
+    if (start_thread(&rx, rx_thread) == 0) {
+        rx_running = 1;
+    }
+}
+
+/**
+ * Prints the statistics of one stage.
+ */
+static void print_stage(char const *name, struct pipeline_stage const *stage, u_int64_t elapsed_ns) {
+    printf("  %s: frames=%lu batches=%lu (%.1f per batch) utilization=%.1f%%\n", name, stage->frames, stage->batches,
+           stage->batches > 0 ? (double)stage->frames / stage->batches : 0.0,
+           elapsed_ns > 0 ? 100.0 * stage->busy_ns / elapsed_ns : 0.0);
+}
+
+/**
+ * Prints the statistics of the pipeline to stdout. The counters of the RX and TX threads are read without
+ * synchronization, so they can be slightly behind.
+ */
+void print_pipeline_stats() {
+    u_int64_t elapsed_ns = now_ns() - start_ns;
+    printf("Pipeline (rings of %d frames):\n", PIPELINE_RING_SIZE);
+    print_stage("rx", &rx_stage, elapsed_ns);
+    print_stage("forward", &forward_stage, elapsed_ns);
+    print_stage("tx", &tx_stage, elapsed_ns);
+    printf("  rx ring: used=%u max=%lu dropped=%lu\n", spsc_ring_used(&rx_ring), rx_ring.max_used, rx_dropped);
+    printf("  tx ring: used=%u max=%lu direct=%lu errors=%lu\n", spsc_ring_used(&tx_ring), tx_ring.max_used,
+           tx_direct, tx_errors);
+    fflush(stdout);
+}
@@ -0,0 +1,21 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "../mipd_common.h"
+
+#define PIPELINE_RING_SIZE  1024    // Number of frames in each ring between the stages, a power of two.
+#define PIPELINE_BATCH      32      // Maximum number of frames received or sent by one syscall.
+
+int pipeline_start(struct fds *fds);
+
+void pipeline_rx_event(struct fds fds, struct ifs_data ifs_data);
+
+void pipeline_flush();
+
+void pipeline_pause(struct fds fds, struct ifs_data ifs_data);
+
+void pipeline_resume();
+
+void print_pipeline_stats();
+
+#endif //PIPELINE_H
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <string.h>
+#include "spsc_ring.h"
+
+/**
+ * Initializes an empty ring.
+ *
+ * @param ring: The ring.
+ * @param size: The number of slots, a power of two.
+ * @param slot_size: The size of each slot in bytes.
+ * @return: 0 on success, -1 if the size is not a power of two or the memory could not be allocated.
+ */
+int spsc_ring_init(struct spsc_ring *ring, unsigned size, size_t slot_size) {
+    if (size == 0 || (size & (size - 1)) != 0) {
+        return -1;
+    }
+    memset(ring, 0, sizeof(struct spsc_ring));
+    ring->size = size;
+    ring->slot_size = slot_size;
+    ring->slots = calloc(size, slot_size);
+    return ring->slots == NULL ? -1 : 0;
+}
+
+/**
+ * Returns a slot of the ring.
+ *
+ * @param ring: The ring.
+ * @param index: A head or tail index, or an index after it. Wraps around.
+ * @return: The slot.
+ */
+void *spsc_ring_slot(struct spsc_ring const *ring, unsigned index) {
+    return ring->slots + (size_t)(index & (ring->size - 1)) * ring->slot_size;
+}
+
+/**
+ * Returns how many slots the producer can write, starting at ring->tail. Only called by the producer.
+ *
+ * @param ring: The ring.
+ * @return: The number of free slots.
+ */
+unsigned spsc_ring_writable(struct spsc_ring *ring) {
+    unsigned free_slots = ring->size - (ring->tail - ring->cached_head);
+    if (free_slots == 0) {
+        ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        free_slots = ring->size - (ring->tail - ring->cached_head);
+    }
+    return free_slots;
+}
+
+/**
+ * Hands written slots over to the consumer. Only called by the producer.
+ *
+ * @param ring: The ring.
+ * @param count: The number of slots written after ring->tail.
+ */
+void spsc_ring_push(struct spsc_ring *ring, unsigned count) {
+    __atomic_store_n(&ring->tail, ring->tail + count, __ATOMIC_RELEASE);
+}
+
+/**
+ * Returns how many slots the consumer can read, starting at ring->head. Only called by the consumer.
+ *
+ * @param ring: The ring.
+ * @return: The number of slots ready to be read.
+ */
+unsigned spsc_ring_readable(struct spsc_ring *ring) {
+    unsigned ready = ring->cached_tail - ring->head;
+    if (ready == 0) {
+        ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        ready = ring->cached_tail - ring->head;
+        if (ready > ring->max_used) {
+            ring->max_used = ready;
+        }
+    }
+    return ready;
+}
+
+/**
+ * Gives read slots back to the producer. Only called by the consumer.
+ *
+ * @param ring: The ring.
+ * @param count: The number of slots read after ring->head.
+ */
+void spsc_ring_pop(struct spsc_ring *ring, unsigned count) {
+    __atomic_store_n(&ring->head, ring->head + count, __ATOMIC_RELEASE);
+}
+
+/**
+ * Returns the number of slots in use. Can be called from any thread, for statistics.
+ *
+ * @param ring: The ring.
+ * @return: The number of slots written and not yet read.
+ */
+unsigned spsc_ring_used(struct spsc_ring const *ring) {
+    return __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) - __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+}
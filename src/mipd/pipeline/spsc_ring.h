@@ -0,0 +1,41 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SPSC_CACHE_LINE 64  // Size of a cache line. The indices of the producer and the consumer are kept apart by it.
+
+/**
+ * A lock-free ring of fixed size slots with one producer thread and one consumer thread.
+ *
+ * The producer writes slots at the tail and the consumer reads them at the head. Each index is only written by
+ * one side and lives on its own cache line, with a cached copy of the other side's index, so the two threads
+ * only share a cache line when the ring looks full or empty.
+ */
+struct spsc_ring {
+    _Alignas(SPSC_CACHE_LINE) unsigned tail;   // Next slot to write, written by the producer.
+    unsigned cached_head;                       // The head as last seen by the producer.
+    _Alignas(SPSC_CACHE_LINE) unsigned head;   // Next slot to read, written by the consumer.
+    unsigned cached_tail;                       // The tail as last seen by the consumer.
+    unsigned long max_used;                     // Most slots found ready at once by the consumer.
+    _Alignas(SPSC_CACHE_LINE) unsigned size;   // Number of slots, a power of two.
+    size_t slot_size;                           // Size of each slot in bytes.
+    u_int8_t *slots;                            // Memory of the slots.
+};
+
+int spsc_ring_init(struct spsc_ring *ring, unsigned size, size_t slot_size);
+
+void *spsc_ring_slot(struct spsc_ring const *ring, unsigned index);
+
+unsigned spsc_ring_writable(struct spsc_ring *ring);
+
+void spsc_ring_push(struct spsc_ring *ring, unsigned count);
+
+unsigned spsc_ring_readable(struct spsc_ring *ring);
+
+void spsc_ring_pop(struct spsc_ring *ring, unsigned count);
+
+unsigned spsc_ring_used(struct spsc_ring const *ring);
+
+#endif //SPSC_RING_H
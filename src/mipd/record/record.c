@@ -0,0 +1,329 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "record.h"
+#include "../lower/mip/mip.h"
+#include "../lower/mip/queues/arp_queue.h"
+#include "../lower/mip/queues/route_queue.h"
+#include "../../common/snapshot/snapshot.h"
+
+static int record_fd = -1;                          // The log being written, -1 if mipd is not recording.
+static u_int8_t record_buffer[RECORD_BUFFER_SIZE];  // Events not yet written to the log.
+static size_t record_buffered = 0;                  // Bytes in record_buffer.
+static u_int64_t record_last_us = 0;                // Time of the previous event.
+static unsigned long record_events[RECORD_KINDS];   // Events recorded, by kind.
+static unsigned long record_bytes = 0;              // Bytes written to the log, header included.
+
+/**
+ * Returns the time of CLOCK_MONOTONIC in microseconds.
+ */
+static u_int64_t record_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Writes the buffered events to the log.
+ *
+ * @return: 0 on success, -1 if the log could not be written. Recording then stops.
+ */
+static int record_flush() {
+    size_t written = 0;
+    while (written < record_buffered) {
+        ssize_t rc = write(record_fd, record_buffer + written, record_buffered - written);
+        if (rc < 0) {
+            perror("write: record");
+            close(record_fd);
+            record_fd = -1;
+            return -1;
+        }
+        written += (size_t)rc;
+    }
+    record_bytes += record_buffered;
+    record_buffered = 0;
+    return 0;
+}
+
+/**
+ * Adds an event to the log. The payload is given in up to three parts, which are stored back to back, without the
+ * trailing zero bytes of the last part.
+ *
+ * @param kind: The kind of event.
+ * @param type: SDU type of the upper layer, 0 if none.
+ * @param parts: The parts of the payload.
+ * @param lens: The length of each part.
+ * @param num_parts: Number of parts, 0 for none.
+ */
+static void record_event(u_int8_t kind, u_int8_t type, void const *const *parts, size_t const *lens, int num_parts) {
+    if (record_fd < 0) {
+        return;
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < num_parts; i++) {
+        len += lens[i];
+    }
+    if (num_parts > 0) {
+        u_int8_t const *last = parts[num_parts - 1];
+        size_t last_len = lens[num_parts - 1];
+        while (last_len > 0 && last[last_len - 1] == 0) {
+            last_len--;
+            len--;
+        }
+    }
+
+    if (record_buffered + sizeof(struct record_event) + len > sizeof(record_buffer) && record_flush() < 0) {
+        return;
+    }
+
+    u_int64_t now = record_now_us();
+    u_int64_t delta = now - record_last_us;
+    record_last_us = now;
+
+    struct record_event event;
+    event.delta_us = delta > UINT32_MAX ? UINT32_MAX : (u_int32_t)delta;
+    event.kind = kind;
+    event.type = type;
+    event.len = (u_int16_t)len;
+    memcpy(record_buffer + record_buffered, &event, sizeof(event));
+    record_buffered += sizeof(event);
+    for (int i = 0; i < num_parts && len > 0; i++) {
+        size_t part_len = lens[i] < len ? lens[i] : len;
+        memcpy(record_buffer + record_buffered, parts[i], part_len);
+        record_buffered += part_len;
+        len -= part_len;
+    }
+    record_events[kind]++;
+}
+
+/**
+ * Starts recording every input event of mipd to a log, for mipd-replay to feed back through the same functions.
+ * The ARP cache, the backup next hops and the queued packets are written with the header, so a recording made
+ * after a warm start or a handoff replays from the same state.
+ *
+ * @param path: Pathname of the log. An existing file is overwritten.
+ * @param fds: The file descriptors of mipd, tells which upper layers are already connected.
+ * @param ifs_data: The interfaces of mipd.
+ * @return: 0 on success, -1 if the log could not be created.
+ */
+int record_start(const char *path, struct fds fds, struct ifs_data ifs_data) {
+    record_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (record_fd < 0) {
+        perror("open: record");
+        return -1;
+    }
+
+    struct record_file_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = RECORD_MAGIC;
+    header.version = RECORD_VERSION;
+    header.start_ms = snapshot_now_ms();
+    header.local_mip_addr = ifs_data.local_mip_addr;
+    header.ifn = (u_int8_t)ifs_data.ifn;
+    for (int i = 0; i < fds.num_accepted_usds; i++) {
+        if (fds.accepted_usds[i].type == MIP_SDU_TYPE_PING) {
+            header.ping_connected++;
+        } else if (fds.accepted_usds[i].type == MIP_SDU_TYPE_ROUTING) {
+            header.routing_connected++;
+        }
+    }
+    memcpy(header.addr, ifs_data.addr, sizeof(header.addr));
+    header.arp_cache = *arp_cache;
+    memcpy(header.backup_next_hops, backup_next_hops, sizeof(backup_next_hops));
+
+    static u_int8_t arp_next_hops[RECORD_MAX_QUEUED];
+    static struct mip_pdu arp_pdus[RECORD_MAX_QUEUED];
+    static struct mip_pdu route_pdus[RECORD_MAX_QUEUED];
+    int num_arp = arp_queue_copy(arp_next_hops, arp_pdus, RECORD_MAX_QUEUED);
+    int num_route = route_queue_copy(route_pdus, RECORD_MAX_QUEUED - num_arp);
+    header.num_queued = num_arp + num_route;
+
+    memcpy(record_buffer, &header, sizeof(header));
+    record_buffered = sizeof(header);
+    for (int i = 0; i < num_arp + num_route; i++) {
+        if (record_buffered + sizeof(struct record_queued) > RECORD_BUFFER_SIZE && record_flush() < 0) {
+            return -1;
+        }
+        struct record_queued queued;
+        if (i < num_arp) {
+            queued.queue = RECORD_QUEUE_ARP;
+            queued.next_hop = arp_next_hops[i];
+            queued.pdu = arp_pdus[i];
+        } else {
+            queued.queue = RECORD_QUEUE_ROUTE;
+            queued.next_hop = 0;
+            queued.pdu = route_pdus[i - num_arp];
+        }
+        memcpy(record_buffer + record_buffered, &queued, sizeof(queued));
+        record_buffered += sizeof(queued);
+    }
+    record_last_us = record_now_us();
+    return 0;
+}
+
+/**
+ * Tells if mipd is recording.
+ *
+ * @return: 1 if it is, 0 otherwise.
+ */
+int record_active() {
+    return record_fd >= 0;
+}
+
+/**
+ * Records a frame received on the raw socket, before it is handled.
+ *
+ * @param msghdr: The frame, as given to handle_frame().
+ */
+void record_frame(struct msghdr const *msghdr) {
+    if (record_fd < 0) {
+        return;
+    }
+    size_t pdu_len = msghdr->msg_iov[1].iov_len < sizeof(struct mip_pdu) ? msghdr->msg_iov[1].iov_len
+                                                                         : sizeof(struct mip_pdu);
+    void const *parts[] = {msghdr->msg_name, msghdr->msg_iov[0].iov_base, msghdr->msg_iov[1].iov_base};
+    size_t lens[] = {sizeof(struct sockaddr_ll), sizeof(struct ether_frame), pdu_len};
+    record_event(RECORD_FRAME, 0, parts, lens, 3);
+}
+
+/**
+ * Records a message from an upper layer, before it is handled.
+ *
+ * @param type: The SDU type of the upper layer.
+ * @param buf: The message, as given to handle_upper_message().
+ */
+void record_upper(u_int8_t type, char const *buf) {
+    if (record_fd < 0) {
+        return;
+    }
+    message_header const *header = (message_header const *)buf;
+    int response = type == MIP_SDU_TYPE_ROUTING && header->id1 == 0x52 && header->id2 == 0x53 && header->id3 == 0x50;
+    void const *parts[] = {buf};
+    size_t lens[] = {sizeof(struct unix_message)};
+    record_event(response ? RECORD_RESPONSE : RECORD_UPPER, type, parts, lens, 1);
+}
+
+/**
+ * Records an upper layer connecting, or its socket being closed.
+ *
+ * @param kind: RECORD_CONNECT or RECORD_CLOSE.
+ * @param type: The SDU type of the upper layer.
+ */
+void record_connection(u_int8_t kind, u_int8_t type) {
+    record_event(kind, type, NULL, NULL, 0);
+}
+
+/**
+ * Records a tick of the ARP timer, before it is handled.
+ */
+void record_timer() {
+    record_event(RECORD_TIMER, 0, NULL, NULL, 0);
+}
+
+/**
+ * Writes the events that are still buffered and closes the log.
+ */
+void record_stop() {
+    if (record_fd < 0) {
+        return;
+    }
+    record_flush();
+    if (record_fd >= 0) {
+        close(record_fd);
+        record_fd = -1;
+    }
+}
+
+/**
+ * Prints the number of events recorded so far.
+ */
+void print_record_stats() {
+    printf("Recording: frames=%lu upper=%lu responses=%lu connects=%lu closes=%lu timers=%lu bytes=%lu%s\n",
+           record_events[RECORD_FRAME], record_events[RECORD_UPPER], record_events[RECORD_RESPONSE],
+           record_events[RECORD_CONNECT], record_events[RECORD_CLOSE], record_events[RECORD_TIMER],
+           record_bytes + record_buffered,
+           record_fd < 0 ? " (stopped)" : "");
+    fflush(stdout);
+}
+
+/**
+ * Maps a log into memory and checks its header.
+ *
+ * @param path: Pathname of the log.
+ * @param size: Set to the size of the log.
+ * @return: The mapped log, starting with its struct record_file_header, or NULL on failure.
+ */
+void *record_map(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open: record");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct record_file_header)) {
+        fprintf(stderr, "%s is not a mipd recording\n", path);
+        close(fd);
+        return NULL;
+    }
+    void *log = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (log == MAP_FAILED) {
+        perror("mmap: record");
+        return NULL;
+    }
+
+    struct record_file_header const *header = log;
+    if (header->magic != RECORD_MAGIC || header->version != RECORD_VERSION || header->ifn > MAX_IFS
+        || header->num_queued > RECORD_MAX_QUEUED || record_first_event(log) > (size_t)st.st_size) {
+        fprintf(stderr, "%s is not a mipd recording of version %d\n", path, RECORD_VERSION);
+        munmap(log, (size_t)st.st_size);
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    return log;
+}
+
+/**
+ * Returns the offset of the first event of a mapped log, after the header and the queued packets.
+ *
+ * @param log: The mapped log.
+ * @return: The offset.
+ */
+size_t record_first_event(void const *log) {
+    struct record_file_header const *header = log;
+    return sizeof(struct record_file_header) + (size_t)header->num_queued * sizeof(struct record_queued);
+}
+
+/**
+ * Reads the next event of a mapped log.
+ *
+ * @param log: The mapped log.
+ * @param size: The size of the log.
+ * @param offset: Offset of the event to read, the first one is at record_first_event(). Moved to the next event.
+ * @param event: Set to the header of the event.
+ * @param payload: Set to the payload of the event, padded with zeroes to RECORD_MAX_PAYLOAD bytes.
+ * @return: 1 if an event was read, 0 at the end of the log, -1 if the event is cut short or malformed.
+ */
+int record_next(u_int8_t const *log, size_t size, size_t *offset, struct record_event *event, u_int8_t *payload) {
+    if (*offset == size) {
+        return 0;
+    }
+    if (*offset + sizeof(*event) > size) {
+        return -1;
+    }
+    memcpy(event, log + *offset, sizeof(*event));
+    if (event->kind == 0 || event->kind >= RECORD_KINDS || event->len > RECORD_MAX_PAYLOAD
+        || *offset + sizeof(*event) + event->len > size) {
+        return -1;
+    }
+    memcpy(payload, log + *offset + sizeof(*event), event->len);
+    memset(payload + event->len, 0, RECORD_MAX_PAYLOAD - event->len);
+    *offset += sizeof(*event) + event->len;
+    return 1;
+}
@@ -0,0 +1,91 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "../mipd_common.h"
+#include "../upper/upper.h"
+#include "../lower/arp/cache.h"
+
+#define RECORD_MAGIC 0x5250494D     // "MIPR" in a little-endian file.
+#define RECORD_VERSION 2            // Bumped when the layout of the log changes.
+#define RECORD_BUFFER_SIZE (1 << 20) // Bytes of events gathered before they are written to the log.
+#define RECORD_MAX_QUEUED 4096      // Maximum number of queued packets recorded with the header.
+#define RECORD_QUEUE_ARP 1          // The packet waits in the ARP queue.
+#define RECORD_QUEUE_ROUTE 2        // The packet waits in the route queue.
+
+#define RECORD_FRAME 1              // A frame received on the raw socket.
+#define RECORD_UPPER 2              // A message from an upper layer, other than a routing response.
+#define RECORD_RESPONSE 3           // A routing response from the routing daemon.
+#define RECORD_CONNECT 4            // An upper layer connected, type is its SDU type.
+#define RECORD_CLOSE 5              // The socket of an upper layer was closed, type is its SDU type.
+#define RECORD_TIMER 6              // A tick of the ARP timer.
+#define RECORD_KINDS 7
+
+// Longest payload of an event: the sockaddr_ll, ethernet header and MIP packet of a frame.
+#define RECORD_MAX_PAYLOAD (sizeof(struct sockaddr_ll) + sizeof(struct ether_frame) + sizeof(struct mip_pdu))
+
+/**
+ * Header at the start of a log. Holds what mipd knew about itself when the recording started, which the replay
+ * needs to handle the events the same way. That includes the state mipd may start with, from a snapshot or a
+ * handoff: the ARP cache, the backup next hops and the packets in the queues, which follow the header.
+ */
+struct record_file_header {
+    u_int32_t magic;                    // RECORD_MAGIC
+    u_int32_t version;                  // RECORD_VERSION
+    u_int64_t start_ms;                 // Wall clock time the recording started.
+    u_int8_t local_mip_addr;            // The MIP address of mipd.
+    u_int8_t ifn;                       // Number of interfaces.
+    u_int8_t ping_connected;            // Number of ping applications connected when the recording started.
+    u_int8_t routing_connected;         // Number of routing daemons connected when the recording started.
+    struct sockaddr_ll addr[MAX_IFS];   // The interfaces.
+    u_int32_t num_queued;               // Number of queued packets that follow the header.
+    struct arp_cache arp_cache;         // The ARP cache.
+    u_int8_t backup_next_hops[256];     // The backup next hop of each destination.
+};
+
+/**
+ * A packet waiting in one of the queues when the recording started, stored after the header.
+ */
+struct record_queued {
+    u_int8_t queue;                     // RECORD_QUEUE_ARP or RECORD_QUEUE_ROUTE.
+    u_int8_t next_hop;                  // The next hop the packet waits for, for the ARP queue.
+    struct mip_pdu pdu;                 // The packet.
+} __attribute__((packed));
+
+/**
+ * Header of every event in a log, followed by len bytes of payload. Payloads are stored without their trailing
+ * zero bytes, and are padded with zeroes again when read. Most SDUs are far shorter than the 511 bytes mipd
+ * passes around, so this keeps the log small without a compressor on the receive path.
+ */
+struct record_event {
+    u_int32_t delta_us;                 // Time since the previous event, or since the start for the first one.
+    u_int8_t kind;                      // RECORD_FRAME, RECORD_UPPER, RECORD_RESPONSE, RECORD_CONNECT, RECORD_CLOSE or RECORD_TIMER.
+    u_int8_t type;                      // SDU type of the upper layer, 0 for frames.
+    u_int16_t len;                      // Bytes of payload that follow.
+} __attribute__((packed));
+
+int record_start(const char *path, struct fds fds, struct ifs_data ifs_data);
+
+int record_active();
+
+void record_frame(struct msghdr const *msghdr);
+
+void record_upper(u_int8_t type, char const *buf);
+
+void record_connection(u_int8_t kind, u_int8_t type);
+
+void record_timer();
+
+void record_stop();
+
+void print_record_stats();
+
+void *record_map(const char *path, size_t *size);
+
+size_t record_first_event(void const *log);
+
+int record_next(u_int8_t const *log, size_t size, size_t *offset, struct record_event *event, u_int8_t *payload);
+
+#endif //RECORD_H
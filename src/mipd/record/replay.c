@@ -0,0 +1,355 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include "record.h"
+#include "../mipd_common.h"
+#include "../lower/lower.h"
+#include "../lower/arp/cache.h"
+#include "../lower/mip/queues/arp_queue.h"
+#include "../lower/mip/queues/route_queue.h"
+#include "../lower/nexthop/nexthop.h"
+#include "../upper/upper.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL    // Offset basis of 64-bit FNV-1a.
+#define FNV_PRIME 0x100000001b3ULL          // Prime of 64-bit FNV-1a.
+
+/**
+ * The statistics of a replay.
+ */
+struct replay_stats {
+    unsigned long events[RECORD_KINDS];     // Events replayed, by kind.
+    unsigned long frames_out;               // Frames mipd sent.
+    unsigned long bytes_out;                // Bytes of the frames mipd sent.
+    unsigned long upper_out;                // Messages mipd sent to the upper layers.
+    u_int64_t digest;                       // FNV-1a hash of everything mipd sent, in order.
+    u_int64_t max_late_us;                  // Longest an event was handled after its time, when pacing.
+};
+
+static struct replay_stats stats;
+static int sinks[2][2] = {{-1, -1}, {-1, -1}}; // Socket pairs standing in for the ping and routing applications.
+static int connected[2] = {0, 0};               // Number of ping and routing applications connected.
+
+/**
+ * Prints the help message
+ * @param argv: The command line arguments
+ * @return void
+ */
+void print_help(char *argv[]) {
+    printf("Usage: %s [-h] [-d] [-p] [-j] <log>\n", argv[0]);
+    printf("  -h\t\tPrints this help message\n");
+    printf("  -d\t\tRuns mipd in debug mode\n");
+    printf("  -p\t\tReplays at the pace the events were recorded at, instead of as fast as possible\n");
+    printf("  -j\t\tPrints the report as JSON\n");
+    printf("  <log>\t\tLog recorded by mipd -r\n");
+}
+
+/**
+ * Prints a basic usage message and exits the program.
+ * @param argv The command line arguments
+ * @return void
+ */
+void usage_and_exit(char *argv[]) {
+    printf("Usage: %s [-h] [-d] [-p] [-j] <log>\n", argv[0]);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Returns the time of CLOCK_MONOTONIC in microseconds.
+ */
+static u_int64_t replay_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Adds bytes to the digest of everything mipd sent.
+ */
+static void digest(void const *data, size_t len) {
+    u_int8_t const *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        stats.digest = (stats.digest ^ bytes[i]) * FNV_PRIME;
+    }
+}
+
+/**
+ * Stands in for the raw socket. Set as packet_transmit_hook, so every frame mipd sends ends up here instead of on
+ * the network, and is counted and added to the digest.
+ *
+ * @param rsd: Unused, there is no raw socket.
+ * @param msghdr: The frame.
+ * @return: The length of the frame, as if it had been sent.
+ */
+static long replay_transmit(int rsd, struct msghdr const *msghdr) {
+    (void)rsd;
+    long len = 0;
+    for (size_t i = 0; i < msghdr->msg_iovlen; i++) {
+        digest(msghdr->msg_iov[i].iov_base, msghdr->msg_iov[i].iov_len);
+        len += (long)msghdr->msg_iov[i].iov_len;
+    }
+    stats.frames_out++;
+    stats.bytes_out += (unsigned long)len;
+    return len;
+}
+
+/**
+ * Reads what mipd sent to the stand-ins for the upper layers since the last call, and adds it to the digest.
+ */
+static void drain_sinks() {
+    char buf[1024];
+    for (int i = 0; i < 2; i++) {
+        long rc;
+        while ((rc = recv(sinks[i][1], buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+            digest(buf, (size_t)rc);
+            stats.upper_out++;
+        }
+    }
+}
+
+/**
+ * Connects or disconnects the stand-in for an upper layer, as the recorded application did. mipd delivers to the
+ * stand-in while at least one application of that type is connected.
+ *
+ * @param fds: The file descriptors of mipd.
+ * @param type: SDU type of the application.
+ * @param change: 1 if it connected, -1 if its socket was closed.
+ */
+static void replay_connection(struct fds *fds, u_int8_t type, int change) {
+    int i = type == MIP_SDU_TYPE_PING ? 0 : 1;
+    connected[i] += change;
+    if (connected[i] < 0) {
+        connected[i] = 0;
+    }
+    int usd = connected[i] > 0 ? sinks[i][0] : -1;
+    if (type == MIP_SDU_TYPE_PING) {
+        fds->ping_usd = usd;
+    } else if (type == MIP_SDU_TYPE_ROUTING) {
+        fds->routing_usd = usd;
+    }
+}
+
+/**
+ * Handles one recorded event with the functions mipd handles it with.
+ *
+ * @param fds: The file descriptors of mipd.
+ * @param ifs_data: The interfaces of mipd, from the header of the log.
+ * @param event: The event.
+ * @param payload: Its payload, padded with zeroes.
+ */
+static void replay_event(struct fds *fds, struct ifs_data ifs_data, struct record_event const *event,
+                         u_int8_t *payload) {
+    switch (event->kind) {
+        case RECORD_FRAME: {
+            struct iovec msgvec[2];
+            msgvec[0].iov_base = payload + sizeof(struct sockaddr_ll);
+            msgvec[0].iov_len = sizeof(struct ether_frame);
+            msgvec[1].iov_base = payload + sizeof(struct sockaddr_ll) + sizeof(struct ether_frame);
+            msgvec[1].iov_len = sizeof(struct mip_pdu);
+            struct msghdr msghdr;
+            memset(&msghdr, 0, sizeof(struct msghdr));
+            msghdr.msg_name = payload;
+            msghdr.msg_namelen = sizeof(struct sockaddr_ll);
+            msghdr.msg_iov = msgvec;
+            msghdr.msg_iovlen = 2;
+            handle_frame(*fds, ifs_data, &msghdr);
+            break;
+        }
+        case RECORD_UPPER:
+        case RECORD_RESPONSE:
+            handle_upper_message(*fds, ifs_data, event->type, (char *)payload);
+            break;
+        case RECORD_CONNECT:
+            replay_connection(fds, event->type, 1);
+            break;
+        case RECORD_CLOSE:
+            replay_connection(fds, event->type, -1);
+            break;
+        case RECORD_TIMER:
+            nexthop_arp_tick(*fds, ifs_data);
+            break;
+    }
+    drain_sinks();
+}
+
+/**
+ * Prints the report of a replay, as text or as one line of JSON.
+ */
+static void print_report(struct record_file_header const *header, double seconds, double recorded_s, int paced,
+                         int json) {
+    unsigned long total = 0;
+    for (int i = 1; i < RECORD_KINDS; i++) {
+        total += stats.events[i];
+    }
+    double rate = seconds > 0 ? total / seconds : 0;
+    double ns_per_event = total > 0 ? seconds * 1e9 / total : 0;
+
+    if (json) {
+        printf("{\"mip_addr\": %d, \"paced\": %s, \"events\": %lu, \"frames\": %lu, \"upper\": %lu, "
+               "\"responses\": %lu, \"connects\": %lu, \"closes\": %lu, \"timers\": %lu, \"frames_out\": %lu, "
+               "\"bytes_out\": %lu, \"upper_out\": %lu, \"digest\": \"%016llx\", \"recorded_seconds\": %.3f, \"seconds\": %.6f, "
+               "\"events_per_second\": %.0f, \"ns_per_event\": %.1f, \"max_late_us\": %lu}\n",
+               header->local_mip_addr, paced ? "true" : "false", total, stats.events[RECORD_FRAME],
+               stats.events[RECORD_UPPER], stats.events[RECORD_RESPONSE], stats.events[RECORD_CONNECT],
+               stats.events[RECORD_CLOSE], stats.events[RECORD_TIMER], stats.frames_out, stats.bytes_out,
+               stats.upper_out,
+               (unsigned long long)stats.digest, recorded_s, seconds, rate, ns_per_event,
+               (unsigned long)stats.max_late_us);
+        return;
+    }
+
+    printf("Replayed %lu events recorded by mipd %d over %.3f s: frames=%lu upper=%lu responses=%lu "
+           "connects=%lu closes=%lu timers=%lu\n", total, header->local_mip_addr, recorded_s,
+           stats.events[RECORD_FRAME], stats.events[RECORD_UPPER], stats.events[RECORD_RESPONSE], stats.events[RECORD_CONNECT],
+           stats.events[RECORD_CLOSE], stats.events[RECORD_TIMER]);
+    printf("mipd sent %lu frames (%lu bytes) and %lu upper layer messages, digest %016llx\n",
+           stats.frames_out, stats.bytes_out, stats.upper_out, (unsigned long long)stats.digest);
+    printf("Took %.6f s, %.0f events/s, %.1f ns per event", seconds, rate, ns_per_event);
+    if (paced) {
+        printf(", at most %lu us late", (unsigned long)stats.max_late_us);
+    }
+    printf("\n");
+}
+
+/**
+ * Main function of the replay harness.
+ *
+ * Feeds a log recorded with mipd -r back through handle_frame() and handle_upper_message(), the functions mipd
+ * handles its input with, and the ticks of the ARP timer through nexthop_arp_tick(), in the order they were
+ * recorded. The network is stubbed out: frames mipd sends go to packet_transmit_hook, and messages to the upper
+ * layers go to socket pairs that are drained after every event. The routing responses in the log release the
+ * packets that wait for them, as they did when recorded. Everything mipd sends is hashed into a digest, so two
+ * builds can be checked to handle the same traffic the same way.
+ *
+ * The whole log is mapped before the replay starts, so the time reported is that of handling the events.
+ *
+ * @param argc: Integer, number of arguments passed to the program from the terminal.
+ * @param argv: Array of strings representing the arguments passed to the program.
+ *
+ * @return: Integer representing the exit status of the program. 0 indicating normal termination,
+ * and exits with EXIT_FAILURE status on invalid options or a log that cannot be read.
+ */
+int main(int argc, char *argv[]) {
+    int opt;
+    int hflag = 0;      // Stores if the help-flag is given.
+    int paced = 0;      // Replays at the recorded pace.
+    int json = 0;       // Prints the report as JSON.
+
+    while ((opt = getopt(argc, argv, "hdpj")) != -1) {
+        switch (opt) {
+            case 'h':
+                // Help flag given
+                hflag = 1;
+                break;
+            case 'd':
+                debug_flag = 1;
+                break;
+            case 'p':
+                paced = 1;
+                break;
+            case 'j':
+                json = 1;
+                break;
+            default:
+                usage_and_exit(argv);
+        }
+    }
+
+    // Check if the help flag was given, if so print help message and exit
+    if (hflag) {
+        print_help(argv);
+        exit(EXIT_SUCCESS);
+    }
+    if (argc - optind != 1) {
+        usage_and_exit(argv);
+    }
+
+    size_t size;
+    u_int8_t *log = record_map(argv[optind], &size);
+    if (log == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    struct record_file_header const *header = (struct record_file_header const *)log;
+
+    // Set mipd up as it was when the recording started
+    arp_cache_init();
+    init_arp_queue();
+    init_route_queue();
+
+    struct ifs_data ifs_data;
+    memset(&ifs_data, 0, sizeof(ifs_data));
+    memcpy(ifs_data.addr, header->addr, sizeof(ifs_data.addr));
+    ifs_data.ifn = header->ifn;
+    ifs_data.local_mip_addr = header->local_mip_addr;
+    *arp_cache = header->arp_cache;
+    memcpy(backup_next_hops, header->backup_next_hops, sizeof(backup_next_hops));
+    struct record_queued const *queued = (struct record_queued const *)(log + sizeof(struct record_file_header));
+    for (u_int32_t i = 0; i < header->num_queued; i++) {
+        if (queued[i].queue == RECORD_QUEUE_ARP) {
+            arp_enqueue_mip_pdu(&queued[i].pdu, queued[i].next_hop);
+        } else {
+            route_enqueue(queued[i].pdu);
+        }
+    }
+
+    struct fds fds;
+    memset(&fds, 0, sizeof(fds));
+    fds.rsd = -1;
+    fds.usd = -1;
+    fds.num_accepted_usds = 0;
+    fds.ping_usd = -1;
+    fds.routing_usd = -1;
+    for (int i = 0; i < 2; i++) {
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sinks[i]) < 0) {
+            perror("socketpair");
+            exit(EXIT_FAILURE);
+        }
+        // Never block mipd on a full stand-in, they are drained after every event
+        fcntl(sinks[i][0], F_SETFL, O_NONBLOCK);
+    }
+    for (int i = 0; i < header->ping_connected; i++) {
+        replay_connection(&fds, MIP_SDU_TYPE_PING, 1);
+    }
+    for (int i = 0; i < header->routing_connected; i++) {
+        replay_connection(&fds, MIP_SDU_TYPE_ROUTING, 1);
+    }
+    packet_transmit_hook = replay_transmit;
+
+    memset(&stats, 0, sizeof(stats));
+    stats.digest = FNV_OFFSET;
+    static u_int8_t payload[RECORD_MAX_PAYLOAD];
+    struct record_event event;
+    size_t offset = record_first_event(log);
+    u_int64_t recorded_us = 0;
+    u_int64_t start = replay_now_us();
+    int rc;
+
+    while ((rc = record_next(log, size, &offset, &event, payload)) == 1) {
+        recorded_us += event.delta_us;
+        if (paced) {
+            u_int64_t now = replay_now_us();
+            if (now < start + recorded_us) {
+                u_int64_t wait = start + recorded_us - now;
+                struct timespec ts = {(time_t)(wait / 1000000), (long)(wait % 1000000) * 1000};
+                while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+            } else if (now - (start + recorded_us) > stats.max_late_us) {
+                stats.max_late_us = now - (start + recorded_us);
+            }
+        }
+        replay_event(&fds, ifs_data, &event, payload);
+        stats.events[event.kind]++;
+    }
+    double seconds = (double)(replay_now_us() - start) / 1e6;
+
+    if (rc < 0) {
+        fprintf(stderr, "The log is cut short at byte %zu, replayed the events before it\n", offset);
+    }
+    print_report(header, seconds, (double)recorded_us / 1e6, paced, json);
+    munmap(log, size);
+    return 0;
+}
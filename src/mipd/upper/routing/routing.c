@@ -1,7 +1,26 @@
+#include <string.h>
 #include <sys/socket.h>
 #include "routing.h"
 #include "../../mipd_common.h"
 
+routingd_transport routingd_transport_hook = NULL; // Set to deliver messages without the unix socket, NULL otherwise.
+
+/**
+ * Sends a message to routingd, on its unix socket or through routingd_transport_hook if it is set.
+ *
+ * @param usd: The Unix Socket Descriptor of routingd.
+ * @param message: The message to send.
+ * @param len: The length of the message.
+ *
+ * @return: The number of bytes sent, or -1 on failure.
+ */
+static long send_to_routingd(int usd, void const *message, size_t len) {
+    if (routingd_transport_hook != NULL) {
+        return routingd_transport_hook(message, len);
+    }
+    return send(usd, message, len, 0);
+}
+
 /**
  * Forwarding a routing message to routingd.
  *
@@ -10,11 +29,17 @@
  *
  * @param mip_pdu: An instance of a  MIP PDU that needs to be forwarded to the routing daemon.
  *
- * @return: This function doesn't return any value. Errors during the message sending are assumed to be handled by the 'send_usd_message' function.
+ * @return: This function doesn't return any value. Errors during the message sending are only logged.
  */
 void forward_routing_message(struct fds fds, struct mip_pdu mip_pdu) {
     global_debug("Forwarding routing message to routingd \n");
-    send_usd_message(fds.routing_usd, mip_pdu);
+    struct unix_message unix_message;
+    unix_message.mip_addr = mip_pdu.src_addr;
+    unix_message.ttl = mip_pdu.ttl;
+    memcpy(unix_message.sdu, mip_pdu.sdu, sizeof(unix_message.sdu));
+    if (send_to_routingd(fds.routing_usd, &unix_message, sizeof(unix_message)) < 0) {
+        global_debug("Error sending message to routingd");
+    }
 }
 
 /**
@@ -36,10 +61,39 @@ int send_routing_request(int usd, struct ifs_data ifs_data, u_int8_t dest_addr)
     request.header.id3 = 0x51; // Q
     request.mip_look_up = dest_addr; // The MIP address we want to find a route to
 
-    long rc = send(usd, &request, sizeof(request_message), 0);
+    long rc = send_to_routingd(usd, &request, sizeof(request_message));
     if (rc < 0) {
         global_debug("send");
         return -1;
     }
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * Tells routingd that the data plane considers a next hop to be down.
+ *
+ * @param usd: The Unix Socket Descriptor used for sending the message.
+ * @param ifs_data: Contains information about network interfaces, includes the local MIP address that is used in the header of the message.
+ * @param next_hop: The MIP address of the next hop that is down.
+ * @param reason: Why the next hop is considered down, one of NEXTHOP_DOWN_*.
+ *
+ * @return: 0 if the message is sent successfully; -1 if an error occurs during the send operation.
+ */
+int send_nexthop_down(int usd, struct ifs_data ifs_data, u_int8_t next_hop, u_int8_t reason) {
+    global_debug("Telling routingd that next hop %d is down\n", next_hop);
+    nexthop_down_message message;
+    message.header.mip_addr = ifs_data.local_mip_addr;
+    message.header.ttl = 0;
+    message.header.id1 = 0x4E; // N
+    message.header.id2 = 0x48; // H
+    message.header.id3 = 0x44; // D
+    message.next_hop_mip = next_hop;
+    message.reason = reason;
+
+    long rc = send_to_routingd(usd, &message, sizeof(nexthop_down_message));
+    if (rc < 0) {
+        global_debug("send");
+        return -1;
+    }
+    return 0;
+}
@@ -5,8 +5,18 @@
 #include "../../mipd_common.h"
 #include "../upper.h"
 
+/**
+ * Delivers a message from mipd to routingd. Used instead of the unix socket when the routing engine runs
+ * inside mipd.
+ */
+typedef long (*routingd_transport)(void const *message, size_t len);
+
+extern routingd_transport routingd_transport_hook; // Set to deliver messages without the unix socket, NULL otherwise.
+
 void forward_routing_message(struct fds fds, struct mip_pdu mip_pdu);
 
 int send_routing_request(int usd, struct ifs_data ifs_data, u_int8_t dest_addr);
 
+int send_nexthop_down(int usd, struct ifs_data ifs_data, u_int8_t next_hop, u_int8_t reason);
+
 #endif //ROUTING_H
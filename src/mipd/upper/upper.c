@@ -1,7 +1,9 @@
 #include <string.h>
+#include <unistd.h>
 #include <sys/socket.h>
 #include "upper.h"
 #include "../mipd_common.h"
+#include "../record/record.h"
 
 /**
  * Handles a client request on a Unix Socket Descriptor (USD).
@@ -56,9 +58,42 @@ int handle_usd_request(struct fds *fds) {
     }
     fds->accepted_usds[fds->num_accepted_usds] = identified_usd;
     fds->num_accepted_usds++;
+    record_connection(RECORD_CONNECT, identified_usd.type);
     return accept_usd;
 }
 
+/**
+ * Closes an accepted Unix Socket Descriptor and removes it from fds.
+ *
+ * If it was the socket that ping or routing messages are delivered to, they are delivered to the most recently
+ * accepted remaining socket of the same type instead, so a ping server keeps receiving requests after a
+ * ping client on the same node has exited.
+ *
+ * @param fds: A struct containing file descriptors.
+ * @param index: The index of the socket in fds->accepted_usds.
+ */
+void close_accepted_usd(struct fds *fds, int index) {
+    int usd = fds->accepted_usds[index].usd;
+    close(usd);
+    record_connection(RECORD_CLOSE, fds->accepted_usds[index].type);
+    // Remove usd from accepted_usds
+    for (int k = index; k < fds->num_accepted_usds - 1; k++) {
+        fds->accepted_usds[k] = fds->accepted_usds[k + 1];
+    }
+    fds->num_accepted_usds--;
+
+    if (fds->ping_usd == usd || fds->routing_usd == usd) {
+        int *bound = fds->ping_usd == usd ? &fds->ping_usd : &fds->routing_usd;
+        u_int8_t type = fds->ping_usd == usd ? MIP_SDU_TYPE_PING : MIP_SDU_TYPE_ROUTING;
+        *bound = -1;
+        for (int k = 0; k < fds->num_accepted_usds; k++) {
+            if (fds->accepted_usds[k].type == type) {
+                *bound = fds->accepted_usds[k].usd;
+            }
+        }
+    }
+}
+
 /**
  * Handles an event on an already accepted Unix Socket Descriptor.
  *
@@ -70,10 +105,10 @@ int handle_usd_request(struct fds *fds) {
  * Only when an EOF (End of File) is received, it returns -2 to signal a closed connection.
  */
 int handle_usd_event(struct fds fds, struct ifs_data ifs_data, struct accepted_usd accepted_usd) {
-    // Receive the unix message and send it to the correct handler
+    // Receive the unix message and send it to the correct handler. The message may already have been handled,
+    // by the AF_XDP backend reading the routing responses between frames, so do not wait for one.
     char buf[1024];
-    struct unix_message *unix_message;
-    long rc = recv(accepted_usd.usd, buf, sizeof(buf), 0);
+    long rc = recv(accepted_usd.usd, buf, sizeof(buf), MSG_DONTWAIT);
     if (rc < 0) {
         global_debug("recv");
         return 0;
@@ -82,7 +117,28 @@ int handle_usd_event(struct fds fds, struct ifs_data ifs_data, struct accepted_u
         return -2;
     }
 
-    if (accepted_usd.type == MIP_SDU_TYPE_ROUTING) {
+    return handle_upper_message(fds, ifs_data, accepted_usd.type, buf);
+}
+
+/**
+ * Handles a message from an upper layer.
+ *
+ * Routing responses are handed to the forwarding code, everything else is sent as a MIP packet with the SDU type
+ * of the upper layer. Used for messages received on an accepted unix socket, and for messages from the routing
+ * engine when it runs inside mipd.
+ *
+ * @param fds: A struct containing file descriptors.
+ * @param ifs_data: A struct containing information about network interfaces.
+ * @param type: The SDU type of the upper layer that sent the message.
+ * @param buf: The message, at least sizeof(struct unix_message) bytes.
+ *
+ * @return: Always returns 0, errors are handled internally.
+ */
+int handle_upper_message(struct fds fds, struct ifs_data ifs_data, u_int8_t type, char *buf) {
+    struct unix_message *unix_message;
+    record_upper(type, buf);
+
+    if (type == MIP_SDU_TYPE_ROUTING) {
         //global_debug("Received routing message");
         // Check for response routing message
         general_message *general_message = (struct general_message *)buf;
@@ -115,7 +171,7 @@ int handle_usd_event(struct fds fds, struct ifs_data ifs_data, struct accepted_u
 
     // Create the MIP PDU
     struct mip_pdu mip_pdu;
-    mip_pdu.sdu_type = accepted_usd.type;
+    mip_pdu.sdu_type = type;
     mip_pdu.sdu_len = sizeof(unix_message->sdu);
     mip_pdu.src_addr = ifs_data.local_mip_addr;
     mip_pdu.dest_addr = unix_message->mip_addr;
@@ -139,6 +195,10 @@ int handle_usd_event(struct fds fds, struct ifs_data ifs_data, struct accepted_u
  * @param mip_pdu: The MIP_PDU to be sent, contains the ping message.
  */
 void send_ping_message(struct fds fds,  struct mip_pdu mip_pdu) {
+    if (fds.ping_usd < 0) {
+        global_debug("No ping application connected, dropping ping message");
+        return;
+    }
     send_usd_message(fds.ping_usd, mip_pdu);
 }
 
@@ -13,8 +13,12 @@ struct unix_message {
 
 int handle_usd_request(struct fds *fds);
 
+void close_accepted_usd(struct fds *fds, int index);
+
 int handle_usd_event(struct fds fds, struct ifs_data ifs_data, struct accepted_usd accepted_usd);
 
+int handle_upper_message(struct fds fds, struct ifs_data ifs_data, u_int8_t type, char *buf);
+
 void send_ping_message(struct fds fds, struct mip_pdu mip_pdu);
 
 int send_usd_message(int usd, struct mip_pdu mip_pdu);
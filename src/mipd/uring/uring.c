@@ -0,0 +1,684 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+#include "../lower/lower.h"
+#include "../lower/mip/mip.h"
+#include "../upper/upper.h"
+
+/*
+ * An event loop backend on io_uring, used instead of epoll with -U.
+ *
+ * The raw socket and the accepted unix sockets are read with multishot receives into a ring of buffers shared with
+ * the kernel, so a stream of packets needs no syscall per packet. Frames sent on the raw socket are queued as
+ * submissions and handed to the kernel together with the wait for the next completions, in one io_uring_enter().
+ * The listening unix socket and the other file descriptors are watched with polls, and reported to the main loop
+ * as epoll events so it can handle them like before.
+ */
+
+#define URING_KIND_RSD      1   // Multishot receive on the raw socket.
+#define URING_KIND_USD      2   // Multishot receive on an accepted unix socket.
+#define URING_KIND_POLL     3   // Poll on another file descriptor.
+#define URING_KIND_TX       4   // A frame sent on the raw socket.
+#define URING_KIND_CANCEL   5   // Cancellation of all requests.
+#define URING_KIND_PROBE    6   // The no-op that ends the probe of multishot receives.
+#define URING_BUFFER_GROUP  0   // The buffer group of the receive buffers.
+
+/**
+ * A file descriptor watched by the ring.
+ */
+struct uring_watch {
+    int fd;             // The file descriptor, -1 if the slot is unused.
+    u_int8_t kind;      // URING_KIND_RSD, URING_KIND_USD or URING_KIND_POLL.
+    u_int8_t armed;     // If its request is in the kernel.
+    u_int8_t failed;    // If the kernel refused its request with EINVAL. It is not armed again.
+};
+
+/**
+ * A frame waiting to be sent, kept until the kernel has completed the send.
+ */
+struct uring_tx_slot {
+    struct msghdr msghdr;
+    struct iovec iov;
+    struct sockaddr_ll addr;
+    u_int8_t frame[sizeof(struct ether_frame) + sizeof(struct mip_pdu)];
+};
+
+/**
+ * Statistics of the io_uring event loop.
+ */
+struct uring_stats {
+    unsigned long enters;           // Calls to io_uring_enter().
+    unsigned long submitted;        // Requests submitted.
+    unsigned long max_submitted;    // Most requests submitted by one call.
+    unsigned long completions;      // Completions handled.
+    unsigned long frames;           // Frames received on the raw socket.
+    unsigned long messages;         // Messages received on the unix sockets.
+    unsigned long tx_queued;        // Frames sent through the ring.
+    unsigned long tx_direct;        // Frames sent with sendmsg() because the ring was full.
+    unsigned long tx_errors;        // Frames the kernel failed to send.
+    unsigned long no_buffers;       // Receives stopped because all buffers were in use.
+};
+
+static int ring_fd = -1;                        // The io_uring file descriptor, -1 if not set up.
+static unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+static unsigned sq_entries;
+static unsigned sq_local_tail = 0;              // Tail including submissions not yet published to the kernel.
+static unsigned sq_submitted = 0;               // Tail up to which submissions have been handed to the kernel.
+static struct io_uring_sqe *sqes;
+static unsigned *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_cqe *cqes;
+static void *ring_mem = MAP_FAILED;             // The mapping of the submission and completion queues.
+static size_t ring_mem_size = 0;
+static void *sqe_mem = MAP_FAILED;              // The mapping of the submission queue entries.
+static size_t sqe_mem_size = 0;
+
+static struct io_uring_buf_ring *buf_ring = MAP_FAILED; // The ring of receive buffers shared with the kernel.
+static unsigned short buf_tail = 0;             // Tail of the buffer ring.
+static u_int8_t *buffers = NULL;                // Memory of the receive buffers.
+
+static struct uring_watch watches[URING_MAX_WATCHES];
+static struct uring_tx_slot tx_slots[URING_TX_SLOTS];
+static int tx_free[URING_TX_SLOTS];             // Stack of free transmit slots.
+static int tx_free_count = 0;
+static struct msghdr rsd_msghdr;                // Tells multishot recvmsg how much room to leave for the address.
+static struct fds *uring_fds;
+static struct ifs_data *uring_ifs_data;
+static int paused = 0;                          // If the multishot requests have been cancelled by uring_pause().
+static int multishot_failed = 0;                // If the kernel refused a multishot receive with EINVAL.
+static struct uring_stats stats;
+
+/**
+ * Returns the user data of a request of the given kind.
+ */
+static u_int64_t user_data(u_int32_t kind, u_int32_t value) {
+    return ((u_int64_t)kind << 32) | value;
+}
+
+/**
+ * Publishes the queued submissions and calls io_uring_enter().
+ *
+ * @param min_complete: Number of completions to wait for.
+ * @return: The return value of io_uring_enter().
+ */
+static int enter(unsigned min_complete) {
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = sq_local_tail - sq_submitted;
+    unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    stats.enters++;
+    int rc = (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+    if (rc > 0) {
+        sq_submitted += rc;
+        stats.submitted += rc;
+        if ((unsigned long)rc > stats.max_submitted) {
+            stats.max_submitted = rc;
+        }
+    }
+    return rc;
+}
+
+/**
+ * Returns a cleared submission queue entry, submitting the queued ones first if the queue is full.
+ *
+ * @return: The entry, or NULL if the queue is still full.
+ */
+static struct io_uring_sqe *get_sqe() {
+    if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+        enter(0);
+        if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+            return NULL;
+        }
+    }
+    unsigned index = sq_local_tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sq_array[index] = index;
+    sq_local_tail++;
+    return sqe;
+}
+
+/**
+ * Gives a receive buffer back to the kernel.
+ *
+ * @param bid: The buffer ID.
+ */
+static void return_buffer(unsigned short bid) {
+    struct io_uring_buf *buf = &buf_ring->bufs[buf_tail & (URING_BUFFERS - 1)];
+    buf->addr = (u_int64_t)(unsigned long)(buffers + (size_t)bid * URING_BUFFER_SIZE);
+    buf->len = URING_BUFFER_SIZE;
+    buf->bid = bid;
+    buf_tail++;
+    __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Submits the request of a watched file descriptor, a multishot receive or a poll.
+ *
+ * @param watch: The watched file descriptor.
+ * @return: 0 on success, -1 if the submission queue is full.
+ */
+static int arm(struct uring_watch *watch) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->fd = watch->fd;
+    sqe->user_data = user_data(watch->kind, watch->fd);
+    switch (watch->kind) {
+        case URING_KIND_RSD:
+            sqe->opcode = IORING_OP_RECVMSG;
+            sqe->addr = (u_int64_t)(unsigned long)&rsd_msghdr;
+            sqe->len = 1;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = URING_BUFFER_GROUP;
+            break;
+        case URING_KIND_USD:
+            sqe->opcode = IORING_OP_RECV;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = URING_BUFFER_GROUP;
+            break;
+        default:
+            // A single poll, armed again after the main loop has handled the event, reports readiness the same
+            // way as level-triggered epoll.
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->poll32_events = POLLIN;
+            break;
+    }
+    watch->armed = 1;
+    return 0;
+}
+
+/**
+ * Submits the requests of the watched file descriptors that are not in the kernel. Polls after they have
+ * reported an event, and multishot receives that the kernel has ended, for example because all buffers were in use.
+ */
+static void arm_all() {
+    if (paused) {
+        return;
+    }
+    for (int i = 0; i < URING_MAX_WATCHES; i++) {
+        if (watches[i].fd >= 0 && !watches[i].armed && !watches[i].failed && arm(&watches[i]) < 0) {
+            return;
+        }
+    }
+}
+
+/**
+ * Starts watching a file descriptor.
+ *
+ * @param fd: The file descriptor.
+ * @param kind: URING_KIND_RSD, URING_KIND_USD or URING_KIND_POLL.
+ * @return: 0 on success, -1 if too many file descriptors are watched.
+ */
+static int add_watch(int fd, u_int8_t kind) {
+    for (int i = 0; i < URING_MAX_WATCHES; i++) {
+        if (watches[i].fd < 0) {
+            watches[i].fd = fd;
+            watches[i].kind = kind;
+            watches[i].armed = 0;
+            watches[i].failed = 0;
+            if (!paused) {
+                arm(&watches[i]);
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Returns the watch of a file descriptor, or NULL if it is not watched.
+ */
+static struct uring_watch *find_watch(int fd, u_int8_t kind) {
+    for (int i = 0; i < URING_MAX_WATCHES; i++) {
+        if (watches[i].fd == fd && watches[i].kind == kind) {
+            return &watches[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Queues a frame to be sent on the raw socket. Used as packet_transmit_hook.
+ * The frame is copied, and sent with the next call to io_uring_enter(). If no slot or submission queue entry
+ * is free, or the event loop is paused for a handoff, it is sent right away with sendmsg().
+ *
+ * @param rsd: Raw socket descriptor used for sending the frame.
+ * @param msghdr: The frame, with the sockaddr_ll of the interface as msg_name.
+ * @return: The number of bytes queued or sent, or -1 on failure.
+ */
+static long uring_transmit(int rsd, struct msghdr const *msghdr) {
+    size_t len = 0;
+    for (size_t i = 0; i < msghdr->msg_iovlen; i++) {
+        len += msghdr->msg_iov[i].iov_len;
+    }
+    if (paused || tx_free_count == 0 || len > sizeof(tx_slots[0].frame)) {
+        stats.tx_direct++;
+        return sendmsg(rsd, msghdr, 0);
+    }
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == NULL) {
+        stats.tx_direct++;
+        return sendmsg(rsd, msghdr, 0);
+    }
+
+    int index = tx_free[--tx_free_count];
+    struct uring_tx_slot *slot = &tx_slots[index];
+    size_t offset = 0;
+    for (size_t i = 0; i < msghdr->msg_iovlen; i++) {
+        memcpy(slot->frame + offset, msghdr->msg_iov[i].iov_base, msghdr->msg_iov[i].iov_len);
+        offset += msghdr->msg_iov[i].iov_len;
+    }
+    memcpy(&slot->addr, msghdr->msg_name, sizeof(struct sockaddr_ll));
+    slot->iov.iov_base = slot->frame;
+    slot->iov.iov_len = len;
+    memset(&slot->msghdr, 0, sizeof(struct msghdr));
+    slot->msghdr.msg_name = &slot->addr;
+    slot->msghdr.msg_namelen = sizeof(struct sockaddr_ll);
+    slot->msghdr.msg_iov = &slot->iov;
+    slot->msghdr.msg_iovlen = 1;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = rsd;
+    sqe->addr = (u_int64_t)(unsigned long)&slot->msghdr;
+    sqe->len = 1;
+    sqe->user_data = user_data(URING_KIND_TX, index);
+    stats.tx_queued++;
+    return (long)len;
+}
+
+/**
+ * Handles a completed multishot recvmsg on the raw socket.
+ */
+static void handle_rsd_completion(struct io_uring_cqe const *cqe) {
+    if (cqe->res < 0) {
+        if (cqe->res == -ENOBUFS) {
+            stats.no_buffers++;
+        } else if (cqe->res == -EINVAL) {
+            multishot_failed = 1;
+        } else if (cqe->res != -ECANCELED) {
+            global_debug("io_uring recvmsg on raw socket failed: %s", strerror(-cqe->res));
+        }
+        return;
+    }
+    unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    u_int8_t *buf = buffers + (size_t)bid * URING_BUFFER_SIZE;
+    struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buf;
+    u_int8_t *name = buf + sizeof(struct io_uring_recvmsg_out);
+    u_int8_t *payload = name + rsd_msghdr.msg_namelen + rsd_msghdr.msg_controllen;
+
+    if (out->payloadlen >= sizeof(struct ether_frame)) {
+        // The buffer is large enough for a whole MIP packet after the ethernet header, as with recvmsg()
+        struct iovec msgvec[2];
+        msgvec[0].iov_base = payload;
+        msgvec[0].iov_len = sizeof(struct ether_frame);
+        msgvec[1].iov_base = payload + sizeof(struct ether_frame);
+        msgvec[1].iov_len = out->payloadlen - sizeof(struct ether_frame);
+        struct msghdr msghdr;
+        memset(&msghdr, 0, sizeof(struct msghdr));
+        msghdr.msg_name = name;
+        msghdr.msg_namelen = out->namelen;
+        msghdr.msg_iov = msgvec;
+        msghdr.msg_iovlen = 2;
+        stats.frames++;
+        handle_frame(*uring_fds, *uring_ifs_data, &msghdr);
+    }
+    return_buffer(bid);
+}
+
+/**
+ * Handles a completed multishot recv on an accepted unix socket.
+ *
+ * @return: 1 if the socket was closed, 0 otherwise.
+ */
+static int handle_usd_completion(struct io_uring_cqe const *cqe, int usd) {
+    int index = -1;
+    for (int i = 0; i < uring_fds->num_accepted_usds; i++) {
+        if (uring_fds->accepted_usds[i].usd == usd) {
+            index = i;
+        }
+    }
+
+    if (cqe->res > 0) {
+        unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (index >= 0) {
+            stats.messages++;
+            handle_upper_message(*uring_fds, *uring_ifs_data, uring_fds->accepted_usds[index].type,
+                                 (char *)(buffers + (size_t)bid * URING_BUFFER_SIZE));
+        }
+        return_buffer(bid);
+        return 0;
+    }
+    if (cqe->res == -ENOBUFS) {
+        stats.no_buffers++;
+        return 0;
+    }
+    if (cqe->res == -ECANCELED) {
+        return 0;
+    }
+    if (cqe->res == -EINVAL) {
+        multishot_failed = 1;
+        global_debug("io_uring recv on unix socket failed: %s", strerror(-cqe->res));
+        return 0;
+    }
+
+    // EOF or an error, the same as handle_usd_event() failing in the epoll loop
+    global_debug("EOF received. Closing socket.");
+    if (index >= 0) {
+        close_accepted_usd(uring_fds, index);
+    }
+    return 1;
+}
+
+/**
+ * Handles the completions in the completion queue.
+ *
+ * @param events: Where readable file descriptors are reported.
+ * @param max_events: The room in events. Handling stops when it is full.
+ * @return: The number of events reported.
+ */
+static int reap(struct epoll_event *events, int max_events) {
+    int num_events = 0;
+    unsigned head = *cq_head;
+    while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe cqe = cqes[head & *cq_mask];
+        u_int32_t kind = cqe.user_data >> 32;
+        u_int32_t value = cqe.user_data & 0xFFFFFFFF;
+        if (kind == URING_KIND_POLL && cqe.res >= 0 && !paused && num_events == max_events) {
+            break;
+        }
+        head++;
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        stats.completions++;
+
+        struct uring_watch *watch = NULL;
+        int more = cqe.flags & IORING_CQE_F_MORE;
+        switch (kind) {
+            case URING_KIND_RSD:
+                watch = find_watch((int)value, kind);
+                handle_rsd_completion(&cqe);
+                break;
+            case URING_KIND_USD:
+                watch = find_watch((int)value, kind);
+                if (handle_usd_completion(&cqe, (int)value) && watch != NULL) {
+                    watch->fd = -1;
+                    watch = NULL;
+                }
+                break;
+            case URING_KIND_POLL:
+                watch = find_watch((int)value, kind);
+                if (cqe.res >= 0 && !paused) {
+                    events[num_events].events = EPOLLIN;
+                    events[num_events].data.fd = (int)value;
+                    num_events++;
+                }
+                break;
+            case URING_KIND_TX:
+                if (cqe.res < 0) {
+                    stats.tx_errors++;
+                    global_debug("io_uring sendmsg failed: %s", strerror(-cqe.res));
+                }
+                tx_free[tx_free_count++] = (int)value;
+                break;
+            default:
+                break;
+        }
+        if (watch != NULL && !more) {
+            watch->armed = 0;
+            // Arming it again would fail the same way, in a loop
+            watch->failed = cqe.res == -EINVAL && kind != URING_KIND_POLL;
+        }
+    }
+    return num_events;
+}
+
+/**
+ * Unmaps the queues and the buffer ring and closes the io_uring instance, after uring_init() failed.
+ */
+static void teardown() {
+    if (ring_fd >= 0) {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+    if (ring_mem != MAP_FAILED) {
+        munmap(ring_mem, ring_mem_size);
+        ring_mem = MAP_FAILED;
+    }
+    if (sqe_mem != MAP_FAILED) {
+        munmap(sqe_mem, sqe_mem_size);
+        sqe_mem = MAP_FAILED;
+    }
+    if (buf_ring != MAP_FAILED) {
+        munmap(buf_ring, URING_BUFFERS * sizeof(struct io_uring_buf));
+        buf_ring = MAP_FAILED;
+    }
+    free(buffers);
+    buffers = NULL;
+    buf_tail = 0;
+    tx_free_count = 0;
+    for (int i = 0; i < URING_MAX_WATCHES; i++) {
+        watches[i].fd = -1;
+    }
+}
+
+/**
+ * Starts the multishot recvmsg on the raw socket, and checks that the kernel supports it.
+ *
+ * Kernels before 6.0 refuse multishot receives with EINVAL, and do so when the request is submitted. A no-op
+ * submitted after it is waited for, so the refusal is in the completion queue by the time the no-op is.
+ *
+ * @return: 0 if the receive was accepted, -1 if it was refused.
+ */
+static int probe_multishot(int rsd) {
+    add_watch(rsd, URING_KIND_RSD);
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = user_data(URING_KIND_PROBE, 0);
+    if (enter(1) < 0) {
+        perror("io_uring_enter: probe");
+        return -1;
+    }
+    reap(NULL, 0);
+    if (multishot_failed) {
+        fprintf(stderr, "io_uring: multishot receives are not supported\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Sets up the io_uring instance and starts receiving on the raw socket and the accepted unix sockets, and
+ * watching the listening unix socket. From here on, frames on the raw socket are sent through the ring.
+ *
+ * @param fds: The file descriptors of mipd. Kept, so accepted and closed unix sockets are seen.
+ * @param ifs_data: The interfaces of mipd. Kept, like fds.
+ * @return: 0 on success, -1 if io_uring or one of the features used is not available, multishot receives
+ * included. Then everything set up is undone, and the epoll loop should be used.
+ */
+int uring_init(struct fds *fds, struct ifs_data *ifs_data) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // Only this thread submits, and completions are only needed when it waits for them
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    ring_fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring_fd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        ring_fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    }
+    if (ring_fd < 0) {
+        perror("io_uring_setup");
+        return -1;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        fprintf(stderr, "io_uring: kernel too old\n");
+        teardown();
+        return -1;
+    }
+
+    // Map the submission and completion queues, which share one mapping, and the submission queue entries
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring_mem_size = sq_size > cq_size ? sq_size : cq_size;
+    ring_mem = mmap(NULL, ring_mem_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (ring_mem != MAP_FAILED) {
+        sqe_mem_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqe_mem = mmap(NULL, sqe_mem_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    }
+    if (sqe_mem == MAP_FAILED) {
+        perror("mmap: io_uring");
+        teardown();
+        return -1;
+    }
+    u_int8_t *ring = ring_mem;
+    sq_head = (unsigned *)(ring + params.sq_off.head);
+    sq_tail = (unsigned *)(ring + params.sq_off.tail);
+    sq_mask = (unsigned *)(ring + params.sq_off.ring_mask);
+    sq_array = (unsigned *)(ring + params.sq_off.array);
+    sq_entries = params.sq_entries;
+    sq_local_tail = sq_submitted = *sq_tail;
+    sqes = sqe_mem;
+    cq_head = (unsigned *)(ring + params.cq_off.head);
+    cq_tail = (unsigned *)(ring + params.cq_off.tail);
+    cq_mask = (unsigned *)(ring + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+
+    // Register the ring of receive buffers, shared by all multishot receives
+    buf_ring = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    buffers = malloc((size_t)URING_BUFFERS * URING_BUFFER_SIZE);
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (u_int64_t)(unsigned long)buf_ring;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (buf_ring == MAP_FAILED || buffers == NULL
+        || syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        perror("io_uring_register: buffer ring");
+        teardown();
+        return -1;
+    }
+    for (int i = 0; i < URING_BUFFERS; i++) {
+        return_buffer(i);
+    }
+
+    for (int i = 0; i < URING_TX_SLOTS; i++) {
+        tx_free[tx_free_count++] = i;
+    }
+    for (int i = 0; i < URING_MAX_WATCHES; i++) {
+        watches[i].fd = -1;
+    }
+    memset(&rsd_msghdr, 0, sizeof(struct msghdr));
+    rsd_msghdr.msg_namelen = sizeof(struct sockaddr_ll);
+
+    uring_fds = fds;
+    uring_ifs_data = ifs_data;
+    if (probe_multishot(fds->rsd) < 0) {
+        teardown();
+        return -1;
+    }
+    add_watch(fds->usd, URING_KIND_POLL);
+    for (int i = 0; i < fds->num_accepted_usds; i++) {
+        add_watch(fds->accepted_usds[i].usd, URING_KIND_USD);
+    }
+    packet_transmit_hook = uring_transmit;
+    return 0;
+}
+
+/**
+ * Reports when a file descriptor is readable, as an event from uring_wait().
+ *
+ * @param fd: The file descriptor.
+ * @return: 0 on success, -1 if too many file descriptors are watched.
+ */
+int uring_watch(int fd) {
+    return add_watch(fd, URING_KIND_POLL);
+}
+
+/**
+ * Starts receiving on an accepted unix socket. Its messages are handled by uring_wait().
+ *
+ * @param usd: The accepted unix socket, already added to fds.
+ * @return: 0 on success, -1 if too many file descriptors are watched.
+ */
+int uring_watch_usd(int usd) {
+    return add_watch(usd, URING_KIND_USD);
+}
+
+/**
+ * Sends the queued frames, waits for completions and handles them.
+ *
+ * Frames and messages received on the raw socket and the accepted unix sockets are handled here. Other file
+ * descriptors that became readable are returned like epoll_wait() does.
+ *
+ * @param events: Where readable file descriptors are reported.
+ * @param max_events: The room in events.
+ * @return: The number of events, which can be 0 if only received packets were handled. -1 on failure, with
+ * errno set. EINTR means a signal arrived.
+ */
+int uring_wait(struct epoll_event *events, int max_events) {
+    arm_all();
+    int ready = *cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    int rc = enter(ready ? 0 : 1);
+    if (rc < 0 && errno != EBUSY) {
+        return -1;
+    }
+    return reap(events, max_events);
+}
+
+/**
+ * Sends the queued frames and cancels the multishot requests, handling what they received until they end.
+ * Used before handing the sockets over to another mipd, so this one does not read from them anymore.
+ */
+void uring_pause() {
+    paused = 1;
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    sqe->user_data = user_data(URING_KIND_CANCEL, 0);
+
+    int armed = 1;
+    while (armed || tx_free_count < URING_TX_SLOTS) {
+        if (enter(1) < 0 && errno != EINTR && errno != EBUSY) {
+            return;
+        }
+        reap(NULL, 0);
+        armed = 0;
+        for (int i = 0; i < URING_MAX_WATCHES; i++) {
+            armed |= watches[i].fd >= 0 && watches[i].armed;
+        }
+    }
+}
+
+/**
+ * Starts the multishot requests again after uring_pause(), if the handover did not happen.
+ */
+void uring_resume() {
+    paused = 0;
+    arm_all();
+}
+
+/**
+ * Prints the statistics of the io_uring event loop to stdout.
+ */
+void print_uring_stats() {
+    printf("io_uring: enters=%lu submitted=%lu (max %lu per enter) completions=%lu\n",
+           stats.enters, stats.submitted, stats.max_submitted, stats.completions);
+    printf("  received: frames=%lu messages=%lu, out of buffers=%lu\n", stats.frames, stats.messages, stats.no_buffers);
+    printf("  sent: queued=%lu direct=%lu errors=%lu\n", stats.tx_queued, stats.tx_direct, stats.tx_errors);
+    fflush(stdout);
+}
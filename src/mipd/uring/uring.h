@@ -0,0 +1,27 @@
+#ifndef URING_H
+#define URING_H
+
+#include <sys/epoll.h>
+#include "../mipd_common.h"
+
+#define URING_ENTRIES       256     // Number of entries in the submission queue.
+#define URING_BUFFERS       256     // Number of receive buffers in the buffer ring, a power of two.
+#define URING_BUFFER_SIZE   2048    // Size of each receive buffer, enough for an ethernet frame.
+#define URING_TX_SLOTS      128     // Maximum number of frames waiting to be sent.
+#define URING_MAX_WATCHES   (MAX_ACCEPTED_USDS + 5) // Maximum number of file descriptors watched by the ring.
+
+int uring_init(struct fds *fds, struct ifs_data *ifs_data);
+
+int uring_watch(int fd);
+
+int uring_watch_usd(int usd);
+
+int uring_wait(struct epoll_event *events, int max_events);
+
+void uring_pause();
+
+void uring_resume();
+
+void print_uring_stats();
+
+#endif //URING_H
@@ -0,0 +1,568 @@
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include "xdp.h"
+#include "../lower/lower.h"
+#include "../lower/mip/mip.h"
+#include "../upper/upper.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/*
+ * A link backend on AF_XDP sockets, used instead of the raw socket with -X.
+ *
+ * Every interface gets an AF_XDP socket bound to its receive queue XSK_QUEUE, and a small XDP program, attached in
+ * generic (SKB) mode so that it also works on veth, which redirects the frames of type ETH_P_MIP to that socket
+ * through an XSKMAP. Every other frame, and MIP frames on the other queues, are passed on to the kernel, so the rest
+ * of the traffic is untouched and the raw socket stays as the fallback. The program is assembled here by hand and
+ * loaded with the bpf() syscall, so mipd does not depend on libbpf. It is attached through a BPF link, which the
+ * kernel detaches when mipd exits.
+ *
+ * The frames of an interface live in one UMEM, shared by receiving and sending: a pool of free frames feeds both
+ * the fill ring and the frames that are sent, and frames come back to it once handled or once the kernel has
+ * completed sending them. Received frames are handed to handle_frame() where they lie in the UMEM. Frames sent by
+ * mipd are written straight into a UMEM frame by packet_transmit_hook and handed to the kernel in batches.
+ */
+
+/**
+ * One of the four rings of an AF_XDP socket, mapped from the kernel.
+ */
+struct xsk_ring {
+    u_int32_t *producer;    // Index of the next descriptor the producer writes.
+    u_int32_t *consumer;    // Index of the next descriptor the consumer reads.
+    void *descs;            // The descriptors: struct xdp_desc for RX and TX, frame addresses for fill and completion.
+    void *map;              // The mapping of the ring.
+    size_t map_len;         // Length of the mapping.
+};
+
+/**
+ * The AF_XDP socket of an interface, its UMEM and its XDP program.
+ */
+struct xsk {
+    int fd;                     // The AF_XDP socket.
+    int ifi;                    // Index of the interface in ifs_data.
+    int ifindex;                // Kernel index of the interface.
+    int map_fd;                 // The XSKMAP the program redirects to.
+    int prog_fd;                // The XDP program.
+    int link_fd;                // The link attaching the program to the interface.
+    u_int8_t *umem;             // The frames.
+    struct xsk_ring rx, tx, fill, completion;
+    u_int64_t free_frames[XSK_NUM_FRAMES];  // Addresses of the frames neither the kernel nor mipd is using.
+    unsigned num_free;                      // Number of free frames.
+    unsigned tx_pending;                    // Frames queued for sending since the kernel was last woken.
+
+    unsigned long rx_frames;    // Frames received.
+    unsigned long rx_batches;   // Wakeups that received frames.
+    unsigned long tx_frames;    // Frames queued for sending.
+    unsigned long tx_kicks;     // Calls to sendto() that woke the kernel to send.
+    unsigned long tx_direct;    // Frames sent on the raw socket because the TX ring or the UMEM was full.
+};
+
+static struct xsk xsks[MAX_IFS];    // The sockets, one per interface.
+static int num_xsks = 0;            // Number of sockets.
+
+/**
+ * Builds an eBPF instruction.
+ */
+#define BPF_INSN(CODE, DST, SRC, OFF, IMM) \
+    ((struct bpf_insn){.code = (CODE), .dst_reg = (DST), .src_reg = (SRC), .off = (OFF), .imm = (IMM)})
+
+/**
+ * Calls the bpf() syscall.
+ */
+static int bpf(int cmd, union bpf_attr *attr) {
+    return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * Loads the XDP program of an interface. In C it would read:
+ *
+ *     if (data + sizeof(struct ether_frame) > data_end || eth_proto != ETH_P_MIP) return XDP_PASS;
+ *     return bpf_redirect_map(&xskmap, ctx->rx_queue_index, XDP_PASS);
+ *
+ * @param map_fd: The XSKMAP of the interface.
+ * @return: The file descriptor of the program, or -1 on failure.
+ */
+static int load_program(int map_fd) {
+    struct bpf_insn program[] = {
+        // r2 = ctx->data, r3 = ctx->data_end
+        BPF_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data), 0),
+        BPF_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end), 0),
+        // if (r2 + sizeof(struct ether_frame) > r3) goto pass
+        BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+        BPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, sizeof(struct ether_frame)),
+        BPF_INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 10, 0),
+        // The ethernet type is compared a byte at a time, so the program does not depend on the byte order
+        BPF_INSN(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_4, BPF_REG_2, offsetof(struct ether_frame, eth_proto), 0),
+        BPF_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_4, 0, 8, ETH_P_MIP >> 8),
+        BPF_INSN(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_4, BPF_REG_2, offsetof(struct ether_frame, eth_proto) + 1, 0),
+        BPF_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_4, 0, 6, ETH_P_MIP & 0xFF),
+        // return bpf_redirect_map(map, ctx->rx_queue_index, XDP_PASS)
+        BPF_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, rx_queue_index), 0),
+        BPF_INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd),
+        BPF_INSN(0, 0, 0, 0, 0),
+        BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS),
+        BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+        BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+        // pass: return XDP_PASS
+        BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),
+        BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+    char log[4096] = "";
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insns = (u_int64_t)(unsigned long)program;
+    attr.insn_cnt = sizeof(program) / sizeof(program[0]);
+    attr.license = (u_int64_t)(unsigned long)"GPL";
+    attr.log_buf = (u_int64_t)(unsigned long)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    int fd = bpf(BPF_PROG_LOAD, &attr);
+    if (fd < 0) {
+        perror("bpf: BPF_PROG_LOAD");
+        global_debug("Verifier log:\n%s", log);
+    }
+    return fd;
+}
+
+/**
+ * Maps one of the rings of an AF_XDP socket.
+ *
+ * @param fd: The socket.
+ * @param ring: Set to the mapped ring.
+ * @param offsets: Offsets of the indices and descriptors in the mapping, from XDP_MMAP_OFFSETS.
+ * @param pgoff: Which ring to map.
+ * @param desc_size: Size of a descriptor.
+ * @return: 0 on success, -1 on failure.
+ */
+static int map_ring(int fd, struct xsk_ring *ring, struct xdp_ring_offset const *offsets, off_t pgoff,
+                    size_t desc_size) {
+    ring->map_len = offsets->desc + XSK_RING_SIZE * desc_size;
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (ring->map == MAP_FAILED) {
+        perror("mmap: xsk ring");
+        ring->map = NULL;
+        return -1;
+    }
+    ring->producer = (u_int32_t *)((u_int8_t *)ring->map + offsets->producer);
+    ring->consumer = (u_int32_t *)((u_int8_t *)ring->map + offsets->consumer);
+    ring->descs = (u_int8_t *)ring->map + offsets->desc;
+    return 0;
+}
+
+/**
+ * Hands free frames to the kernel through the fill ring, as many as it has room for.
+ *
+ * @param xsk: The socket.
+ */
+static void refill(struct xsk *xsk) {
+    u_int32_t producer = *xsk->fill.producer;
+    u_int32_t room = XSK_RING_SIZE - (producer - __atomic_load_n(xsk->fill.consumer, __ATOMIC_ACQUIRE));
+    u_int32_t count = room < xsk->num_free ? room : xsk->num_free;
+    u_int64_t *addrs = xsk->fill.descs;
+    for (u_int32_t i = 0; i < count; i++) {
+        addrs[(producer + i) & (XSK_RING_SIZE - 1)] = xsk->free_frames[--xsk->num_free];
+    }
+    __atomic_store_n(xsk->fill.producer, producer + count, __ATOMIC_RELEASE);
+}
+
+/**
+ * Takes back the frames the kernel has finished sending.
+ *
+ * @param xsk: The socket.
+ */
+static void reclaim(struct xsk *xsk) {
+    u_int32_t consumer = *xsk->completion.consumer;
+    u_int32_t producer = __atomic_load_n(xsk->completion.producer, __ATOMIC_ACQUIRE);
+    u_int64_t const *addrs = xsk->completion.descs;
+    for (; consumer != producer; consumer++) {
+        xsk->free_frames[xsk->num_free++] = addrs[consumer & (XSK_RING_SIZE - 1)];
+    }
+    __atomic_store_n(xsk->completion.consumer, consumer, __ATOMIC_RELEASE);
+}
+
+/**
+ * Wakes the kernel to send the frames in the TX ring. In copy mode the kernel sends a limited batch per call, so
+ * it is called until the ring is empty or the kernel stops making progress.
+ *
+ * @param xsk: The socket.
+ */
+static void kick(struct xsk *xsk) {
+    xsk->tx_pending = 0;
+    for (int i = 0; i < XSK_RING_SIZE / 16; i++) {
+        u_int32_t consumer = __atomic_load_n(xsk->tx.consumer, __ATOMIC_ACQUIRE);
+        if (consumer == *xsk->tx.producer) {
+            break;
+        }
+        xsk->tx_kicks++;
+        if (sendto(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 && errno != EAGAIN && errno != EBUSY
+            && errno != ENOBUFS) {
+            global_debug("sendto: xsk: %s", strerror(errno));
+            break;
+        }
+        if (__atomic_load_n(xsk->tx.consumer, __ATOMIC_ACQUIRE) == consumer) {
+            break;
+        }
+    }
+    reclaim(xsk);
+}
+
+/**
+ * Closes the socket of an interface and detaches its program.
+ *
+ * @param xsk: The socket.
+ */
+static void xsk_close(struct xsk *xsk) {
+    struct xsk_ring *rings[] = {&xsk->rx, &xsk->tx, &xsk->fill, &xsk->completion};
+    for (int i = 0; i < 4; i++) {
+        if (rings[i]->map != NULL) {
+            munmap(rings[i]->map, rings[i]->map_len);
+        }
+    }
+    int fds[] = {xsk->link_fd, xsk->prog_fd, xsk->map_fd, xsk->fd};
+    for (int i = 0; i < 4; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    if (xsk->umem != NULL) {
+        munmap(xsk->umem, (size_t)XSK_NUM_FRAMES * XSK_FRAME_SIZE);
+    }
+}
+
+/**
+ * Creates the AF_XDP socket of an interface with its UMEM, and attaches the XDP program to the interface.
+ *
+ * @param xsk: The socket, its file descriptors set to -1.
+ * @return: 0 on success, -1 on failure.
+ */
+static int xsk_open(struct xsk *xsk) {
+    xsk->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (xsk->fd < 0) {
+        perror("socket: AF_XDP");
+        return -1;
+    }
+
+    xsk->umem = mmap(NULL, (size_t)XSK_NUM_FRAMES * XSK_FRAME_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (xsk->umem == MAP_FAILED) {
+        perror("mmap: umem");
+        xsk->umem = NULL;
+        return -1;
+    }
+    struct xdp_umem_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (u_int64_t)(unsigned long)xsk->umem;
+    reg.len = (u_int64_t)XSK_NUM_FRAMES * XSK_FRAME_SIZE;
+    reg.chunk_size = XSK_FRAME_SIZE;
+    if (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) {
+        perror("setsockopt: XDP_UMEM_REG");
+        return -1;
+    }
+
+    int ring_size = XSK_RING_SIZE;
+    int options[] = {XDP_UMEM_FILL_RING, XDP_UMEM_COMPLETION_RING, XDP_RX_RING, XDP_TX_RING};
+    for (int i = 0; i < 4; i++) {
+        if (setsockopt(xsk->fd, SOL_XDP, options[i], &ring_size, sizeof(ring_size)) < 0) {
+            perror("setsockopt: xsk ring size");
+            return -1;
+        }
+    }
+    struct xdp_mmap_offsets offsets;
+    socklen_t optlen = sizeof(offsets);
+    if (getsockopt(xsk->fd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &optlen) < 0) {
+        perror("getsockopt: XDP_MMAP_OFFSETS");
+        return -1;
+    }
+    if (map_ring(xsk->fd, &xsk->rx, &offsets.rx, XDP_PGOFF_RX_RING, sizeof(struct xdp_desc)) < 0
+        || map_ring(xsk->fd, &xsk->tx, &offsets.tx, XDP_PGOFF_TX_RING, sizeof(struct xdp_desc)) < 0
+        || map_ring(xsk->fd, &xsk->fill, &offsets.fr, XDP_UMEM_PGOFF_FILL_RING, sizeof(u_int64_t)) < 0
+        || map_ring(xsk->fd, &xsk->completion, &offsets.cr, XDP_UMEM_PGOFF_COMPLETION_RING, sizeof(u_int64_t)) < 0) {
+        return -1;
+    }
+
+    // All frames start out free, and the kernel gets as many as the fill ring holds
+    for (unsigned i = 0; i < XSK_NUM_FRAMES; i++) {
+        xsk->free_frames[i] = (u_int64_t)(XSK_NUM_FRAMES - 1 - i) * XSK_FRAME_SIZE;
+    }
+    xsk->num_free = XSK_NUM_FRAMES;
+    refill(xsk);
+
+    struct sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = xsk->ifindex;
+    sxdp.sxdp_queue_id = XSK_QUEUE;
+    sxdp.sxdp_flags = XDP_COPY;
+    if (bind(xsk->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0) {
+        perror("bind: xsk");
+        return -1;
+    }
+
+    // The XSKMAP is indexed by receive queue, only XSK_QUEUE has a socket
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(u_int32_t);
+    attr.value_size = sizeof(u_int32_t);
+    attr.max_entries = XSK_QUEUE + 1;
+    xsk->map_fd = bpf(BPF_MAP_CREATE, &attr);
+    if (xsk->map_fd < 0) {
+        perror("bpf: BPF_MAP_CREATE");
+        return -1;
+    }
+    u_int32_t key = XSK_QUEUE;
+    u_int32_t value = (u_int32_t)xsk->fd;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = xsk->map_fd;
+    attr.key = (u_int64_t)(unsigned long)&key;
+    attr.value = (u_int64_t)(unsigned long)&value;
+    if (bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        perror("bpf: BPF_MAP_UPDATE_ELEM");
+        return -1;
+    }
+
+    xsk->prog_fd = load_program(xsk->map_fd);
+    if (xsk->prog_fd < 0) {
+        return -1;
+    }
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = xsk->prog_fd;
+    attr.link_create.target_ifindex = xsk->ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    xsk->link_fd = bpf(BPF_LINK_CREATE, &attr);
+    if (xsk->link_fd < 0) {
+        perror("bpf: BPF_LINK_CREATE");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Sends a frame through the AF_XDP socket of its interface. Used as packet_transmit_hook.
+ * The frame is written into a free UMEM frame and queued in the TX ring; the kernel is woken by xdp_flush(), or
+ * right away once XSK_TX_BATCH frames are waiting. If the interface has no socket, or the TX ring or the UMEM is
+ * full, the frame is sent on the raw socket instead.
+ *
+ * @param rsd: Raw socket descriptor, used as the fallback.
+ * @param msghdr: The frame, with the sockaddr_ll of the interface as msg_name.
+ * @return: The number of bytes queued or sent, or -1 on failure.
+ */
+static long xdp_transmit(int rsd, struct msghdr const *msghdr) {
+    struct sockaddr_ll const *addr = msghdr->msg_name;
+    struct xsk *xsk = NULL;
+    for (int i = 0; i < num_xsks; i++) {
+        if (xsks[i].ifindex == addr->sll_ifindex) {
+            xsk = &xsks[i];
+            break;
+        }
+    }
+    size_t len = 0;
+    for (size_t i = 0; i < msghdr->msg_iovlen; i++) {
+        len += msghdr->msg_iov[i].iov_len;
+    }
+    if (xsk == NULL || len > XSK_FRAME_SIZE) {
+        return sendmsg(rsd, msghdr, 0);
+    }
+
+    u_int32_t producer = *xsk->tx.producer;
+    if (xsk->num_free == 0 || producer - __atomic_load_n(xsk->tx.consumer, __ATOMIC_ACQUIRE) == XSK_RING_SIZE) {
+        kick(xsk);
+        if (xsk->num_free == 0 || producer - __atomic_load_n(xsk->tx.consumer, __ATOMIC_ACQUIRE) == XSK_RING_SIZE) {
+            xsk->tx_direct++;
+            return sendmsg(rsd, msghdr, 0);
+        }
+    }
+
+    u_int64_t frame = xsk->free_frames[--xsk->num_free];
+    size_t offset = 0;
+    for (size_t i = 0; i < msghdr->msg_iovlen; i++) {
+        memcpy(xsk->umem + frame + offset, msghdr->msg_iov[i].iov_base, msghdr->msg_iov[i].iov_len);
+        offset += msghdr->msg_iov[i].iov_len;
+    }
+    struct xdp_desc *desc = (struct xdp_desc *)xsk->tx.descs + (producer & (XSK_RING_SIZE - 1));
+    desc->addr = frame;
+    desc->len = (u_int32_t)len;
+    desc->options = 0;
+    __atomic_store_n(xsk->tx.producer, producer + 1, __ATOMIC_RELEASE);
+    xsk->tx_frames++;
+    if (++xsk->tx_pending >= XSK_TX_BATCH) {
+        kick(xsk);
+    }
+    return (long)len;
+}
+
+/**
+ * Creates an AF_XDP socket for every interface and attaches the XDP program to them. From here on, the frames
+ * mipd sends go through these sockets. The raw socket is kept, both as the fallback for sending and to receive the
+ * MIP frames that arrive on other queues than XSK_QUEUE.
+ *
+ * @param ifs_data: The interfaces of mipd.
+ * @param sockets: Set to the sockets, one per interface, to be added to the epoll instance and handled with
+ * xdp_rx_event(). Room for MAX_IFS.
+ * @return: The number of sockets, or -1 on failure, in which case nothing is left attached.
+ */
+int xdp_start(struct ifs_data *ifs_data, int *sockets) {
+    for (int i = 0; i < ifs_data->ifn; i++) {
+        struct xsk *xsk = &xsks[i];
+        memset(xsk, 0, sizeof(*xsk));
+        xsk->fd = xsk->map_fd = xsk->prog_fd = xsk->link_fd = -1;
+        xsk->ifi = i;
+        xsk->ifindex = ifs_data->addr[i].sll_ifindex;
+        num_xsks = i + 1;
+        if (xsk_open(xsk) < 0) {
+            fprintf(stderr, "xdp: could not set up interface %d\n", xsk->ifindex);
+            for (int j = 0; j <= i; j++) {
+                xsk_close(&xsks[j]);
+            }
+            num_xsks = 0;
+            return -1;
+        }
+        sockets[i] = xsk->fd;
+        global_debug("AF_XDP socket on interface %d, queue %d", xsk->ifindex, XSK_QUEUE);
+    }
+    packet_transmit_hook = xdp_transmit;
+    return num_xsks;
+}
+
+/**
+ * Tells which interface an AF_XDP socket belongs to.
+ *
+ * @param fd: A file descriptor.
+ * @return: The index of the socket, to be passed to xdp_rx_event(), or -1 if fd is not one of the sockets.
+ */
+int xdp_socket_index(int fd) {
+    for (int i = 0; i < num_xsks; i++) {
+        if (xsks[i].fd == fd) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Handles the routing responses waiting on the routing socket.
+ *
+ * A ring of frames to forward makes as many routing requests, while the main loop reads one response per event.
+ * Without this, routingd blocks sending responses that mipd does not read, while mipd blocks sending it requests.
+ *
+ * @param fds: A struct that contains multiple file descriptors including raw and unix sockets.
+ * @param ifs_data: A struct that contains information about network interfaces.
+ */
+static void drain_routing_responses(struct fds fds, struct ifs_data ifs_data) {
+    if (fds.routing_usd < 0) {
+        return;
+    }
+    struct accepted_usd routing = {fds.routing_usd, MIP_SDU_TYPE_ROUTING};
+    struct pollfd pfd = {fds.routing_usd, POLLIN, 0};
+    // A closed socket is left to the main loop
+    while (poll(&pfd, 1, 0) == 1 && pfd.revents == POLLIN) {
+        if (handle_usd_event(fds, ifs_data, routing) < 0) {
+            break;
+        }
+    }
+}
+
+/**
+ * Handles the frames waiting in the RX ring of a socket with handle_frame(), straight from the UMEM, then gives
+ * their frames back to the kernel through the fill ring. The routing responses that the frames ask for are handled
+ * after every XSK_RX_BUDGET frames.
+ *
+ * @param fds: A struct that contains multiple file descriptors including raw and unix sockets.
+ * @param ifs_data: A struct that contains information about network interfaces.
+ * @param index: The index of the socket, from xdp_socket_index().
+ */
+void xdp_rx_event(struct fds fds, struct ifs_data ifs_data, int index) {
+    struct xsk *xsk = &xsks[index];
+    u_int32_t consumer = *xsk->rx.consumer;
+    u_int32_t producer = __atomic_load_n(xsk->rx.producer, __ATOMIC_ACQUIRE);
+    if (consumer == producer) {
+        return;
+    }
+
+    struct sockaddr_ll addr = ifs_data.addr[xsk->ifi];
+    unsigned handled = 0;
+    for (; consumer != producer; consumer++) {
+        struct xdp_desc const *desc = (struct xdp_desc *)xsk->rx.descs + (consumer & (XSK_RING_SIZE - 1));
+        if (desc->len >= sizeof(struct ether_frame)) {
+            // The frame has room for a whole MIP packet after the ethernet header, as with recvmsg()
+            struct iovec msgvec[2];
+            msgvec[0].iov_base = xsk->umem + desc->addr;
+            msgvec[0].iov_len = sizeof(struct ether_frame);
+            msgvec[1].iov_base = xsk->umem + desc->addr + sizeof(struct ether_frame);
+            msgvec[1].iov_len = desc->len - sizeof(struct ether_frame);
+            struct msghdr msghdr;
+            memset(&msghdr, 0, sizeof(struct msghdr));
+            msghdr.msg_name = &addr;
+            msghdr.msg_namelen = sizeof(struct sockaddr_ll);
+            msghdr.msg_iov = msgvec;
+            msghdr.msg_iovlen = 2;
+            handle_frame(fds, ifs_data, &msghdr);
+        }
+        // The address points past the kernel's headroom, the frame starts at its aligned base
+        xsk->free_frames[xsk->num_free++] = desc->addr & ~(u_int64_t)(XSK_FRAME_SIZE - 1);
+        xsk->rx_frames++;
+        if (++handled % XSK_RX_BUDGET == 0) {
+            drain_routing_responses(fds, ifs_data);
+        }
+    }
+    __atomic_store_n(xsk->rx.consumer, consumer, __ATOMIC_RELEASE);
+    xsk->rx_batches++;
+    refill(xsk);
+    drain_routing_responses(fds, ifs_data);
+}
+
+/**
+ * Wakes the kernel to send the frames queued on the sockets, and takes back the frames it has sent.
+ * Called after every batch of events.
+ */
+void xdp_flush() {
+    for (int i = 0; i < num_xsks; i++) {
+        if (xsks[i].tx_pending > 0) {
+            kick(&xsks[i]);
+        } else if (xsks[i].num_free < XSK_NUM_FRAMES / 2) {
+            reclaim(&xsks[i]);
+        }
+    }
+}
+
+/**
+ * Prints the statistics of the AF_XDP sockets to stdout, with the drops counted by the kernel.
+ */
+void print_xdp_stats() {
+    printf("AF_XDP (%d frames of %d bytes per interface, rings of %d):\n", XSK_NUM_FRAMES, XSK_FRAME_SIZE,
+           XSK_RING_SIZE);
+    for (int i = 0; i < num_xsks; i++) {
+        struct xsk const *xsk = &xsks[i];
+        struct xdp_statistics kernel;
+        socklen_t optlen = sizeof(kernel);
+        memset(&kernel, 0, sizeof(kernel));
+        getsockopt(xsk->fd, SOL_XDP, XDP_STATISTICS, &kernel, &optlen);
+        printf("  if %d: rx frames=%lu (%.1f per wakeup) tx frames=%lu kicks=%lu direct=%lu free=%u\n", xsk->ifindex,
+               xsk->rx_frames, xsk->rx_batches > 0 ? (double)xsk->rx_frames / xsk->rx_batches : 0.0,
+               xsk->tx_frames, xsk->tx_kicks, xsk->tx_direct, xsk->num_free);
+        printf("    kernel: rx dropped=%llu rx ring full=%llu fill ring empty=%llu invalid rx=%llu tx=%llu\n",
+               (unsigned long long)kernel.rx_dropped, (unsigned long long)kernel.rx_ring_full,
+               (unsigned long long)kernel.rx_fill_ring_empty_descs, (unsigned long long)kernel.rx_invalid_descs,
+               (unsigned long long)kernel.tx_invalid_descs);
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,23 @@
+#ifndef XDP_H
+#define XDP_H
+
+#include "../mipd_common.h"
+
+#define XSK_NUM_FRAMES      4096    // Number of frames in the UMEM of each interface, shared by receiving and sending.
+#define XSK_FRAME_SIZE      2048    // Size of each frame, enough for an ethernet frame after the kernel's headroom.
+#define XSK_RING_SIZE       1024    // Number of descriptors in each of the four rings of a socket, a power of two.
+#define XSK_QUEUE           0       // The receive queue of the interface the sockets are bound to.
+#define XSK_RX_BUDGET       32       // Frames handled before the routing responses they asked for are read.
+#define XSK_TX_BATCH        64      // Frames queued for sending before the kernel is woken without waiting for xdp_flush().
+
+int xdp_start(struct ifs_data *ifs_data, int *sockets);
+
+int xdp_socket_index(int fd);
+
+void xdp_rx_event(struct fds fds, struct ifs_data ifs_data, int index);
+
+void xdp_flush();
+
+void print_xdp_stats();
+
+#endif //XDP_H
@@ -1,3 +1,5 @@
+#include <math.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,7 +10,12 @@
 #include <time.h>
 #include "../mipd/mipd_common.h"
 
-#define TIMEOUT 1
+#define TIMEOUT 1               // Default time in seconds to wait for a reply.
+#define MAX_PAYLOAD 505         // Longest payload that fits in a reply after the "PONG:" prefix and the terminator.
+
+#define SEQ_PENDING 0           // No reply yet.
+#define SEQ_RECEIVED 1          // A reply has been received.
+#define SEQ_EXPIRED 2           // No reply within the timeout.
 
 struct unix_message {
     u_int8_t mip_addr;
@@ -16,14 +23,36 @@ struct unix_message {
     char message[511];
 };
 
+/**
+ * The statistics of a run.
+ */
+struct ping_stats {
+    unsigned long sent;         // Requests sent.
+    unsigned long received;     // Requests that got at least one reply.
+    unsigned long duplicates;   // Replies to requests that already had one.
+    unsigned long reordered;    // Replies that came after a reply to a later request.
+    unsigned long late;         // Replies that came after the timeout, counted as received.
+    unsigned long outstanding;  // Requests waiting for a reply within the timeout.
+    double *rtt_ms;             // RTT of each received request, in the order received.
+};
+
+static volatile sig_atomic_t stop_flag = 0; // Set by SIGINT, the client then stops and prints the summary.
+
 /**
  * Prints the help message
  * @param argv: The command line arguments
  * @return void
  */
 void print_help(char *argv[]) {
-    printf("Usage: %s [-h] <socket_lower> <mip_addr> <message> <ttl> \n", argv[0]);
+    printf("Usage: %s [-h] [-c <count>] [-i <ms>] [-s <bytes>] [-w <window>] [-W <ms>] [-q] [-j] <socket_lower> <mip_addr> <message> <ttl> \n", argv[0]);
     printf("  -h\t\tPrints this help message\n");
+    printf("  -c <count>\tNumber of requests to send (default 1)\n");
+    printf("  -i <ms>\tInterval between requests, 0 to send as fast as the window allows (default 1000)\n");
+    printf("  -s <bytes>\tPads the payload to <bytes> bytes, at most %d\n", MAX_PAYLOAD);
+    printf("  -w <window>\tMaximum number of requests waiting for a reply (default 1)\n");
+    printf("  -W <ms>\tTime to wait for a reply (default %d)\n", TIMEOUT * 1000);
+    printf("  -q\t\tOnly prints the summary\n");
+    printf("  -j\t\tPrints the summary as JSON\n");
     printf("  <socket_lower>\tPathname of the UNIX socket used to interface with lower layers.\n");
     printf("  <mip_addr>\tThe MIP address of the destination host\n");
     printf("  <message>\tThe message to send\n");
@@ -36,23 +65,114 @@ void print_help(char *argv[]) {
  * @return void
  */
 void usage_and_exit(char *argv[]) {
-    printf("Usage: %s [-h] <socket_lower> <mip_addr> <message> \n", argv[0]);
+    printf("Usage: %s [-h] [-c <count>] [-i <ms>] [-s <bytes>] [-w <window>] [-W <ms>] [-q] [-j] <socket_lower> <mip_addr> <message> \n", argv[0]);
     exit(EXIT_FAILURE);
 }
 
+/**
+ * Signal handler for SIGINT. Stops sending and prints the summary.
+ * @param signum: The signal number
+ * @return void
+ */
+void handle_stop_signal(int signum) {
+    (void)signum;
+    stop_flag = 1;
+}
+
+/**
+ * Returns the monotonic time in microseconds.
+ */
+static u_int64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Compares two doubles, for qsort().
+ */
+static int compare_double(void const *a, void const *b) {
+    double x = *(double const *)a, y = *(double const *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Returns a percentile of sorted values, using the nearest rank.
+ *
+ * @param sorted: The values, sorted in increasing order.
+ * @param n: The number of values, at least one.
+ * @param p: The percentile, between 0 and 1.
+ * @return: The smallest value that at least p of the values are less than or equal to.
+ */
+static double percentile(double const *sorted, unsigned long n, double p) {
+    unsigned long rank = (unsigned long)ceil(p * n);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * Prints the summary of a run, as text or as JSON.
+ *
+ * @param stats: The statistics of the run.
+ * @param destination: The MIP address pinged.
+ * @param elapsed_s: Time from the first request to the end of the run, in seconds.
+ * @param json: If the summary is printed as JSON.
+ */
+static void print_summary(struct ping_stats *stats, int destination, double elapsed_s, int json) {
+    unsigned long n = stats->received;
+    unsigned long lost = stats->sent - n;
+    double min = 0, avg = 0, max = 0, stddev = 0, p50 = 0, p99 = 0, p999 = 0;
+    if (n > 0) {
+        double sum = 0, sum_sq = 0;
+        for (unsigned long i = 0; i < n; i++) {
+            sum += stats->rtt_ms[i];
+            sum_sq += stats->rtt_ms[i] * stats->rtt_ms[i];
+        }
+        avg = sum / n;
+        stddev = sqrt(fmax(sum_sq / n - avg * avg, 0));
+        qsort(stats->rtt_ms, n, sizeof(double), compare_double);
+        min = stats->rtt_ms[0];
+        max = stats->rtt_ms[n - 1];
+        p50 = percentile(stats->rtt_ms, n, 0.5);
+        p99 = percentile(stats->rtt_ms, n, 0.99);
+        p999 = percentile(stats->rtt_ms, n, 0.999);
+    }
+    double loss = stats->sent > 0 ? 100.0 * lost / stats->sent : 0;
+    double rate = elapsed_s > 0 ? n / elapsed_s : 0;
+
+    if (json) {
+        printf("{\"destination\":%d,\"sent\":%lu,\"received\":%lu,\"lost\":%lu,\"loss_pct\":%.3f,"
+               "\"duplicates\":%lu,\"reordered\":%lu,\"late\":%lu,\"elapsed_s\":%.6f,\"replies_per_s\":%.1f,"
+               "\"rtt_ms\":{\"min\":%.6f,\"avg\":%.6f,\"max\":%.6f,\"stddev\":%.6f,\"p50\":%.6f,\"p99\":%.6f,\"p999\":%.6f}}\n",
+               destination, stats->sent, n, lost, loss, stats->duplicates, stats->reordered, stats->late,
+               elapsed_s, rate, min, avg, max, stddev, p50, p99, p999);
+        return;
+    }
+    printf("--- %d ping statistics ---\n", destination);
+    printf("%lu sent, %lu received, %lu lost (%.1f%%), %lu duplicates, %lu reordered, %lu late\n",
+           stats->sent, n, lost, loss, stats->duplicates, stats->reordered, stats->late);
+    if (n > 0) {
+        printf("rtt min/avg/max/stddev = %.3f/%.3f/%.3f/%.3f ms\n", min, avg, max, stddev);
+        printf("rtt p50/p99/p999 = %.3f/%.3f/%.3f ms\n", p50, p99, p999);
+    }
+    printf("%.1f replies/s over %.3f s\n", rate, elapsed_s);
+}
+
 /**
  * Main function for the ping program using the MIP protocol.
  *
- * Accepts destination host and TTL (default 8 seconds) as arguments. The program
+ * Accepts destination host and TTL (default 8) as arguments. The program
  * interfaces with relevant services over a Unix domain socket. It sets up Unix
  * socket for communication and sends initial message indicating the type of data the
  * higher layers are supposed to handle with the lower layers by sending a specific SDU type.
- * Constructs a ping message and sends to destination host using the Unix socket.
- * It waits for a response from the destination host for a specfied TTL or a timeout.
  *
- * On getting a response from the host, it computes the Round Trip Time (RTT), prints the
- * received PING message along with the RTT. If no response is received from the host
- * within the specified TTL or a timeout, it prints a timeout message.
+ * Sends <count> ping messages to the destination host, one every <interval> milliseconds, or as fast as
+ * possible with an interval of 0, with at most <window> of them waiting for a reply at a time. The payload of
+ * each message starts with its sequence number and send time, so the replies can be matched and timed without
+ * keeping per-request state in the server. A request without a reply within the timeout is counted as lost.
+ *
+ * Each reply is printed with its RTT, unless -q is given or the interval is 0. With more than one request,
+ * a summary of loss, duplicates, reordering and the RTT distribution is printed at the end, or when
+ * SIGINT is received. With a single request and no reply, a timeout message is printed.
  *
  * @param argc: Integer, number of arguments passed to the program from the terminal.
  * @param argv: Array of strings representing the arguments passed to the program.
@@ -64,13 +184,40 @@ int main(int argc, char *argv[]) {
 
     int opt, hflag = 0;
     const char *socket_lower, *destination_host, *message;
+    unsigned long count = 1;    // Number of requests to send.
+    long interval_ms = 1000;    // Time between requests.
+    int payload_size = 0;       // Size the payload is padded to, 0 for no padding.
+    unsigned long window = 1;   // Maximum number of requests waiting for a reply.
+    long timeout_ms = TIMEOUT * 1000;
+    int quiet = 0, json = 0;
 
-    while ((opt = getopt(argc, argv, "h")) != -1) {
+    while ((opt = getopt(argc, argv, "hc:i:s:w:W:qj")) != -1) {
         switch (opt) {
             case 'h':
                 // Help flag given
                 hflag = 1;
                 break;
+            case 'c':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'i':
+                interval_ms = atol(optarg);
+                break;
+            case 's':
+                payload_size = atoi(optarg);
+                break;
+            case 'w':
+                window = strtoul(optarg, NULL, 10);
+                break;
+            case 'W':
+                timeout_ms = atol(optarg);
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            case 'j':
+                json = 1;
+                break;
             default:
                 usage_and_exit(argv);
         }
@@ -86,6 +233,9 @@ int main(int argc, char *argv[]) {
     if (argc - optind != 3 && argc - optind != 4) {
         usage_and_exit(argv);
     }
+    if (count == 0 || window == 0 || interval_ms < 0 || timeout_ms <= 0 || payload_size < 0 || payload_size > MAX_PAYLOAD) {
+        usage_and_exit(argv);
+    }
 
     // Set the arguments
     socket_lower = argv[optind];
@@ -96,6 +246,9 @@ int main(int argc, char *argv[]) {
     if (argc - optind == 4) {
         ttl = atoi(argv[optind + 3]);
     }
+    if (interval_ms == 0) {
+        quiet = 1; // Printing every reply would slow down a flood
+    }
 
     // Create unix socket for interfacing with lower layers
     int usd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
@@ -122,23 +275,7 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    // Construct the ping message
-    char ping_message[256];
-    snprintf(ping_message, sizeof(ping_message), "PING:%s", message);
-
-    // Create the packet
-    struct unix_message packet;
-    packet.mip_addr = atoi(destination_host);
-    strncpy(packet.message, message, sizeof(packet.message));
-    packet.ttl = ttl;
-
-    // Send the ping message
-    if (send(usd, &packet, sizeof(packet), 0) == -1) {
-        perror("send");
-        exit(EXIT_FAILURE);
-    }
-
-    // Wait for a response or timeout
+    // Wait for responses or timeouts
     struct epoll_event ev, events[1];
     int epollfd = epoll_create1(0);
     if (epollfd == -1) {
@@ -153,30 +290,143 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    struct timespec start, end;
-    clock_gettime(CLOCK_MONOTONIC, &start);
+    // Stop early and print the summary on SIGINT
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
 
-    int nfds = epoll_wait(epollfd, events, 1, TIMEOUT * 1000); // timeout in milliseconds
+    struct ping_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    u_int8_t *state = calloc(count, sizeof(u_int8_t));         // SEQ_* of each request.
+    u_int64_t *sent_us = calloc(count, sizeof(u_int64_t));      // Send time of each request.
+    stats.rtt_ms = calloc(count, sizeof(double));
+    if (state == NULL || sent_us == NULL || stats.rtt_ms == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
 
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    struct unix_message packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.mip_addr = atoi(destination_host);
+    packet.ttl = ttl;
 
-    if (nfds == 0) {
-        printf("timeout\n");
-    } else {
-        // Read the pong message
-        char buffer[256];
-        recv(usd, buffer, sizeof(buffer), 0);
-        // Check if the received message the same as the sent message
-        char const *recv_message = strstr(buffer, ":") + 1; // Skip the PONG: part of the string
-        if (memcmp(recv_message, message, strlen(message)) != 0) {
-            printf("Received pong message does not match sent message\n");
+    u_int64_t start_us = now_us();
+    u_int64_t next_send_us = start_us;
+    unsigned long oldest = 0;       // The oldest request that may still be waiting for a reply.
+    long highest_seq = -1;          // The highest sequence number a reply has been received for.
+
+    while (!stop_flag && (stats.sent < count || stats.outstanding > 0)) {
+        u_int64_t now = now_us();
+
+        // Send the requests that are due, as far as the window allows
+        while (stats.sent < count && stats.outstanding < window && now >= next_send_us) {
+            unsigned long seq = stats.sent;
+            // The payload is text, so it is echoed unchanged by servers that copy it as a string
+            int len = snprintf(packet.message, sizeof(packet.message), "%lu %llu %s", seq, (unsigned long long)now, message);
+            if (len > MAX_PAYLOAD) {
+                len = MAX_PAYLOAD;
+            }
+            if (len < payload_size) {
+                memset(packet.message + len, '.', payload_size - len);
+                len = payload_size;
+            }
+            packet.message[len] = '\0';
+
+            if (send(usd, &packet, sizeof(packet), 0) == -1) {
+                perror("send");
+                exit(EXIT_FAILURE);
+            }
+            sent_us[seq] = now;
+            stats.sent++;
+            stats.outstanding++;
+            next_send_us = interval_ms > 0 ? next_send_us + interval_ms * 1000 : now;
+        }
+
+        // Give up on the requests that have waited longer than the timeout
+        while (oldest < stats.sent && (state[oldest] != SEQ_PENDING || now - sent_us[oldest] >= (u_int64_t)timeout_ms * 1000)) {
+            if (state[oldest] == SEQ_PENDING) {
+                state[oldest] = SEQ_EXPIRED;
+                stats.outstanding--;
+            }
+            oldest++;
+        }
+        if (stats.sent == count && stats.outstanding == 0) {
+            break;
+        }
+
+        // Sleep until the next request is due, the oldest request times out or a reply arrives
+        u_int64_t wake_us = now + (u_int64_t)timeout_ms * 1000;
+        if (oldest < stats.sent && sent_us[oldest] + timeout_ms * 1000 < wake_us) {
+            wake_us = sent_us[oldest] + timeout_ms * 1000;
+        }
+        if (stats.sent < count && stats.outstanding < window && next_send_us < wake_us) {
+            wake_us = next_send_us;
+        }
+        int wait_ms = wake_us > now ? (int)((wake_us - now + 999) / 1000) : 0;
+        int nfds = epoll_wait(epollfd, events, 1, wait_ms);
+        if (nfds <= 0) {
+            continue;
+        }
+
+        // Read all the replies that have arrived
+        char buffer[sizeof(struct unix_message)];
+        long rc;
+        while ((rc = recv(usd, buffer, sizeof(buffer) - 1, MSG_DONTWAIT)) > 0) {
+            u_int64_t received_us = now_us();
+            buffer[rc] = '\0';
+            char const *reply = buffer + 2; // Skip the MIP address and TTL
+            char const *payload = strstr(reply, ":"); // Skip the PONG: part of the string
+            unsigned long seq;
+            unsigned long long timestamp;
+            int text_offset = 0;
+            if (payload == NULL || sscanf(payload + 1, "%lu %llu %n", &seq, &timestamp, &text_offset) < 2
+                || seq >= stats.sent || timestamp != sent_us[seq]) {
+                if (!quiet) {
+                    printf("Received pong message does not match sent message\n");
+                }
+                continue;
+            }
+
+            double rtt_ms = (received_us - timestamp) / 1000.0;
+            if (state[seq] == SEQ_RECEIVED) {
+                stats.duplicates++;
+                continue;
+            }
+            if (state[seq] == SEQ_PENDING) {
+                stats.outstanding--;
+            } else {
+                stats.late++;
+            }
+            state[seq] = SEQ_RECEIVED;
+            stats.rtt_ms[stats.received++] = rtt_ms;
+            if ((long)seq < highest_seq) {
+                stats.reordered++;
+            } else {
+                highest_seq = (long)seq;
+            }
+            if (!quiet) {
+                printf("Received: PONG:%.*s, seq=%lu, RTT: %.4f seconds\n",
+                       (int)strlen(message), payload + 1 + text_offset, seq, rtt_ms / 1000);
+            }
         }
-        printf("Received: %s, RTT: %.4f seconds\n", buffer, elapsed);
+    }
+    double elapsed_s = (now_us() - start_us) / 1e6;
+
+    if (count == 1 && !json) {
+        // A single ping keeps the short output
+        if (stats.received == 0) {
+            printf("timeout\n");
+        }
+    } else {
+        print_summary(&stats, packet.mip_addr, elapsed_s, json);
     }
 
     // Close the UNIX socket
     close(usd);
+    free(state);
+    free(sent_us);
+    free(stats.rtt_ms);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // For recvmmsg() and sendmmsg().
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,22 +6,39 @@
 #include <sys/socket.h>
 #include <sys/epoll.h>
 #include <sys/un.h>
+#include <time.h>
 #include "../mipd/mipd_common.h"
 
+#define BATCH 64                    // Maximum number of requests received or answered by one syscall.
+#define PONG_PREFIX "PONG:"         // Put in front of the echoed request.
+#define PONG_PREFIX_LEN 5
+#define PONG_TTL 15                 // TTL of the replies.
+
 struct unix_message {
     u_int8_t mip_addr;
     u_int8_t ttl;
     char message[511];
 };
 
+/**
+ * Returns the monotonic time in milliseconds.
+ */
+static u_int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 /**
  * Prints the help message
  * @param argv: The command line arguments
  * @return void
  */
 void print_help(char *argv[]) {
-    printf("Usage: %s [-h] <socket_lower>\n", argv[0]);
+    printf("Usage: %s [-h] [-v] [-r <s>] <socket_lower>\n", argv[0]);
     printf("  -h\t\tPrints this help message\n");
+    printf("  -v\t\tPrints every request\n");
+    printf("  -r <s>\tPrints the requests per second every <s> seconds while there are requests, 0 to disable (default 1)\n");
     printf("  <socket_lower>\tpathname of the socket that the MIP daemon uses to communicate with upper layers .\n");
 }
 
@@ -30,7 +48,7 @@ void print_help(char *argv[]) {
  * @return void
  */
 void usage_and_exit(char *argv[]) {
-    printf("Usage: %s [-h] <socket_lower>\n", argv[0]);
+    printf("Usage: %s [-h] [-v] [-r <s>] <socket_lower>\n", argv[0]);
     exit(EXIT_FAILURE);
 }
 
@@ -47,7 +65,10 @@ void usage_and_exit(char *argv[]) {
  * An epoll instance is created to handle multiple file descriptors.
  *
  * The function then enters a loop where it waits for incoming events.
- * If an event happens on the Unix socket, a response message is read and a PONG reply is prepared and sent back.
+ * If an event happens on the Unix socket, all the requests waiting on it are received with one recvmmsg() call,
+ * each into a reply buffer right after the "PONG:" prefix, so the reply is the request echoed in place. The
+ * replies of the batch are sent back with one sendmmsg() call. Requests from any number of clients are answered
+ * to the MIP address they came from. Every <s> seconds with requests, the number of requests per second is printed.
  * If an error occurs during any of these steps, the function exits with a failure status.
  *
  * @param argc: Integer, number of arguments passed to the program from the terminal.
@@ -60,14 +81,22 @@ void usage_and_exit(char *argv[]) {
 int main(int argc, char *argv[]) {
     int opt;
     int hflag = 0; // Stores if the help-flag is given.
+    int verbose = 0; // Stores if every request is printed.
+    int report_s = 1; // Seconds between the reports of requests per second, 0 for no reports.
     char const *socket_lower; // Stores the pathname of the socket that the MIP daemon uses to communicate with upper layers.
 
-    while ((opt = getopt(argc, argv, "h")) != -1) {
+    while ((opt = getopt(argc, argv, "hvr:")) != -1) {
         switch (opt) {
             case 'h':
                 // Help flag given
                 hflag = 1;
                 break;
+            case 'v':
+                verbose = 1;
+                break;
+            case 'r':
+                report_s = atoi(optarg);
+                break;
             default:
                 usage_and_exit(argv);
         }
@@ -127,36 +156,94 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    // Reply buffers. Each request is received right after the prefix of its reply, and the MIP address of the
+    // request is the destination of the reply, so nothing has to be copied or formatted.
+    // The end of a request that does not fit after the prefix is cut off, as snprintf() would do.
+    static struct unix_message replies[BATCH];
+    struct mmsghdr msgs[BATCH];
+    struct iovec request_iovs[BATCH][2];    // The address and TTL in place, and the request after the prefix.
+    struct iovec reply_iovs[BATCH];         // The whole reply.
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < BATCH; i++) {
+        memcpy(replies[i].message, PONG_PREFIX, PONG_PREFIX_LEN);
+        request_iovs[i][0].iov_base = &replies[i];
+        request_iovs[i][0].iov_len = 2;
+        request_iovs[i][1].iov_base = replies[i].message + PONG_PREFIX_LEN;
+        request_iovs[i][1].iov_len = sizeof(replies[i].message) - PONG_PREFIX_LEN - 1;
+        reply_iovs[i].iov_base = &replies[i];
+        reply_iovs[i].iov_len = sizeof(struct unix_message);
+    }
+
+    unsigned long total = 0;                // Requests answered since the start.
+    unsigned long reported = 0;             // Requests answered at the last report.
+    u_int64_t report_ms = now_ms();         // Time of the last report.
+
     // Main loop for receiving and handling messages
     while (1) {
-        int nfds = epoll_wait(epollfd, events, 10, -1);
+        int timeout_ms = -1;
+        if (report_s > 0 && total != reported) {
+            u_int64_t due_ms = report_ms + report_s * 1000;
+            u_int64_t now = now_ms();
+            timeout_ms = due_ms > now ? (int)(due_ms - now) : 0;
+        }
+        int nfds = epoll_wait(epollfd, events, 10, timeout_ms);
         if (nfds == -1) {
             perror("epoll_wait");
             exit(EXIT_FAILURE);
         }
+        if (total == reported) {
+            // The first requests after a quiet period start a new report interval
+            report_ms = now_ms();
+        }
 
         for (int i = 0; i < nfds; ++i) {
             if (events[i].data.fd == usd) {
-                // Received something on the Unix socket
-                struct unix_message received_packet;
-                ssize_t n = recv(usd, &received_packet, sizeof(received_packet), 0);
-                if (n > 0) {
-
-                    printf("Received from host %c: %s\n", received_packet.mip_addr, received_packet.message);
-
-                    // Prepare a PONG response
-                    struct unix_message response_packet;
-                    response_packet.mip_addr = received_packet.mip_addr;
-                    response_packet.ttl = 15; // Default TTL
-                    snprintf(response_packet.message, sizeof(response_packet.message), "PONG:%s", received_packet.message);
-
-                    // Send the response back
-                    if (send(usd, &response_packet, sizeof(response_packet), 0) == -1) {
-                        perror("send");
-                        exit(EXIT_FAILURE);
+                // Received something on the Unix socket. Answer everything that is waiting, a batch at a time.
+                int n;
+                do {
+                    for (int j = 0; j < BATCH; j++) {
+                        msgs[j].msg_hdr.msg_iov = request_iovs[j];
+                        msgs[j].msg_hdr.msg_iovlen = 2;
+                    }
+                    n = recvmmsg(usd, msgs, BATCH, MSG_DONTWAIT, NULL);
+                    if (n <= 0) {
+                        break;
+                    }
+
+                    for (int j = 0; j < n; j++) {
+                        replies[j].ttl = PONG_TTL;
+                        replies[j].message[sizeof(replies[j].message) - 1] = '\0';
+                        if (verbose) {
+                            printf("Received from host %d: %s\n", replies[j].mip_addr, replies[j].message + PONG_PREFIX_LEN);
+                        }
+                        msgs[j].msg_hdr.msg_iov = &reply_iovs[j];
+                        msgs[j].msg_hdr.msg_iovlen = 1;
+                    }
+
+                    // Send the replies back
+                    int sent = 0;
+                    while (sent < n) {
+                        int rc = sendmmsg(usd, msgs + sent, n - sent, 0);
+                        if (rc == -1) {
+                            perror("send");
+                            exit(EXIT_FAILURE);
+                        }
+                        sent += rc;
                     }
-                }
+                    total += n;
+                } while (n == BATCH);
             }
         }
+
+        // Report the request rate
+        u_int64_t now = now_ms();
+        if (report_s > 0 && now - report_ms >= (u_int64_t)report_s * 1000) {
+            if (total != reported) {
+                printf("%.1f requests/s (%lu in total)\n", (total - reported) * 1000.0 / (now - report_ms), total);
+                fflush(stdout);
+            }
+            reported = total;
+            report_ms = now;
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include "convergence.h"
+#include "../table/table.h"
+#include "../linkstate/linkstate.h"
+
+/**
+ * A burst of routing table changes, from the first change after a quiet period to the last change before the next.
+ */
+struct convergence_episode {
+    u_int64_t start_ms;     // Time of the first change.
+    u_int64_t end_ms;       // Time of the last change so far.
+    unsigned long changes;  // Number of changes in the episode.
+};
+
+static unsigned long seen_version = 0;              // The table version when the table was last checked.
+static struct convergence_episode current;          // The episode in progress, or the last one.
+static struct convergence_episode longest;          // The longest episode that has ended.
+static unsigned long episodes = 0;                  // Number of episodes, including the current one.
+static u_int64_t total_ms = 0;                      // Sum of the length of the episodes that have ended.
+
+/**
+ * Ends the current episode and adds it to the totals.
+ */
+static void end_episode() {
+    u_int64_t length = current.end_ms - current.start_ms;
+    total_ms += length;
+    if (length >= longest.end_ms - longest.start_ms) {
+        longest = current;
+    }
+}
+
+/**
+ * Checks if the routing table has changed since the last check, and records when it did.
+ *
+ * Called from the main loop after every event, for both routing engines. Changes that come less than
+ * CONVERGENCE_QUIET_MS apart belong to the same episode. The length of an episode, from its first to its
+ * last change, is how long this node took to converge after a topology change. Since the start and end are
+ * taken from the monotonic clock, the episodes of different nodes on one host can be compared to find the
+ * convergence time of the whole network.
+ */
+void convergence_check() {
+    if (table_version == seen_version) {
+        return;
+    }
+    unsigned long changes = table_version - seen_version;
+    seen_version = table_version;
+
+    u_int64_t now = current_time_ms();
+    if (episodes == 0 || now - current.end_ms >= CONVERGENCE_QUIET_MS) {
+        if (episodes > 0) {
+            end_episode();
+        }
+        episodes++;
+        current.start_ms = now;
+        current.changes = 0;
+    }
+    current.end_ms = now;
+    current.changes += changes;
+}
+
+/**
+ * Prints the convergence episodes to stdout.
+ * The current episode is included if it has been quiet for CONVERGENCE_QUIET_MS.
+ */
+void print_convergence_stats() {
+    int current_done = episodes > 0 && current_time_ms() - current.end_ms >= CONVERGENCE_QUIET_MS;
+    unsigned long done = current_done ? episodes : (episodes > 0 ? episodes - 1 : 0);
+    u_int64_t total = total_ms + (current_done ? current.end_ms - current.start_ms : 0);
+    struct convergence_episode const *max = &longest;
+    if (current_done && current.end_ms - current.start_ms >= longest.end_ms - longest.start_ms) {
+        max = &current;
+    }
+
+    printf("Convergence (%s): episodes=%lu avg=%.1f ms max=%llu ms\n",
+           linkstate_mode ? "link-state" : "distance vector", done,
+           done > 0 ? (double)total / done : 0.0, (unsigned long long)(max->end_ms - max->start_ms));
+    if (episodes > 0) {
+        printf("  last episode: start=%llu end=%llu (%llu ms, %lu changes)%s\n",
+               (unsigned long long)current.start_ms, (unsigned long long)current.end_ms,
+               (unsigned long long)(current.end_ms - current.start_ms), current.changes,
+               current_done ? "" : " in progress");
+    }
+    fflush(stdout);
+}
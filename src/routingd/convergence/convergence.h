@@ -0,0 +1,12 @@
+#ifndef CONVERGENCE_H
+#define CONVERGENCE_H
+
+#include "../routing_common.h"
+
+#define CONVERGENCE_QUIET_MS 2000   // Time without routing table changes after which the table is considered converged.
+
+void convergence_check();
+
+void print_convergence_stats();
+
+#endif //CONVERGENCE_H
@@ -3,6 +3,10 @@
 #include "hello/hello.h"
 #include "update/update.h"
 #include "request/request.h"
+#include "liveness/liveness.h"
+#include "hello/checkin.h"
+#include "linkstate/linkstate.h"
+#include "warm_restart/warm_restart.h"
 #include "routing_common.h"
 
 
@@ -19,7 +23,20 @@ void handle_message(int usd, general_message message) {
     u_int8_t id3 = message.header.id3;
     //global_debug("Received message with ID %c%c%c\n", id1, id2, id3);
 
-    // Identify HELLO, UPDATE, REQUEST
+    // REQUEST and NEXT HOP DOWN come from the local mipd, everything else from a neighbour
+    int from_mipd = (id1 == 0x52 && id2 == 0x45 && id3 == 0x51) || (id1 == 0x4e && id2 == 0x48 && id3 == 0x44);
+    if (!from_mipd) {
+        warm_restart_heard(message.header.mip_addr);
+    } else if (local_mip_addr != message.header.mip_addr) {
+        // mipd puts its own address in the header, and sends a REQUEST as soon as we have connected
+        global_debug("Learned local MIP address %d from mipd\n", message.header.mip_addr);
+        local_mip_addr = message.header.mip_addr;
+        if (linkstate_mode) {
+            linkstate_schedule_lsa();
+        }
+    }
+
+    // Identify HELLO, UPDATE, REQUEST, LIVENESS, NEXT HOP DOWN, LINK-STATE ADVERTISEMENT, TABLE REQUEST
     if (id1 == 0x48 && id2 == 0x45 && id3 == 0x4c) {
         // HELLO
         hello_message hello;
@@ -29,12 +46,32 @@ void handle_message(int usd, general_message message) {
         // UPDATE
         update_message update;
         memcpy(&update, &message, sizeof(update));
-        handle_update_message(usd, update);
+        handle_update_message(update);
     } else if (id1 == 0x52 && id2 == 0x45 && id3 == 0x51) {
         // REQUEST
         request_message request;
         memcpy(&request, &message, sizeof(request));
         handle_request_message(usd, request);
+    } else if (id1 == 0x4c && id2 == 0x49 && id3 == 0x56) {
+        // LIVENESS
+        liveness_message liveness;
+        memcpy(&liveness, &message, sizeof(liveness));
+        handle_liveness_message(usd, liveness);
+    } else if (id1 == 0x4e && id2 == 0x48 && id3 == 0x44) {
+        // NEXT HOP DOWN
+        nexthop_down_message nexthop_down;
+        memcpy(&nexthop_down, &message, sizeof(nexthop_down));
+        handle_nexthop_down_message(nexthop_down);
+    } else if (id1 == 0x4c && id2 == 0x53 && id3 == 0x41) {
+        // LINK-STATE ADVERTISEMENT
+        lsa_message lsa;
+        memcpy(&lsa, &message, sizeof(lsa));
+        handle_lsa_message(usd, lsa);
+    } else if (id1 == 0x54 && id2 == 0x52 && id3 == 0x51) {
+        // TABLE REQUEST
+        table_request_message table_request;
+        memcpy(&table_request, &message, sizeof(table_request));
+        handle_table_request_message(usd, table_request);
     } else {
         global_debug("Unknown message ID\n");
     }
@@ -1,12 +1,73 @@
+#include <stdint.h>
 #include "checkin.h"
 #include "../table/table.h"
+#include "../timer/timer.h"
+#include "../update/update.h"
+#include "../routing_common.h"
+#include "../liveness/liveness.h"
+#include "hello.h"
 
-u_int8_t checkins[MAX_NODES];
+int neighbour_dead_interval_ms = 10000; // How long a neighbour may be silent before it is considered dead.
+
+int checkins[MAX_NODES]; // The dead-interval timer of each node, 0 if the node has never checked in.
+
+/**
+ * Invalidates all routes via a neighbour that is no longer reachable.
+ *
+ * Marks all routes via the neighbour as unreachable, schedules UPDATE messages to the remaining neighbours
+ * and resets the HELLO interval. Used both when the dead interval runs out and when the liveness session of the neighbour goes down.
+ *
+ * @param mip_addr: The MIP address of the neighbour.
+ */
+void neighbour_down(u_int8_t mip_addr) {
+    global_debug("Neighbour %d is down\n", mip_addr);
+    set_hop_unreachable(mip_addr);
+    print_routing_table();
+    hello_topology_changed();
+    schedule_update_messages();
+}
+
+/**
+ * Handles a message from mipd telling that the data plane considers a next hop to be down.
+ *
+ * mipd sends it when sends to the next hop keep failing, its ARP requests go unanswered or packets pile up
+ * in the ARP queue. Routes via the next hop are invalidated right away instead of waiting for the dead interval.
+ *
+ * @param message: The next hop down message that was received.
+ */
+void handle_nexthop_down_message(nexthop_down_message message) {
+    u_int8_t next_hop = message.next_hop_mip;
+    global_debug("mipd reports next hop %d as down (reason %d)\n", next_hop, message.reason);
+    if (!is_neighbour(next_hop)) {
+        // Not a neighbour, nothing to invalidate
+        return;
+    }
+    neighbour_down(next_hop);
+}
+
+/**
+ * Called when a neighbour has not checked in within the dead interval.
+ * The neighbour is only declared down here if no liveness session is watching it.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ * @param arg: The MIP address of the neighbour, stored in the pointer.
+ */
+static void neighbour_timed_out(int usd, void *arg) {
+    (void)usd;
+    u_int8_t mip_addr = (u_int8_t)(uintptr_t)arg;
+    if (!is_neighbour(mip_addr) || liveness_session_up(mip_addr)) {
+        // Not a neighbour anymore, or its liveness session decides
+        return;
+    }
+    global_debug("Neighbour %d has timed out\n", mip_addr);
+    neighbour_down(mip_addr);
+}
 
 /**
  * Initializes the check-ins table for MIP nodes.
  *
  * Sets all entries in the check-ins table to zero, indicating no nodes have checked in yet.
+ * The dead-interval timers are created when a node first checks in.
  */
 void init_checkins() {
     for (int i = 0; i < MAX_NODES; i++) {
@@ -17,27 +78,43 @@ void init_checkins() {
 /**
  * Marks the node identified by the given MIP address as having checked in.
  *
+ * Restarts the dead-interval timer of the node, so it times out after the hold time it advertised, or
+ * neighbour_dead_interval_ms if that is longer, unless it checks in again.
+ *
  * @param mip_addr: The MIP address of the node which has checked in.
+ * @param hold_ms: The hold time from the HELLO message of the node.
  */
-void checkin_node(u_int8_t mip_addr) {
-    checkins[mip_addr] = 1;
+void checkin_node(u_int8_t mip_addr, u_int32_t hold_ms) {
+    if (checkins[mip_addr] == 0) {
+        int timer_id = timer_create_new(neighbour_timed_out, (void *)(uintptr_t)mip_addr);
+        if (timer_id < 0) {
+            // Tried again on the next check-in
+            global_debug("Could not create the dead-interval timer of node %d\n", mip_addr);
+            return;
+        }
+        checkins[mip_addr] = timer_id;
+    }
+    u_int32_t dead_ms = (u_int32_t)neighbour_dead_interval_ms;
+    u_int64_t dead_interval = hold_ms > dead_ms ? hold_ms : dead_ms;
+    timer_arm(checkins[mip_addr], dead_interval);
 }
 
 /**
- * Checks if a node, identified by the given MIP address, has checked in.
+ * Checks if a node, identified by the given MIP address, is within its dead interval.
  *
  * @param mip_addr: The MIP address of the node to check.
- * @return: The check-in status of the node identified by mip_addr, 1 for checked in, 0 otherwise.
+ * @return: 1 if the node has checked in within the dead interval, 0 otherwise.
  */
 int has_node_checked_in(u_int8_t mip_addr) {
-    return checkins[mip_addr];
+    return timer_is_armed(checkins[mip_addr]);
 }
 
 /**
  * Removes the check-in status of the node identified by the given MIP address.
+ * Stops its dead-interval timer without declaring it dead.
  *
  * @param mip_addr: The MIP address of the node to uncheck.
  */
 void uncheckin_node(u_int8_t mip_addr) {
-    checkins[mip_addr] = 0;
-}
\ No newline at end of file
+    timer_disarm(checkins[mip_addr]);
+}
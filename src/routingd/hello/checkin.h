@@ -2,10 +2,17 @@
 #define CHECKIN_H
 
 #include <sys/types.h>
+#include "../../common/routing/routing_messages.h"
+
+extern int neighbour_dead_interval_ms; // How long a neighbour may be silent before it is considered dead.
+
+void neighbour_down(u_int8_t mip_addr);
+
+void handle_nexthop_down_message(nexthop_down_message message);
 
 void init_checkins();
 
-void checkin_node(u_int8_t mip_addr);
+void checkin_node(u_int8_t mip_addr, u_int32_t hold_ms);
 
 int has_node_checked_in(u_int8_t mip_addr);
 
@@ -1,20 +1,65 @@
 #include <sys/socket.h>
 #include <stdio.h>
+#include <arpa/inet.h>
 #include "../table/table.h"
 #include "../../common/routing/routing_messages.h"
 #include "../routing_common.h"
 #include "../update/update.h"
 #include "hello.h"
 #include "checkin.h"
+#include "../timer/timer.h"
+#include "../liveness/liveness.h"
+#include "../metric/metric.h"
+#include "../linkstate/linkstate.h"
 
 #define MIP_BROADCAST 255
 #define BROADCAST_TTL 1
 
+int hello_interval_ms = 1000;       // Interval between HELLO messages after startup or a topology change.
+int hello_max_interval_ms = 30000;  // Interval between HELLO messages once the neighbourhood has been stable.
+
+static int hello_timer = 0;                 // Timer that sends the periodic HELLO messages.
+static int current_interval_ms = 0;         // Interval until the next HELLO message.
+static int fast_hellos_left = HELLO_FAST_COUNT; // HELLO messages left to send at hello_interval_ms before backing off.
+static u_int64_t last_hello_ms = 0;         // When the last HELLO message was sent.
+
+/**
+ * Counters for HELLO messages, printed on SIGUSR1.
+ */
+static struct {
+    unsigned long sent;         // HELLO messages sent.
+    unsigned long received;     // HELLO messages received.
+    unsigned long changes;      // Received HELLO messages that changed a neighbour or link cost.
+    unsigned long resets;       // Times the interval was reset to hello_interval_ms by a topology change.
+} hello_stats;
+
+/**
+ * Returns the hold time to advertise in our HELLO messages.
+ * It is the dead interval, or HELLO_HOLD_MULT times hello_interval_ms if that is longer. It does not grow with
+ * the backed-off interval, so a neighbour notices that we are gone within the dead interval. Instead the
+ * interval backs off to at most a HELLO_HOLD_MULT part of the hold time, see start_hello_timer().
+ */
+static u_int32_t hello_hold_ms() {
+    u_int64_t hold = (u_int64_t)hello_interval_ms * HELLO_HOLD_MULT;
+    if (hold < (u_int64_t)neighbour_dead_interval_ms) {
+        hold = neighbour_dead_interval_ms;
+    }
+    return (u_int32_t)hold;
+}
+
 /**
  * Function to process 'HELLO' messages received in the MIP routing protocol.
  *
  * This function handles the response to incoming 'HELLO' messages, managing updates
  * to routing tables and communicating changes to other nodes.
+ * If liveness is enabled, a liveness session is started with the sender. While that session is
+ * down after having been up, the sender is not added back as a neighbour.
+ * The measurements in the HELLO update the cost of the link to the sender. If the cost changes by more
+ * than the hysteresis, all routes via the sender are adjusted by the same amount.
+ * A new neighbour is asked for its whole table. In link-state mode, it is also sent the whole link-state database.
+ * Only a new neighbour or a changed link cost schedules UPDATE messages and resets the HELLO interval.
+ * A HELLO that changes nothing only restarts the dead-interval timer of the sender, for as long as the
+ * hold time it advertises.
  *
  * @param usd: The file descriptor of the unix socket used for routing communication.
  * @param message: The 'HELLO' message that was received.
@@ -23,17 +68,38 @@
 void handle_hello_message(int usd, const hello_message message) {
     global_debug("Received HELLO message\n");
     uint8_t sender_mip = message.header.mip_addr;
-    // Check in the neighbour
-    checkin_node(sender_mip);
-    // Neighbour send us an HELLO message. Check if we have a fastest route of 1 to the sender
-    if (find_fastest_route(sender_mip).cost != 1) {
-        // This is a new neighbour. Add a route to the sender with a cost of 1
-        add_update_route(sender_mip, sender_mip, 1);
+    hello_stats.received++;
+    // Check in the neighbour for as long as it asks for
+    checkin_node(sender_mip, ntohl(message.hold_ms));
+    metric_hello_received(sender_mip, &message);
+    liveness_neighbour_seen(usd, sender_mip);
+    if (liveness_blocks_neighbour(sender_mip)) {
+        global_debug("Liveness session with %d is down, ignoring HELLO\n", sender_mip);
+        return;
+    }
+    // Neighbour send us an HELLO message. Check if we have a direct route to the sender
+    if (!is_neighbour(sender_mip)) {
+        // This is a new neighbour. Add a route to the sender with the cost of the link
+        metric_refresh_link_cost(sender_mip);
+        add_update_route(sender_mip, sender_mip, metric_link_cost(sender_mip));
         global_debug("Added %d as a new neighbour\n", sender_mip);
         print_routing_table();
+        send_table_request(usd, sender_mip);
+        if (linkstate_mode) {
+            linkstate_send_database(usd, sender_mip);
+        }
+    } else if (metric_refresh_link_cost(sender_mip)) {
+        // The link cost has changed, move all routes via the sender with it
+        adjust_routes_via(sender_mip, metric_link_cost(sender_mip) - find_direct_route(sender_mip).cost);
+        print_routing_table();
+    } else {
+        // Nothing changed, the periodic UPDATE messages sent with our own HELLO keep the neighbour up to date
+        return;
     }
-    // Send an UPDATE message to all neighbours, needs to get the new neighbour updated
-    send_update_messages(usd);
+    hello_stats.changes++;
+    hello_topology_changed();
+    // Schedule an UPDATE message to all neighbours, needs to get the new neighbour updated
+    schedule_update_messages();
 }
 
 
@@ -50,10 +116,102 @@ void send_hello_message(int usd) {
     message.header.id1 = 0x48; // H
     message.header.id2 = 0x45; // E
     message.header.id3 = 0x4C; // L
+    message.hold_ms = htonl(hello_hold_ms());
+    metric_fill_hello(&message);
 
     // Send the HELLO message
-    global_debug("Sending HELLO message\n");
-    if (send(usd, &message, sizeof(message), 0) == -1) {
+    global_debug("Sending HELLO message, next in %d ms\n", current_interval_ms);
+    if (routing_send(usd, &message, sizeof(message)) == -1) {
         perror("send");
     }
-}
\ No newline at end of file
+    hello_stats.sent++;
+    last_hello_ms = current_time_ms();
+}
+
+/**
+ * Picks the interval until the next HELLO message.
+ * The first HELLO_FAST_COUNT messages after startup or a topology change are sent hello_interval_ms apart,
+ * after that the interval doubles with every HELLO until it reaches hello_max_interval_ms.
+ */
+static void next_hello_interval() {
+    if (fast_hellos_left > 0) {
+        fast_hellos_left--;
+        current_interval_ms = hello_interval_ms;
+    } else if (current_interval_ms < hello_max_interval_ms) {
+        current_interval_ms = current_interval_ms * 2 < hello_max_interval_ms ? current_interval_ms * 2 : hello_max_interval_ms;
+    }
+}
+
+/**
+ * Timer callback that sends a HELLO message and arms the timer for the next one.
+ * Every HELLO is followed by UPDATE messages to all neighbours, so routes that were lost or timed out are
+ * refreshed at the pace of the HELLO messages.
+ */
+static void hello_timer_expired(int usd, void *arg) {
+    (void)arg;
+    next_hello_interval();
+    send_hello_message(usd);
+    schedule_update_messages();
+    timer_arm(hello_timer, current_interval_ms);
+}
+
+/**
+ * Resets the HELLO interval to hello_interval_ms after a change in the neighbourhood.
+ *
+ * Neighbours learn of the change, and the new link costs are measured, without waiting for a backed-off
+ * interval. The next HELLO is sent right away, unless the last one was sent less than hello_interval_ms ago.
+ */
+void hello_topology_changed() {
+    if (hello_timer == 0) {
+        return;
+    }
+    int was_backed_off = current_interval_ms > hello_interval_ms;
+    fast_hellos_left = HELLO_FAST_COUNT;
+    current_interval_ms = hello_interval_ms;
+    if (!was_backed_off) {
+        return;
+    }
+    hello_stats.resets++;
+    u_int64_t next = last_hello_ms + hello_interval_ms;
+    u_int64_t now = current_time_ms();
+    if (next < now) {
+        next = now;
+    }
+    if (timer_deadline(hello_timer) > next) {
+        global_debug("Topology changed, resetting HELLO interval\n");
+        timer_arm_at(hello_timer, next);
+    }
+}
+
+/**
+ * Starts sending HELLO messages, beginning with HELLO_FAST_COUNT messages every hello_interval_ms.
+ * The first HELLO is sent one interval from now.
+ * hello_max_interval_ms is lowered so that HELLO_HOLD_MULT intervals fit in the hold time.
+ */
+void start_hello_timer() {
+    int max_interval_ms = (int)(hello_hold_ms() / HELLO_HOLD_MULT);
+    if (hello_max_interval_ms > max_interval_ms) {
+        global_debug("Backing off HELLO messages to %d ms, the dead interval allows no more\n", max_interval_ms);
+        hello_max_interval_ms = max_interval_ms;
+    }
+    if (hello_max_interval_ms < hello_interval_ms) {
+        hello_max_interval_ms = hello_interval_ms;
+    }
+    if (hello_timer == 0) {
+        hello_timer = timer_create_new(hello_timer_expired, NULL);
+    }
+    if (current_interval_ms == 0) {
+        current_interval_ms = hello_interval_ms;
+    }
+    timer_arm(hello_timer, current_interval_ms);
+}
+
+/**
+ * Prints the HELLO message counters and the current interval to stdout.
+ */
+void print_hello_stats() {
+    printf("HELLO: sent=%lu received=%lu changes=%lu resets=%lu interval=%d ms (min %d, max %d)\n",
+           hello_stats.sent, hello_stats.received, hello_stats.changes, hello_stats.resets,
+           current_interval_ms, hello_interval_ms, hello_max_interval_ms);
+    fflush(stdout);
+}
@@ -4,8 +4,20 @@
 #include "../routing_common.h"
 #include "../../common/routing/routing_messages.h"
 
+#define HELLO_FAST_COUNT 3   // HELLO messages sent at the minimum interval before backing off.
+#define HELLO_HOLD_MULT 3    // HELLO intervals a neighbour may miss before it is considered dead.
+
+extern int hello_interval_ms;       // Interval between HELLO messages after startup or a topology change.
+extern int hello_max_interval_ms;   // Interval between HELLO messages once the neighbourhood has been stable.
+
 void handle_hello_message(int usd, hello_message message);
 
 void send_hello_message(int usd);
 
+void start_hello_timer();
+
+void hello_topology_changed();
+
+void print_hello_stats();
+
 #endif //HELLO_H
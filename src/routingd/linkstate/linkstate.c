@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "linkstate.h"
+#include "spf.h"
+#include "../table/table.h"
+#include "../timer/timer.h"
+#include "../update/update.h"
+
+int linkstate_mode = 0; // Set to compute routes with link-state instead of distance vector.
+
+/**
+ * The newest link-state advertisement received from a node.
+ */
+struct lsa_entry {
+    int valid;                              // Set if the entry holds an advertisement.
+    u_int16_t seq;                          // Sequence number of the advertisement.
+    int num_links;                          // Number of links advertised.
+    u_int8_t neighbours[MAX_LSA_LINKS];     // The neighbour at the other end of each link.
+    u_int16_t costs[MAX_LSA_LINKS];         // The cost of each link.
+    u_int64_t received_ms;                  // When the advertisement was installed.
+};
+
+/**
+ * Counters for the link-state protocol.
+ */
+struct linkstate_stats {
+    unsigned long originated;   // Advertisements of our own links.
+    unsigned long received;     // Advertisements received from neighbours.
+    unsigned long installed;    // Received advertisements that were newer than the one in the database.
+    unsigned long flooded;      // Advertisements sent to neighbours, including our own.
+    unsigned long purged;       // Advertisements removed because they were not refreshed.
+};
+
+static struct lsa_entry lsdb[MAX_NODES];                // The link-state database, indexed by origin.
+static u_int16_t announced[MAX_NODES][MAX_NODES];       // Cost of each link as advertised by its first node.
+static u_int16_t own_seq = 0;                           // Sequence number of our last advertisement.
+static int origination_timer = 0;                       // Timer that advertises our links after a change.
+static int check_timer = 0;                             // Timer that refreshes and removes advertisements.
+static struct linkstate_stats linkstate_stats;
+
+/**
+ * Checks if sequence number a is newer than b, allowing for wrap-around.
+ */
+static int seq_newer(u_int16_t a, u_int16_t b) {
+    return (int16_t)(a - b) > 0;
+}
+
+/**
+ * Lists the nodes a node advertises links to.
+ * Links are only used in both directions, so these are also the only nodes that can have a link to it.
+ *
+ * @param node: The MIP address of the node.
+ * @param links: Array to hold the MIP addresses of the nodes at the other end of the links.
+ * @return: The number of links.
+ */
+int lsdb_links(u_int8_t node, u_int8_t links[MAX_NODES]) {
+    struct lsa_entry const *entry = &lsdb[node];
+    if (!entry->valid) {
+        return 0;
+    }
+    memcpy(links, entry->neighbours, entry->num_links);
+    return entry->num_links;
+}
+
+/**
+ * Returns the cost of the link from one node to another.
+ * A link is only used if both nodes advertise it, so a node that lost its neighbour is not routed through.
+ *
+ * @param from: The MIP address of the node the link starts at.
+ * @param to: The MIP address of the node the link ends at.
+ * @return: The cost advertised by the first node, or MAX_COST if the link is not advertised by both.
+ */
+u_int16_t lsdb_edge_cost(u_int8_t from, u_int8_t to) {
+    if (announced[to][from] == MAX_COST) {
+        return MAX_COST;
+    }
+    return announced[from][to];
+}
+
+/**
+ * Writes the routes to the destinations whose distance or first hops changed into the routing table.
+ *
+ * Each destination gets one route via each first hop. Routes over other next hops are deleted, and the routes
+ * that are already in the table with the right cost are left alone, so only real changes count as changes.
+ * Direct routes to neighbours are left alone, they are maintained by the HELLO messages.
+ *
+ * @param changed: Set for each destination whose routes should be written.
+ */
+static void apply_routes(u_int8_t const changed[MAX_NODES]) {
+    u_int8_t hops[MAX_NODES];
+    u_int8_t wanted[MAX_NODES];
+    unsigned long version = table_version;
+
+    for (int dest = 0; dest < MAX_NODES; dest++) {
+        if (!changed[dest] || dest == local_mip_addr) {
+            continue;
+        }
+
+        memset(wanted, 0, sizeof(wanted));
+        u_int32_t distance = spf_distance(dest);
+        int num_hops = 0;
+        if (distance != SPF_INFINITY && distance < (u_int32_t)route_infinity) {
+            num_hops = spf_first_hops(dest, hops);
+        }
+        for (int i = 0; i < num_hops; i++) {
+            wanted[hops[i]] = 1;
+        }
+        delete_indirect_routes(dest, wanted);
+
+        for (int i = 0; i < num_hops; i++) {
+            if (hops[i] != dest) {
+                add_update_route(dest, hops[i], (int)distance);
+            }
+        }
+    }
+
+    if (table_version != version) {
+        print_routing_table();
+    }
+}
+
+/**
+ * Installs an advertisement in the database and updates the shortest path tree for the links that changed.
+ *
+ * @param origin: The node whose links are advertised.
+ * @param seq: The sequence number of the advertisement.
+ * @param num_links: The number of links.
+ * @param neighbours: The neighbour at the other end of each link.
+ * @param costs: The cost of each link.
+ */
+static void install_lsa(u_int8_t origin, u_int16_t seq, int num_links, u_int8_t const *neighbours, u_int16_t const *costs) {
+    struct lsa_entry *entry = &lsdb[origin];
+    u_int16_t old_row[MAX_NODES];
+    struct spf_edge_change changes[2 * MAX_NODES];
+    int num_changes = 0;
+
+    memcpy(old_row, announced[origin], sizeof(old_row));
+    for (int i = 0; i < MAX_NODES; i++) {
+        announced[origin][i] = MAX_COST;
+    }
+    for (int i = 0; i < num_links; i++) {
+        announced[origin][neighbours[i]] = costs[i];
+    }
+
+    entry->valid = 1;
+    entry->seq = seq;
+    entry->num_links = num_links;
+    memcpy(entry->neighbours, neighbours, num_links);
+    memcpy(entry->costs, costs, num_links * sizeof(u_int16_t));
+    entry->received_ms = current_time_ms();
+
+    // Both directions of a link change when one end starts or stops advertising it
+    for (int node = 0; node < MAX_NODES; node++) {
+        u_int16_t old_cost = old_row[node];
+        u_int16_t new_cost = announced[origin][node];
+        if (old_cost == new_cost) {
+            continue;
+        }
+        u_int16_t reverse = announced[node][origin];
+        if (reverse == MAX_COST) {
+            // The link is not used until the other end advertises it too
+            continue;
+        }
+        changes[num_changes++] = (struct spf_edge_change){origin, node, old_cost, new_cost};
+        if (old_cost == MAX_COST || new_cost == MAX_COST) {
+            changes[num_changes++] = (struct spf_edge_change){node, origin,
+                old_cost == MAX_COST ? MAX_COST : reverse, new_cost == MAX_COST ? MAX_COST : reverse};
+        }
+    }
+
+    if (local_mip_addr < 0) {
+        return;
+    }
+    u_int8_t changed[MAX_NODES];
+    if (spf_source() != local_mip_addr) {
+        spf_full(local_mip_addr, changed);
+    } else if (num_changes > 0) {
+        spf_incremental(changes, num_changes, changed);
+    } else {
+        return;
+    }
+    apply_routes(changed);
+}
+
+/**
+ * Sends the advertisement of a node to all neighbours, except the one it came from.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ * @param origin: The node whose advertisement is sent.
+ * @param except: The neighbour not to send to, or -1 to send to all.
+ */
+static void flood_lsa(int usd, u_int8_t origin, int except) {
+    u_int8_t neighbours[MAX_NODES];
+    get_all_neighbours(neighbours);
+
+    for (int node = 0; node < MAX_NODES; node++) {
+        if (neighbours[node] && node != except) {
+            linkstate_send_lsa(usd, origin, node);
+        }
+    }
+}
+
+/**
+ * Sends the advertisement of a node from the database to one neighbour.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ * @param origin: The node whose advertisement is sent.
+ * @param neighbour: The MIP address of the neighbour.
+ */
+void linkstate_send_lsa(int usd, u_int8_t origin, u_int8_t neighbour) {
+    struct lsa_entry const *entry = &lsdb[origin];
+    lsa_message message;
+    message.header.mip_addr = neighbour;
+    message.header.ttl = 1;
+    message.header.id1 = 0x4C; // L
+    message.header.id2 = 0x53; // S
+    message.header.id3 = 0x41; // A
+    message.origin = origin;
+    message.seq = htons(entry->seq);
+    message.num_links = entry->num_links;
+    for (int i = 0; i < entry->num_links; i++) {
+        message.links[i].mip_addr = entry->neighbours[i];
+        message.links[i].cost = htons(entry->costs[i]);
+    }
+
+    if (routing_send(usd, &message, sizeof(message)) == -1) {
+        perror("send");
+        return;
+    }
+    linkstate_stats.flooded++;
+}
+
+/**
+ * Advertises the links of this node, if they have changed since the last advertisement.
+ *
+ * The links are the neighbours with a reachable direct route and the cost of that route.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ * @param force: Advertise even if nothing has changed, to refresh the advertisement.
+ */
+static void originate_lsa(int usd, int force) {
+    u_int8_t neighbours[MAX_LSA_LINKS];
+    u_int16_t costs[MAX_LSA_LINKS];
+    int num_links = 0;
+
+    if (local_mip_addr < 0) {
+        // Not known until mipd has told us
+        return;
+    }
+    for (int node = 0; node < MAX_NODES && num_links < MAX_LSA_LINKS; node++) {
+        if (is_neighbour(node)) {
+            neighbours[num_links] = node;
+            costs[num_links] = find_direct_route(node).cost;
+            num_links++;
+        }
+    }
+
+    struct lsa_entry const *own = &lsdb[local_mip_addr];
+    if (!force && own->valid && own->num_links == num_links && memcmp(own->neighbours, neighbours, num_links) == 0
+            && memcmp(own->costs, costs, num_links * sizeof(u_int16_t)) == 0) {
+        return;
+    }
+
+    own_seq++;
+    global_debug("Advertising %d links with sequence number %d\n", num_links, own_seq);
+    install_lsa(local_mip_addr, own_seq, num_links, neighbours, costs);
+    linkstate_stats.originated++;
+    flood_lsa(usd, local_mip_addr, -1);
+}
+
+/**
+ * Timer callback that advertises our links after they have changed.
+ */
+static void origination_timer_expired(int usd, void *arg) {
+    (void)arg;
+    originate_lsa(usd, 0);
+}
+
+/**
+ * Timer callback that refreshes our advertisement and removes the ones that have not been refreshed.
+ */
+static void check_timer_expired(int usd, void *arg) {
+    (void)arg;
+    u_int64_t now = current_time_ms();
+    u_int8_t no_neighbours[1];
+    u_int16_t no_costs[1];
+
+    for (int node = 0; node < MAX_NODES; node++) {
+        struct lsa_entry *entry = &lsdb[node];
+        if (!entry->valid) {
+            continue;
+        }
+        if (node == local_mip_addr) {
+            if (now - entry->received_ms >= LSA_REFRESH_MS) {
+                originate_lsa(usd, 1);
+            }
+        } else if (now - entry->received_ms >= LSA_MAX_AGE_MS) {
+            global_debug("Advertisement from %d has expired\n", node);
+            install_lsa(node, entry->seq, 0, no_neighbours, no_costs);
+            entry->valid = 0;
+            linkstate_stats.purged++;
+        }
+    }
+    timer_arm(check_timer, LSA_CHECK_INTERVAL_MS);
+}
+
+/**
+ * Initializes the link-state database and starts the timer that refreshes it.
+ */
+void init_linkstate() {
+    for (int i = 0; i < MAX_NODES; i++) {
+        for (int j = 0; j < MAX_NODES; j++) {
+            announced[i][j] = MAX_COST;
+        }
+    }
+    origination_timer = timer_create_new(origination_timer_expired, NULL);
+    check_timer = timer_create_new(check_timer_expired, NULL);
+    timer_arm(check_timer, LSA_CHECK_INTERVAL_MS);
+}
+
+/**
+ * Marks that the links of this node may have changed. They are advertised once the coalescing window
+ * of the UPDATE messages has passed, so a burst of changes gives one advertisement.
+ */
+void linkstate_schedule_lsa() {
+    if (!timer_is_armed(origination_timer)) {
+        timer_arm(origination_timer, update_coalesce_ms);
+    }
+}
+
+/**
+ * Sends all advertisements in the database to a neighbour, so a new neighbour does not have to wait for
+ * them to be refreshed.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ * @param neighbour: The MIP address of the neighbour.
+ */
+void linkstate_send_database(int usd, u_int8_t neighbour) {
+    for (int node = 0; node < MAX_NODES; node++) {
+        if (lsdb[node].valid) {
+            linkstate_send_lsa(usd, node, neighbour);
+        }
+    }
+}
+
+/**
+ * Handles a link-state advertisement from a neighbour.
+ *
+ * A newer advertisement than the one in the database is installed and flooded to the other neighbours.
+ * If the neighbour sent an older one, it gets the newer one back. An advertisement of our own links that is
+ * newer than ours was sent by us before a restart, so we advertise again with a higher sequence number.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ * @param message: The advertisement that was received.
+ */
+void handle_lsa_message(int usd, lsa_message message) {
+    if (!linkstate_mode) {
+        return;
+    }
+    u_int8_t sender = message.header.mip_addr;
+    u_int8_t origin = message.origin;
+    u_int16_t seq = ntohs(message.seq);
+    int num_links = message.num_links < MAX_LSA_LINKS ? message.num_links : MAX_LSA_LINKS;
+    linkstate_stats.received++;
+
+    if (origin == local_mip_addr) {
+        if (seq_newer(seq, own_seq)) {
+            own_seq = seq;
+            originate_lsa(usd, 1);
+        }
+        return;
+    }
+
+    struct lsa_entry const *entry = &lsdb[origin];
+    if (entry->valid && !seq_newer(seq, entry->seq)) {
+        if (seq_newer(entry->seq, seq)) {
+            linkstate_send_lsa(usd, origin, sender);
+        }
+        return;
+    }
+
+    u_int8_t neighbours[MAX_LSA_LINKS];
+    u_int16_t costs[MAX_LSA_LINKS];
+    for (int i = 0; i < num_links; i++) {
+        neighbours[i] = message.links[i].mip_addr;
+        costs[i] = ntohs(message.links[i].cost);
+    }
+    global_debug("Installing advertisement from %d with sequence number %d\n", origin, seq);
+    install_lsa(origin, seq, num_links, neighbours, costs);
+    linkstate_stats.installed++;
+    flood_lsa(usd, origin, sender);
+}
+
+/**
+ * Prints the link-state counters and the cost of the shortest path computations to stdout.
+ */
+void print_linkstate_stats() {
+    if (!linkstate_mode) {
+        return;
+    }
+    int entries = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        entries += lsdb[i].valid;
+    }
+    unsigned long runs = spf_stats.full_runs + spf_stats.incremental_runs;
+    printf("Link-state stats: lsdb=%d originated=%lu received=%lu installed=%lu flooded=%lu purged=%lu\n",
+           entries, linkstate_stats.originated, linkstate_stats.received, linkstate_stats.installed,
+           linkstate_stats.flooded, linkstate_stats.purged);
+    printf("SPF stats: full=%lu incremental=%lu settled=%.1f nodes/run cpu=%.1f us/run last=%llu us (%d nodes)\n",
+           spf_stats.full_runs, spf_stats.incremental_runs,
+           runs > 0 ? (double)spf_stats.nodes_settled / runs : 0.0,
+           runs > 0 ? (double)spf_stats.cpu_ns / 1000.0 / runs : 0.0,
+           (unsigned long long)(spf_stats.last_run_ns / 1000), spf_stats.last_settled);
+    fflush(stdout);
+}
@@ -0,0 +1,29 @@
+#ifndef LINKSTATE_H
+#define LINKSTATE_H
+
+#include "../../common/routing/routing_messages.h"
+#include "../routing_common.h"
+
+#define LSA_REFRESH_MS 20000        // How often a node advertises its links even if they have not changed.
+#define LSA_MAX_AGE_MS 60000        // How long an advertisement is kept without being refreshed.
+#define LSA_CHECK_INTERVAL_MS 5000  // How often the database is checked for advertisements to refresh or remove.
+
+extern int linkstate_mode;  // Set to compute routes with link-state instead of distance vector.
+
+void init_linkstate();
+
+void linkstate_schedule_lsa();
+
+void linkstate_send_lsa(int usd, u_int8_t origin, u_int8_t neighbour);
+
+void linkstate_send_database(int usd, u_int8_t neighbour);
+
+void handle_lsa_message(int usd, lsa_message message);
+
+int lsdb_links(u_int8_t node, u_int8_t links[MAX_NODES]);
+
+u_int16_t lsdb_edge_cost(u_int8_t from, u_int8_t to);
+
+void print_linkstate_stats();
+
+#endif //LINKSTATE_H
@@ -0,0 +1,402 @@
+#include <string.h>
+#include "spf.h"
+#include "linkstate.h"
+#include "../routing_common.h"
+
+struct spf_stats spf_stats; // Counters for the shortest path computations.
+
+static int source = -1;                             // The node the tree is computed from, -1 if not known.
+static u_int32_t dist[MAX_NODES];                   // Distance from the source to each node.
+static u_int64_t first_hops[MAX_NODES][4];          // Bitset of the neighbours of the source each node is reached through.
+
+static u_int8_t heap[MAX_NODES];                    // Binary min-heap of nodes, ordered by dist.
+static int heap_pos[MAX_NODES];                     // Position of each node in the heap, -1 if not in it.
+static int heap_size = 0;
+
+/**
+ * Swaps two entries of the heap and updates their positions.
+ */
+static void heap_swap(int a, int b) {
+    u_int8_t tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+    heap_pos[heap[a]] = a;
+    heap_pos[heap[b]] = b;
+}
+
+/**
+ * Moves a heap entry up until its parent is not farther away.
+ */
+static void heap_sift_up(int i) {
+    while (i > 0 && dist[heap[(i - 1) / 2]] > dist[heap[i]]) {
+        heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+/**
+ * Moves a heap entry down until none of its children are closer.
+ */
+static void heap_sift_down(int i) {
+    while (1) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = 2 * i + 2;
+        if (left < heap_size && dist[heap[left]] < dist[heap[smallest]]) {
+            smallest = left;
+        }
+        if (right < heap_size && dist[heap[right]] < dist[heap[smallest]]) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+/**
+ * Adds a node to the heap, or moves it up if its distance has decreased.
+ */
+static void heap_update(u_int8_t node) {
+    if (heap_pos[node] < 0) {
+        heap[heap_size] = node;
+        heap_pos[node] = heap_size++;
+    }
+    heap_sift_up(heap_pos[node]);
+}
+
+/**
+ * Removes and returns the closest node in the heap.
+ */
+static u_int8_t heap_pop() {
+    u_int8_t node = heap[0];
+    heap_swap(0, --heap_size);
+    heap_pos[node] = -1;
+    heap_sift_down(0);
+    return node;
+}
+
+/**
+ * Empties the heap.
+ */
+static void heap_clear() {
+    heap_size = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        heap_pos[i] = -1;
+    }
+}
+
+/**
+ * Runs Dijkstra from the nodes currently in the heap.
+ * Nodes not in the heap are taken to already have their final distance, or an upper bound of it.
+ *
+ * @return: The number of nodes taken off the heap.
+ */
+static int run_dijkstra() {
+    u_int8_t links[MAX_NODES];
+    int settled = 0;
+
+    while (heap_size > 0) {
+        u_int8_t node = heap_pop();
+        settled++;
+        int num_links = lsdb_links(node, links);
+        for (int i = 0; i < num_links; i++) {
+            u_int16_t cost = lsdb_edge_cost(node, links[i]);
+            if (cost == MAX_COST) {
+                continue;
+            }
+            u_int32_t candidate = dist[node] + cost;
+            if (candidate < dist[links[i]]) {
+                dist[links[i]] = candidate;
+                heap_update(links[i]);
+            }
+        }
+    }
+    return settled;
+}
+
+/**
+ * Returns the cost an edge had before the changes, looking it up in the list of changes first.
+ */
+static u_int16_t old_edge_cost(u_int8_t from, u_int8_t to, struct spf_edge_change const *changes, int num_changes) {
+    for (int i = 0; i < num_changes; i++) {
+        if (changes[i].from == from && changes[i].to == to) {
+            return changes[i].old_cost;
+        }
+    }
+    return lsdb_edge_cost(from, to);
+}
+
+/**
+ * Computes the first hops of the nodes that may have been affected, closest first.
+ *
+ * A node is recomputed if it is marked dirty, or if one of the nodes it has an edge from is dirty. Its first hops
+ * are the union of those of its parents in the shortest path graph, a parent being the source itself giving the
+ * node as first hop. A recomputed node whose first hops changed makes the nodes after it dirty in turn.
+ *
+ * @param dirty: Nodes whose distance or incoming edges changed. Nodes whose first hops change are added.
+ * @param old_dist: The distances before the computation.
+ * @param changed: Set for every node whose distance or first hops changed.
+ * @return: The number of changed nodes.
+ */
+static int update_first_hops(u_int8_t dirty[MAX_NODES], u_int32_t const old_dist[MAX_NODES], u_int8_t changed[MAX_NODES]) {
+    u_int8_t order[MAX_NODES];
+    u_int8_t links[MAX_NODES];
+    int num_changed = 0;
+
+    // Sort the nodes by distance, the unreachable ones last
+    for (int i = 0; i < MAX_NODES; i++) {
+        order[i] = i;
+    }
+    for (int i = 1; i < MAX_NODES; i++) {
+        u_int8_t node = order[i];
+        int j = i - 1;
+        while (j >= 0 && dist[order[j]] > dist[node]) {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = node;
+    }
+
+    for (int i = 0; i < MAX_NODES; i++) {
+        u_int8_t node = order[i];
+        if (node == source) {
+            continue;
+        }
+        int num_links = lsdb_links(node, links);
+        int recompute = dirty[node];
+        for (int j = 0; j < num_links && !recompute; j++) {
+            recompute = dirty[links[j]];
+        }
+        if (!recompute) {
+            continue;
+        }
+
+        u_int64_t hops[4] = {0, 0, 0, 0};
+        if (dist[node] != SPF_INFINITY) {
+            for (int j = 0; j < num_links; j++) {
+                u_int8_t parent = links[j];
+                u_int16_t cost = lsdb_edge_cost(parent, node);
+                if (cost == MAX_COST || dist[parent] == SPF_INFINITY || dist[parent] + cost != dist[node]) {
+                    continue;
+                }
+                if (parent == source) {
+                    hops[node / 64] |= 1ULL << (node % 64);
+                } else {
+                    for (int k = 0; k < 4; k++) {
+                        hops[k] |= first_hops[parent][k];
+                    }
+                }
+            }
+        }
+
+        int hops_changed = memcmp(hops, first_hops[node], sizeof(hops)) != 0;
+        if (hops_changed) {
+            memcpy(first_hops[node], hops, sizeof(hops));
+            dirty[node] = 1;
+        }
+        if (hops_changed || dist[node] != old_dist[node]) {
+            changed[node] = 1;
+            num_changed++;
+        }
+    }
+    return num_changed;
+}
+
+/**
+ * Finishes a computation by updating the counters.
+ */
+static void record_run(u_int64_t start, int settled) {
+    u_int64_t elapsed = cpu_time_ns() - start;
+    spf_stats.cpu_ns += elapsed;
+    spf_stats.last_run_ns = elapsed;
+    spf_stats.nodes_settled += settled;
+    spf_stats.last_settled = settled;
+}
+
+/**
+ * Computes the whole shortest path tree from a source.
+ *
+ * @param new_source: The MIP address of this node.
+ * @param changed: Set for every node whose distance or first hops changed.
+ * @return: The number of changed nodes.
+ */
+int spf_full(int new_source, u_int8_t changed[MAX_NODES]) {
+    u_int64_t start = cpu_time_ns();
+    u_int32_t old_dist[MAX_NODES];
+    u_int8_t dirty[MAX_NODES];
+
+    memcpy(old_dist, dist, sizeof(dist));
+    if (source != new_source) {
+        // The old tree means nothing for the new source
+        for (int i = 0; i < MAX_NODES; i++) {
+            old_dist[i] = SPF_INFINITY;
+        }
+    }
+    source = new_source;
+    memset(changed, 0, MAX_NODES);
+    memset(dirty, 1, sizeof(dirty));
+
+    heap_clear();
+    for (int i = 0; i < MAX_NODES; i++) {
+        dist[i] = SPF_INFINITY;
+    }
+    dist[source] = 0;
+    heap_update(source);
+    int settled = run_dijkstra();
+    int num_changed = update_first_hops(dirty, old_dist, changed);
+
+    spf_stats.full_runs++;
+    record_run(start, settled);
+    return num_changed;
+}
+
+/**
+ * Updates the shortest path tree after some edges changed cost, appeared or disappeared.
+ *
+ * Only the part of the tree that can be affected is computed again:
+ * - An edge that got more expensive or disappeared only matters if it was in the shortest path graph. The nodes
+ *   below it lose their distance and are given the best distance through nodes that were not affected.
+ * - An edge that got cheaper or appeared only matters if it gives a shorter path to the node it leads to.
+ * Dijkstra then runs from just these nodes, and first hops are recomputed for the nodes around them.
+ *
+ * @param changes: The edges that changed.
+ * @param num_changes: The number of entries in changes.
+ * @param changed: Set for every node whose distance or first hops changed.
+ * @return: The number of changed nodes.
+ */
+int spf_incremental(struct spf_edge_change const *changes, int num_changes, u_int8_t changed[MAX_NODES]) {
+    u_int64_t start = cpu_time_ns();
+    u_int32_t old_dist[MAX_NODES];
+    u_int8_t invalid[MAX_NODES];
+    u_int8_t dirty[MAX_NODES];
+    u_int8_t queue[MAX_NODES];
+    u_int8_t links[MAX_NODES];
+    int head = 0, tail = 0;
+
+    memset(changed, 0, MAX_NODES);
+    if (source < 0) {
+        return 0;
+    }
+    memcpy(old_dist, dist, sizeof(dist));
+    memset(invalid, 0, sizeof(invalid));
+    memset(dirty, 0, sizeof(dirty));
+    heap_clear();
+
+    // Find the nodes below edges of the shortest path graph that got more expensive
+    for (int i = 0; i < num_changes; i++) {
+        struct spf_edge_change const *change = &changes[i];
+        dirty[change->to] = 1;
+        if (change->new_cost <= change->old_cost || change->old_cost == MAX_COST) {
+            continue;
+        }
+        if (old_dist[change->from] == SPF_INFINITY || old_dist[change->from] + change->old_cost != old_dist[change->to]) {
+            continue;
+        }
+        if (!invalid[change->to] && change->to != source) {
+            invalid[change->to] = 1;
+            queue[tail++] = change->to;
+        }
+    }
+    while (head < tail) {
+        u_int8_t node = queue[head++];
+        int num_links = lsdb_links(node, links);
+        for (int j = 0; j < num_links; j++) {
+            u_int8_t child = links[j];
+            u_int16_t cost = old_edge_cost(node, child, changes, num_changes);
+            if (invalid[child] || child == source || cost == MAX_COST || old_dist[child] == SPF_INFINITY) {
+                continue;
+            }
+            if (old_dist[node] + cost == old_dist[child]) {
+                invalid[child] = 1;
+                queue[tail++] = child;
+            }
+        }
+    }
+
+    // Give the affected nodes their best distance through the unaffected ones
+    for (int i = 0; i < tail; i++) {
+        dist[queue[i]] = SPF_INFINITY;
+        dirty[queue[i]] = 1;
+    }
+    for (int i = 0; i < tail; i++) {
+        u_int8_t node = queue[i];
+        int num_links = lsdb_links(node, links);
+        for (int j = 0; j < num_links; j++) {
+            u_int8_t parent = links[j];
+            u_int16_t cost = lsdb_edge_cost(parent, node);
+            if (invalid[parent] || cost == MAX_COST || dist[parent] == SPF_INFINITY) {
+                continue;
+            }
+            if (dist[parent] + cost < dist[node]) {
+                dist[node] = dist[parent] + cost;
+            }
+        }
+        if (dist[node] != SPF_INFINITY) {
+            heap_update(node);
+        }
+    }
+
+    // Edges that got cheaper may give shorter paths
+    for (int i = 0; i < num_changes; i++) {
+        struct spf_edge_change const *change = &changes[i];
+        if (change->new_cost >= change->old_cost || dist[change->from] == SPF_INFINITY) {
+            continue;
+        }
+        u_int32_t candidate = dist[change->from] + change->new_cost;
+        if (candidate < dist[change->to]) {
+            dist[change->to] = candidate;
+            heap_update(change->to);
+        }
+    }
+
+    int settled = run_dijkstra();
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (dist[i] != old_dist[i]) {
+            dirty[i] = 1;
+        }
+    }
+    int num_changed = update_first_hops(dirty, old_dist, changed);
+
+    spf_stats.incremental_runs++;
+    record_run(start, settled);
+    return num_changed;
+}
+
+/**
+ * Returns the node the tree is computed from, -1 if it has not been computed yet.
+ */
+int spf_source() {
+    return source;
+}
+
+/**
+ * Returns the distance from this node to another, SPF_INFINITY if it cannot be reached.
+ *
+ * @param node: The MIP address of the node.
+ */
+u_int32_t spf_distance(u_int8_t node) {
+    if (source < 0) {
+        return SPF_INFINITY;
+    }
+    return dist[node];
+}
+
+/**
+ * Lists the neighbours through which a node is reached at the lowest cost.
+ *
+ * @param node: The MIP address of the node.
+ * @param hops: Array to hold the first hops.
+ * @return: The number of first hops, 0 if the node cannot be reached.
+ */
+int spf_first_hops(u_int8_t node, u_int8_t hops[MAX_NODES]) {
+    int count = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (first_hops[node][i / 64] & (1ULL << (i % 64))) {
+            hops[count++] = i;
+        }
+    }
+    return count;
+}
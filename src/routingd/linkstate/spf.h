@@ -0,0 +1,43 @@
+#ifndef SPF_H
+#define SPF_H
+
+#include <sys/types.h>
+#include "../table/table.h"
+
+#define SPF_INFINITY 0xFFFFFFFFu    // Distance of a node that cannot be reached.
+
+/**
+ * A change in the cost of a directed edge of the graph, MAX_COST meaning that the edge does not exist.
+ */
+struct spf_edge_change {
+    u_int8_t from;
+    u_int8_t to;
+    u_int16_t old_cost;
+    u_int16_t new_cost;
+};
+
+/**
+ * Counters for the shortest path computations.
+ */
+struct spf_stats {
+    unsigned long full_runs;            // Number of times the whole tree was computed.
+    unsigned long incremental_runs;     // Number of times only the changed part of the tree was computed.
+    unsigned long nodes_settled;        // Nodes taken off the heap over all runs.
+    u_int64_t cpu_ns;                   // CPU time spent computing.
+    u_int64_t last_run_ns;              // CPU time of the last computation.
+    int last_settled;                   // Nodes taken off the heap in the last computation.
+};
+
+extern struct spf_stats spf_stats;
+
+int spf_full(int source, u_int8_t changed[MAX_NODES]);
+
+int spf_incremental(struct spf_edge_change const *changes, int num_changes, u_int8_t changed[MAX_NODES]);
+
+int spf_source();
+
+u_int32_t spf_distance(u_int8_t node);
+
+int spf_first_hops(u_int8_t node, u_int8_t first_hops[MAX_NODES]);
+
+#endif //SPF_H
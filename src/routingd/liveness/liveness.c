@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "liveness.h"
+#include "../table/table.h"
+#include "../timer/timer.h"
+#include "../hello/checkin.h"
+#include "../hello/hello.h"
+#include "../update/update.h"
+#include "../metric/metric.h"
+
+int liveness_interval_ms = 0;   // Desired transmit and required receive interval, 0 disables liveness.
+int liveness_detect_mult = 3;   // Number of missed intervals before a neighbour is declared down.
+
+struct liveness_stats liveness_stats; // Counters for the liveness protocol.
+
+/**
+ * A liveness session with one neighbour.
+ */
+struct liveness_session {
+    int active;                 // Set once the neighbour has been discovered.
+    int state;                  // LIVENESS_STATE_*
+    int was_up;                 // Set once the session has been up.
+    int tx_timer;               // Timer for the next liveness message to the neighbour.
+    int detect_timer;           // Timer that declares the session down.
+    u_int16_t remote_tx_ms;     // Interval the neighbour would like to transmit at.
+    u_int16_t remote_rx_ms;     // Shortest interval the neighbour is willing to receive at.
+    u_int8_t remote_mult;       // Detection multiplier of the neighbour.
+    u_int64_t last_rx;          // When the last liveness message was received.
+    u_int64_t last_detect_ms;   // Time from the last received message until the session was declared down.
+    unsigned long sent;         // Liveness messages sent to the neighbour.
+    unsigned long received;     // Liveness messages received from the neighbour.
+};
+
+static struct liveness_session sessions[MAX_NODES];
+
+/**
+ * Returns the negotiated transmit interval towards a neighbour.
+ * While the session is not up, the slow interval is used.
+ */
+static u_int64_t session_tx_interval(struct liveness_session const *session) {
+    if (session->state != LIVENESS_STATE_UP) {
+        return LIVENESS_SLOW_INTERVAL_MS;
+    }
+    u_int64_t interval = liveness_interval_ms;
+    if (session->remote_rx_ms > interval) {
+        interval = session->remote_rx_ms;
+    }
+    return interval;
+}
+
+/**
+ * Returns the detection time of a session, the time without liveness messages after which it goes down.
+ * It is the detection multiplier of the neighbour times the interval it actually transmits at.
+ */
+static u_int64_t session_detect_time(struct liveness_session const *session) {
+    u_int64_t interval = liveness_interval_ms;
+    if (session->remote_tx_ms > interval) {
+        interval = session->remote_tx_ms;
+    }
+    if (session->state != LIVENESS_STATE_UP && interval < LIVENESS_SLOW_INTERVAL_MS) {
+        interval = LIVENESS_SLOW_INTERVAL_MS;
+    }
+    return session->remote_mult * interval;
+}
+
+/**
+ * Sends a liveness message to a neighbour.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ * @param mip_addr: The MIP address of the neighbour.
+ */
+static void send_liveness_message(int usd, u_int8_t mip_addr) {
+    struct liveness_session *session = &sessions[mip_addr];
+    liveness_message message;
+    message.header.mip_addr = mip_addr;
+    message.header.ttl = 1;
+    message.header.id1 = 0x4C; // L
+    message.header.id2 = 0x49; // I
+    message.header.id3 = 0x56; // V
+    message.state = session->state;
+    message.detect_mult = liveness_detect_mult;
+    message.desired_tx_ms = htons(liveness_interval_ms);
+    message.required_rx_ms = htons(liveness_interval_ms);
+
+    if (routing_send(usd, &message, sizeof(message)) == -1) {
+        perror("send");
+        return;
+    }
+    session->sent++;
+    liveness_stats.sent++;
+}
+
+/**
+ * Timer callback that sends the next liveness message to a neighbour and arms the timer again.
+ * The interval is reduced by up to 25% at random, so the messages of different sessions do not align.
+ * A session that is down stops transmitting once the neighbour no longer sends HELLO messages.
+ */
+static void tx_timer_expired(int usd, void *arg) {
+    u_int8_t mip_addr = (u_int8_t)(uintptr_t)arg;
+    struct liveness_session *session = &sessions[mip_addr];
+    u_int64_t start = cpu_time_ns();
+
+    if (session->state == LIVENESS_STATE_DOWN && !has_node_checked_in(mip_addr)) {
+        global_debug("Stopping liveness session with %d\n", mip_addr);
+        return;
+    }
+
+    send_liveness_message(usd, mip_addr);
+    u_int64_t interval = session_tx_interval(session);
+    timer_arm(session->tx_timer, interval - (interval * (rand() % 26)) / 100);
+
+    liveness_stats.cpu_ns += cpu_time_ns() - start;
+}
+
+/**
+ * Timer callback that declares a session down when no liveness message has arrived within the detection time.
+ * If the session was up, all routes via the neighbour are invalidated.
+ */
+static void detect_timer_expired(int usd, void *arg) {
+    (void)usd;
+    u_int8_t mip_addr = (u_int8_t)(uintptr_t)arg;
+    struct liveness_session *session = &sessions[mip_addr];
+    int was_up = session->state == LIVENESS_STATE_UP;
+
+    session->state = LIVENESS_STATE_DOWN;
+    session->last_detect_ms = current_time_ms() - session->last_rx;
+    if (was_up) {
+        liveness_stats.down_events++;
+        global_debug("Liveness session with %d is down after %llu ms\n", mip_addr,
+                     (unsigned long long)session->last_detect_ms);
+        neighbour_down(mip_addr);
+    }
+}
+
+/**
+ * Moves a session to a new state. When the session comes up, the neighbour is added to the
+ * routing table again if it was removed while the session was down.
+ */
+static void set_session_state(u_int8_t mip_addr, int state) {
+    struct liveness_session *session = &sessions[mip_addr];
+    if (session->state == state) {
+        return;
+    }
+    session->state = state;
+    if (state == LIVENESS_STATE_UP) {
+        global_debug("Liveness session with %d is up\n", mip_addr);
+        session->was_up = 1;
+        if (!is_neighbour(mip_addr)) {
+            add_update_route(mip_addr, mip_addr, metric_link_cost(mip_addr));
+            print_routing_table();
+            hello_topology_changed();
+            schedule_update_messages();
+        }
+    }
+}
+
+/**
+ * Starts a liveness session with a neighbour discovered through a HELLO message.
+ * Does nothing if liveness is disabled or the session is already transmitting.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ * @param mip_addr: The MIP address of the neighbour.
+ */
+void liveness_neighbour_seen(int usd, u_int8_t mip_addr) {
+    if (liveness_interval_ms == 0) {
+        return;
+    }
+    struct liveness_session *session = &sessions[mip_addr];
+    if (!session->active) {
+        session->active = 1;
+        session->state = LIVENESS_STATE_DOWN;
+        session->remote_mult = liveness_detect_mult;
+        session->tx_timer = timer_create_new(tx_timer_expired, (void *)(uintptr_t)mip_addr);
+        session->detect_timer = timer_create_new(detect_timer_expired, (void *)(uintptr_t)mip_addr);
+    }
+    if (!timer_is_armed(session->tx_timer)) {
+        send_liveness_message(usd, mip_addr);
+        timer_arm(session->tx_timer, session_tx_interval(session));
+    }
+}
+
+/**
+ * Checks if the liveness session with a neighbour is up.
+ *
+ * @param mip_addr: The MIP address of the neighbour.
+ * @return: 1 if the session is up, 0 otherwise.
+ */
+int liveness_session_up(u_int8_t mip_addr) {
+    return sessions[mip_addr].active && sessions[mip_addr].state == LIVENESS_STATE_UP;
+}
+
+/**
+ * Checks if a neighbour must not be used even though it sends HELLO and UPDATE messages.
+ * This is the case when its liveness session has been up before and is now down.
+ *
+ * @param mip_addr: The MIP address of the neighbour.
+ * @return: 1 if routes via the neighbour should not be added, 0 otherwise.
+ */
+int liveness_blocks_neighbour(u_int8_t mip_addr) {
+    struct liveness_session const *session = &sessions[mip_addr];
+    return session->active && session->was_up && session->state != LIVENESS_STATE_UP;
+}
+
+/**
+ * Handles a liveness message from a neighbour.
+ *
+ * Runs the three-way handshake of the session (DOWN -> INIT -> UP), stores the intervals the neighbour
+ * announced and restarts the detection timer.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ * @param message: The liveness message that was received.
+ */
+void handle_liveness_message(int usd, liveness_message message) {
+    if (liveness_interval_ms == 0) {
+        return;
+    }
+    u_int64_t start = cpu_time_ns();
+    u_int8_t mip_addr = message.header.mip_addr;
+    liveness_neighbour_seen(usd, mip_addr);
+
+    struct liveness_session *session = &sessions[mip_addr];
+    session->received++;
+    liveness_stats.received++;
+    session->last_rx = current_time_ms();
+    session->remote_tx_ms = ntohs(message.desired_tx_ms);
+    session->remote_rx_ms = ntohs(message.required_rx_ms);
+    session->remote_mult = message.detect_mult;
+
+    int old_state = session->state;
+    switch (session->state) {
+        case LIVENESS_STATE_DOWN:
+            if (message.state == LIVENESS_STATE_DOWN) {
+                set_session_state(mip_addr, LIVENESS_STATE_INIT);
+            } else if (message.state == LIVENESS_STATE_INIT) {
+                set_session_state(mip_addr, LIVENESS_STATE_UP);
+            }
+            break;
+        case LIVENESS_STATE_INIT:
+            if (message.state != LIVENESS_STATE_DOWN) {
+                set_session_state(mip_addr, LIVENESS_STATE_UP);
+            }
+            break;
+        case LIVENESS_STATE_UP:
+            if (message.state == LIVENESS_STATE_DOWN) {
+                // The neighbour has lost us
+                timer_disarm(session->detect_timer);
+                detect_timer_expired(usd, (void *)(uintptr_t)mip_addr);
+                liveness_stats.cpu_ns += cpu_time_ns() - start;
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (session->state != LIVENESS_STATE_DOWN) {
+        timer_arm(session->detect_timer, session_detect_time(session));
+    }
+    if (session->state != old_state) {
+        // Tell the neighbour about the new state right away, and switch to the negotiated interval
+        send_liveness_message(usd, mip_addr);
+        timer_arm(session->tx_timer, session_tx_interval(session));
+    }
+
+    liveness_stats.cpu_ns += cpu_time_ns() - start;
+}
+
+/**
+ * Prints the liveness counters and the state of each session to stdout.
+ *
+ * For each session the negotiated transmit interval and the detection time are printed, together with
+ * the CPU time spent per second on liveness, so the two can be tuned against each other.
+ */
+void print_liveness_stats() {
+    if (liveness_interval_ms == 0) {
+        return;
+    }
+    printf("Liveness stats: sent=%lu received=%lu down_events=%lu cpu_us=%llu (%.2f us/message)\n",
+           liveness_stats.sent, liveness_stats.received, liveness_stats.down_events,
+           (unsigned long long)(liveness_stats.cpu_ns / 1000),
+           liveness_stats.sent + liveness_stats.received > 0
+               ? (double)liveness_stats.cpu_ns / 1000.0 / (double)(liveness_stats.sent + liveness_stats.received)
+               : 0.0);
+    for (int i = 0; i < MAX_NODES; i++) {
+        struct liveness_session const *session = &sessions[i];
+        if (!session->active) {
+            continue;
+        }
+        const char *state = session->state == LIVENESS_STATE_UP ? "up"
+                            : session->state == LIVENESS_STATE_INIT ? "init" : "down";
+        printf("  neighbour %d: state=%s tx_interval=%llu ms detect_time=%llu ms sent=%lu received=%lu last_detection=%llu ms\n",
+               i, state, (unsigned long long)session_tx_interval(session),
+               (unsigned long long)session_detect_time(session), session->sent, session->received,
+               (unsigned long long)session->last_detect_ms);
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,38 @@
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include "../../common/routing/routing_messages.h"
+#include "../routing_common.h"
+
+#define LIVENESS_STATE_DOWN 0
+#define LIVENESS_STATE_INIT 1
+#define LIVENESS_STATE_UP   2
+
+#define LIVENESS_SLOW_INTERVAL_MS 1000 // Transmit interval used while a session is not up.
+
+extern int liveness_interval_ms;    // Desired transmit and required receive interval, 0 disables liveness.
+extern int liveness_detect_mult;    // Number of missed intervals before a neighbour is declared down.
+
+/**
+ * Counters for the liveness protocol, summed over all sessions.
+ */
+struct liveness_stats {
+    unsigned long sent;             // Number of liveness messages sent.
+    unsigned long received;         // Number of liveness messages received.
+    unsigned long down_events;      // Number of times an up session went down.
+    u_int64_t cpu_ns;               // CPU time spent sending and handling liveness messages.
+};
+
+extern struct liveness_stats liveness_stats;
+
+void liveness_neighbour_seen(int usd, u_int8_t mip_addr);
+
+int liveness_session_up(u_int8_t mip_addr);
+
+int liveness_blocks_neighbour(u_int8_t mip_addr);
+
+void handle_liveness_message(int usd, liveness_message message);
+
+void print_liveness_stats();
+
+#endif //LIVENESS_H
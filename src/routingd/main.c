@@ -5,14 +5,13 @@
 #include <sys/socket.h>
 #include <sys/epoll.h>
 #include <sys/un.h>
-#include "table/table.h"
+#include <signal.h>
+#include <errno.h>
 #include "../common/routing/routing_messages.h"
-#include "time.h"
-#include "hello/hello.h"
 #include "handle_messages.h"
 #include "routing_common.h"
-#include "hello/checkin.h"
-#include "update/update.h"
+#include "routingd.h"
+#include "timer/timer.h"
 
 /**
  * Prints the help message
@@ -20,9 +19,8 @@
  * @return void
  */
 void print_help(char *argv[]) {
-    printf("Usage: %s [-h] [-d] <socket_routing>\n", argv[0]);
-    printf("  -h\t\tPrints this help message\n");
-    printf("  -d\t\tRuns the program in debug mode\n");
+    printf("Usage: %s [-h] [-d] [-i <ms>] [-I <ms>] [-t <ms>] [-c <ms>] [-m <ms>] [-l <ms>] [-x <mult>] [-M] [-y <pct>] [-L] [-s <file>] <socket_routing>\n", argv[0]);
+    routingd_print_options();
     printf("  <socket_routing>\tpathname of the socket that the routing daemon uses to communicate.\n");
 }
 
@@ -32,10 +30,22 @@ void print_help(char *argv[]) {
 * @return void
 */
 void usage_and_exit(char *argv[]) {
-    printf("Usage: %s [-h] [-d] <socket_routing>\n", argv[0]);
+    printf("Usage: %s [-h] [-d] [-i <ms>] [-I <ms>] [-t <ms>] [-c <ms>] [-m <ms>] [-l <ms>] [-x <mult>] [-M] [-y <pct>] [-L] [-s <file>] <socket_routing>\n", argv[0]);
     exit(EXIT_FAILURE);
 }
 
+static volatile sig_atomic_t print_stats_flag = 0; // Set by SIGUSR1, the main loop then prints the statistics.
+
+/**
+ * Signal handler for SIGUSR1. Asks the main loop to print the statistics.
+ * @param signum: The signal number
+ * @return void
+ */
+void handle_stats_signal(int signum) {
+    (void)signum;
+    print_stats_flag = 1;
+}
+
 /**
  * The main function for a routing daemon using the MIP protocol.
  *
@@ -45,10 +55,11 @@ void usage_and_exit(char *argv[]) {
  * The socket is created and connected to the appropriate network interface.
  * Initial message is then sent to the routing daemon to identify the sdu type handled.
  *
- * An epoll instance is created to handle multiple file descriptors.
+ * An epoll instance is created to handle the socket and the timerfd of the timer subsystem.
  * The function then enters a main loop where it waits for incoming events if they happen on the socket,
- * handles the routing protocol messages and sends HELLO messages periodically.
- * It also checks if it's time to send a HELLO and UPDATE message and checks whether any neighbours have timed out.
+ * handles the routing protocol messages and runs the expired timers. The timers send HELLO messages
+ * at an interval that backs off while the neighbours are stable, flush pending UPDATE messages and declare neighbours dead when they stop checking in.
+ * Sending SIGUSR1 to the process prints the statistics to stdout.
  *
  * @param argc: Integer, number of arguments passed to the program from the terminal.
  * @param argv: Array of strings representing the arguments passed to the program.
@@ -58,25 +69,12 @@ void usage_and_exit(char *argv[]) {
  * sending messages, handling epoll events or creating the thread for sending periodic messages.
  */
 int main(int argc, char *argv[]) {
-    int opt, hflag = 0;
     char *socket_routing;
 
-    while ((opt = getopt(argc, argv, "dh")) != -1) {
-        switch (opt) {
-            case 'd':
-                // Running in debug mode
-                debug_flag = 1; // This variable is declared in common.h.
-                global_debug("Running in debug mode");
-                break;
-            case 'h':
-                hflag = 1;
-                break;
-            default:
-                usage_and_exit(argv);
-        }
-    }
-
-    if (hflag) {
+    int rc = routingd_parse_options(argc, argv);
+    if (rc < 0) {
+        usage_and_exit(argv);
+    } else if (rc == 1) {
         print_help(argv);
         exit(EXIT_SUCCESS);
     }
@@ -85,8 +83,6 @@ int main(int argc, char *argv[]) {
         usage_and_exit(argv);
     }
 
-    init_routing_table();
-
     socket_routing = argv[optind];
 
     // Create and set up the UNIX socket
@@ -124,6 +120,12 @@ int main(int argc, char *argv[]) {
     //    exit(EXIT_FAILURE);
     //}
 
+    // Print statistics on SIGUSR1
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stats_signal;
+    sigaction(SIGUSR1, &sa, NULL);
+
     // Create and set up epoll
     global_debug("Setting up epoll\n");
     int epollfd = epoll_create1(0);
@@ -141,25 +143,25 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    // Set up the hello timer and related variables
-    u_int8_t neighbours[MAX_NODES];
-    init_checkins();
-    time_t current_time;
-    int hello_interval = 5;
-    int hello_timeout = 10;
-    u_int8_t any_timeout = 0;
-
-    // Send initial HELLO message
-    send_hello_message(usd);
-    time_t last_hello_time = time(NULL);
-    time_t last_timeout_check = time(NULL);
-
+    // Start the routing engine. HELLO messages and neighbour timeouts are driven by the timerfd.
+    int timer_fd = routingd_start(usd);
+    if (timer_fd == -1) {
+        exit(EXIT_FAILURE);
+    }
+    ev.events = EPOLLIN;
+    ev.data.fd = timer_fd;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, timer_fd, &ev) == -1) {
+        perror("epoll_ctl: timer_fd");
+        exit(EXIT_FAILURE);
+    }
 
-    // Main loop for handling routing messages
+    // Main loop for handling routing messages. Sleeps until a message arrives or the next timer expires.
     global_debug("Entering main loop\n");
     while (1) {
-        int nfds = epoll_wait(epollfd, events, 10, 100);
-        if (nfds == -1) {
+        int nfds = epoll_wait(epollfd, events, 10, -1);
+        if (nfds == -1 && errno == EINTR) {
+            nfds = 0;
+        } else if (nfds == -1) {
             perror("epoll_wait");
             exit(EXIT_FAILURE);
         }
@@ -176,45 +178,17 @@ int main(int argc, char *argv[]) {
 
                 handle_message(usd, received_message);
 
+            } else if (events[i].data.fd == timer_fd) {
+                // One or more timers have expired
+                handle_timer_event(usd);
             }
         }
 
-        // Check if it is time to send a HELLO message
-        current_time = time(NULL);
-        if (current_time - last_hello_time >= hello_interval) {
-            // Send HELLO message
-            send_hello_message(usd);
-            last_hello_time = current_time;
-        }
+        routingd_event_done();
 
-        // Check if it is time to check if any neighbours have timed out
-        current_time = time(NULL);
-        if (current_time - last_timeout_check >= hello_timeout) {
-            // Check if any neighbours have timed out
-            last_timeout_check = current_time;
-            global_debug("Checking for timed out neighbours\n");
-            get_all_neighbours(neighbours);
-            for (int i = 0; i < MAX_NODES; i++) {
-                if (neighbours[i] != 0) {
-                    global_debug("Checking neighbour %d\n", i);
-                    if (has_node_checked_in(i) == 0) {
-                        global_debug("Neighbour %d has not checked in\n", i);
-                        // This neighbour has timed out
-                        global_debug("Neighbour %d has timed out\n", i);
-                        set_hop_unreachable(i);
-                        print_routing_table();
-                        any_timeout = 1;
-                    } else {
-                        // Reset the checkin
-                        uncheckin_node(i);
-                    }
-                }
-            }
-            if (any_timeout) {
-                // Send UPDATE messages to all neighbours
-                send_update_messages(usd);
-                any_timeout = 0;
-            }
+        if (print_stats_flag) {
+            print_stats_flag = 0;
+            routingd_print_stats();
         }
     }
 }
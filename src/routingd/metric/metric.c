@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <arpa/inet.h>
+#include "metric.h"
+#include "../table/table.h"
+#include "../hello/checkin.h"
+
+#define METRIC_ALPHA 0.25           // Weight of a new sample in the smoothed RTT and delivery ratios.
+#define METRIC_MAX_SEQ_GAP 100      // Larger gaps in HELLO sequence numbers are treated as a restart, not loss.
+#define METRIC_MIN_DELIVERY 0.05    // Lower bound for the delivery ratios, so the ETX stays finite.
+#define METRIC_MAX_RTT_US 10000000  // RTT samples above this are discarded as bogus.
+
+int metric_hop_count = 0;           // Set to use a cost of 1 per link instead of measured link costs.
+int metric_hysteresis_pct = 20;     // How much a link cost must change, in percent, before it is used.
+
+/**
+ * What has been measured about the link to one neighbour.
+ */
+struct link_metric {
+    int active;                     // Set once a HELLO has been received from the neighbour.
+    u_int16_t last_seq;             // Sequence number of the last HELLO from the neighbour.
+    u_int32_t last_timestamp_us;    // Timestamp of the last HELLO from the neighbour, echoed back to it.
+    u_int64_t last_rx_us;           // When the last HELLO from the neighbour was received.
+    double delivery;                // Smoothed share of the neighbour's HELLO messages that reach us.
+    double reverse_delivery;        // Share of our HELLO messages that reach the neighbour, as it reports.
+    double srtt_us;                 // Smoothed round trip time.
+    int have_rtt;                   // Set once srtt_us holds a sample.
+    u_int16_t cost;                 // The link cost in use, 0 if none has been computed yet.
+    unsigned long received;         // HELLO messages received from the neighbour.
+    unsigned long lost;             // HELLO messages from the neighbour that never arrived.
+    unsigned long rtt_samples;      // Number of RTT samples taken.
+};
+
+/**
+ * One of our own HELLO messages, remembered so that echoes of it can be recognised.
+ * routingd does not know its own MIP address, so echoes are matched on sequence number and timestamp.
+ */
+struct sent_hello {
+    int valid;
+    u_int16_t seq;
+    u_int32_t timestamp_us;
+};
+
+static struct link_metric links[MAX_NODES];
+static struct sent_hello sent_hellos[HELLO_HISTORY];
+static u_int16_t hello_seq = 0;
+
+/**
+ * Computes the cost of the link to a neighbour from its measurements.
+ *
+ * The cost is the expected transmission count (ETX), 1 / (forward delivery * reverse delivery), times
+ * LINK_COST_BASE plus the smoothed RTT in milliseconds. A clean link without delay costs LINK_COST_BASE.
+ * Links that are worse than LINK_COST_MAX all cost LINK_COST_MAX, so that route_infinity stays small.
+ *
+ * @param link: The measurements of the link.
+ * @return: The link cost, between 1 and LINK_COST_MAX.
+ */
+static u_int16_t compute_link_cost(struct link_metric const *link) {
+    if (metric_hop_count) {
+        return 1;
+    }
+    if (!link->active) {
+        return LINK_COST_BASE;
+    }
+
+    double forward = link->delivery > METRIC_MIN_DELIVERY ? link->delivery : METRIC_MIN_DELIVERY;
+    double reverse = link->reverse_delivery > METRIC_MIN_DELIVERY ? link->reverse_delivery : METRIC_MIN_DELIVERY;
+    double etx = 1.0 / (forward * reverse);
+    double delay_ms = link->have_rtt ? link->srtt_us / 1000.0 : 0.0;
+    double cost = etx * (LINK_COST_BASE + delay_ms) + 0.5;
+
+    if (cost < 1) {
+        return 1;
+    } else if (cost > LINK_COST_MAX) {
+        return LINK_COST_MAX;
+    }
+    return (u_int16_t)cost;
+}
+
+/**
+ * Fills in the measurement fields of a HELLO message before it is sent.
+ *
+ * The HELLO gets the next sequence number and the current time, and is remembered so the RTT can be computed
+ * when a neighbour echoes it. For every neighbour we currently hear, the last HELLO received from it is echoed
+ * together with how long it was held and how many of its HELLO messages reach us.
+ *
+ * @param message: The HELLO message to fill in.
+ */
+void metric_fill_hello(hello_message *message) {
+    u_int64_t now = current_time_us();
+    hello_seq++;
+
+    struct sent_hello *sent = &sent_hellos[hello_seq % HELLO_HISTORY];
+    sent->valid = 1;
+    sent->seq = hello_seq;
+    sent->timestamp_us = (u_int32_t)now;
+
+    message->seq = htons(hello_seq);
+    message->timestamp_us = htonl((u_int32_t)now);
+    message->num_echoes = 0;
+
+    for (int node = 0; node < MAX_NODES && message->num_echoes < MAX_HELLO_ECHOES; node++) {
+        struct link_metric const *link = &links[node];
+        if (!link->active || !has_node_checked_in(node)) {
+            continue;
+        }
+        hello_echo *echo = &message->echoes[message->num_echoes++];
+        echo->mip_addr = node;
+        echo->seq = htons(link->last_seq);
+        echo->timestamp_us = htonl(link->last_timestamp_us);
+        echo->hold_us = htonl((u_int32_t)(now - link->last_rx_us));
+        echo->delivery_ratio = (u_int8_t)(link->delivery * 255.0 + 0.5);
+    }
+}
+
+/**
+ * Takes the measurements carried by a HELLO message from a neighbour.
+ *
+ * Gaps in the sequence numbers count as lost HELLO messages and lower the forward delivery ratio. If the
+ * neighbour echoes one of our recent HELLO messages, the time since we sent it minus the time the neighbour
+ * held it is an RTT sample, and the delivery ratio it reports for us is the reverse delivery ratio.
+ * The echo also tells which MIP address the neighbour knows us by, which is how routingd learns its own.
+ *
+ * @param mip_addr: The MIP address of the neighbour.
+ * @param message: The HELLO message that was received.
+ */
+void metric_hello_received(u_int8_t mip_addr, hello_message const *message) {
+    struct link_metric *link = &links[mip_addr];
+    u_int64_t now = current_time_us();
+    u_int16_t seq = ntohs(message->seq);
+
+    if (!link->active) {
+        link->active = 1;
+        link->delivery = 1.0;
+        link->reverse_delivery = 1.0;
+    } else {
+        u_int16_t gap = seq - link->last_seq;
+        if (gap == 0) {
+            // Duplicate
+            return;
+        }
+        if (gap <= METRIC_MAX_SEQ_GAP) {
+            for (int i = 1; i < gap; i++) {
+                link->delivery *= 1.0 - METRIC_ALPHA;
+                link->lost++;
+            }
+        }
+        link->delivery = link->delivery * (1.0 - METRIC_ALPHA) + METRIC_ALPHA;
+    }
+    link->received++;
+    link->last_seq = seq;
+    link->last_timestamp_us = ntohl(message->timestamp_us);
+    link->last_rx_us = now;
+
+    int num_echoes = message->num_echoes < MAX_HELLO_ECHOES ? message->num_echoes : MAX_HELLO_ECHOES;
+    for (int i = 0; i < num_echoes; i++) {
+        hello_echo const *echo = &message->echoes[i];
+        struct sent_hello const *sent = &sent_hellos[ntohs(echo->seq) % HELLO_HISTORY];
+        if (!sent->valid || sent->seq != ntohs(echo->seq) || sent->timestamp_us != ntohl(echo->timestamp_us)) {
+            continue;
+        }
+
+        // This echo is of one of our HELLO messages
+        u_int32_t rtt_us = (u_int32_t)now - sent->timestamp_us - ntohl(echo->hold_us);
+        if (rtt_us < METRIC_MAX_RTT_US) {
+            link->srtt_us = link->have_rtt ? link->srtt_us * (1.0 - METRIC_ALPHA) + rtt_us * METRIC_ALPHA : rtt_us;
+            link->have_rtt = 1;
+            link->rtt_samples++;
+        }
+        link->reverse_delivery = echo->delivery_ratio / 255.0;
+        if (local_mip_addr != echo->mip_addr) {
+            global_debug("Learned local MIP address %d from %d\n", echo->mip_addr, mip_addr);
+            local_mip_addr = echo->mip_addr;
+        }
+        break;
+    }
+}
+
+/**
+ * Returns the cost in use for the link to a neighbour.
+ * The first time it is asked for, the cost is computed from the measurements taken so far.
+ *
+ * @param mip_addr: The MIP address of the neighbour.
+ * @return: The link cost.
+ */
+u_int16_t metric_link_cost(u_int8_t mip_addr) {
+    struct link_metric *link = &links[mip_addr];
+    if (link->cost == 0) {
+        link->cost = compute_link_cost(link);
+    }
+    return link->cost;
+}
+
+/**
+ * Computes the cost of the link to a neighbour again, and starts using it if it differs enough.
+ *
+ * The new cost only replaces the one in use if they differ by more than metric_hysteresis_pct percent.
+ * This keeps small variations in RTT and loss from causing routing updates.
+ *
+ * @param mip_addr: The MIP address of the neighbour.
+ * @return: 1 if the link cost in use changed, 0 otherwise.
+ */
+int metric_refresh_link_cost(u_int8_t mip_addr) {
+    struct link_metric *link = &links[mip_addr];
+    u_int16_t cost = compute_link_cost(link);
+    if (link->cost == 0) {
+        link->cost = cost;
+        return 0;
+    }
+
+    int difference = cost > link->cost ? cost - link->cost : link->cost - cost;
+    if (difference * 100 <= link->cost * metric_hysteresis_pct) {
+        return 0;
+    }
+    global_debug("Link cost to %d changed from %d to %d\n", mip_addr, link->cost, cost);
+    link->cost = cost;
+    return 1;
+}
+
+/**
+ * Prints the measurements and the cost of the link to each neighbour to stdout.
+ */
+void print_metric_stats() {
+    printf("Link metrics (%s, hysteresis %d%%):\n", metric_hop_count ? "hop count" : "measured", metric_hysteresis_pct);
+    for (int i = 0; i < MAX_NODES; i++) {
+        struct link_metric const *link = &links[i];
+        if (!link->active) {
+            continue;
+        }
+        printf("  neighbour %d: cost=%d (now %d) srtt=%.3f ms delivery=%.2f reverse=%.2f received=%lu lost=%lu rtt_samples=%lu\n",
+               i, link->cost, compute_link_cost(link), link->srtt_us / 1000.0, link->delivery, link->reverse_delivery,
+               link->received, link->lost, link->rtt_samples);
+    }
+    fflush(stdout);
+}
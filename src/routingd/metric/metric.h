@@ -0,0 +1,24 @@
+#ifndef METRIC_H
+#define METRIC_H
+
+#include "../../common/routing/routing_messages.h"
+#include "../routing_common.h"
+
+#define LINK_COST_BASE 10       // Cost of a perfect link with no delay, so hop count still matters.
+#define LINK_COST_MAX (4 * LINK_COST_BASE) // Cost of the worst links. Routes are unreachable at MAX_HOPS times this.
+#define HELLO_HISTORY 8         // Number of our own HELLO messages remembered for matching echoes.
+
+extern int metric_hop_count;            // Set to use a cost of 1 per link instead of measured link costs.
+extern int metric_hysteresis_pct;       // How much a link cost must change, in percent, before it is used.
+
+void metric_fill_hello(hello_message *message);
+
+void metric_hello_received(u_int8_t mip_addr, hello_message const *message);
+
+u_int16_t metric_link_cost(u_int8_t mip_addr);
+
+int metric_refresh_link_cost(u_int8_t mip_addr);
+
+void print_metric_stats();
+
+#endif //METRIC_H
@@ -1,7 +1,9 @@
 #include <stdio.h>
+#include <string.h>
 #include <sys/socket.h>
 #include "request.h"
 #include "../routing_common.h"
+#include "../hello/checkin.h"
 
 /**
  * Sends a 'RESPONSE' message in the MIP protocol.
@@ -12,8 +14,12 @@
  * @param usd: Integer representing the file descriptor of the unix socket used for routing communication.
  * @param request: The 'REQUEST' message that was received.
  * @param next_hop: The MIP address of the next hop node.
+ * @param backup_next_hop: The MIP address of the loop-free alternate next hop, 255 if there is none.
+ * @param equal_cost_next_hops: All next hops with the lowest cost, the first one is the next hop.
+ * @param num_equal_cost: The number of entries in equal_cost_next_hops.
  */
-void send_response_message(int usd, request_message request, u_int8_t next_hop) {
+void send_response_message(int usd, request_message request, u_int8_t next_hop, u_int8_t backup_next_hop,
+                           u_int8_t const equal_cost_next_hops[MAX_EQUAL_COST_ROUTES], int num_equal_cost) {
     response_message response;
     response.header.mip_addr = request.header.mip_addr;
     response.header.ttl = 0;
@@ -21,10 +27,15 @@ void send_response_message(int usd, request_message request, u_int8_t next_hop)
     response.header.id2 = 0x53; // S
     response.header.id3 = 0x50; // P
     response.next_hop_mip = next_hop;
+    response.backup_next_hop_mip = backup_next_hop;
+    response.num_equal_cost = num_equal_cost;
+    memset(response.equal_cost_next_hops, 0, sizeof(response.equal_cost_next_hops));
+    memcpy(response.equal_cost_next_hops, equal_cost_next_hops, num_equal_cost);
 
     // Send the RESPONSE message
-    global_debug("Sending RESPONSE message: next hop is %d\n", next_hop);
-    if (send(usd, &response, sizeof(response), 0) == -1) {
+    global_debug("Sending RESPONSE message: next hop is %d, backup is %d, %d equal cost next hops\n",
+                 next_hop, backup_next_hop, num_equal_cost);
+    if (routing_send(usd, &response, sizeof(response)) == -1) {
         perror("send");
     }
 
@@ -35,7 +46,12 @@ void send_response_message(int usd, request_message request, u_int8_t next_hop)
  *
  * This function handles the parsing and response for incoming 'REQUEST' messages.
  * Given such a message, it finds the fastest route to the requested MIP.
- * If no route is found, it designates the next hop as 255.
+ * If no route is found but the requested MIP is a node that has recently sent us a HELLO, it is
+ * reached directly. This lets liveness messages reach a neighbour whose routes are invalidated.
+ * Otherwise, it designates the next hop as 255.
+ * A loop-free alternate next hop is included, so mipd can switch to it locally if the next hop fails.
+ * All next hops with the same lowest cost are included as well, so mipd can spread flows across them.
+ * A REQUEST for the address of mipd itself is not answered. mipd sends it when routingd connects, to tell its address.
  *
  * @param usd: The file descriptor of the unix socket used for routing communication.
  * @param message: The 'REQUEST' message that was received.
@@ -43,14 +59,31 @@ void send_response_message(int usd, request_message request, u_int8_t next_hop)
 void handle_request_message(int usd, request_message message) {
     u_int8_t mip_look_up = message.mip_look_up;
     u_int8_t next_hop;
+    u_int8_t backup_next_hop = 255;
+    u_int8_t equal_cost_next_hops[MAX_EQUAL_COST_ROUTES];
+    int num_equal_cost = 0;
+
+    if (mip_look_up == message.header.mip_addr) {
+        // mipd telling us its address when we connect, handled by handle_message()
+        return;
+    }
 
     global_debug("Received REQUEST for MIP %d\n", mip_look_up);
     route_info fastest_route = find_fastest_route(mip_look_up);
-    if (fastest_route.next_hop == 0) {
+    if (fastest_route.next_hop == 0 && has_node_checked_in(mip_look_up)) {
+        global_debug("No route found, but %d is a neighbour", mip_look_up);
+        next_hop = mip_look_up;
+        equal_cost_next_hops[num_equal_cost++] = next_hop;
+    } else if (fastest_route.next_hop == 0) {
         global_debug("No route found");
         next_hop = 255;
     } else {
         next_hop = fastest_route.next_hop;
+        num_equal_cost = find_equal_cost_routes(mip_look_up, equal_cost_next_hops);
+        route_info backup_route = find_backup_route(mip_look_up, fastest_route);
+        if (backup_route.next_hop != 0) {
+            backup_next_hop = backup_route.next_hop;
+        }
     }
-    send_response_message(usd, message, next_hop);
+    send_response_message(usd, message, next_hop, backup_next_hop, equal_cost_next_hops, num_equal_cost);
 }
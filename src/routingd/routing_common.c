@@ -2,7 +2,31 @@
 #include <stdio.h>
 #include <time.h>
 #include <stdarg.h>
+#include <sys/socket.h>
 
+int local_mip_addr = -1; // The MIP address of this node, -1 until it has been learned from mipd.
+routing_transport routing_transport_hook = NULL; // Set to deliver messages without the unix socket, NULL otherwise.
+
+/**
+ * Sends a routing message to the MIP daemon.
+ *
+ * Standalone, the message is sent on the unix socket. When the routing engine runs inside mipd, it is handed to
+ * routing_transport_hook instead.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ * @param message: The message to send.
+ * @param len: The length of the message.
+ * @return: The number of bytes sent, or -1 on failure.
+ */
+long routing_send(int usd, void const *message, size_t len) {
+    if (routing_transport_hook != NULL) {
+        return routing_transport_hook(usd, message, len);
+    }
+    return send(usd, message, len, 0);
+}
+
+// Inside mipd, mipd's debug_flag and global_debug are used
+#ifndef ROUTINGD_EMBEDDED
 int debug_flag = 0; // Global variable that represents if the demon runs in debug-mode.
 
 
@@ -39,4 +63,64 @@ void global_debug(const char *format, ...) {
         va_end(args);
         printf("\n");
     }
-}
\ No newline at end of file
+}
+#endif //ROUTINGD_EMBEDDED
+
+#ifdef ROUTINGD_SIM
+// Every simulated node has its own value, so their clocks differ like those of real hosts
+u_int64_t sim_clock_offset_us = 0; // What the clock of this node is ahead of the virtual clock.
+
+/**
+ * Returns the clock of this node in the simulator in milliseconds.
+ *
+ * @return: The number of milliseconds since an unspecified starting point.
+ */
+u_int64_t current_time_ms() {
+    return (sim_clock_us + sim_clock_offset_us) / 1000;
+}
+
+/**
+ * Returns the clock of this node in the simulator in microseconds.
+ *
+ * @return: The number of microseconds since an unspecified starting point.
+ */
+u_int64_t current_time_us() {
+    return sim_clock_us + sim_clock_offset_us;
+}
+#else
+/**
+ * Returns the current time of the monotonic clock in milliseconds.
+ * Used for timers and intervals, since it is not affected by changes to the wall clock.
+ *
+ * @return: The number of milliseconds since an unspecified starting point.
+ */
+u_int64_t current_time_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u_int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Returns the current time of the monotonic clock in microseconds.
+ * Used where millisecond resolution is too coarse, such as measuring round trip times.
+ *
+ * @return: The number of microseconds since an unspecified starting point.
+ */
+u_int64_t current_time_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u_int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+#endif //ROUTINGD_SIM
+
+/**
+ * Returns the CPU time used by the process in nanoseconds.
+ * Used to measure how much work the different parts of the routing protocol cost.
+ *
+ * @return: The CPU time used by the process.
+ */
+u_int64_t cpu_time_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (u_int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
@@ -1,10 +1,33 @@
 #ifndef ROUTING_COMMON_H
 #define ROUTING_COMMON_H
 
+#include <stddef.h>
 #include <sys/types.h>
 
+/**
+ * Delivers a message from routingd to the MIP daemon. Used instead of the unix socket when the routing engine
+ * runs inside mipd.
+ */
+typedef long (*routing_transport)(int usd, void const *message, size_t len);
+
+extern routing_transport routing_transport_hook; // Set to deliver messages without the unix socket, NULL otherwise.
+
 extern int debug_flag; // Global variable that represents if the demon runs in debug-mode.
+extern int local_mip_addr; // The MIP address of this node, -1 until it has been learned from mipd.
+
+#ifdef ROUTINGD_SIM
+extern u_int64_t sim_clock_us; // The virtual clock of the simulator, read by current_time_ms() and current_time_us().
+extern u_int64_t sim_clock_offset_us; // What the clock of this node is ahead of the virtual clock.
+#endif
 
 void global_debug(const char *format, ...);
 
+long routing_send(int usd, void const *message, size_t len);
+
+u_int64_t current_time_ms();
+
+u_int64_t current_time_us();
+
+u_int64_t cpu_time_ns();
+
 #endif //ROUTING_COMMON_H
@@ -0,0 +1,193 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "routingd.h"
+#include "table/table.h"
+#include "hello/hello.h"
+#include "hello/checkin.h"
+#include "update/update.h"
+#include "timer/timer.h"
+#include "liveness/liveness.h"
+#include "metric/metric.h"
+#include "linkstate/linkstate.h"
+#include "convergence/convergence.h"
+#include "warm_restart/warm_restart.h"
+
+/**
+ * Parses the argument of a numeric option of the routing engine. Prints an error if it is not valid.
+ *
+ * @param opt: The option.
+ * @param arg: The argument.
+ * @param min: The smallest value allowed.
+ * @param max: The largest value allowed.
+ * @return: The number, or -1 if the argument is not a decimal number from min to max.
+ */
+static int parse_value(int opt, char const *arg, int min, int max) {
+    char *end;
+    errno = 0;
+    long value = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno != 0 || value < min || value > max) {
+        fprintf(stderr, "-%c needs a number from %d to %d\n", opt, min, max);
+        return -1;
+    }
+    return (int)value;
+}
+
+/**
+ * Parses the options of the routing engine.
+ *
+ * Used by the standalone routingd, and by mipd when the routing engine runs inside it. Parsing stops at the
+ * first argument that is not an option, which is left at argv[optind].
+ *
+ * @param argc: The number of arguments.
+ * @param argv: The arguments, starting with the program name.
+ * @return: 0 if the options were parsed, 1 if help was asked for, -1 on an unknown option or an invalid value.
+ */
+int routingd_parse_options(int argc, char *argv[]) {
+    int opt, hflag = 0;
+    while ((opt = getopt(argc, argv, ROUTINGD_OPTIONS)) != -1) {
+        switch (opt) {
+            case 'd':
+                // Running in debug mode
+                debug_flag = 1; // This variable is declared in common.h.
+                global_debug("Running in debug mode");
+                break;
+            case 'h':
+                hflag = 1;
+                break;
+            case 'i':
+                hello_interval_ms = parse_value(opt, optarg, 1, INT_MAX);
+                if (hello_interval_ms < 0) {
+                    return -1;
+                }
+                break;
+            case 'I':
+                hello_max_interval_ms = parse_value(opt, optarg, 1, INT_MAX);
+                if (hello_max_interval_ms < 0) {
+                    return -1;
+                }
+                break;
+            case 't':
+                neighbour_dead_interval_ms = parse_value(opt, optarg, 1, INT_MAX);
+                if (neighbour_dead_interval_ms < 0) {
+                    return -1;
+                }
+                break;
+            case 'c':
+                update_coalesce_ms = parse_value(opt, optarg, 0, INT_MAX);
+                if (update_coalesce_ms < 0) {
+                    return -1;
+                }
+                break;
+            case 'm':
+                update_min_interval_ms = parse_value(opt, optarg, 0, INT_MAX);
+                if (update_min_interval_ms < 0) {
+                    return -1;
+                }
+                break;
+            case 'l':
+                liveness_interval_ms = parse_value(opt, optarg, 1, INT_MAX);
+                if (liveness_interval_ms < 0) {
+                    return -1;
+                }
+                break;
+            case 'x':
+                liveness_detect_mult = parse_value(opt, optarg, 1, UINT8_MAX);
+                if (liveness_detect_mult < 0) {
+                    return -1;
+                }
+                break;
+            case 'M':
+                metric_hop_count = 1;
+                break;
+            case 'y':
+                metric_hysteresis_pct = parse_value(opt, optarg, 0, 1000);
+                if (metric_hysteresis_pct < 0) {
+                    return -1;
+                }
+                break;
+            case 'L':
+                linkstate_mode = 1;
+                break;
+            case 's':
+                warm_restart_path = optarg;
+                break;
+            default:
+                return -1;
+        }
+    }
+    return hflag;
+}
+
+/**
+ * Prints a line of help for each option of the routing engine.
+ */
+void routingd_print_options() {
+    printf("  -h\t\tPrints this help message\n");
+    printf("  -d\t\tRuns the program in debug mode\n");
+    printf("  -i <ms>\tInterval between HELLO messages after startup or a topology change (default %d)\n", hello_interval_ms);
+    printf("  -I <ms>\tMaximum interval between HELLO messages while the neighbours are stable (default %d,\n"
+           "\t\tat most a third of the -t time)\n", hello_max_interval_ms);
+    printf("  -t <ms>\tMinimum time without HELLO before a neighbour is considered dead (default %d)\n", neighbour_dead_interval_ms);
+    printf("  -c <ms>\tCoalescing window for triggered UPDATE messages (default %d)\n", update_coalesce_ms);
+    printf("  -m <ms>\tMinimum interval between UPDATE messages to the same neighbour (default %d)\n", update_min_interval_ms);
+    printf("  -l <ms>\tEnables liveness sessions with neighbours, sending every <ms> milliseconds\n");
+    printf("  -x <mult>\tMissed liveness intervals before a neighbour is declared down (default %d)\n", liveness_detect_mult);
+    printf("  -M\t\tUses hop count as link cost instead of the RTT and loss measured by HELLO messages\n");
+    printf("  -y <pct>\tChange in measured link cost, in percent, needed before routes are updated (default %d)\n", metric_hysteresis_pct);
+    printf("  -L\t\tComputes routes with link-state advertisements and SPF instead of distance vector\n");
+    printf("  -s <file>\tKeeps a snapshot of the routing table in <file>, and starts from it after a restart\n");
+}
+
+/**
+ * Starts the routing engine.
+ *
+ * Initializes the routing table and its bound on route costs, the timers and the check-ins, starts the link-state engine if it is enabled and
+ * loads the warm restart snapshot. Then the first HELLO message is sent and the HELLO timer is started.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ * @return: The timerfd that must be watched, and handle_timer_event() called when it is readable. -1 on failure.
+ */
+int routingd_start(int usd) {
+    init_routing_table();
+    route_infinity = MAX_HOPS * (metric_hop_count ? 1 : LINK_COST_MAX);
+
+    int timer_fd = init_timers();
+    if (timer_fd == -1) {
+        return -1;
+    }
+    init_checkins();
+    if (linkstate_mode) {
+        init_linkstate();
+    }
+    init_warm_restart(usd);
+    srand(time(NULL) ^ getpid());
+
+    // Send initial HELLO message, and start sending them periodically
+    send_hello_message(usd);
+    start_hello_timer();
+    return timer_fd;
+}
+
+/**
+ * Called after every batch of events has been handled. Records routing table changes for the convergence stats.
+ */
+void routingd_event_done() {
+    convergence_check();
+}
+
+/**
+ * Prints the statistics of every part of the routing engine to stdout.
+ */
+void routingd_print_stats() {
+    print_hello_stats();
+    print_update_stats();
+    print_liveness_stats();
+    print_metric_stats();
+    print_linkstate_stats();
+    print_convergence_stats();
+    print_warm_restart_stats();
+}
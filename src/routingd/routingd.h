@@ -0,0 +1,18 @@
+#ifndef ROUTINGD_H
+#define ROUTINGD_H
+
+#include "routing_common.h"
+
+#define ROUTINGD_OPTIONS "dhi:I:t:c:m:l:x:My:Ls:"  // The getopt string of the routing engine options.
+
+int routingd_parse_options(int argc, char *argv[]);
+
+void routingd_print_options();
+
+int routingd_start(int usd);
+
+void routingd_event_done();
+
+void routingd_print_stats();
+
+#endif //ROUTINGD_H
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim.h"
+#include "topology.h"
+#include "../routingd.h"
+
+#define SIM_MAX_ARGS 32     // Maximum number of routing engine options given with -R.
+
+static char labels[SIM_MAX_PHASES][32]; // Labels of the phases of the scenario.
+static int num_labels = 0;              // Number of labels used.
+
+/**
+ * Prints the help message
+ * @param argv: The command line arguments
+ * @return void
+ */
+void print_help(char *argv[]) {
+    printf("Usage: %s [-h] [-t <topology>] [-n <nodes>] [-S <seed>] [-D <ms>] [-l <pct>] [-N] [-w <s>] [-f <n>] [-F <n>] [-p <ms>] [-g <s>] [-j] [-R <options>]\n", argv[0]);
+    printf("  -h\t\tPrints this help message\n");
+    printf("  -t <topology>\tline, ring, grid or mesh (default grid)\n");
+    printf("  -n <nodes>\tNumber of nodes, at most %d (default 100)\n", SIM_MAX_NODES);
+    printf("  -S <seed>\tSeed of the random mesh, the losses and the failures (default 1)\n");
+    printf("  -D <ms>\tDelay of every link, may be fractional (default 1)\n");
+    printf("  -l <pct>\tShare of frames lost on every link, in percent (default 0)\n");
+    printf("  -N\t\tTells both ends of a cut link right away, as mipd does after send errors\n");
+    printf("  -w <s>\tSimulated seconds before the first failure (default 60)\n");
+    printf("  -f <n>\tCuts <n> random links one at a time, and brings each back after <gap> (default 1)\n");
+    printf("  -F <n>\tThen flaps a random link down and up <n> times\n");
+    printf("  -p <ms>\tTime a flapping link stays down, and up, in each flap (default 1000)\n");
+    printf("  -g <s>\tSimulated seconds between the steps of the scenario (default 60)\n");
+    printf("  -j\t\tPrints the report as JSON\n");
+    printf("  -R <options>\tOptions of the routing engine, as one argument. Those of routingd:\n");
+    routingd_print_options();
+}
+
+/**
+ * Prints a basic usage message and exits the program.
+ * @param argv The command line arguments
+ * @return void
+ */
+void usage_and_exit(char *argv[]) {
+    printf("Usage: %s [-h] [-t <topology>] [-n <nodes>] [-S <seed>] [-D <ms>] [-l <pct>] [-N] [-w <s>] [-f <n>] [-F <n>] [-p <ms>] [-g <s>] [-j] [-R <options>]\n", argv[0]);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Parses the options of the routing engine given with -R. They apply to every simulated node.
+ *
+ * @param options: The options separated by spaces, as given to routingd. May be NULL.
+ * @return: 0 if the options were parsed, -1 otherwise.
+ */
+static int parse_routing_options(char *options) {
+    char *argv[SIM_MAX_ARGS + 1];
+    int argc = 0;
+    argv[argc++] = "routing";
+    if (options != NULL) {
+        for (char *arg = strtok(options, " "); arg != NULL && argc < SIM_MAX_ARGS; arg = strtok(NULL, " ")) {
+            argv[argc++] = arg;
+        }
+    }
+    argv[argc] = NULL;
+
+    optind = 0; // Restart getopt, it has already been used for the options of the simulator.
+    if (routingd_parse_options(argc, argv) != 0 || optind != argc) {
+        fprintf(stderr, "Invalid routing engine options: %s\n", options);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Returns a label for a phase of the scenario, such as "cut 3-7".
+ */
+static char const *phase_label(char const *what, struct sim_link const *link) {
+    if (num_labels == SIM_MAX_PHASES) {
+        return NULL;
+    }
+    snprintf(labels[num_labels], sizeof(labels[num_labels]), "%s %d-%d", what, link->a, link->b);
+    return labels[num_labels++];
+}
+
+/**
+ * Picks a random link.
+ */
+static int random_link(struct sim_topology const *topology) {
+    return (int)(sim_random() % topology->num_links);
+}
+
+/**
+ * Main function of the routing simulator.
+ *
+ * Builds the topology and gives every node its own routing engine, with the options given with -R. The nodes
+ * start within the first SIM_START_SPREAD_US, and get <warmup> seconds to converge. Then the scenario cuts links one
+ * at a time, and brings each back <gap> seconds later, and then flaps a link. The whole scenario is scheduled up
+ * front, and the simulation runs until <gap> seconds after its last step. Every step starts a phase, and the report
+ * gives the messages, convergence time, count-to-infinity episodes and wrong routes of every phase.
+ *
+ * @param argc: Integer, number of arguments passed to the program from the terminal.
+ * @param argv: Array of strings representing the arguments passed to the program.
+ *
+ * @return: Integer representing the exit status of the program. 0 indicating normal termination,
+ * and exits with EXIT_FAILURE status on invalid options or when the simulation cannot be set up.
+ */
+int main(int argc, char *argv[]) {
+    int opt;
+    int hflag = 0;                  // Stores if the help-flag is given.
+    char const *kind = "grid";      // The kind of topology.
+    int num_nodes = 100;            // The number of nodes.
+    int warmup_s = 60;              // Seconds before the first failure.
+    int failures = 1;               // Links cut one at a time.
+    int flaps = 0;                  // Times a link flaps.
+    int flap_ms = 1000;             // Time a flapping link stays down, and up.
+    int gap_s = 60;                 // Seconds between the steps of the scenario.
+    int json = 0;                   // Prints the report as JSON.
+    char *routing_options = NULL;   // Options of the routing engine.
+    struct sim_config config = {1000, 0, 0, 1};
+
+    while ((opt = getopt(argc, argv, "ht:n:S:D:l:Nw:f:F:p:g:jR:")) != -1) {
+        switch (opt) {
+            case 'h':
+                // Help flag given
+                hflag = 1;
+                break;
+            case 't':
+                kind = optarg;
+                break;
+            case 'n':
+                num_nodes = atoi(optarg);
+                break;
+            case 'S':
+                config.seed = (unsigned int)atoi(optarg);
+                break;
+            case 'D':
+                config.delay_us = (u_int64_t)(atof(optarg) * 1000);
+                break;
+            case 'l':
+                config.loss_pct = atoi(optarg);
+                break;
+            case 'N':
+                config.report_down = 1;
+                break;
+            case 'w':
+                warmup_s = atoi(optarg);
+                break;
+            case 'f':
+                failures = atoi(optarg);
+                break;
+            case 'F':
+                flaps = atoi(optarg);
+                break;
+            case 'p':
+                flap_ms = atoi(optarg);
+                break;
+            case 'g':
+                gap_s = atoi(optarg);
+                break;
+            case 'j':
+                json = 1;
+                break;
+            case 'R':
+                routing_options = optarg;
+                break;
+            default:
+                usage_and_exit(argv);
+        }
+    }
+
+    // Check if the help flag was given, if so print help message and exit
+    if (hflag) {
+        print_help(argv);
+        exit(EXIT_SUCCESS);
+    }
+    if (argc - optind != 0) {
+        usage_and_exit(argv);
+    }
+
+    static struct sim_topology topology;
+    if (topology_build(&topology, kind, num_nodes, config.seed) == -1) {
+        fprintf(stderr, "Cannot build a %s of %d nodes\n", kind, num_nodes);
+        exit(EXIT_FAILURE);
+    }
+    if (parse_routing_options(routing_options) == -1) {
+        exit(EXIT_FAILURE);
+    }
+    if (sim_init(&topology, &config) == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Schedule the scenario
+    u_int64_t at_us = (u_int64_t)warmup_s * 1000000;
+    u_int64_t gap_us = (u_int64_t)gap_s * 1000000;
+    for (int i = 0; i < failures; i++) {
+        int link = random_link(&topology);
+        sim_schedule_link(at_us, link, 0, phase_label("cut", &topology.links[link]));
+        at_us += gap_us;
+        sim_schedule_link(at_us, link, 1, phase_label("restore", &topology.links[link]));
+        at_us += gap_us;
+    }
+    if (flaps > 0) {
+        int link = random_link(&topology);
+        char const *label = phase_label("flap", &topology.links[link]);
+        for (int i = 0; i < flaps; i++) {
+            sim_schedule_link(at_us, link, 0, i == 0 ? label : NULL);
+            at_us += (u_int64_t)flap_ms * 1000;
+            sim_schedule_link(at_us, link, 1, NULL);
+            at_us += (u_int64_t)flap_ms * 1000;
+        }
+        at_us += gap_us;
+    }
+
+    sim_run(at_us);
+    sim_print_report(json);
+    return 0;
+}
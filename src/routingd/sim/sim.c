@@ -0,0 +1,669 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sim.h"
+#include "../routingd.h"
+#include "../routing_common.h"
+#include "../handle_messages.h"
+#include "../timer/timer.h"
+#include "../table/table.h"
+#include "../../common/routing/routing_messages.h"
+
+/*
+ * Discrete-event simulator of many routing engines.
+ *
+ * Every simulated node runs the routing engine of routingd. The state of the engine is kept in the globals of its
+ * modules, which the build links into one section, routing_state (see state.ld). The simulator keeps a copy of
+ * that section for every node, and swaps it in before the node handles an event. Messages the engine sends
+ * through routing_transport_hook go on an in-memory bus that does what mipd would: a broadcast goes out on every
+ * link of the node, and a message to a neighbour on the link to it. Each frame is delivered after the link delay.
+ * Timers run on a virtual clock that jumps from one event to the next, so simulated time passes as fast as the
+ * events can be handled. Every node sees the virtual clock with its own offset, as hosts have their own clocks.
+ */
+
+extern char __start_routing_state[]; // Start of the globals of the routing engine, defined by the linker.
+extern char __stop_routing_state[];  // End of the globals of the routing engine.
+
+u_int64_t sim_clock_us = 0; // The virtual clock, read by current_time_ms() and current_time_us() of every node.
+
+#define EVENT_START 0   // A node starts its routing engine.
+#define EVENT_FRAME 1   // A frame arrives at a node.
+#define EVENT_TIMER 2   // The earliest timer of a node expires.
+#define EVENT_LINK  3   // A link is cut or comes back.
+
+#define NUM_TYPES   6   // Kinds of routing messages counted separately, the last one is everything else.
+
+/**
+ * Something that happens at a given time. Events at the same time happen in the order they were scheduled.
+ */
+struct sim_event {
+    u_int64_t at_us;            // When the event happens.
+    unsigned long seq;          // Order in which the event was scheduled.
+    int type;                   // EVENT_*
+    int node;                   // The node the event happens at. For EVENT_LINK, the index of the link.
+    int from;                   // EVENT_FRAME: the sender. EVENT_LINK: 1 to bring the link up, 0 to cut it.
+    int link;                   // EVENT_FRAME: the index of the link the frame is carried on.
+    u_int64_t deadline_ms;      // EVENT_TIMER: the deadline of the timer, stale if the node has moved it since.
+    char const *label;          // EVENT_LINK: starts a new phase with this label, NULL to continue the current one.
+    size_t len;                 // EVENT_FRAME: length of data.
+    unsigned char data[];       // EVENT_FRAME: the routing message, as handed to routing_transport_hook.
+};
+
+/**
+ * A part of the simulation, from one step of the scenario to the next. Everything that happens until the next
+ * phase starts is counted in the phase.
+ */
+struct sim_phase {
+    char label[32];             // What the scenario did, "start" for the first phase.
+    u_int64_t start_us;         // When the phase started.
+    u_int64_t last_event_us;    // When the scenario last changed the network in this phase.
+    u_int64_t last_change_us;   // When a routing table last changed in this phase, 0 if none did.
+    unsigned long changes;      // Routing table changes, counted as table_version increments.
+    unsigned long messages;     // Frames sent.
+    unsigned long bytes;        // Bytes of routing messages in the frames, without the unused end of the SDU.
+    unsigned long lost;         // Frames lost on a link or while it was cut.
+    unsigned long cti;          // Count-to-infinity episodes.
+    int wrong;                  // Routes that are missing, lead nowhere or loop at the end of the phase.
+};
+
+static struct sim_topology *sim_topology = NULL;    // The simulated network.
+static struct sim_config sim_config;                // How the links behave.
+
+static size_t state_size = 0;                       // Size of the routing_state section.
+static char *states[SIM_MAX_NODES + 1];             // Saved state of every node. states[0] is the initial state.
+static int loaded = 0;                              // The node whose state is in routing_state, 0 for none.
+
+static int started[SIM_MAX_NODES + 1];              // Set when the routing engine of a node has been started.
+static unsigned long seen_version[SIM_MAX_NODES + 1]; // table_version of every node after its last event.
+static u_int64_t timer_due_ms[SIM_MAX_NODES + 1];   // Deadline of the timer event scheduled for every node, 0 if none.
+static u_int16_t costs[SIM_MAX_NODES + 1][SIM_MAX_NODES + 1]; // Cost of the fastest route of every node to every node.
+static u_int8_t next_hops[SIM_MAX_NODES + 1][SIM_MAX_NODES + 1]; // Next hop of those routes, 0 if none.
+static u_int8_t streaks[SIM_MAX_NODES + 1][SIM_MAX_NODES + 1]; // Consecutive increases of those costs.
+
+static struct sim_event **heap = NULL;              // Min-heap of scheduled events, ordered by time and sequence.
+static int heap_size = 0;                           // Number of scheduled events.
+static int heap_capacity = 0;                       // Room in the heap.
+static unsigned long next_seq = 0;                  // Sequence number of the next scheduled event.
+
+static struct sim_phase phases[SIM_MAX_PHASES];     // The phases so far.
+static int num_phases = 0;                          // Number of phases, the last one is in progress.
+static unsigned int rng_state = 1;                  // State of sim_random().
+
+static char const *type_names[NUM_TYPES] = {"HELLO", "UPDATE", "LSA", "LIVENESS", "TABLE REQUEST", "other"};
+static char const *type_ids[NUM_TYPES - 1] = {"HEL", "UPD", "LSA", "LIV", "TRQ"};
+
+/**
+ * Counters for the whole simulation, printed by sim_print_report().
+ */
+static struct {
+    unsigned long events;       // Events handled.
+    unsigned long swaps;        // Times the state of a node was swapped in.
+    unsigned long messages[NUM_TYPES];  // Frames sent, per kind of routing message.
+    unsigned long bytes[NUM_TYPES];     // Bytes of routing messages in those frames.
+    unsigned long lost;         // Frames lost on a link or while it was cut.
+    unsigned long unroutable;   // Messages to a node that is not a neighbour.
+    unsigned long cti;          // Count-to-infinity episodes.
+    u_int64_t wall_us;          // Real time spent in sim_run().
+} sim_stats;
+
+/**
+ * Returns the next number of a xorshift generator. Used for everything random in the simulator, so that a run
+ * only depends on the seed.
+ *
+ * @return: A pseudo-random number.
+ */
+unsigned int sim_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/**
+ * Returns the real monotonic time in microseconds, to measure how fast the simulation runs.
+ */
+static u_int64_t wall_time_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u_int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Returns 1 if event a happens before event b.
+ */
+static int event_before(struct sim_event const *a, struct sim_event const *b) {
+    return a->at_us < b->at_us || (a->at_us == b->at_us && a->seq < b->seq);
+}
+
+/**
+ * Schedules an event. Exits if memory runs out, since the simulation cannot go on without it.
+ *
+ * @param event: The event, allocated with malloc(). Owned by the simulator from now on.
+ */
+static void schedule(struct sim_event *event) {
+    if (heap_size == heap_capacity) {
+        heap_capacity = heap_capacity > 0 ? heap_capacity * 2 : 1024;
+        heap = realloc(heap, heap_capacity * sizeof(*heap));
+        if (heap == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    event->seq = next_seq++;
+    int pos = heap_size++;
+    while (pos > 0 && event_before(event, heap[(pos - 1) / 2])) {
+        heap[pos] = heap[(pos - 1) / 2];
+        pos = (pos - 1) / 2;
+    }
+    heap[pos] = event;
+}
+
+/**
+ * Removes the earliest event from the heap.
+ *
+ * @return: The event, to be freed by the caller, or NULL if no events are scheduled.
+ */
+static struct sim_event *next_event() {
+    if (heap_size == 0) {
+        return NULL;
+    }
+    struct sim_event *first = heap[0];
+    struct sim_event *last = heap[--heap_size];
+    int pos = 0;
+    while (1) {
+        int child = 2 * pos + 1;
+        if (child >= heap_size) {
+            break;
+        }
+        if (child + 1 < heap_size && event_before(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!event_before(heap[child], last)) {
+            break;
+        }
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = last;
+    return first;
+}
+
+/**
+ * Allocates an event.
+ *
+ * @param at_us: When the event happens.
+ * @param type: EVENT_*
+ * @param node: The node the event happens at, or the link for EVENT_LINK.
+ * @param len: Room for data.
+ * @return: The event, with the other fields zeroed.
+ */
+static struct sim_event *new_event(u_int64_t at_us, int type, int node, size_t len) {
+    struct sim_event *event = calloc(1, sizeof(struct sim_event) + len);
+    if (event == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    event->at_us = at_us;
+    event->type = type;
+    event->node = node;
+    event->len = len;
+    return event;
+}
+
+/**
+ * Swaps the state of a node into the routing_state section, saving the state of the node that was there.
+ *
+ * @param node: MIP address of the node.
+ */
+static void load(int node) {
+    if (node == loaded) {
+        return;
+    }
+    if (loaded != 0) {
+        memcpy(states[loaded], __start_routing_state, state_size);
+    }
+    memcpy(__start_routing_state, states[node], state_size);
+    loaded = node;
+    sim_stats.swaps++;
+}
+
+/**
+ * Returns the index of the kind of a routing message in type_names.
+ */
+static int message_type(unsigned char const *message) {
+    for (int i = 0; i < NUM_TYPES - 1; i++) {
+        if (memcmp(message + 2, type_ids[i], 3) == 0) {
+            return i;
+        }
+    }
+    return NUM_TYPES - 1;
+}
+
+/**
+ * Puts a message from the routing engine of the loaded node on the bus, in place of sending it to mipd.
+ *
+ * A broadcast is sent as one frame on every link of the node that is up, and a message to a neighbour as one frame
+ * on the link to it. Responses to routing requests are dropped, since the simulated nodes have no data plane.
+ *
+ * @param usd: The MIP address of the sending node, given to routingd_start() in place of a unix socket.
+ * @param message: The message, starting with the destination MIP address and TTL.
+ * @param len: The length of the message.
+ * @return: The length of the message, or -1 if it is too long for a MIP SDU.
+ */
+static long sim_send(int usd, void const *message, size_t len) {
+    unsigned char const *bytes = message;
+    if (len < 5 || len > sizeof(general_message)) {
+        return -1;
+    }
+    if (memcmp(bytes + 2, "RSP", 3) == 0) {
+        return (long)len;
+    }
+
+    int type = message_type(bytes);
+    int dest = bytes[0];
+    int sent = 0;
+    struct sim_phase *phase = &phases[num_phases - 1];
+    for (int i = 0; i < sim_topology->num_links; i++) {
+        struct sim_link const *link = &sim_topology->links[i];
+        int other = link->a == usd ? link->b : (link->b == usd ? link->a : 0);
+        if (other == 0 || (dest != 255 && dest != other)) {
+            continue;
+        }
+        sent = 1;
+        if (!link->up) {
+            continue; // The interface is down, mipd has nowhere to send it
+        }
+        sim_stats.messages[type]++;
+        sim_stats.bytes[type] += len - 2;
+        phase->messages++;
+        phase->bytes += len - 2;
+        if (sim_config.loss_pct > 0 && (int)(sim_random() % 100) < sim_config.loss_pct) {
+            sim_stats.lost++;
+            phase->lost++;
+            continue;
+        }
+
+        struct sim_event *event = new_event(sim_clock_us + sim_config.delay_us, EVENT_FRAME, other, len);
+        event->from = usd;
+        event->link = i;
+        memcpy(event->data, message, len);
+        schedule(event);
+    }
+    if (!sent) {
+        sim_stats.unroutable++;
+    }
+    return (long)len;
+}
+
+/**
+ * Records the new costs of the routes of the loaded node, and counts a count-to-infinity episode when the cost to a
+ * destination has gone up SIM_CTI_STREAK times in a row without the route being lost or getting cheaper.
+ *
+ * @param node: MIP address of the loaded node.
+ */
+static void track_costs(int node) {
+    struct sim_phase *phase = &phases[num_phases - 1];
+    for (int dest = 1; dest <= sim_topology->num_nodes; dest++) {
+        if (dest == node) {
+            continue;
+        }
+        route_info fastest = find_fastest_route(dest);
+        u_int16_t cost = fastest.cost;
+        u_int16_t old_cost = costs[node][dest];
+        next_hops[node][dest] = fastest.next_hop;
+        if (cost == old_cost) {
+            continue;
+        }
+        if (old_cost != MAX_COST && cost != MAX_COST && cost > old_cost) {
+            if (++streaks[node][dest] == SIM_CTI_STREAK) {
+                sim_stats.cti++;
+                phase->cti++;
+            }
+        } else {
+            streaks[node][dest] = 0;
+        }
+        costs[node][dest] = cost;
+    }
+}
+
+/**
+ * Does what the main loop of routingd does after every event, for the loaded node. Then records routing table
+ * changes, and schedules the next timer of the node if it has moved.
+ *
+ * @param node: MIP address of the loaded node.
+ */
+static void event_done(int node) {
+    routingd_event_done();
+
+    if (table_version != seen_version[node]) {
+        struct sim_phase *phase = &phases[num_phases - 1];
+        phase->changes += table_version - seen_version[node];
+        phase->last_change_us = sim_clock_us;
+        seen_version[node] = table_version;
+        track_costs(node);
+    }
+
+    u_int64_t deadline = timer_next_deadline();
+    if (deadline != 0 && deadline != timer_due_ms[node]) {
+        // The deadline is on the clock of the node
+        u_int64_t at_us = deadline * 1000 - sim_clock_offset_us;
+        if (at_us < sim_clock_us) {
+            at_us = sim_clock_us;
+        }
+        struct sim_event *event = new_event(at_us, EVENT_TIMER, node, 0);
+        event->deadline_ms = deadline;
+        schedule(event);
+    }
+    timer_due_ms[node] = deadline;
+}
+
+/**
+ * Hands a routing message to the routing engine of the loaded node, as routingd would receive it from mipd.
+ *
+ * @param node: MIP address of the loaded node.
+ * @param from: MIP address written in the header, the sender for messages from a neighbour.
+ * @param data: The message as it was sent, starting with the destination MIP address and TTL.
+ * @param len: The length of the message.
+ */
+static void deliver(int node, int from, unsigned char const *data, size_t len) {
+    general_message message;
+    memset(&message, 0, sizeof(message));
+    memcpy(&message, data, len);
+    message.header.mip_addr = from;
+    handle_message(node, message);
+    event_done(node);
+}
+
+/**
+ * Follows the next hops of the fastest routes from a node towards a destination.
+ *
+ * @param node: MIP address of the node the packet starts at.
+ * @param dest: MIP address of the destination.
+ * @return: 1 if the packet gets to the destination over links that are up, 0 if a node on the way has no route,
+ * its next hop is not at the other end of a link that is up, or the packet loops.
+ */
+static int route_delivers(int node, int dest) {
+    int at = node;
+    for (int hops = 0; hops < sim_topology->num_nodes; hops++) {
+        int next_hop = next_hops[at][dest];
+        if (next_hop == 0) {
+            return 0;
+        }
+        int link = topology_find_link(sim_topology, at, next_hop);
+        if (link < 0 || !sim_topology->links[link].up) {
+            return 0;
+        }
+        if (next_hop == dest) {
+            return 1;
+        }
+        at = next_hop;
+    }
+    return 0;
+}
+
+/**
+ * Checks the routes of every node against the topology, and stores the number of routes that are wrong in the
+ * current phase. A route is wrong if it is missing, if it leads to a node that cannot be reached, or if
+ * following the next hops does not get to the destination over links that are up without a loop.
+ */
+static void check_routes() {
+    u_int8_t reachable[SIM_MAX_NODES + 1];
+    int wrong = 0;
+    for (int node = 1; node <= sim_topology->num_nodes; node++) {
+        topology_reachable(sim_topology, node, reachable);
+        for (int dest = 1; dest <= sim_topology->num_nodes; dest++) {
+            if (dest == node) {
+                continue;
+            }
+            int has_route = costs[node][dest] != MAX_COST;
+            if (has_route != reachable[dest] || (has_route && !route_delivers(node, dest))) {
+                wrong++;
+            }
+        }
+    }
+    phases[num_phases - 1].wrong = wrong;
+}
+
+/**
+ * Ends the current phase and starts a new one.
+ *
+ * @param label: What the scenario does in the new phase.
+ */
+static void start_phase(char const *label) {
+    if (num_phases == SIM_MAX_PHASES) {
+        return; // Counted in the last phase
+    }
+    if (num_phases > 0) {
+        check_routes();
+    }
+    struct sim_phase *phase = &phases[num_phases++];
+    memset(phase, 0, sizeof(*phase));
+    snprintf(phase->label, sizeof(phase->label), "%s", label);
+    phase->start_us = sim_clock_us;
+    phase->last_event_us = sim_clock_us;
+}
+
+/**
+ * Cuts a link or brings it back. A cut link drops the frames on it. If report_down is set, both ends are told
+ * with a NEXT HOP DOWN message, as mipd does when it cannot send to a next hop.
+ *
+ * @param event: The EVENT_LINK event.
+ */
+static void change_link(struct sim_event const *event) {
+    struct sim_link *link = &sim_topology->links[event->node];
+    if (event->label != NULL) {
+        start_phase(event->label);
+    }
+    phases[num_phases - 1].last_event_us = sim_clock_us;
+    link->up = event->from;
+    if (link->up || !sim_config.report_down) {
+        return;
+    }
+
+    int ends[2] = {link->a, link->b};
+    for (int i = 0; i < 2; i++) {
+        if (!started[ends[i]]) {
+            continue;
+        }
+        nexthop_down_message message;
+        message.header.mip_addr = ends[i];
+        message.header.ttl = 0;
+        message.header.id1 = 0x4E; // N
+        message.header.id2 = 0x48; // H
+        message.header.id3 = 0x44; // D
+        message.next_hop_mip = ends[1 - i];
+        message.reason = NEXTHOP_DOWN_SEND_ERRORS;
+        load(ends[i]);
+        deliver(ends[i], ends[i], (unsigned char const *)&message, sizeof(message));
+    }
+}
+
+/**
+ * Sets up the simulation. Every node gets a copy of the current state of the routing engine, so the routing engine
+ * options must have been parsed before. The nodes start at random times within SIM_START_SPREAD_US.
+ *
+ * @param topology: The simulated network. Kept, and changed by the scenario.
+ * @param config: How the links behave.
+ * @return: 0 on success, -1 if memory runs out.
+ */
+int sim_init(struct sim_topology *topology, struct sim_config const *config) {
+    sim_topology = topology;
+    sim_config = *config;
+    rng_state = config->seed != 0 ? config->seed : 1;
+    state_size = __stop_routing_state - __start_routing_state;
+
+    routing_transport_hook = sim_send;
+    for (int node = 0; node <= topology->num_nodes; node++) {
+        states[node] = malloc(state_size);
+        if (states[node] == NULL) {
+            perror("malloc");
+            return -1;
+        }
+        memcpy(states[node], __start_routing_state, state_size);
+        for (int dest = 0; dest <= SIM_MAX_NODES; dest++) {
+            costs[node][dest] = MAX_COST;
+        }
+    }
+    for (int node = 1; node <= topology->num_nodes; node++) {
+        schedule(new_event(sim_random() % SIM_START_SPREAD_US, EVENT_START, node, 0));
+    }
+    start_phase("start");
+    global_debug("Simulating %d nodes with %zu bytes of routing state each\n", topology->num_nodes, state_size);
+    return 0;
+}
+
+/**
+ * Schedules a link to be cut or brought back.
+ *
+ * @param at_us: When the link changes.
+ * @param link: The index of the link in the topology.
+ * @param up: 1 to bring the link up, 0 to cut it.
+ * @param phase_label: Starts a new phase with this label, NULL to count the change in the current phase. Not copied.
+ */
+void sim_schedule_link(u_int64_t at_us, int link, int up, char const *phase_label) {
+    struct sim_event *event = new_event(at_us, EVENT_LINK, link, 0);
+    event->from = up;
+    event->label = phase_label;
+    schedule(event);
+}
+
+/**
+ * Runs the simulation until the virtual clock reaches a given time, then checks the routes of the last phase.
+ *
+ * @param until_us: When to stop.
+ */
+void sim_run(u_int64_t until_us) {
+    u_int64_t wall_start = wall_time_us();
+    struct sim_event *event;
+    while ((event = next_event()) != NULL) {
+        if (event->at_us > until_us) {
+            schedule(event);
+            break;
+        }
+        if (event->at_us > sim_clock_us) {
+            sim_clock_us = event->at_us;
+        }
+        sim_stats.events++;
+
+        switch (event->type) {
+            case EVENT_START:
+                load(event->node);
+                local_mip_addr = event->node;
+                // Clocks that are apart by a random number of microseconds, so that nodes do not send HELLO messages
+                // with the same timestamps, as hosts do not
+                sim_clock_offset_us = (u_int64_t)sim_random() * 1000 + sim_random() % 1000 + sim_clock_us;
+                routingd_start(event->node);
+                srand(sim_config.seed + event->node); // routingd_start() seeds from the time and pid
+                started[event->node] = 1;
+                event_done(event->node);
+                break;
+            case EVENT_FRAME:
+                if (!sim_topology->links[event->link].up) {
+                    sim_stats.lost++;
+                    phases[num_phases - 1].lost++;
+                } else if (started[event->node]) {
+                    load(event->node);
+                    deliver(event->node, event->from, event->data, event->len);
+                }
+                break;
+            case EVENT_TIMER:
+                if (event->deadline_ms == timer_due_ms[event->node]) {
+                    timer_due_ms[event->node] = 0;
+                    load(event->node);
+                    handle_timer_event(event->node);
+                    event_done(event->node);
+                }
+                break;
+            case EVENT_LINK:
+                change_link(event);
+                break;
+        }
+        free(event);
+    }
+    sim_clock_us = until_us;
+    check_routes();
+    sim_stats.wall_us += wall_time_us() - wall_start;
+}
+
+/**
+ * Returns how long after the last change of the network in a phase the routing tables stopped changing, in
+ * milliseconds. A phase that ended with wrong routes has not converged, whether the tables changed or not.
+ *
+ * @return: The convergence time, or -1 if the phase did not converge.
+ */
+static double convergence_ms(struct sim_phase const *phase) {
+    if (phase->wrong > 0) {
+        return -1;
+    }
+    if (phase->last_change_us <= phase->last_event_us) {
+        return 0;
+    }
+    return (double)(phase->last_change_us - phase->last_event_us) / 1000.0;
+}
+
+/**
+ * Prints the counters of the simulation and of every phase to stdout.
+ *
+ * @param json: If set, prints them as one JSON object instead.
+ */
+void sim_print_report(int json) {
+    double simulated_s = (double)sim_clock_us / 1000000.0;
+    double wall_s = (double)sim_stats.wall_us / 1000000.0;
+    double speedup = wall_s > 0 ? simulated_s / wall_s : 0;
+    unsigned long messages = 0, bytes = 0;
+    for (int i = 0; i < NUM_TYPES; i++) {
+        messages += sim_stats.messages[i];
+        bytes += sim_stats.bytes[i];
+    }
+
+    if (json) {
+        printf("{\"nodes\":%d,\"links\":%d,\"simulated_s\":%.3f,\"wall_s\":%.3f,\"speedup\":%.1f,\"events\":%lu,"
+               "\"swaps\":%lu,\"state_bytes\":%zu,\"messages\":%lu,\"bytes\":%lu,\"lost\":%lu,\"unroutable\":%lu,"
+               "\"count_to_infinity\":%lu,\"types\":{",
+               sim_topology->num_nodes, sim_topology->num_links, simulated_s, wall_s, speedup, sim_stats.events,
+               sim_stats.swaps, state_size, messages, bytes, sim_stats.lost, sim_stats.unroutable, sim_stats.cti);
+        for (int i = 0; i < NUM_TYPES; i++) {
+            printf("%s\"%s\":{\"messages\":%lu,\"bytes\":%lu}", i > 0 ? "," : "", type_names[i],
+                   sim_stats.messages[i], sim_stats.bytes[i]);
+        }
+        printf("},\"phases\":[");
+        for (int i = 0; i < num_phases; i++) {
+            struct sim_phase const *phase = &phases[i];
+            char converged[32];
+            snprintf(converged, sizeof(converged), "%.3f", convergence_ms(phase));
+            printf("%s{\"label\":\"%s\",\"start_s\":%.3f,\"convergence_ms\":%s,\"changes\":%lu,\"messages\":%lu,"
+                   "\"bytes\":%lu,\"lost\":%lu,\"count_to_infinity\":%lu,\"wrong_routes\":%d}",
+                   i > 0 ? "," : "", phase->label, (double)phase->start_us / 1000000.0,
+                   phase->wrong > 0 ? "null" : converged, phase->changes, phase->messages, phase->bytes,
+                   phase->lost, phase->cti, phase->wrong);
+        }
+        printf("]}\n");
+        fflush(stdout);
+        return;
+    }
+
+    printf("Simulation: %d nodes, %d links, %.1f s simulated in %.3f s (%.0fx real time)\n",
+           sim_topology->num_nodes, sim_topology->num_links, simulated_s, wall_s, speedup);
+    printf("  events=%lu state swaps=%lu state=%zu bytes per node\n", sim_stats.events, sim_stats.swaps, state_size);
+    printf("Messages: total=%lu bytes=%lu lost=%lu unroutable=%lu count-to-infinity=%lu\n",
+           messages, bytes, sim_stats.lost, sim_stats.unroutable, sim_stats.cti);
+    for (int i = 0; i < NUM_TYPES; i++) {
+        printf("  %-14s messages=%lu bytes=%lu\n", type_names[i], sim_stats.messages[i], sim_stats.bytes[i]);
+    }
+    printf("Phases:\n");
+    for (int i = 0; i < num_phases; i++) {
+        struct sim_phase const *phase = &phases[i];
+        char converged[48];
+        if (phase->wrong > 0) {
+            snprintf(converged, sizeof(converged), "not converged");
+        } else {
+            snprintf(converged, sizeof(converged), "converged in %.1f ms", convergence_ms(phase));
+        }
+        printf("  %-16s at %9.3f s: %s, changes=%lu messages=%lu bytes=%lu lost=%lu count-to-infinity=%lu "
+               "wrong routes=%d\n",
+               phase->label, (double)phase->start_us / 1000000.0, converged, phase->changes,
+               phase->messages, phase->bytes, phase->lost, phase->cti, phase->wrong);
+    }
+    fflush(stdout);
+}
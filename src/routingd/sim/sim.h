@@ -0,0 +1,31 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <sys/types.h>
+#include "topology.h"
+
+#define SIM_MAX_PHASES 256          // Maximum number of phases, the start and every scenario step.
+#define SIM_CTI_STREAK 3            // Consecutive increases of a route's cost that make a count-to-infinity episode.
+#define SIM_START_SPREAD_US 100000  // The nodes start at random times within this many microseconds.
+
+/**
+ * How the simulated links behave.
+ */
+struct sim_config {
+    u_int64_t delay_us;         // Time a frame takes over a link.
+    int loss_pct;               // Share of frames lost on a link, in percent.
+    int report_down;            // If set, both ends of a cut link get a NEXT HOP DOWN, as mipd sends after send errors.
+    unsigned int seed;          // Seed of the losses and start times, and of the random numbers of the routing engine.
+};
+
+int sim_init(struct sim_topology *topology, struct sim_config const *config);
+
+void sim_schedule_link(u_int64_t at_us, int link, int up, char const *phase_label);
+
+void sim_run(u_int64_t until_us);
+
+unsigned int sim_random();
+
+void sim_print_report(int json);
+
+#endif //SIM_H
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <string.h>
+#include "topology.h"
+
+/**
+ * Adds a link between two nodes, unless they are the same node or already linked.
+ *
+ * @param topology: The topology to add the link to.
+ * @param a: MIP address of one end.
+ * @param b: MIP address of the other end.
+ * @return: 0 if the link was added or already exists, -1 if there is no room for it.
+ */
+static int add_link(struct sim_topology *topology, int a, int b) {
+    if (a == b || topology_find_link(topology, a, b) != -1) {
+        return 0;
+    }
+    if (topology->num_links == SIM_MAX_LINKS) {
+        return -1;
+    }
+    struct sim_link *link = &topology->links[topology->num_links++];
+    link->a = a < b ? a : b;
+    link->b = a < b ? b : a;
+    link->up = 1;
+    return 0;
+}
+
+/**
+ * Builds one of the generated topologies. All links start up.
+ *
+ * line: node i is linked to node i + 1.
+ * ring: a line with the last node linked back to the first.
+ * grid: nodes laid out row by row, in rows as long as the integer square root of the number of nodes, and linked
+ *       to the nodes right of and below them.
+ * mesh: a random spanning tree, so that every node can be reached, with as many random links again on top.
+ *
+ * @param topology: The topology to build.
+ * @param kind: "line", "ring", "grid" or "mesh".
+ * @param num_nodes: The number of nodes, at most SIM_MAX_NODES.
+ * @param seed: The seed of the random mesh.
+ * @return: 0 on success, -1 if the kind is unknown or the topology does not fit.
+ */
+int topology_build(struct sim_topology *topology, char const *kind, int num_nodes, unsigned int seed) {
+    if (num_nodes < 2 || num_nodes > SIM_MAX_NODES) {
+        return -1;
+    }
+    memset(topology, 0, sizeof(*topology));
+    topology->num_nodes = num_nodes;
+
+    int rc = 0;
+    if (strcmp(kind, "line") == 0 || strcmp(kind, "ring") == 0) {
+        for (int i = 1; i < num_nodes; i++) {
+            rc |= add_link(topology, i, i + 1);
+        }
+        if (strcmp(kind, "ring") == 0 && num_nodes > 2) {
+            rc |= add_link(topology, 1, num_nodes);
+        }
+    } else if (strcmp(kind, "grid") == 0) {
+        int width = 1;
+        while ((width + 1) * (width + 1) <= num_nodes) {
+            width++;
+        }
+        for (int i = 1; i <= num_nodes; i++) {
+            if (i % width != 0 && i + 1 <= num_nodes) {
+                rc |= add_link(topology, i, i + 1);
+            }
+            if (i + width <= num_nodes) {
+                rc |= add_link(topology, i, i + width);
+            }
+        }
+    } else if (strcmp(kind, "mesh") == 0) {
+        srand(seed);
+        for (int i = 2; i <= num_nodes; i++) {
+            rc |= add_link(topology, rand() % (i - 1) + 1, i);
+        }
+        int extra = num_nodes - 1;
+        for (int tries = 0; extra > 0 && tries < num_nodes * num_nodes; tries++) {
+            int a = rand() % num_nodes + 1;
+            int b = rand() % num_nodes + 1;
+            if (a == b || topology_find_link(topology, a, b) != -1) {
+                continue;
+            }
+            rc |= add_link(topology, a, b);
+            extra--;
+        }
+    } else {
+        return -1;
+    }
+    return rc;
+}
+
+/**
+ * Finds the link between two nodes.
+ *
+ * @param topology: The topology to search.
+ * @param a: MIP address of one end.
+ * @param b: MIP address of the other end.
+ * @return: The index of the link in topology->links, or -1 if the nodes are not linked.
+ */
+int topology_find_link(struct sim_topology const *topology, int a, int b) {
+    for (int i = 0; i < topology->num_links; i++) {
+        struct sim_link const *link = &topology->links[i];
+        if ((link->a == a && link->b == b) || (link->a == b && link->b == a)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Finds the nodes that can be reached from a node over the links that are up.
+ *
+ * @param topology: The topology to search.
+ * @param from: MIP address of the node to start from.
+ * @param reachable: Set to 1 for every reachable node, including from itself, and 0 for the others.
+ * @return: The number of reachable nodes, including from itself.
+ */
+int topology_reachable(struct sim_topology const *topology, int from, u_int8_t reachable[SIM_MAX_NODES + 1]) {
+    int queue[SIM_MAX_NODES];
+    int head = 0, tail = 0;
+    memset(reachable, 0, SIM_MAX_NODES + 1);
+    reachable[from] = 1;
+    queue[tail++] = from;
+    while (head < tail) {
+        int node = queue[head++];
+        for (int i = 0; i < topology->num_links; i++) {
+            struct sim_link const *link = &topology->links[i];
+            if (!link->up) {
+                continue;
+            }
+            int next = link->a == node ? link->b : (link->b == node ? link->a : 0);
+            if (next != 0 && !reachable[next]) {
+                reachable[next] = 1;
+                queue[tail++] = next;
+            }
+        }
+    }
+    return tail;
+}
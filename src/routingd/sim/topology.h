@@ -0,0 +1,33 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <sys/types.h>
+
+#define SIM_MAX_NODES 254       // Maximum number of simulated nodes, MIP addresses 1 to 254.
+#define SIM_MAX_LINKS 4096      // Maximum number of links between simulated nodes.
+
+/**
+ * A point-to-point link between two simulated nodes, like a veth pair.
+ */
+struct sim_link {
+    u_int8_t a;                 // MIP address of one end.
+    u_int8_t b;                 // MIP address of the other end.
+    int up;                     // 1 if frames are carried, 0 if the link has been cut.
+};
+
+/**
+ * The simulated network. Node i has MIP address i, for i from 1 to num_nodes.
+ */
+struct sim_topology {
+    int num_nodes;
+    int num_links;
+    struct sim_link links[SIM_MAX_LINKS];
+};
+
+int topology_build(struct sim_topology *topology, char const *kind, int num_nodes, unsigned int seed);
+
+int topology_find_link(struct sim_topology const *topology, int a, int b);
+
+int topology_reachable(struct sim_topology const *topology, int from, u_int8_t reachable[SIM_MAX_NODES + 1]);
+
+#endif //TOPOLOGY_H
@@ -6,6 +6,9 @@
 // Global routing table
 route_node *routing_table[MAX_NODES];
 
+int route_infinity = MAX_COST; // Routes that cost this much or more are unreachable, set by routingd_start().
+unsigned long table_version = 0; // Incremented every time a route is added, removed or changes cost.
+
 /**
  * Initializes the routing table for the MIP protocol.
  *
@@ -24,6 +27,7 @@ void init_routing_table() {
  * or updating an existing route via the specified next hop with the given cost.
  * If the route does not exist, it creates a new route node and adds it to the table.
  * If the route exists, it just updates the cost and sets its status to valid.
+ * Either way the route is no longer stale.
  *
  * @param dest: The MIP address of the destination node.
  * @param next_hop: The MIP address of the next hop node on the route to the destination.
@@ -40,11 +44,15 @@ void add_update_route(uint8_t dest, uint8_t next_hop, int cost) {
         (*current)->route.next_hop = next_hop;
         (*current)->route.cost = cost;
         (*current)->route.valid = 1;
+        (*current)->route.stale = 0;
         (*current)->next = NULL;
-    } else { // Update existing route
+        table_version++;
+    } else if ((*current)->route.cost != cost || !(*current)->route.valid) { // Update existing route
         (*current)->route.cost = cost;
         (*current)->route.valid = 1;
+        table_version++;
     }
+    (*current)->route.stale = 0;
 
     //global_debug("Added/updated route to %d via %d with cost %d\n", dest, next_hop, cost);
     //print_routing_table();
@@ -73,6 +81,71 @@ int route_exists(uint8_t dest, uint8_t next_hop) {
     }
 }
 
+/**
+ * Adds a route loaded from a snapshot, marked as stale.
+ *
+ * Stale routes are used like any other route until they are confirmed by the neighbour they go through, or
+ * removed by delete_stale_routes(). A route that already exists is left alone.
+ *
+ * @param dest: The MIP address of the destination node.
+ * @param next_hop: The MIP address of the next hop node on the route to the destination.
+ * @param cost: The cost of the route when the snapshot was taken.
+ */
+void add_stale_route(uint8_t dest, uint8_t next_hop, int cost) {
+    if (route_exists(dest, next_hop)) {
+        return;
+    }
+    add_update_route(dest, next_hop, cost);
+    route_node *current = routing_table[dest];
+    while (current->route.next_hop != next_hop) {
+        current = current->next;
+    }
+    current->route.stale = 1;
+}
+
+/**
+ * Confirms a stale route to a neighbour over the direct link, because a message was received from it.
+ * The cost is kept.
+ *
+ * @param neighbour: The MIP address of the neighbour.
+ * @return: 1 if a stale route was confirmed, 0 otherwise.
+ */
+int confirm_direct_route(uint8_t neighbour) {
+    route_node *current = routing_table[neighbour];
+    while (current != NULL) {
+        if (current->route.next_hop == neighbour && current->route.stale) {
+            current->route.stale = 0;
+            return 1;
+        }
+        current = current->next;
+    }
+    return 0;
+}
+
+/**
+ * Deletes all routes that are still stale.
+ *
+ * @return: The number of routes deleted.
+ */
+int delete_stale_routes() {
+    int deleted = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        route_node **current = &routing_table[i];
+        while (*current != NULL) {
+            if ((*current)->route.stale) {
+                route_node *temp = *current;
+                *current = (*current)->next;
+                free(temp);
+                table_version++;
+                deleted++;
+            } else {
+                current = &(*current)->next;
+            }
+        }
+    }
+    return deleted;
+}
+
 /**
  * Deletes a specific route from the routing table.
  *
@@ -93,13 +166,38 @@ void delete_route(uint8_t dest, uint8_t next_hop) {
         route_node *temp = *current;
         *current = (*current)->next;
         free(temp);
+        table_version++;
+    }
+}
+
+/**
+ * Deletes the routes to a destination over next hops that are no longer wanted.
+ *
+ * Used by the link-state engine before it writes the routes it computed for the destination, so the routes it
+ * keeps are left alone. Direct routes to neighbours, where the destination is its own next hop, are maintained
+ * by the HELLO messages, and are always kept.
+ *
+ * @param dest: The MIP address of the destination node.
+ * @param keep: Set for each next hop whose route to the destination is kept.
+ */
+void delete_indirect_routes(uint8_t dest, u_int8_t const keep[MAX_NODES]) {
+    route_node **current = &routing_table[dest];
+    while (*current != NULL) {
+        if ((*current)->route.next_hop != dest && !keep[(*current)->route.next_hop]) {
+            route_node *temp = *current;
+            *current = (*current)->next;
+            free(temp);
+            table_version++;
+        } else {
+            current = &(*current)->next;
+        }
     }
 }
 
 /**
  * Marks a specific hop as unreachable in the routing table.
  *
- * This function iterates over the entire routing table and sets the cost to 255 (representing unreachable)
+ * This function iterates over the entire routing table and sets the cost to MAX_COST (representing unreachable)
  * for any route that uses the specified next hop node. This function is typically called when the specified
  * next hop node has become unreachable, and hence all paths via that node should be updated to reflect this.
  *
@@ -109,14 +207,79 @@ void set_hop_unreachable(u_int8_t next_hop) {
     for (int i = 0; i < MAX_NODES; i++) {
         route_node *current = routing_table[i];
         while (current != NULL) {
-            if (current->route.next_hop == next_hop) {
-                current->route.cost = 255;
+            if (current->route.next_hop == next_hop && current->route.cost != MAX_COST) {
+                current->route.cost = MAX_COST;
+                table_version++;
             }
             current = current->next;
         }
     }
 }
 
+/**
+ * Changes the cost of all reachable routes via a neighbour by the same amount.
+ *
+ * Used when the measured cost of the link to the neighbour changes. Every route via the neighbour costs the
+ * link plus the neighbour's own distance, so all of them move by the change in link cost. Routes that would
+ * reach route_infinity become unreachable.
+ *
+ * @param next_hop: The MIP address of the neighbour.
+ * @param delta: The change in the cost of the link to the neighbour.
+ */
+void adjust_routes_via(uint8_t next_hop, int delta) {
+    for (int i = 0; i < MAX_NODES; i++) {
+        route_node *current = routing_table[i];
+        while (current != NULL) {
+            if (current->route.next_hop == next_hop && current->route.cost < MAX_COST) {
+                int cost = current->route.cost + delta;
+                if (cost < 1) {
+                    cost = 1;
+                } else if (cost >= route_infinity) {
+                    cost = MAX_COST;
+                }
+                if (current->route.cost != cost) {
+                    current->route.cost = cost;
+                    table_version++;
+                }
+            }
+            current = current->next;
+        }
+    }
+}
+
+/**
+ * Finds the route to a neighbour over the direct link to it.
+ *
+ * @param neighbour: The MIP address of the neighbour.
+ * @return: The route with the neighbour as both destination and next hop. If there is none, returns a
+ * route with next hop 0 and cost MAX_COST.
+ */
+route_info find_direct_route(uint8_t neighbour) {
+    route_node *current = routing_table[neighbour];
+    route_info direct_route = {0, MAX_COST, 0, 0};
+
+    while (current != NULL) {
+        if (current->route.next_hop == neighbour) {
+            direct_route = current->route;
+            break;
+        }
+        current = current->next;
+    }
+
+    return direct_route;
+}
+
+/**
+ * Checks if a node is an immediate neighbour, meaning there is a reachable route to it over a direct link.
+ *
+ * @param mip_addr: The MIP address of the node.
+ * @return: 1 if the node is a neighbour, 0 otherwise.
+ */
+int is_neighbour(uint8_t mip_addr) {
+    route_info direct_route = find_direct_route(mip_addr);
+    return direct_route.next_hop != 0 && direct_route.valid && direct_route.cost < MAX_COST;
+}
+
 /**
  * Finds the fastest route to a given destination in the routing table.
  *
@@ -129,7 +292,7 @@ void set_hop_unreachable(u_int8_t next_hop) {
  */
 route_info find_fastest_route(uint8_t dest) {
     route_node *current = routing_table[dest];
-    route_info fastest_route = {0, MAX_COST, 0};
+    route_info fastest_route = {0, MAX_COST, 0, 0};
 
     while (current != NULL) {
         if (current->route.valid && current->route.cost < fastest_route.cost) {
@@ -141,6 +304,79 @@ route_info find_fastest_route(uint8_t dest) {
     return fastest_route;
 }
 
+/**
+ * Finds all next hops that reach a given destination at the lowest cost.
+ *
+ * This function iterates over all routes to the given destination and collects the next hop of every
+ * valid route whose cost equals the cost of the fastest route, in the order they appear in the table.
+ * At most MAX_EQUAL_COST_ROUTES next hops are returned.
+ *
+ * @param dest: The MIP address of the destination node.
+ * @param next_hops: Array to hold the equal cost next hops.
+ * @return: The number of next hops stored in next_hops, 0 if the destination is unreachable.
+ */
+int find_equal_cost_routes(uint8_t dest, uint8_t next_hops[MAX_EQUAL_COST_ROUTES]) {
+    route_info fastest_route = find_fastest_route(dest);
+    int count = 0;
+
+    if (fastest_route.next_hop == 0) {
+        return 0;
+    }
+
+    route_node *current = routing_table[dest];
+    while (current != NULL && count < MAX_EQUAL_COST_ROUTES) {
+        if (current->route.valid && current->route.cost == fastest_route.cost) {
+            next_hops[count++] = current->route.next_hop;
+        }
+        current = current->next;
+    }
+
+    return count;
+}
+
+/**
+ * Finds a loop-free alternate route to a given destination, to be used if the primary next hop fails.
+ *
+ * Every valid route via another neighbour N is a candidate. Its cost is the cost of the link to N plus
+ * N's own distance to the destination. N is loop-free if it does not route back through this node:
+ *     dist(N, dest) < dist(N, self) + dist(self, dest)
+ * where dist(N, self) is taken to be the cost of the link to N. The cheapest candidate that satisfies this
+ * is returned. If no candidate is found, returns a route with next hop 0 and cost MAX_COST.
+ *
+ * @param dest: The MIP address of the destination node.
+ * @param primary: The fastest route to the destination, as returned by find_fastest_route().
+ * @return: A route_info structure containing information about the backup route to the destination.
+ */
+route_info find_backup_route(uint8_t dest, route_info primary) {
+    route_node *current = routing_table[dest];
+    route_info backup_route = {0, MAX_COST, 0, 0};
+
+    if (primary.next_hop == 0) {
+        return backup_route;
+    }
+
+    while (current != NULL) {
+        route_info candidate = current->route;
+        current = current->next;
+        if (!candidate.valid || candidate.cost >= MAX_COST || candidate.next_hop == primary.next_hop) {
+            continue;
+        }
+
+        // The cost of the direct link to the candidate next hop
+        if (!is_neighbour(candidate.next_hop)) {
+            continue;
+        }
+
+        int link_cost = find_direct_route(candidate.next_hop).cost;
+        int neighbour_distance = candidate.cost - link_cost;
+        if (neighbour_distance < link_cost + primary.cost && candidate.cost < backup_route.cost) {
+            backup_route = candidate;
+        }
+    }
+
+    return backup_route;
+}
+
 /**
  * Logs the entire routing table for debugging purposes.
  *
@@ -156,7 +392,8 @@ void print_routing_table() {
         route_node *current = routing_table[i];
         while (current != NULL) {
             if (current->route.valid) {
-                global_debug("%-12d %-12d %-12d\n", i, current->route.next_hop, current->route.cost);
+                global_debug("%-12d %-12d %-12d%s\n", i, current->route.next_hop, current->route.cost,
+                             current->route.stale ? " (stale)" : "");
             }
             current = current->next;
         }
@@ -174,7 +411,7 @@ void print_routing_table() {
  * @param dest_mip_addr: The MIP address of the neighbor node.
  * @param fastest_routes: Array to hold the cost of fastest route to every other node in the network.
  */
-void get_all_fastest_routes_for_neighbour(uint8_t dest_mip_addr, u_int8_t fastest_routes[MAX_NODES]) {
+void get_all_fastest_routes_for_neighbour(uint8_t dest_mip_addr, u_int16_t fastest_routes[MAX_NODES]) {
     //global_debug("Getting all fastest routes for neighbour %d\n", dest_mip_addr);
     for (int node = 0; node < MAX_NODES; node++) {
         // Find the fastest route for each destination
@@ -195,7 +432,7 @@ void get_all_fastest_routes_for_neighbour(uint8_t dest_mip_addr, u_int8_t fastes
  *
  * @param fastest_routes: Array to hold the cost of fastest route to every other node in the network.
  */
-void get_all_fastest_routes(uint8_t fastest_routes[MAX_NODES]) {
+void get_all_fastest_routes(u_int16_t fastest_routes[MAX_NODES]) {
     //global_debug("Getting all fastest routes\n");
     for (int node = 0; node < MAX_NODES; node++) {
         // Find the fastest route for each destination
@@ -207,7 +444,7 @@ void get_all_fastest_routes(uint8_t fastest_routes[MAX_NODES]) {
  * Identifies all immediate neighbors.
  *
  * This function checks the entire routing table and identifies all nodes that are immediate neighbors.
- * A node is considered a neighbor if the cost of the fastest route to that node is 1. For each neighbor found,
+ * A node is considered a neighbor if there is a reachable route to it over a direct link. For each neighbor found,
  * it assigns 1 to the corresponding element in the neighbors array. For non-neighbors, it assigns 0.
  *
  * @param neighbours: Array to hold the identification of neighbour nodes. If node 'i' is a neighbour, neighbours[i] will be 1, 0 otherwise.
@@ -216,7 +453,7 @@ void get_all_neighbours(uint8_t neighbours[MAX_NODES]) {
     // global_debug("Getting all neighbours\n");
     for (int node = 0; node < MAX_NODES; node++) {
         // Find the fastest route for each destination
-        if (find_fastest_route(node).cost == 1) {
+        if (is_neighbour(node)) {
             //global_debug("Found neighbour %d\n", node);
             neighbours[node] = 1;
         } else {
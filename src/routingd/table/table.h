@@ -6,13 +6,16 @@
 #include <sys/types.h>
 
 #define MAX_NODES 256
-#define MAX_COST 255
+#define MAX_COST 0xFFFF // Cost of an unreachable route, in the table and in UPDATE messages.
+#define MAX_HOPS 16     // Links of the largest cost a route may cross before it counts as unreachable.
+#define MAX_EQUAL_COST_ROUTES 8
 
 // Structure for each route info
 typedef struct {
     uint8_t next_hop;
-    u_int8_t cost;
+    u_int16_t cost;
     int valid;
+    int stale;      // Set for routes loaded from a snapshot that have not been confirmed since.
 } route_info;
 
 // Node in the linked list for each destination
@@ -21,23 +24,45 @@ typedef struct route_node {
     struct route_node *next;
 } route_node;
 
+extern route_node *routing_table[MAX_NODES]; // The routes to each destination.
+extern int route_infinity; // Routes that cost this much or more are unreachable, set by routingd_start().
+extern unsigned long table_version; // Incremented every time a route is added, removed or changes cost.
+
 void init_routing_table();
 
 void add_update_route(uint8_t dest, uint8_t next_hop, int cost);
 
 int route_exists(uint8_t dest, uint8_t next_hop);
 
+void add_stale_route(uint8_t dest, uint8_t next_hop, int cost);
+
+int confirm_direct_route(uint8_t neighbour);
+
+int delete_stale_routes();
+
 void delete_route(uint8_t dest, uint8_t next_hop);
 
+void delete_indirect_routes(uint8_t dest, u_int8_t const keep[MAX_NODES]);
+
 void set_hop_unreachable(u_int8_t next_hop);
 
+void adjust_routes_via(uint8_t next_hop, int delta);
+
+route_info find_direct_route(uint8_t neighbour);
+
+int is_neighbour(uint8_t mip_addr);
+
 route_info find_fastest_route(uint8_t dest);
 
+route_info find_backup_route(uint8_t dest, route_info primary);
+
+int find_equal_cost_routes(uint8_t dest, uint8_t next_hops[MAX_EQUAL_COST_ROUTES]);
+
 void print_routing_table();
 
-void get_all_fastest_routes_for_neighbour(uint8_t dest_mip_addr, u_int8_t fastest_routes[MAX_NODES]);
+void get_all_fastest_routes_for_neighbour(uint8_t dest_mip_addr, u_int16_t fastest_routes[MAX_NODES]);
 
-void get_all_fastest_routes(uint8_t fastest_routes[MAX_NODES]);
+void get_all_fastest_routes(u_int16_t fastest_routes[MAX_NODES]);
 
 void get_all_neighbours(uint8_t neighbours[MAX_NODES]);
 
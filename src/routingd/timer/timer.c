@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "timer.h"
+#include "../routing_common.h"
+
+/**
+ * A single timer. The deadline is an absolute time on the monotonic clock, in milliseconds.
+ */
+struct timer {
+    timer_callback callback;    // Function called when the timer expires.
+    void *arg;                  // Argument passed to the callback.
+    u_int64_t deadline;         // When the timer expires.
+    int heap_pos;               // Position in the heap, -1 if the timer is not armed.
+};
+
+static struct timer timers[MAX_TIMERS];    // All created timers. The timer id is the index + 1.
+static int num_timers = 0;                 // Number of created timers.
+static int heap[MAX_TIMERS];               // Min-heap of armed timer indexes, ordered by deadline.
+static int heap_size = 0;                  // Number of armed timers.
+static int timer_fd = -1;                  // The timerfd that is armed for the earliest deadline.
+static u_int64_t armed_deadline = 0;       // The deadline the timerfd is currently armed for, 0 if disarmed.
+
+/**
+ * Swaps two entries in the heap and updates their stored positions.
+ */
+static void heap_swap(int a, int b) {
+    int tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+    timers[heap[a]].heap_pos = a;
+    timers[heap[b]].heap_pos = b;
+}
+
+/**
+ * Moves the heap entry at pos towards the root until the heap property holds.
+ */
+static void heap_sift_up(int pos) {
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (timers[heap[parent]].deadline <= timers[heap[pos]].deadline) {
+            break;
+        }
+        heap_swap(pos, parent);
+        pos = parent;
+    }
+}
+
+/**
+ * Moves the heap entry at pos towards the leaves until the heap property holds.
+ */
+static void heap_sift_down(int pos) {
+    while (1) {
+        int smallest = pos;
+        int left = 2 * pos + 1;
+        int right = 2 * pos + 2;
+        if (left < heap_size && timers[heap[left]].deadline < timers[heap[smallest]].deadline) {
+            smallest = left;
+        }
+        if (right < heap_size && timers[heap[right]].deadline < timers[heap[smallest]].deadline) {
+            smallest = right;
+        }
+        if (smallest == pos) {
+            break;
+        }
+        heap_swap(pos, smallest);
+        pos = smallest;
+    }
+}
+
+/**
+ * Removes the heap entry at pos.
+ */
+static void heap_remove(int pos) {
+    int index = heap[pos];
+    heap_size--;
+    if (pos != heap_size) {
+        heap[pos] = heap[heap_size];
+        timers[heap[pos]].heap_pos = pos;
+        heap_sift_up(pos);
+        heap_sift_down(timers[heap[pos]].heap_pos);
+    }
+    timers[index].heap_pos = -1;
+}
+
+/**
+ * Arms the timerfd for the earliest deadline in the heap, or disarms it if no timers are armed.
+ * Does nothing if the timerfd is already armed for that deadline.
+ */
+static void update_timerfd() {
+#ifdef ROUTINGD_SIM
+    return; // The simulator asks for timer_next_deadline() after every event instead
+#endif
+    u_int64_t deadline = heap_size > 0 ? timers[heap[0]].deadline : 0;
+    if (deadline == armed_deadline) {
+        return;
+    }
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (deadline != 0) {
+        its.it_value.tv_sec = (time_t)(deadline / 1000);
+        its.it_value.tv_nsec = (long)(deadline % 1000) * 1000000;
+    }
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+        perror("timerfd_settime");
+        return;
+    }
+    armed_deadline = deadline;
+}
+
+/**
+ * Initializes the timer subsystem and creates the timerfd that drives it.
+ *
+ * The timerfd should be added to the epoll instance of the main loop, and handle_timer_event() called
+ * when it becomes readable. In the simulator there is no timerfd, and 0 is returned.
+ *
+ * @return: The file descriptor of the timerfd, or -1 on failure.
+ */
+int init_timers() {
+    num_timers = 0;
+    heap_size = 0;
+    armed_deadline = 0;
+#ifdef ROUTINGD_SIM
+    return 0;
+#endif
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1) {
+        perror("timerfd_create");
+        return -1;
+    }
+    return timer_fd;
+}
+
+/**
+ * Creates a new timer. The timer is not armed until timer_arm() is called.
+ *
+ * @param callback: Function called when the timer expires.
+ * @param arg: Argument passed to the callback.
+ * @return: The id of the new timer, or -1 if MAX_TIMERS timers already exist.
+ */
+int timer_create_new(timer_callback callback, void *arg) {
+    if (num_timers >= MAX_TIMERS) {
+        global_debug("Too many timers");
+        return -1;
+    }
+    timers[num_timers].callback = callback;
+    timers[num_timers].arg = arg;
+    timers[num_timers].deadline = 0;
+    timers[num_timers].heap_pos = -1;
+    num_timers++;
+    return num_timers;
+}
+
+/**
+ * Arms a timer to expire at the given absolute time. If the timer is already armed it is moved.
+ *
+ * @param timer_id: The id returned by timer_create_new().
+ * @param deadline_ms: The absolute expiry time, in milliseconds of current_time_ms().
+ */
+void timer_arm_at(int timer_id, u_int64_t deadline_ms) {
+    if (timer_id < 1 || timer_id > num_timers) {
+        return;
+    }
+    struct timer *timer = &timers[timer_id - 1];
+    if (deadline_ms == 0) {
+        deadline_ms = 1; // 0 means disarmed for the timerfd
+    }
+
+    if (timer->heap_pos == -1) {
+        heap[heap_size] = timer_id - 1;
+        timer->heap_pos = heap_size;
+        heap_size++;
+        timer->deadline = deadline_ms;
+        heap_sift_up(timer->heap_pos);
+    } else {
+        u_int64_t old_deadline = timer->deadline;
+        timer->deadline = deadline_ms;
+        if (deadline_ms < old_deadline) {
+            heap_sift_up(timer->heap_pos);
+        } else {
+            heap_sift_down(timer->heap_pos);
+        }
+    }
+    update_timerfd();
+}
+
+/**
+ * Arms a timer to expire delay_ms milliseconds from now. If the timer is already armed it is moved.
+ *
+ * @param timer_id: The id returned by timer_create_new().
+ * @param delay_ms: Milliseconds until the timer expires.
+ */
+void timer_arm(int timer_id, u_int64_t delay_ms) {
+    timer_arm_at(timer_id, current_time_ms() + delay_ms);
+}
+
+/**
+ * Disarms a timer. Does nothing if the timer is not armed.
+ *
+ * @param timer_id: The id returned by timer_create_new().
+ */
+void timer_disarm(int timer_id) {
+    if (timer_id < 1 || timer_id > num_timers) {
+        return;
+    }
+    struct timer const *timer = &timers[timer_id - 1];
+    if (timer->heap_pos != -1) {
+        heap_remove(timer->heap_pos);
+        update_timerfd();
+    }
+}
+
+/**
+ * Checks if a timer is armed.
+ *
+ * @param timer_id: The id returned by timer_create_new().
+ * @return: 1 if the timer is armed, 0 otherwise.
+ */
+int timer_is_armed(int timer_id) {
+    if (timer_id < 1 || timer_id > num_timers) {
+        return 0;
+    }
+    return timers[timer_id - 1].heap_pos != -1;
+}
+
+/**
+ * Returns the absolute expiry time of an armed timer.
+ *
+ * @param timer_id: The id returned by timer_create_new().
+ * @return: The deadline in milliseconds of current_time_ms(), or 0 if the timer is not armed.
+ */
+u_int64_t timer_deadline(int timer_id) {
+    if (!timer_is_armed(timer_id)) {
+        return 0;
+    }
+    return timers[timer_id - 1].deadline;
+}
+
+/**
+ * Returns the earliest deadline of all armed timers. Used by the simulator, which has no timerfd.
+ *
+ * @return: The deadline in milliseconds of current_time_ms(), or 0 if no timer is armed.
+ */
+u_int64_t timer_next_deadline() {
+    return heap_size > 0 ? timers[heap[0]].deadline : 0;
+}
+
+/**
+ * Handles an event on the timerfd. Runs the callbacks of all expired timers in deadline order.
+ *
+ * An expired timer is disarmed before its callback runs, so the callback may arm it again.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication, passed to the callbacks.
+ */
+void handle_timer_event(int usd) {
+#ifndef ROUTINGD_SIM
+    u_int64_t expirations;
+    read(timer_fd, &expirations, sizeof(expirations)); // Clears the readable state of the timerfd
+#endif
+    armed_deadline = 0;
+
+    u_int64_t now = current_time_ms();
+    while (heap_size > 0 && timers[heap[0]].deadline <= now) {
+        int index = heap[0];
+        heap_remove(0);
+        timers[index].callback(usd, timers[index].arg);
+    }
+    update_timerfd();
+}
@@ -0,0 +1,28 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <sys/types.h>
+
+#define MAX_TIMERS 1024 // Maximum number of timers that can be created.
+
+typedef void (*timer_callback)(int usd, void *arg);
+
+int init_timers();
+
+int timer_create_new(timer_callback callback, void *arg);
+
+void timer_arm(int timer_id, u_int64_t delay_ms);
+
+void timer_arm_at(int timer_id, u_int64_t deadline_ms);
+
+void timer_disarm(int timer_id);
+
+int timer_is_armed(int timer_id);
+
+u_int64_t timer_deadline(int timer_id);
+
+u_int64_t timer_next_deadline();
+
+void handle_timer_event(int usd);
+
+#endif //TIMER_H
@@ -1,36 +1,70 @@
 #include <sys/socket.h>
 #include <stdio.h>
 #include <string.h>
+#include <arpa/inet.h>
 #include "update.h"
+#include "../timer/timer.h"
+#include "../liveness/liveness.h"
+#include "../metric/metric.h"
+#include "../linkstate/linkstate.h"
+#include "../hello/checkin.h"
+
+int update_coalesce_ms = 200;       // How long triggered UPDATEs are collected before they are flushed.
+int update_min_interval_ms = 1000;  // Minimum time between two UPDATE messages to the same neighbour.
+
+struct update_stats update_stats;   // Counters for triggered UPDATE messages.
+
+static int update_pending = 0;                      // Set if an UPDATE round is waiting to be flushed.
+static u_int64_t update_pending_since = 0;          // When the pending UPDATE round was first requested.
+static u_int8_t neighbour_pending[MAX_NODES];       // Neighbours that are still owed an UPDATE message.
+static u_int64_t last_update_sent[MAX_NODES];       // When the last UPDATE message was sent to each neighbour.
+static int flush_timer = 0;                         // Timer that calls flush_update_messages().
+// Set for each neighbour and UPDATE message of the table if the last one sent held only unreachable destinations.
+static u_int8_t unreachable_sent[MAX_NODES][MAX_NODES / UPDATE_NODES_PER_MESSAGE];
 
 /**
  * Sends update message to a neighbor node.
  *
  * This function is used to inform one of the neighbor nodes about the current state of the routing table.
- * The function packs the routing information including the fastest routes to all nodes into an update_message
- * and subsequently sends it to the neighbor specified by dest_mip_addr.
+ * The function packs the routing information including the fastest routes to all nodes into update_messages
+ * and subsequently sends them to the neighbor specified by dest_mip_addr. The costs are 16 bit, so the
+ * table does not fit in one message and is sent as UPDATE_NODES_PER_MESSAGE destinations at a time. A message
+ * whose destinations are all unreachable is left out if the last one sent to the neighbour for them was too, so
+ * networks with fewer than UPDATE_NODES_PER_MESSAGE nodes send one message instead of two.
  *
  * @param usd: The Unix domain socket descriptor used for communicating between MIP daemons.
  * @param dest_mip_addr: The MIP address of the neighbor node to send the update to.
  * @param fastest_routes: Array containing the minimum cost to every other node in the network.
  */
-void send_update_message(int usd, u_int8_t dest_mip_addr, const u_int8_t fastest_routes[MAX_NODES]) {
+void send_update_message(int usd, u_int8_t dest_mip_addr, const u_int16_t fastest_routes[MAX_NODES]) {
     global_debug("Sending UPDATE message to %d", dest_mip_addr);
-    update_message update;
-    update.header.mip_addr = dest_mip_addr;
-    update.header.ttl = 1;
-    update.header.id1 = 0x55; // U
-    update.header.id2 = 0x50; // P
-    update.header.id3 = 0x44; // D
-    memcpy(update.fastest_routes, fastest_routes, sizeof(u_int8_t) * MAX_NODES);
-    //global_debug("Fastest routes to send: ");
-    //for (int i = 0; i < 20; i++) {
-    //    global_debug("%d,", update.fastest_routes[i]);
-    //}
-
-
-    if (send(usd, &update, sizeof(update), 0) == -1) {
-        perror("send");
+    for (int first_node = 0; first_node < MAX_NODES; first_node += UPDATE_NODES_PER_MESSAGE) {
+        int unreachable = 1;
+        for (int i = 0; i < UPDATE_NODES_PER_MESSAGE && unreachable; i++) {
+            unreachable = fastest_routes[first_node + i] == MAX_COST;
+        }
+        u_int8_t *sent = &unreachable_sent[dest_mip_addr][first_node / UPDATE_NODES_PER_MESSAGE];
+        if (unreachable && *sent) {
+            update_stats.skipped++;
+            continue;
+        }
+        *sent = unreachable;
+
+        update_message update;
+        update.header.mip_addr = dest_mip_addr;
+        update.header.ttl = 1;
+        update.header.id1 = 0x55; // U
+        update.header.id2 = 0x50; // P
+        update.header.id3 = 0x44; // D
+        update.first_node = first_node;
+        update.num_nodes = UPDATE_NODES_PER_MESSAGE;
+        for (int i = 0; i < UPDATE_NODES_PER_MESSAGE; i++) {
+            update.fastest_routes[i] = htons(fastest_routes[first_node + i]);
+        }
+
+        if (routing_send(usd, &update, sizeof(update)) == -1) {
+            perror("send");
+        }
     }
 }
 
@@ -51,7 +85,7 @@ void send_update_messages(int usd) {
     for (int node = 0; node < MAX_NODES; node++) {
         if (neighbours[node] != 0) {
             //global_debug("Neighbour: %d\n", node);
-            u_int8_t fastest_routes[MAX_NODES];
+            u_int16_t fastest_routes[MAX_NODES];
             //global_debug("Getting the fastest routes to send to neighbour %d\n", node);
             get_all_fastest_routes_for_neighbour(node, fastest_routes);
             //global_debug("Sending UPDATE message to neighbour %d\n", node);
@@ -64,59 +98,189 @@ void send_update_messages(int usd) {
     }
 }
 
+/**
+ * Timer callback that flushes the pending UPDATE messages.
+ */
+static void flush_timer_expired(int usd, void *arg) {
+    (void)arg;
+    flush_update_messages(usd);
+}
+
+/**
+ * Marks that the routing table has changed and all neighbours should receive an UPDATE.
+ *
+ * Nothing is sent right away. The neighbours are marked as pending, and flush_update_messages() sends
+ * one UPDATE to each of them once the coalescing window has passed. If a neighbour is already pending,
+ * the new request is collapsed into the pending one and counted as suppressed.
+ * In link-state mode, the neighbours are told through a new link-state advertisement instead.
+ */
+void schedule_update_messages() {
+    if (linkstate_mode) {
+        linkstate_schedule_lsa();
+        return;
+    }
+
+    u_int8_t neighbours[MAX_NODES];
+    get_all_neighbours(neighbours);
+
+    update_stats.triggers++;
+    if (!update_pending) {
+        update_pending = 1;
+        update_pending_since = current_time_ms();
+        if (flush_timer == 0) {
+            flush_timer = timer_create_new(flush_timer_expired, NULL);
+        }
+        if (!timer_is_armed(flush_timer)) {
+            timer_arm_at(flush_timer, update_pending_since + update_coalesce_ms);
+        }
+    }
+
+    for (int node = 0; node < MAX_NODES; node++) {
+        if (neighbours[node] != 0) {
+            if (neighbour_pending[node]) {
+                update_stats.suppressed++;
+            } else {
+                neighbour_pending[node] = 1;
+            }
+        }
+    }
+}
+
+/**
+ * Sends the pending UPDATE messages if the coalescing window has passed.
+ *
+ * Called by the flush timer when the coalescing window ends. Each pending neighbour gets one UPDATE computed
+ * from the current routing table, unless an UPDATE was sent to it less than update_min_interval_ms ago.
+ * Such neighbours stay pending, and the timer is armed for when the first of them may be sent to again.
+ *
+ * @param usd: The Unix domain socket descriptor used for communicating between MIP daemons.
+ */
+void flush_update_messages(int usd) {
+    if (!update_pending) {
+        return;
+    }
+
+    u_int64_t now = current_time_ms();
+    if (now - update_pending_since < (u_int64_t)update_coalesce_ms) {
+        timer_arm_at(flush_timer, update_pending_since + update_coalesce_ms);
+        return;
+    }
+
+    u_int8_t neighbours[MAX_NODES];
+    get_all_neighbours(neighbours);
+
+    int still_pending = 0;
+    u_int64_t next_flush = 0;
+    for (int node = 0; node < MAX_NODES; node++) {
+        if (!neighbour_pending[node]) {
+            continue;
+        }
+        if (neighbours[node] == 0) {
+            // No longer a neighbour, nothing to send
+            neighbour_pending[node] = 0;
+            continue;
+        }
+        if (last_update_sent[node] != 0 && now - last_update_sent[node] < (u_int64_t)update_min_interval_ms) {
+            // Sent to this neighbour too recently, try again later
+            update_stats.deferred++;
+            u_int64_t allowed_at = last_update_sent[node] + update_min_interval_ms;
+            if (!still_pending || allowed_at < next_flush) {
+                next_flush = allowed_at;
+            }
+            still_pending = 1;
+            continue;
+        }
+
+        u_int16_t fastest_routes[MAX_NODES];
+        get_all_fastest_routes_for_neighbour(node, fastest_routes);
+        send_update_message(usd, node, fastest_routes);
+        neighbour_pending[node] = 0;
+        last_update_sent[node] = now;
+        update_stats.sent++;
+    }
+
+    update_pending = still_pending;
+    if (still_pending) {
+        timer_arm_at(flush_timer, next_flush);
+    }
+}
+
+/**
+ * Prints the counters for triggered UPDATE messages to stdout.
+ */
+void print_update_stats() {
+    printf("UPDATE stats: triggers=%lu sent=%lu suppressed=%lu deferred=%lu skipped=%lu table_requests=%lu answered=%lu (window %d ms, min interval %d ms)\n",
+           update_stats.triggers, update_stats.sent, update_stats.suppressed, update_stats.deferred,
+           update_stats.skipped, update_stats.table_requests, update_stats.table_answers, update_coalesce_ms, update_min_interval_ms);
+    fflush(stdout);
+}
+
 /**
  * Handles the received UPDATE message and updates the routing table accordingly.
  *
  * This function first checks whether the sender is already recognized as a neighbor or not. If not, it adds
- * the sender as a new neighbor. It then updates the routing table based on the received data.
- * If any changes have been made to the routing table, the function sends an updated routing table to all neighbors.
+ * the sender as a new neighbor and starts its dead interval. It then updates the routing table based on the received data, which covers
+ * the destinations from first_node and num_nodes on. Each route via the sender costs the link to the sender
+ * plus the cost the sender announced. Routes that cost route_infinity or more are unreachable, which bounds
+ * counting to infinity after a failure to MAX_HOPS links.
+ * If any changes have been made to the routing table, the function schedules an UPDATE to all neighbors.
  * If no changes were made, it only prints the current state of the routing table.
  *
- * @param usd: The Unix domain socket descriptor used for communicating between MIP daemons.
  * @param message: The received UPDATE message from a neighbor node.
  */
-void handle_update_message(int usd, const update_message message) {
+void handle_update_message(const update_message message) {
     uint8_t sender_mip_addr = message.header.mip_addr;
     global_debug("Received UPDATE message from %d\n", sender_mip_addr);
+    if (linkstate_mode) {
+        // Routes are computed from the link-state database
+        return;
+    }
+    if (liveness_blocks_neighbour(sender_mip_addr)) {
+        global_debug("Liveness session with %d is down, ignoring UPDATE\n", sender_mip_addr);
+        return;
+    }
 
     // Get all current fastest routes
-    u_int8_t current_fastest_routes[MAX_NODES];
+    u_int16_t current_fastest_routes[MAX_NODES];
     get_all_fastest_routes(current_fastest_routes);
     //global_debug("Current fastest routes: ");
     // for (int i = 0; i < 20; i++) {
     //     global_debug("%d,", current_fastest_routes[i]);
     // }
 
-    u_int8_t received_routes[MAX_NODES];
-    //global_debug("Received routes: ");
-    //for (int i = 0; i < 20; i++) {
-    //    global_debug("%d,", message.fastest_routes[i]);
-    //}
-    memcpy(received_routes, message.fastest_routes, sizeof(u_int8_t) * MAX_NODES);
-    //global_debug("Copied routes: ");
-    //for (int i = 0; i < 20; i++) {
-    //    global_debug("%d,", received_routes[i]);
-    //}
+    u_int16_t received_routes[MAX_NODES];
+    int first_node = message.first_node;
+    int last_node = first_node + message.num_nodes;
+    if (message.num_nodes > UPDATE_NODES_PER_MESSAGE || last_node > MAX_NODES) {
+        global_debug("Malformed UPDATE message from %d\n", sender_mip_addr);
+        return;
+    }
+    for (int node = first_node; node < last_node; node++) {
+        received_routes[node] = ntohs(message.fastest_routes[node - first_node]);
+    }
 
 
 
     int fastest_route_changed = 0;
-    // Get current fastest route to 'node'
-    u_int8_t neighbour_cost = find_fastest_route(sender_mip_addr).cost;
-    // Check if we have a fastest route of 1 to the sender, if not, it's a new neighbour.
-    if (neighbour_cost != 1) {
-        // This is a new neighbour. Add a route to the sender with a cost of 1
-        add_update_route(sender_mip_addr, sender_mip_addr, 1);
-        neighbour_cost = 1;
+    // Check if we have a direct route to the sender, if not, it's a new neighbour.
+    if (!is_neighbour(sender_mip_addr)) {
+        // This is a new neighbour. Add a route to the sender with the cost of the link
+        add_update_route(sender_mip_addr, sender_mip_addr, metric_link_cost(sender_mip_addr));
+        // Its routes expire with the dead interval too, even if its HELLO has not arrived yet
+        checkin_node(sender_mip_addr, 0);
         // This was a new fastest route, so send an UPDATE message later
         fastest_route_changed = 1;
         global_debug("Added %d as a new neighbour\n", sender_mip_addr);
     }
 
 
-    for (int node = 0; node < MAX_NODES; node++) {
+    // Get the cost of the link to the sender
+    int neighbour_cost = find_direct_route(sender_mip_addr).cost;
+
+    for (int node = first_node; node < last_node; node++) {
         if (node != sender_mip_addr) { // If not the sender
-            if (received_routes[node] == MAX_COST) { // If the received route is unreachable
+            int cost = received_routes[node] + neighbour_cost;
+            if (received_routes[node] >= route_infinity || cost >= route_infinity) { // If the route is unreachable
                 if (route_exists(node, sender_mip_addr)) { // And we have a route to the node via the sender
                     // This route is unreachable
                     delete_route(node, sender_mip_addr);
@@ -124,7 +288,7 @@ void handle_update_message(int usd, const update_message message) {
                     continue;
                 }
             } else { // If the received route is reachable
-                add_update_route(node, sender_mip_addr, received_routes[node] + neighbour_cost);
+                add_update_route(node, sender_mip_addr, cost);
             }
 
         }
@@ -141,9 +305,70 @@ void handle_update_message(int usd, const update_message message) {
     }
 
     if (fastest_route_changed) {
-        send_update_messages(usd);
+        schedule_update_messages();
     } else {
         global_debug("No new fastest route found, not sending UPDATE messages\n");
         print_routing_table();
     }
-}
\ No newline at end of file
+}
+
+/**
+ * Asks a newly discovered neighbour for its whole routing table.
+ *
+ * The neighbour answers right away, so a node that has just started or rebooted fills its routing table
+ * in one round trip instead of waiting for the next UPDATE round of its neighbours.
+ *
+ * @param usd: The Unix domain socket descriptor used for communicating between MIP daemons.
+ * @param neighbour: The MIP address of the new neighbour.
+ */
+void send_table_request(int usd, u_int8_t neighbour) {
+    table_request_message request;
+    request.header.mip_addr = neighbour;
+    request.header.ttl = 1;
+    request.header.id1 = 0x54; // T
+    request.header.id2 = 0x52; // R
+    request.header.id3 = 0x51; // Q
+
+    global_debug("Sending TABLE REQUEST to %d\n", neighbour);
+    if (routing_send(usd, &request, sizeof(request)) == -1) {
+        perror("send");
+    }
+}
+
+/**
+ * Handles a table request from a neighbour.
+ *
+ * In distance vector mode the neighbour is sent an UPDATE with our routes, poisoned reverse applied, without
+ * waiting for the coalescing window. A neighbour that was sent an UPDATE less than update_min_interval_ms ago
+ * gets it through the normal UPDATE round instead. In link-state mode it is sent the link-state database.
+ *
+ * @param usd: The Unix domain socket descriptor used for communicating between MIP daemons.
+ * @param message: The table request that was received.
+ */
+void handle_table_request_message(int usd, table_request_message message) {
+    u_int8_t sender_mip_addr = message.header.mip_addr;
+    global_debug("Received TABLE REQUEST from %d\n", sender_mip_addr);
+    update_stats.table_requests++;
+    if (liveness_blocks_neighbour(sender_mip_addr)) {
+        global_debug("Liveness session with %d is down, ignoring TABLE REQUEST\n", sender_mip_addr);
+        return;
+    }
+    if (linkstate_mode) {
+        linkstate_send_database(usd, sender_mip_addr);
+        update_stats.table_answers++;
+        return;
+    }
+
+    u_int64_t now = current_time_ms();
+    if (last_update_sent[sender_mip_addr] != 0 && now - last_update_sent[sender_mip_addr] < (u_int64_t)update_min_interval_ms) {
+        // Sent to this neighbour too recently, it gets the table with the next UPDATE round
+        schedule_update_messages();
+        return;
+    }
+
+    u_int16_t fastest_routes[MAX_NODES];
+    get_all_fastest_routes_for_neighbour(sender_mip_addr, fastest_routes);
+    send_update_message(usd, sender_mip_addr, fastest_routes);
+    last_update_sent[sender_mip_addr] = now;
+    update_stats.table_answers++;
+}
@@ -4,8 +4,36 @@
 #include "../../common/routing/routing_messages.h"
 #include "../routing_common.h"
 
+extern int update_coalesce_ms;      // How long triggered UPDATEs are collected before they are flushed.
+extern int update_min_interval_ms;  // Minimum time between two UPDATE messages to the same neighbour.
+
+/**
+ * Counters for triggered UPDATE messages.
+ */
+struct update_stats {
+    unsigned long triggers;     // Number of times an UPDATE round was requested.
+    unsigned long sent;         // Number of UPDATE messages actually sent.
+    unsigned long suppressed;   // Number of sends that were collapsed into an already pending one.
+    unsigned long deferred;     // Number of flushes where a neighbour had to wait for its minimum interval.
+    unsigned long skipped;      // Number of UPDATE messages left out because they held only unreachable destinations.
+    unsigned long table_requests;   // Number of table requests received from neighbours.
+    unsigned long table_answers;    // Number of table requests answered right away.
+};
+
+extern struct update_stats update_stats;
+
 void send_update_messages(int usd);
 
-void handle_update_message(int usd, const update_message message);
+void schedule_update_messages();
+
+void flush_update_messages(int usd);
+
+void print_update_stats();
+
+void handle_update_message(const update_message message);
+
+void send_table_request(int usd, u_int8_t neighbour);
+
+void handle_table_request_message(int usd, table_request_message message);
 
 #endif //UPDATE_H
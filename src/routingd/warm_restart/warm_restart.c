@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "warm_restart.h"
+#include "../../common/snapshot/snapshot.h"
+#include "../table/table.h"
+#include "../timer/timer.h"
+#include "../update/update.h"
+#include "../hello/checkin.h"
+
+char *warm_restart_path = NULL;     // Pathname of the snapshot file, NULL if warm restart is disabled.
+
+/**
+ * One route in the snapshot.
+ */
+struct route_snapshot_entry {
+    u_int8_t dest;
+    u_int8_t next_hop;
+    u_int16_t cost;
+};
+
+/**
+ * The routing table as kept in the snapshot file.
+ */
+struct routing_snapshot {
+    u_int32_t num_routes;
+    struct route_snapshot_entry routes[WARM_RESTART_MAX_ROUTES];
+};
+
+static struct snapshot snapshot;                // The mapped snapshot file.
+static struct routing_snapshot *saved = NULL;   // The data of the snapshot file.
+static unsigned long saved_version = 0;         // The table version that was last written.
+static int save_timer = 0;                      // Timer that writes the snapshot.
+static int stale_timer = 0;                     // Timer that removes the routes that were not confirmed.
+
+/**
+ * Counters for warm restart, printed on SIGUSR1.
+ */
+static struct {
+    unsigned long loaded;       // Routes loaded from the snapshot.
+    unsigned long confirmed;    // Loaded neighbours that were heard from again.
+    unsigned long expired;      // Loaded routes removed because they were never confirmed.
+    unsigned long saves;        // Times the snapshot was written.
+    u_int64_t age_ms;           // Age of the snapshot when it was loaded.
+} warm_restart_stats;
+
+/**
+ * Writes the valid routes in the routing table to the snapshot.
+ */
+static void save_snapshot() {
+    snapshot_begin_write(&snapshot);
+    u_int32_t count = 0;
+    for (int dest = 0; dest < MAX_NODES; dest++) {
+        for (route_node *current = routing_table[dest]; current != NULL; current = current->next) {
+            if (!current->route.valid || current->route.cost >= route_infinity || count >= WARM_RESTART_MAX_ROUTES) {
+                continue;
+            }
+            saved->routes[count].dest = dest;
+            saved->routes[count].next_hop = current->route.next_hop;
+            saved->routes[count].cost = current->route.cost;
+            count++;
+        }
+    }
+    saved->num_routes = count;
+    snapshot_end_write(&snapshot);
+    saved_version = table_version;
+    warm_restart_stats.saves++;
+}
+
+/**
+ * Timer callback that writes the snapshot if the routing table changed since the last write.
+ */
+static void save_timer_expired(int usd, void *arg) {
+    (void)usd;
+    (void)arg;
+    if (table_version != saved_version) {
+        save_snapshot();
+    }
+    timer_arm(save_timer, WARM_RESTART_SAVE_MS);
+}
+
+/**
+ * Timer callback that removes the loaded routes that no neighbour has confirmed.
+ */
+static void stale_timer_expired(int usd, void *arg) {
+    (void)usd;
+    (void)arg;
+    int deleted = delete_stale_routes();
+    warm_restart_stats.expired += deleted;
+    if (deleted > 0) {
+        global_debug("Removed %d stale routes from the snapshot\n", deleted);
+        print_routing_table();
+        schedule_update_messages();
+    }
+}
+
+/**
+ * Loads the routing table from the snapshot file and starts writing it periodically.
+ *
+ * The routes in a snapshot younger than WARM_RESTART_MAX_AGE_MS are added as stale, so requests from mipd are
+ * answered right away instead of failing until the network has been relearned. Every neighbour in the
+ * snapshot is sent a table request, and its answer replaces the stale routes through it. Routes that have not
+ * been confirmed after neighbour_dead_interval_ms are removed.
+ *
+ * @param usd: The file descriptor of the unix socket used for routing communication.
+ */
+void init_warm_restart(int usd) {
+    if (warm_restart_path == NULL) {
+        return;
+    }
+    saved = snapshot_map(&snapshot, warm_restart_path, WARM_RESTART_MAGIC, sizeof(struct routing_snapshot));
+    if (saved == NULL) {
+        fprintf(stderr, "Warm restart disabled, could not map %s\n", warm_restart_path);
+        return;
+    }
+
+    if (snapshot_valid(&snapshot) && snapshot_age_ms(&snapshot) < WARM_RESTART_MAX_AGE_MS) {
+        warm_restart_stats.age_ms = snapshot_age_ms(&snapshot);
+        u_int32_t count = saved->num_routes < WARM_RESTART_MAX_ROUTES ? saved->num_routes : WARM_RESTART_MAX_ROUTES;
+        for (u_int32_t i = 0; i < count; i++) {
+            struct route_snapshot_entry const *entry = &saved->routes[i];
+            add_stale_route(entry->dest, entry->next_hop, entry->cost);
+        }
+        warm_restart_stats.loaded = count;
+        global_debug("Loaded %u stale routes from a snapshot %llu ms old\n", count,
+                     (unsigned long long)warm_restart_stats.age_ms);
+        print_routing_table();
+
+        for (int node = 0; node < MAX_NODES; node++) {
+            if (is_neighbour(node)) {
+                send_table_request(usd, node);
+            }
+        }
+        stale_timer = timer_create_new(stale_timer_expired, NULL);
+        timer_arm(stale_timer, neighbour_dead_interval_ms);
+    }
+
+    saved_version = table_version;
+    save_timer = timer_create_new(save_timer_expired, NULL);
+    timer_arm(save_timer, WARM_RESTART_SAVE_MS);
+}
+
+/**
+ * Confirms the stale route to a neighbour that a routing message was received from.
+ * Called for every routing message, before it is handled.
+ *
+ * @param mip_addr: The MIP address of the sender.
+ */
+void warm_restart_heard(u_int8_t mip_addr) {
+    if (stale_timer == 0 || !timer_is_armed(stale_timer)) {
+        return;
+    }
+    if (confirm_direct_route(mip_addr)) {
+        // Start its dead interval, in case the message was not a HELLO
+        global_debug("Neighbour %d from the snapshot is back\n", mip_addr);
+        checkin_node(mip_addr, 0);
+        warm_restart_stats.confirmed++;
+    }
+}
+
+/**
+ * Prints the warm restart counters to stdout.
+ */
+void print_warm_restart_stats() {
+    if (warm_restart_path == NULL) {
+        return;
+    }
+    printf("Warm restart (%s): loaded=%lu age=%llu ms confirmed=%lu expired=%lu saves=%lu\n", warm_restart_path,
+           warm_restart_stats.loaded, (unsigned long long)warm_restart_stats.age_ms, warm_restart_stats.confirmed,
+           warm_restart_stats.expired, warm_restart_stats.saves);
+    fflush(stdout);
+}
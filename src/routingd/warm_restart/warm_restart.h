@@ -0,0 +1,19 @@
+#ifndef WARM_RESTART_H
+#define WARM_RESTART_H
+
+#include "../routing_common.h"
+
+#define WARM_RESTART_MAGIC 0x52544231       // "RTB1", identifies a routing table snapshot.
+#define WARM_RESTART_MAX_ROUTES 4096        // Maximum number of routes kept in the snapshot.
+#define WARM_RESTART_SAVE_MS 1000           // How often the snapshot is written if the routing table changed.
+#define WARM_RESTART_MAX_AGE_MS 60000       // Snapshots older than this are not loaded.
+
+extern char *warm_restart_path;     // Pathname of the snapshot file, NULL if warm restart is disabled.
+
+void init_warm_restart(int usd);
+
+void warm_restart_heard(u_int8_t mip_addr);
+
+void print_warm_restart_stats();
+
+#endif //WARM_RESTART_H
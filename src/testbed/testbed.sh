@@ -0,0 +1,435 @@
+#!/bin/bash
+#
+# Network namespace testbed for mipd and routingd.
+#
+# Builds a topology of network namespaces connected by veth pairs, starts mipd, routingd and ping_server
+# in every namespace, and measures the network end to end:
+#   - the time until the first ping gets through after the daemons start,
+#   - throughput and RTT percentiles of a ping_client flood across the topology,
+#   - CPU time used by every daemon during the flood,
+#   - the time until pings get through again after a link on the path is cut.
+# The results are written to a JSON file that can be compared across commits.
+#
+# Node i is in namespace mip<i>, has MIP address i and its daemons listen on <dir>/usock<i>.
+# Must be run as root.
+
+set -u
+
+BIN_DIR=$(cd "$(dirname "$0")/../.." && pwd)
+
+TOPOLOGY=line           # line, ring, grid or mesh
+NODES=4                 # Number of nodes
+SEED=1                  # Seed of the random mesh
+COUNT=10000             # Requests in the flood
+WINDOW=16               # Requests in flight during the flood
+SIZE=0                  # Payload size of the flood requests, 0 for the smallest
+DELAY=""                # netem delay on every link, in ms
+LOSS=""                 # netem loss on every link, in percent
+CONVERGE_TIMEOUT=60     # Seconds to wait for pings to get through
+MIPD_ARGS=""            # Extra arguments to mipd
+ROUTINGD_ARGS=""        # Extra arguments to routingd
+COLO=0                  # Runs mipd-colo instead of mipd and routingd
+OUTPUT=testbed-results.json
+DIR=""                  # Directory for sockets and logs
+KEEP=0                  # Leaves the testbed running
+
+EDGES=()                # Links of the topology, as "i-j"
+PIDS=()                 # Daemons, as "node:name:pid"
+
+print_help() {
+    echo "Usage: $0 [-h] [-t <topology>] [-n <nodes>] [-S <seed>] [-c <count>] [-w <window>] [-s <bytes>]"
+    echo "       [-D <ms>] [-L <pct>] [-T <s>] [-m <args>] [-r <args>] [-C] [-o <file>] [-d <dir>] [-k]"
+    echo -e "  -h\t\tPrints this help message"
+    echo -e "  -t <topology>\tline, ring, grid or mesh (default $TOPOLOGY)"
+    echo -e "  -n <nodes>\tNumber of nodes (default $NODES)"
+    echo -e "  -S <seed>\tSeed of the random mesh (default $SEED)"
+    echo -e "  -c <count>\tRequests in the flood (default $COUNT)"
+    echo -e "  -w <window>\tRequests in flight during the flood (default $WINDOW)"
+    echo -e "  -s <bytes>\tPayload size of the flood requests"
+    echo -e "  -D <ms>\tAdds a netem delay of <ms> on every link"
+    echo -e "  -L <pct>\tAdds a netem loss of <pct> percent on every link"
+    echo -e "  -T <s>\t\tSeconds to wait for pings to get through (default $CONVERGE_TIMEOUT)"
+    echo -e "  -m <args>\tExtra arguments to mipd"
+    echo -e "  -r <args>\tExtra arguments to routingd"
+    echo -e "  -C\t\tRuns mipd-colo instead of mipd and routingd"
+    echo -e "  -o <file>\tResults file (default $OUTPUT)"
+    echo -e "  -d <dir>\tDirectory for sockets and logs (default a new temporary directory)"
+    echo -e "  -k\t\tLeaves the testbed running, remove it with another run"
+}
+
+usage_and_exit() {
+    echo "Usage: $0 [-h] [-t <topology>] [-n <nodes>] [-S <seed>] [-c <count>] [-w <window>] [-s <bytes>]" >&2
+    echo "       [-D <ms>] [-L <pct>] [-T <s>] [-m <args>] [-r <args>] [-C] [-o <file>] [-d <dir>] [-k]" >&2
+    exit 1
+}
+
+log() {
+    echo "testbed: $*" >&2
+}
+
+now_ms() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+# Topologies
+
+build_line() {
+    for ((i = 1; i < NODES; i++)); do
+        EDGES+=("$i-$((i + 1))")
+    done
+}
+
+build_ring() {
+    build_line
+    if ((NODES > 2)); then
+        EDGES+=("1-$NODES")
+    fi
+}
+
+# Nodes are laid out row by row in rows of the integer square root of the node count.
+build_grid() {
+    local width=1
+    while (((width + 1) * (width + 1) <= NODES)); do
+        width=$((width + 1))
+    done
+    for ((i = 1; i <= NODES; i++)); do
+        if ((i % width != 0 && i + 1 <= NODES)); then
+            EDGES+=("$i-$((i + 1))")
+        fi
+        if ((i + width <= NODES)); then
+            EDGES+=("$i-$((i + width))")
+        fi
+    done
+}
+
+# A random spanning tree, so that the mesh is connected, with as many random links again on top.
+build_mesh() {
+    RANDOM=$SEED
+    for ((i = 2; i <= NODES; i++)); do
+        EDGES+=("$((RANDOM % (i - 1) + 1))-$i")
+    done
+    local extra=$((NODES - 1)) tries=0
+    while ((extra > 0 && tries < NODES * NODES)); do
+        tries=$((tries + 1))
+        local a=$((RANDOM % NODES + 1)) b=$((RANDOM % NODES + 1))
+        if ((a == b)); then
+            continue
+        fi
+        if ((a > b)); then
+            local t=$a; a=$b; b=$t
+        fi
+        if has_edge "$a-$b"; then
+            continue
+        fi
+        EDGES+=("$a-$b")
+        extra=$((extra - 1))
+    done
+}
+
+has_edge() {
+    local e
+    for e in "${EDGES[@]}"; do
+        if [ "$e" = "$1" ]; then
+            return 0
+        fi
+    done
+    return 1
+}
+
+# Prints the nodes reachable from node $1 without using link $2, one per line.
+reachable() {
+    local -A seen=([$1]=1)
+    local queue=("$1") e
+    while ((${#queue[@]} > 0)); do
+        local node=${queue[0]}
+        queue=("${queue[@]:1}")
+        echo "$node"
+        for e in "${EDGES[@]}"; do
+            if [ "$e" = "$2" ]; then
+                continue
+            fi
+            local a=${e%-*} b=${e#*-} next=""
+            if [ "$a" = "$node" ]; then next=$b; elif [ "$b" = "$node" ]; then next=$a; fi
+            if [ -n "$next" ] && [ -z "${seen[$next]:-}" ]; then
+                seen[$next]=1
+                queue+=("$next")
+            fi
+        done
+    done
+}
+
+# Prints the hop count from node $1 to every node, as "node hops" lines in breadth first order.
+distances() {
+    local -A dist=([$1]=0)
+    local queue=("$1") e
+    while ((${#queue[@]} > 0)); do
+        local node=${queue[0]}
+        queue=("${queue[@]:1}")
+        echo "$node ${dist[$node]}"
+        for e in "${EDGES[@]}"; do
+            local a=${e%-*} b=${e#*-} next=""
+            if [ "$a" = "$node" ]; then next=$b; elif [ "$b" = "$node" ]; then next=$a; fi
+            if [ -n "$next" ] && [ -z "${dist[$next]:-}" ]; then
+                dist[$next]=$((dist[$node] + 1))
+                queue+=("$next")
+            fi
+        done
+    done
+}
+
+# Prints the node farthest away from node 1 in hops.
+farthest() {
+    distances 1 | tail -n 1 | cut -d' ' -f1
+}
+
+# Prints a link of node 1 on a shortest path to node $1 whose loss leaves the network connected, so that
+# cutting it forces the traffic onto another path. Prints nothing if there is no such link.
+pick_cut() {
+    local -A dist=()
+    local node hops e
+    while read -r node hops; do
+        dist[$node]=$hops
+    done < <(distances "$1")
+    for e in "${EDGES[@]}"; do
+        local a=${e%-*} b=${e#*-} next=""
+        if [ "$a" = 1 ]; then next=$b; elif [ "$b" = 1 ]; then next=$a; fi
+        if [ -n "$next" ] && ((dist[$next] == dist[1] - 1)) && (($(reachable 1 "$e" | wc -l) == NODES)); then
+            echo "$e"
+            return
+        fi
+    done
+}
+
+# Namespaces and links
+
+teardown() {
+    local ns
+    for ns in $(ip netns list | awk '/^mip[0-9]+/ {print $1}'); do
+        ip netns pids "$ns" 2>/dev/null | xargs -r kill 2>/dev/null
+    done
+    sleep 0.3
+    for ns in $(ip netns list | awk '/^mip[0-9]+/ {print $1}'); do
+        ip netns del "$ns"
+    done
+}
+
+setup_network() {
+    local e
+    for ((i = 1; i <= NODES; i++)); do
+        ip netns add "mip$i" || return 1
+        ip -n "mip$i" link set lo up
+    done
+    for e in "${EDGES[@]}"; do
+        local a=${e%-*} b=${e#*-}
+        ip link add "m$a-$b" netns "mip$a" type veth peer name "m$b-$a" netns "mip$b" || return 1
+        ip -n "mip$a" link set "m$a-$b" up
+        ip -n "mip$b" link set "m$b-$a" up
+        if [ -n "$DELAY" ] || [ -n "$LOSS" ]; then
+            local netem=()
+            if [ -n "$DELAY" ]; then netem+=(delay "${DELAY}ms"); fi
+            if [ -n "$LOSS" ]; then netem+=(loss "${LOSS}%"); fi
+            tc -n "mip$a" qdisc add dev "m$a-$b" root netem "${netem[@]}" || return 1
+            tc -n "mip$b" qdisc add dev "m$b-$a" root netem "${netem[@]}" || return 1
+        fi
+    done
+}
+
+# Daemons
+
+start_daemon() {
+    local node=$1 name=$2
+    shift 2
+    ip netns exec "mip$node" "$@" > "$DIR/$name$node.log" 2>&1 &
+    PIDS+=("$node:$name:$!")
+}
+
+start_daemons() {
+    for ((i = 1; i <= NODES; i++)); do
+        if ((COLO)); then
+            # shellcheck disable=SC2086
+            start_daemon "$i" mipd-colo "$BIN_DIR/mipd-colo" $MIPD_ARGS ${ROUTINGD_ARGS:+-R "$ROUTINGD_ARGS"} "$DIR/usock$i" "$i"
+        else
+            # shellcheck disable=SC2086
+            start_daemon "$i" mipd "$BIN_DIR/mipd" $MIPD_ARGS "$DIR/usock$i" "$i"
+        fi
+    done
+    for ((i = 1; i <= NODES; i++)); do
+        wait_for_socket "$DIR/usock$i" || return 1
+    done
+    for ((i = 1; i <= NODES; i++)); do
+        if ((!COLO)); then
+            # shellcheck disable=SC2086
+            start_daemon "$i" routingd "$BIN_DIR/routingd" $ROUTINGD_ARGS "$DIR/usock$i"
+        fi
+        start_daemon "$i" ping_server "$BIN_DIR/ping_server" -r 0 "$DIR/usock$i"
+    done
+}
+
+wait_for_socket() {
+    local tries
+    for ((tries = 0; tries < 50; tries++)); do
+        if [ -S "$1" ]; then
+            return 0
+        fi
+        sleep 0.1
+    done
+    log "$1 did not appear"
+    return 1
+}
+
+# Prints the CPU time used by every daemon so far, in clock ticks, as "node:name:ticks" lines.
+cpu_ticks() {
+    local d
+    for d in "${PIDS[@]}"; do
+        local pid=${d##*:} stat ticks=0
+        if stat=$(cat "/proc/$pid/stat" 2>/dev/null); then
+            # The fields after the command name, which may contain spaces. utime and stime are fields 14 and 15.
+            stat=${stat##*) }
+            ticks=$(echo "$stat" | awk '{print $12 + $13}')
+        fi
+        echo "${d%:*}:$ticks"
+    done
+}
+
+# Measurements
+
+# Pings node $1 from node 1 until a reply comes back. Prints the milliseconds it took, or null on timeout.
+measure_convergence() {
+    local dst=$1 start deadline
+    start=$(now_ms)
+    deadline=$((start + CONVERGE_TIMEOUT * 1000))
+    while (($(now_ms) < deadline)); do
+        if ip netns exec mip1 "$BIN_DIR/ping_client" -c 1 -W 200 -q -j "$DIR/usock1" "$dst" converge 2>/dev/null \
+            | grep -q '"received":1,'; then
+            echo $(($(now_ms) - start))
+            return
+        fi
+    done
+    echo null
+}
+
+json_string() {
+    printf '"%s"' "$(printf '%s' "$1" | sed 's/\\/\\\\/g; s/"/\\"/g')"
+}
+
+main() {
+    local opt
+    while getopts "ht:n:S:c:w:s:D:L:T:m:r:Co:d:k" opt; do
+        case $opt in
+            h) print_help; exit 0 ;;
+            t) TOPOLOGY=$OPTARG ;;
+            n) NODES=$OPTARG ;;
+            S) SEED=$OPTARG ;;
+            c) COUNT=$OPTARG ;;
+            w) WINDOW=$OPTARG ;;
+            s) SIZE=$OPTARG ;;
+            D) DELAY=$OPTARG ;;
+            L) LOSS=$OPTARG ;;
+            T) CONVERGE_TIMEOUT=$OPTARG ;;
+            m) MIPD_ARGS=$OPTARG ;;
+            r) ROUTINGD_ARGS=$OPTARG ;;
+            C) COLO=1 ;;
+            o) OUTPUT=$OPTARG ;;
+            d) DIR=$OPTARG ;;
+            k) KEEP=1 ;;
+            *) usage_and_exit ;;
+        esac
+    done
+    if ((OPTIND <= $#)) || ((NODES < 2 || NODES > 254)); then
+        usage_and_exit
+    fi
+    if ((EUID != 0)); then
+        log "must be run as root"
+        exit 1
+    fi
+
+    case $TOPOLOGY in
+        line) build_line ;;
+        ring) build_ring ;;
+        grid) build_grid ;;
+        mesh) build_mesh ;;
+        *) usage_and_exit ;;
+    esac
+
+    if [ -z "$DIR" ]; then
+        DIR=$(mktemp -d /tmp/mip-testbed.XXXXXX)
+    fi
+    mkdir -p "$DIR"
+    rm -f "$DIR"/usock*
+
+    teardown
+    if ((!KEEP)); then
+        trap teardown EXIT
+    fi
+    setup_network || exit 1
+    start_daemons || exit 1
+
+    local dst cut
+    dst=$(farthest)
+    cut=$(pick_cut "$dst")
+    log "$TOPOLOGY of $NODES nodes: ${EDGES[*]}, flooding 1 -> $dst, logs in $DIR"
+
+    # Time until the network can carry traffic end to end after a cold start
+    local startup_ms
+    startup_ms=$(measure_convergence "$dst")
+    log "first reply after ${startup_ms} ms"
+
+    # Flood
+    local flood before after hz
+    hz=$(getconf CLK_TCK)
+    before=$(cpu_ticks)
+    local size_args=()
+    if ((SIZE > 0)); then size_args=(-s "$SIZE"); fi
+    flood=$(ip netns exec mip1 "$BIN_DIR/ping_client" -c "$COUNT" -i 0 -w "$WINDOW" ${size_args[@]+"${size_args[@]}"} -j \
+        "$DIR/usock1" "$dst" flood 2>/dev/null | tail -n 1)
+    after=$(cpu_ticks)
+    if [ -z "$flood" ]; then
+        flood=null
+    fi
+    log "flood: $flood"
+
+    # Time until traffic gets through again after a link of the source goes down
+    local cut_ms=null
+    if [ -n "$cut" ]; then
+        local a=${cut%-*} b=${cut#*-}
+        ip -n "mip$a" link set "m$a-$b" down
+        ip -n "mip$b" link set "m$b-$a" down
+        cut_ms=$(measure_convergence "$dst")
+        log "first reply after cutting $cut after ${cut_ms} ms"
+    fi
+
+    # Results
+    local cpu="" line
+    while read -r line; do
+        local name=${line#*:}
+        name=${name%%:*}
+        local node=${line%%:*} ticks=${line##*:} prev
+        prev=$(echo "$before" | awk -F: -v n="$node" -v d="$name" '$1 == n && $2 == d {print $3}')
+        cpu+="${cpu:+,}{\"node\":$node,\"daemon\":\"$name\",\"cpu_s\":$(awk -v t="$ticks" -v p="${prev:-0}" -v hz="$hz" \
+            'BEGIN {printf "%.3f", (t - p) / hz}')}"
+    done <<< "$after"
+
+    local edges="" e
+    for e in "${EDGES[@]}"; do
+        edges+="${edges:+,}\"$e\""
+    done
+    local commit
+    commit=$(git -C "$BIN_DIR" rev-parse --short HEAD 2>/dev/null || echo unknown)
+
+    {
+        printf '{"commit":%s,"date":%s,"kernel":%s,\n' "$(json_string "$commit")" \
+            "$(json_string "$(date -u +%Y-%m-%dT%H:%M:%SZ)")" "$(json_string "$(uname -r)")"
+        printf ' "config":{"topology":%s,"nodes":%d,"seed":%d,"edges":[%s],"destination":%d,' \
+            "$(json_string "$TOPOLOGY")" "$NODES" "$SEED" "$edges" "$dst"
+        printf '"count":%d,"window":%d,"size":%d,"delay_ms":%s,"loss_pct":%s,"colo":%s,"mipd_args":%s,"routingd_args":%s},\n' \
+            "$COUNT" "$WINDOW" "$SIZE" "${DELAY:-null}" "${LOSS:-null}" "$( ((COLO)) && echo true || echo false)" \
+            "$(json_string "$MIPD_ARGS")" "$(json_string "$ROUTINGD_ARGS")"
+        printf ' "startup_convergence_ms":%s,\n' "$startup_ms"
+        printf ' "flood":%s,\n' "$flood"
+        printf ' "flood_cpu":[%s],\n' "$cpu"
+        printf ' "cut":%s,"cut_convergence_ms":%s}\n' "$( [ -n "$cut" ] && json_string "$cut" || echo null)" "$cut_ms"
+    } > "$OUTPUT"
+    log "results in $OUTPUT"
+}
+
+main "$@"